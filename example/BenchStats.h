@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * 基准测试用的延迟直方图（对数-线性分桶，类似HdrHistogram）
+ * 每个2的幂区间再均分16个桶，相对误差不超过1/16，记录一次只是一次数组自增，
+ * 百万级QPS下也不需要保存每个样本。每个线程一个，结束时merge。
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+        : counts_(kBuckets, 0),
+          total_(0),
+          sum_(0),
+          max_(0)
+    {
+    }
+
+    void record(uint64_t value)
+    {
+        ++counts_[bucketOf(value)];
+        ++total_;
+        sum_ += value;
+        if (value > max_)
+        {
+            max_ = value;
+        }
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (int i = 0; i < kBuckets; ++i)
+        {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        sum_ += other.sum_;
+        if (other.max_ > max_)
+        {
+            max_ = other.max_;
+        }
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? static_cast<double>(sum_) / total_ : 0.0; }
+
+    // p取值0~100，返回所在桶的中点
+    uint64_t percentile(double p) const
+    {
+        if (total_ == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * total_);
+        if (rank >= total_)
+        {
+            rank = total_ - 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i)
+        {
+            seen += counts_[i];
+            if (seen > rank)
+            {
+                uint64_t low = lowerBound(i);
+                uint64_t high = lowerBound(i + 1);
+                uint64_t mid = low + (high - low) / 2;
+                return mid < max_ ? mid : max_;
+            }
+        }
+        return max_;
+    }
+
+    // 输出 "name":{"p50":..,"p90":..,"p99":..,"p999":..,"max":..,"mean":..}
+    void printJson(FILE *out, const char *name) const
+    {
+        fprintf(out, "\"%s\":{\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu,\"mean\":%.1f}",
+                name,
+                static_cast<unsigned long long>(percentile(50)),
+                static_cast<unsigned long long>(percentile(90)),
+                static_cast<unsigned long long>(percentile(99)),
+                static_cast<unsigned long long>(percentile(99.9)),
+                static_cast<unsigned long long>(max_),
+                mean());
+    }
+
+private:
+    static const int kSubBits = 4;
+    static const int kSub = 1 << kSubBits;
+    static const int kBuckets = (64 - kSubBits + 1) * kSub;
+
+    static int bucketOf(uint64_t value)
+    {
+        if (value < static_cast<uint64_t>(kSub))
+        {
+            return static_cast<int>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - kSubBits;
+        return (shift + 1) * kSub + static_cast<int>((value >> shift) & (kSub - 1));
+    }
+
+    static uint64_t lowerBound(int bucket)
+    {
+        if (bucket < kSub)
+        {
+            return static_cast<uint64_t>(bucket);
+        }
+        int shift = bucket / kSub - 1;
+        return static_cast<uint64_t>(kSub + bucket % kSub) << shift;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t sum_;
+    uint64_t max_;
+};
@@ -0,0 +1,370 @@
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "TcpClient.h"
+#include "Logging.h"
+#include "BenchStats.h"
+
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * TCP基准测试客户端，配合benchServer（回显）使用，全部走loopback，单机即可运行
+ *
+ *   pingpong   每条连接一问一答：发送size字节，收齐回显以后再发下一条，统计往返延迟
+ *   throughput 每条连接保持depth个size字节的块在途，每收齐一个块的回显就再发一个，统计吞吐和每个块的往返延迟
+ *   churn      每条连接循环 建立连接 -> 发送size字节的请求 -> 收齐回显 -> 关闭，统计建连加一次请求的延迟
+ *
+ *      ./benchClient -m pingpong -c 100 -t 4 -s 64 -d 10
+ *
+ * 先预热warmup秒再统计duration秒，结果以一行JSON输出到stdout（MB为2^20字节，延迟单位微秒），
+ * 其余信息输出到stderr，方便脚本比较不同版本的结果
+ */
+
+enum Mode
+{
+    kPingPong,
+    kThroughput,
+    kChurn
+};
+
+static const char *kModeNames[] = {"pingpong", "throughput", "churn"};
+
+struct Options
+{
+    Mode mode;
+    std::string host;
+    uint16_t port;
+    int connections;
+    int threads;
+    size_t size;
+    int depth;
+    double duration;
+    double warmup;
+};
+
+// 每个loop线程一份，只在这个线程中修改
+struct ThreadStats
+{
+    ThreadStats()
+        : messages(0),
+          bytes(0),
+          errors(0)
+    {
+    }
+
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t errors;
+    LatencyHistogram latency;
+};
+
+static std::atomic<bool> g_measuring(false); // 预热结束以后才统计
+static std::atomic<bool> g_running(true);    // 结束以后不再发送新的请求
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const Options &options, ThreadStats *stats, int id)
+        : client_(loop, serverAddr, "BenchClient" + std::to_string(id)),
+          options_(options),
+          stats_(stats),
+          message_(options.size, 'x'),
+          startTime_(0)
+    {
+        client_.setConnectionCallback(
+            std::bind(&Session::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(
+            std::bind(&Session::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        if (options_.mode == kChurn)
+        {
+            // 连接关闭以后TcpClient立即重新连接
+            client_.enableRetry();
+        }
+    }
+
+    void start()
+    {
+        startTime_ = Timestamp::monotonic().microSecondsSinceEpoch();
+        client_.connect();
+    }
+
+    // 在loop线程中调用，之后可以安全地析构；返回仍然存在的连接，用于等待它关闭
+    std::weak_ptr<TcpConnection> stop()
+    {
+        client_.stop();
+        TcpConnectionPtr conn = client_.connection();
+        if (conn)
+        {
+            conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+            conn->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        }
+        return conn;
+    }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+            if (options_.mode == kChurn)
+            {
+                conn->send(message_);
+                return;
+            }
+            int inflight = options_.mode == kThroughput ? options_.depth : 1;
+            int64_t now = Timestamp::monotonic().microSecondsSinceEpoch();
+            sendTimes_.clear();
+            for (int i = 0; i < inflight; ++i)
+            {
+                conn->send(message_);
+                sendTimes_.push_back(now);
+            }
+        }
+        else if (options_.mode == kChurn)
+        {
+            if (!g_running)
+            {
+                client_.stop();
+            }
+            // 下一次建立连接从现在开始计时
+            startTime_ = Timestamp::monotonic().microSecondsSinceEpoch();
+        }
+        else if (g_running && g_measuring)
+        {
+            ++stats_->errors;
+        }
+    }
+
+    // 回显按顺序返回，每收齐size字节就对应最早发出的那个块
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        while (buf->readableBytes() >= options_.size)
+        {
+            buf->retrieve(options_.size);
+            int64_t now = Timestamp::monotonic().microSecondsSinceEpoch();
+            int64_t sent = startTime_;
+            if (options_.mode != kChurn && !sendTimes_.empty())
+            {
+                sent = sendTimes_.front();
+                sendTimes_.pop_front();
+            }
+            if (g_measuring)
+            {
+                ++stats_->messages;
+                stats_->bytes += options_.size;
+                stats_->latency.record(static_cast<uint64_t>(now - sent));
+            }
+
+            if (options_.mode == kChurn)
+            {
+                conn->forceClose();
+                buf->retrieveAll();
+                return;
+            }
+            if (g_running)
+            {
+                conn->send(message_);
+                sendTimes_.push_back(now);
+            }
+        }
+    }
+
+    TcpClient client_;
+    const Options &options_;
+    ThreadStats *stats_;
+    const std::string message_;
+    int64_t startTime_;             // churn本次建连开始的时间，微秒
+    std::deque<int64_t> sendTimes_; // pingpong和throughput每个在途块的发送时间，微秒
+};
+
+// 在loop线程中执行f并等待完成
+template <typename F>
+static void runInLoopAndWait(EventLoop *loop, F f)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]() {
+        f();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+// 在loop线程中检查，直到conns中的连接都已经关闭并析构；关闭过程要经过几轮queueInLoop，
+// 所以每轮都重新放入队列，全部完成以后再通知等待的线程
+static void waitClosedInLoop(EventLoop *loop,
+                             const std::shared_ptr<std::vector<std::weak_ptr<TcpConnection>>> &conns,
+                             const std::shared_ptr<std::promise<void>> &done)
+{
+    for (const auto &conn : *conns)
+    {
+        if (!conn.expired())
+        {
+            loop->queueInLoop(std::bind(&waitClosedInLoop, loop, conns, done));
+            return;
+        }
+    }
+    done->set_value();
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-m pingpong|throughput|churn] [-h host] [-p port] [-c connections]\n"
+            "          [-t threads] [-s size] [-q depth] [-d seconds] [-w warmup]\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    options.mode = kPingPong;
+    options.host = "127.0.0.1";
+    options.port = 9400;
+    options.connections = 100;
+    options.threads = 4;
+    options.size = 64;
+    options.depth = 16;
+    options.duration = 10;
+    options.warmup = 1;
+
+    int opt;
+    while ((opt = ::getopt(argc, argv, "m:h:p:c:t:s:q:d:w:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            if (strcmp(optarg, "pingpong") == 0)
+                options.mode = kPingPong;
+            else if (strcmp(optarg, "throughput") == 0)
+                options.mode = kThroughput;
+            else if (strcmp(optarg, "churn") == 0)
+                options.mode = kChurn;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'h':
+            options.host = optarg;
+            break;
+        case 'p':
+            options.port = static_cast<uint16_t>(atoi(optarg));
+            break;
+        case 'c':
+            options.connections = atoi(optarg);
+            break;
+        case 't':
+            options.threads = atoi(optarg);
+            break;
+        case 's':
+            options.size = static_cast<size_t>(atol(optarg));
+            break;
+        case 'q':
+            options.depth = atoi(optarg);
+            break;
+        case 'd':
+            options.duration = atof(optarg);
+            break;
+        case 'w':
+            options.warmup = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.connections <= 0 || options.threads <= 0 || options.size == 0 || options.depth <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    Logger::setLogLevel(Logger::WARN);
+
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<EventLoop *> loops;
+    std::vector<std::unique_ptr<ThreadStats>> stats;
+    for (int i = 0; i < options.threads; ++i)
+    {
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "bench" + std::to_string(i)));
+        loops.push_back(threads.back()->startLoop());
+        stats.emplace_back(new ThreadStats);
+    }
+
+    // 连接按轮询分配到各个loop，Session只在自己的loop线程中创建、使用和销毁
+    InetAddress serverAddr(options.port, options.host);
+    std::vector<std::vector<std::unique_ptr<Session>>> sessions(options.threads);
+    for (int i = 0; i < options.threads; ++i)
+    {
+        runInLoopAndWait(loops[i], [&, i]() {
+            for (int id = i; id < options.connections; id += options.threads)
+            {
+                sessions[i].emplace_back(new Session(loops[i], serverAddr, options, stats[i].get(), id));
+                sessions[i].back()->start();
+            }
+        });
+    }
+    fprintf(stderr, "%s: %d connections, %d threads, %zu bytes, warmup %.1fs, duration %.1fs\n",
+            kModeNames[options.mode], options.connections, options.threads, options.size, options.warmup, options.duration);
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.warmup));
+    g_measuring = true;
+    Timestamp start = Timestamp::monotonic();
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.duration));
+    g_measuring = false;
+    Timestamp end = Timestamp::monotonic();
+    g_running = false;
+
+    // 在各自的loop线程中读取统计，再停止并销毁会话，等析构的TcpClient把连接都关掉
+    ThreadStats total;
+    for (int i = 0; i < options.threads; ++i)
+    {
+        auto conns = std::make_shared<std::vector<std::weak_ptr<TcpConnection>>>();
+        auto closed = std::make_shared<std::promise<void>>();
+        runInLoopAndWait(loops[i], [&, i]() {
+            total.messages += stats[i]->messages;
+            total.bytes += stats[i]->bytes;
+            total.errors += stats[i]->errors;
+            total.latency.merge(stats[i]->latency);
+            for (auto &session : sessions[i])
+            {
+                conns->push_back(session->stop());
+            }
+            sessions[i].clear();
+            waitClosedInLoop(loops[i], conns, closed);
+        });
+        closed->get_future().wait();
+    }
+
+    double seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / Timestamp::kMicroSecondsPerSecond;
+    printf("{\"bench\":\"%s\",\"connections\":%d,\"threads\":%d,\"size\":%zu,\"depth\":%d,\"duration_s\":%.3f,"
+           "\"messages\":%llu,\"bytes\":%llu,\"errors\":%llu,\"msgs_per_s\":%.1f,\"mb_per_s\":%.2f,",
+           kModeNames[options.mode], options.connections, options.threads, options.size,
+           options.mode == kThroughput ? options.depth : 1, seconds,
+           static_cast<unsigned long long>(total.messages),
+           static_cast<unsigned long long>(total.bytes),
+           static_cast<unsigned long long>(total.errors),
+           total.messages / seconds,
+           total.bytes / seconds / (1024 * 1024));
+    total.latency.printJson(stdout, "latency_us");
+    printf("}\n");
+    fflush(stdout);
+
+    // 连接都已经关闭，退出并回收loop线程
+    threads.clear();
+    return 0;
+}
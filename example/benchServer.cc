@@ -0,0 +1,56 @@
+#include "EventLoop.h"
+#include "TcpServer.h"
+#include "Logging.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * 基准测试服务端：原样回显收到的数据，配合benchClient使用
+ *      ./benchServer [-p 端口] [-t subloop线程数]
+ * 日志级别设为WARN，避免每个连接/每次poll的日志影响结果
+ */
+int main(int argc, char *argv[])
+{
+    uint16_t port = 9400;
+    int threads = 4;
+    int opt;
+    while ((opt = ::getopt(argc, argv, "p:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            port = static_cast<uint16_t>(atoi(optarg));
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p port] [-t threads]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    Logger::setLogLevel(Logger::WARN);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "BenchServer", TcpServer::kReusePort);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf);
+    });
+    server.setThreadNum(threads);
+    server.start();
+    fprintf(stderr, "benchServer listening on %u with %d threads\n", port, threads);
+    loop.loop();
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "EventLoop.h"
+#include "TcpServer.h"
+#include "Coroutine.h"
+#include "Logging.h"
+
+#include <stdlib.h>
+
+/**
+ * 按行回显的服务器，用协程顺序地写处理逻辑（需要C++20）
+ *      sleep N   N毫秒以后再回复
+ *      quit      关闭连接
+ */
+Task<> session(TcpConnectionPtr conn)
+{
+    EventLoop *loop = conn->getLoop();
+    Buffer *buf = conn->inputBuffer();
+    while (size_t n = co_await conn->readUntil("\n"))
+    {
+        std::string line = buf->retrieveAsString(n);
+        if (line.compare(0, 4, "quit") == 0)
+        {
+            break;
+        }
+        if (line.compare(0, 6, "sleep ") == 0)
+        {
+            co_await loop->sleep(atoi(line.c_str() + 6));
+        }
+        if (!co_await conn->write(line))
+        {
+            break;
+        }
+    }
+    conn->shutdown();
+}
+
+int main()
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(8080), "EchoServerCoroutine");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            session(conn);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &, Buffer *, Timestamp) {});
+    server.setThreadNum(2);
+    server.start();
+    loop.loop();
+
+    return 0;
+}
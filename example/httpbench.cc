@@ -0,0 +1,770 @@
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "TcpClient.h"
+#include "Logging.h"
+#include "BenchStats.h"
+#include "Hpack.h"
+#include "Http2Frame.h"
+
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+/**
+ * HTTP压测工具，用库自己的reactor实现，和HttpServer一起单机运行
+ *
+ * 每条长连接保持depth个GET请求在途（HTTP/1.1 pipelining，depth=1就是普通的一问一答），
+ * 每收到一个完整的响应就再发一个。响应支持Content-Length、chunked和读到连接关闭三种结束方式；
+ * 服务端声明Connection: close以后等它关闭连接，TcpClient重新连接，重连次数单独统计。
+ *
+ *      ./httpbench -c 100 -t 4 -q 16 -d 10 -u /hello
+ *
+ * -2使用明文HTTP/2（prior knowledge）：每条连接保持depth个流并发，响应可以乱序返回，
+ * 每个流结束就再打开一个新的流；字节数按响应的帧计算（帧头+HPACK压缩后的头部+DATA）。
+ *
+ *      ./httpbench -2 -c 10 -t 4 -q 100 -d 10 -u /hello
+ *
+ * 延迟从请求写入发送缓冲区开始算，到对应的响应解析完为止（pipelining时包含排队时间）。
+ * 先预热warmup秒再统计duration秒，结果以一行JSON输出到stdout（延迟单位微秒）
+ */
+
+struct Options
+{
+    std::string host;
+    uint16_t port;
+    std::string path;
+    int connections;
+    int threads;
+    int depth;
+    double duration;
+    double warmup;
+    bool http2;
+};
+
+// 每个loop线程一份，只在这个线程中修改
+struct ThreadStats
+{
+    ThreadStats()
+        : requests(0),
+          bytes(0),
+          errors(0),
+          non2xx(0),
+          reconnects(0)
+    {
+    }
+
+    uint64_t requests;   // 收到的完整响应
+    uint64_t bytes;      // 响应字节数（头部+body）
+    uint64_t errors;     // 连接意外断开时丢失的请求、无法解析的响应
+    uint64_t non2xx;     // 状态码不是2xx的响应
+    uint64_t reconnects; // 重新建立连接的次数
+    LatencyHistogram latency;
+};
+
+static std::atomic<bool> g_measuring(false); // 预热结束以后才统计
+static std::atomic<bool> g_running(true);    // 结束以后不再发送新的请求
+
+class Session : noncopyable
+{
+public:
+    Session(EventLoop *loop, const InetAddress &serverAddr, const Options &options, ThreadStats *stats, int id)
+        : client_(loop, serverAddr, "HttpBench" + std::to_string(id)),
+          options_(options),
+          stats_(stats),
+          request_("GET " + options.path + " HTTP/1.1\r\n"
+                   "Host: " + options.host + ":" + std::to_string(options.port) + "\r\n"
+                   "\r\n"),
+          state_(kHeaders),
+          remaining_(0),
+          status_(0),
+          responseBytes_(0),
+          closing_(false),
+          connected_(false),
+          nextStreamId_(1),
+          recvConsumed_(0)
+    {
+        client_.setConnectionCallback(
+            std::bind(&Session::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(
+            std::bind(&Session::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        // 服务端关闭连接以后立即重新连接
+        client_.enableRetry();
+    }
+
+    void start()
+    {
+        client_.connect();
+    }
+
+    // 在loop线程中调用，之后可以安全地析构
+    void stop()
+    {
+        client_.stop();
+        TcpConnectionPtr conn = client_.connection();
+        if (conn)
+        {
+            conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+            conn->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        }
+    }
+
+private:
+    // 响应的解析状态
+    enum State
+    {
+        kHeaders,    // 等待完整的状态行和头部
+        kBody,       // Content-Length，还剩remaining_字节
+        kChunkSize,  // 等待chunk大小一行
+        kChunkData,  // chunk数据和结尾的CRLF，还剩remaining_字节
+        kLastChunk,  // 最后一个chunk（大小为0）后面的CRLF，不支持trailer
+        kUntilClose, // 既没有Content-Length也不是chunked，body读到连接关闭
+    };
+
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            if (connected_ && g_measuring)
+            {
+                ++stats_->reconnects;
+            }
+            connected_ = true;
+            closing_ = false;
+            resetParser();
+            sendTimes_.clear();
+            conn->setTcpNoDelay(true);
+            if (options_.http2)
+            {
+                startHttp2(conn);
+            }
+            if (g_running)
+            {
+                sendRequests(conn, options_.depth);
+            }
+            return;
+        }
+
+        if (state_ == kUntilClose)
+        {
+            // 连接关闭就是body的结尾
+            completeResponse();
+        }
+        // 服务端没有声明关闭就断开了连接，在途的请求都算失败
+        if (!closing_ && g_running && g_measuring)
+        {
+            stats_->errors += sendTimes_.size() + streamTimes_.size();
+        }
+        sendTimes_.clear();
+        streamTimes_.clear();
+        if (!g_running)
+        {
+            client_.stop();
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        if (options_.http2)
+        {
+            onHttp2Message(conn, buf);
+            return;
+        }
+        int completed = 0;
+        while (buf->readableBytes() > 0)
+        {
+            int ret = parse(buf);
+            if (ret < 0)
+            {
+                if (g_measuring)
+                {
+                    ++stats_->errors;
+                }
+                buf->retrieveAll();
+                conn->forceClose();
+                return;
+            }
+            if (ret == 0)
+            {
+                break;
+            }
+            ++completed;
+        }
+
+        // 一次收到多个响应时补发的请求合并成一次发送
+        if (completed > 0 && !closing_ && g_running)
+        {
+            sendRequests(conn, completed);
+        }
+    }
+
+    void sendRequests(const TcpConnectionPtr &conn, int count)
+    {
+        int64_t now = Timestamp::monotonic().microSecondsSinceEpoch();
+        if (options_.http2)
+        {
+            sendStreams(conn, count, now);
+            return;
+        }
+        std::string batch;
+        batch.reserve(request_.size() * count);
+        for (int i = 0; i < count; ++i)
+        {
+            batch += request_;
+            sendTimes_.push_back(now);
+        }
+        conn->send(batch);
+    }
+
+    // 解析一个响应，返回1表示解析完一个响应，0表示数据不够，-1表示格式错误
+    int parse(Buffer *buf)
+    {
+        while (buf->readableBytes() > 0)
+        {
+            switch (state_)
+            {
+            case kHeaders:
+            {
+                const char *end = static_cast<const char *>(
+                    memmem(buf->peek(), buf->readableBytes(), "\r\n\r\n", 4));
+                if (end == NULL)
+                {
+                    return 0;
+                }
+                end += 4;
+                if (!parseHeaders(buf->peek(), end))
+                {
+                    return -1;
+                }
+                responseBytes_ += end - buf->peek();
+                buf->retrieveUntil(end);
+                if (state_ == kHeaders)
+                {
+                    // 没有body
+                    completeResponse();
+                    return 1;
+                }
+                break;
+            }
+            case kBody:
+            case kChunkData:
+            {
+                size_t n = std::min(remaining_, buf->readableBytes());
+                buf->retrieve(n);
+                responseBytes_ += n;
+                remaining_ -= n;
+                if (remaining_ > 0)
+                {
+                    return 0;
+                }
+                if (state_ == kBody)
+                {
+                    completeResponse();
+                    return 1;
+                }
+                state_ = kChunkSize;
+                break;
+            }
+            case kChunkSize:
+            {
+                const char *crlf = buf->findCRLF();
+                if (crlf == NULL)
+                {
+                    return 0;
+                }
+                char *endptr = NULL;
+                remaining_ = static_cast<size_t>(strtoul(buf->peek(), &endptr, 16));
+                if (endptr == buf->peek())
+                {
+                    return -1;
+                }
+                responseBytes_ += crlf + 2 - buf->peek();
+                buf->retrieveUntil(crlf + 2);
+                if (remaining_ == 0)
+                {
+                    state_ = kLastChunk;
+                    break;
+                }
+                remaining_ += 2; // 数据后面的CRLF
+                state_ = kChunkData;
+                break;
+            }
+            case kLastChunk:
+                if (buf->readableBytes() < 2)
+                {
+                    return 0;
+                }
+                buf->retrieve(2);
+                responseBytes_ += 2;
+                completeResponse();
+                return 1;
+            case kUntilClose:
+                responseBytes_ += buf->readableBytes();
+                buf->retrieveAll();
+                return 0;
+            }
+        }
+        return 0;
+    }
+
+    // 解析状态行和头部，决定body的结束方式
+    bool parseHeaders(const char *begin, const char *end)
+    {
+        if (end - begin < 12 || strncmp(begin, "HTTP/1.", 7) != 0)
+        {
+            return false;
+        }
+        status_ = atoi(begin + 9);
+
+        bool chunked = false;
+        long contentLength = -1;
+        const char *line = static_cast<const char *>(memchr(begin, '\n', end - begin)) + 1;
+        while (line < end - 2)
+        {
+            const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+            const char *colon = static_cast<const char *>(memchr(line, ':', eol - line));
+            if (colon != NULL)
+            {
+                size_t nameLen = colon - line;
+                const char *value = colon + 1;
+                while (*value == ' ')
+                {
+                    ++value;
+                }
+                if (nameLen == 14 && strncasecmp(line, "Content-Length", nameLen) == 0)
+                {
+                    contentLength = atol(value);
+                }
+                else if (nameLen == 17 && strncasecmp(line, "Transfer-Encoding", nameLen) == 0)
+                {
+                    chunked = strncasecmp(value, "chunked", 7) == 0;
+                }
+                else if (nameLen == 10 && strncasecmp(line, "Connection", nameLen) == 0)
+                {
+                    closing_ = strncasecmp(value, "close", 5) == 0;
+                }
+            }
+            line = eol + 1;
+        }
+
+        // 1xx、204、304没有body
+        if (status_ < 200 || status_ == 204 || status_ == 304)
+        {
+            state_ = kHeaders;
+        }
+        else if (chunked)
+        {
+            state_ = kChunkSize;
+        }
+        else if (contentLength >= 0)
+        {
+            remaining_ = static_cast<size_t>(contentLength);
+            state_ = remaining_ > 0 ? kBody : kHeaders;
+        }
+        else
+        {
+            state_ = kUntilClose;
+        }
+        return true;
+    }
+
+    void completeResponse()
+    {
+        if (!sendTimes_.empty())
+        {
+            record(sendTimes_.front(), status_, responseBytes_);
+            sendTimes_.pop_front();
+        }
+        resetParser();
+    }
+
+    void record(int64_t sendTime, int status, size_t bytes)
+    {
+        if (g_measuring)
+        {
+            int64_t now = Timestamp::monotonic().microSecondsSinceEpoch();
+            ++stats_->requests;
+            stats_->bytes += bytes;
+            if (status < 200 || status >= 300)
+            {
+                ++stats_->non2xx;
+            }
+            stats_->latency.record(static_cast<uint64_t>(now - sendTime));
+        }
+    }
+
+    // HTTP/2：前言和SETTINGS，流窗口和连接窗口都设成最大，压测中不用频繁发送WINDOW_UPDATE
+    void startHttp2(const TcpConnectionPtr &conn)
+    {
+        encoder_.reset(new HpackEncoder);
+        decoder_.reset(new HpackDecoder);
+        streamTimes_.clear();
+        streamStatus_.clear();
+        streamBytes_.clear();
+        nextStreamId_ = 1;
+        recvConsumed_ = 0;
+        std::string out(http2::kClientPreface, http2::kClientPrefaceLength);
+        http2::appendFrameHeader(&out, 6, http2::kSettings, 0, 0);
+        http2::appendSetting(&out, http2::kSettingsInitialWindowSize, http2::kMaxWindowSize);
+        http2::appendWindowUpdate(&out, 0, http2::kMaxWindowSize - http2::kDefaultWindowSize);
+        conn->send(out);
+    }
+
+    // 打开count个新的流，每个流一个GET请求
+    void sendStreams(const TcpConnectionPtr &conn, int count, int64_t now)
+    {
+        std::string batch;
+        std::string block;
+        std::string authority = options_.host + ":" + std::to_string(options_.port);
+        for (int i = 0; i < count; ++i)
+        {
+            block.clear();
+            encoder_->encode(":method", "GET", &block);
+            encoder_->encode(":scheme", "http", &block);
+            encoder_->encode(":path", options_.path, &block);
+            encoder_->encode(":authority", authority, &block);
+            http2::appendFrameHeader(&batch, static_cast<uint32_t>(block.size()), http2::kHeaders,
+                                     http2::kEndHeaders | http2::kEndStream, nextStreamId_);
+            batch += block;
+            streamTimes_[nextStreamId_] = now;
+            nextStreamId_ += 2;
+        }
+        conn->send(batch);
+    }
+
+    void onHttp2Message(const TcpConnectionPtr &conn, Buffer *buf)
+    {
+        int completed = 0;
+        std::string out;
+        while (buf->readableBytes() >= http2::kFrameHeaderLength)
+        {
+            http2::FrameHeader header = http2::parseFrameHeader(buf->peek());
+            size_t frameLength = http2::kFrameHeaderLength + header.length;
+            if (buf->readableBytes() < frameLength)
+            {
+                break;
+            }
+            int ret = onFrame(header, buf->peek() + http2::kFrameHeaderLength, frameLength, &out);
+            buf->retrieve(frameLength);
+            if (ret < 0)
+            {
+                if (g_measuring)
+                {
+                    ++stats_->errors;
+                }
+                buf->retrieveAll();
+                conn->forceClose();
+                return;
+            }
+            completed += ret;
+        }
+        if (recvConsumed_ > http2::kMaxWindowSize / 2)
+        {
+            http2::appendWindowUpdate(&out, 0, static_cast<uint32_t>(recvConsumed_));
+            recvConsumed_ = 0;
+        }
+        if (!out.empty())
+        {
+            conn->send(out);
+        }
+        if (completed > 0 && !closing_ && g_running)
+        {
+            sendRequests(conn, completed);
+        }
+    }
+
+    // 处理一个帧，返回结束的流数（0或1），-1表示协议错误
+    int onFrame(const http2::FrameHeader &header, const char *payload, size_t frameLength, std::string *out)
+    {
+        switch (header.type)
+        {
+        case http2::kSettings:
+            if (!(header.flags & http2::kAck))
+            {
+                http2::appendFrameHeader(out, 0, http2::kSettings, http2::kAck, 0);
+            }
+            return 0;
+        case http2::kPing:
+            if (!(header.flags & http2::kAck))
+            {
+                http2::appendFrameHeader(out, 8, http2::kPing, http2::kAck, 0);
+                out->append(payload, 8);
+            }
+            return 0;
+        case http2::kGoAway:
+            // 服务端不再接受新的流，等它关闭连接以后重连
+            closing_ = true;
+            return 0;
+        case http2::kRstStream:
+            if (streamTimes_.erase(header.streamId) && g_measuring)
+            {
+                ++stats_->errors;
+            }
+            return 1;
+        case http2::kHeaders:
+        {
+            // 压测的响应头不会超过一帧，不支持CONTINUATION
+            if (!(header.flags & http2::kEndHeaders))
+            {
+                return -1;
+            }
+            const char *p = payload;
+            size_t length = header.length;
+            if (header.flags & http2::kPadded)
+            {
+                size_t padding = static_cast<unsigned char>(*p);
+                if (length < 1 + padding)
+                {
+                    return -1;
+                }
+                ++p;
+                length -= 1 + padding;
+            }
+            if (header.flags & http2::kPriorityFlag)
+            {
+                if (length < 5)
+                {
+                    return -1;
+                }
+                p += 5;
+                length -= 5;
+            }
+            headers_.clear();
+            if (!decoder_->decode(p, length, &headers_))
+            {
+                return -1;
+            }
+            for (const HpackDecoder::Header &field : headers_)
+            {
+                if (field.first == ":status")
+                {
+                    streamStatus_[header.streamId] = atoi(field.second.c_str());
+                }
+            }
+            return onStreamFrame(header, frameLength);
+        }
+        case http2::kData:
+            recvConsumed_ += header.length;
+            return onStreamFrame(header, frameLength);
+        default:
+            return 0;
+        }
+    }
+
+    // 累计流的响应字节数，流结束时统计
+    int onStreamFrame(const http2::FrameHeader &header, size_t frameLength)
+    {
+        streamBytes_[header.streamId] += frameLength;
+        if (!(header.flags & http2::kEndStream))
+        {
+            return 0;
+        }
+        auto it = streamTimes_.find(header.streamId);
+        if (it != streamTimes_.end())
+        {
+            record(it->second, streamStatus_[header.streamId], streamBytes_[header.streamId]);
+            streamTimes_.erase(it);
+        }
+        streamStatus_.erase(header.streamId);
+        streamBytes_.erase(header.streamId);
+        return 1;
+    }
+
+    void resetParser()
+    {
+        state_ = kHeaders;
+        remaining_ = 0;
+        status_ = 0;
+        responseBytes_ = 0;
+    }
+
+    TcpClient client_;
+    const Options &options_;
+    ThreadStats *stats_;
+    const std::string request_;
+    std::deque<int64_t> sendTimes_; // 在途请求的发送时间，响应按顺序返回
+
+    State state_;
+    size_t remaining_;
+    int status_;
+    size_t responseBytes_;
+    bool closing_;   // 服务端声明了Connection: close（或者HTTP/2的GOAWAY），不再发送新的请求
+    bool connected_; // 建立过连接，之后的连接都是重连
+
+    // HTTP/2（-2），每次连接重新开始
+    std::unique_ptr<HpackEncoder> encoder_;
+    std::unique_ptr<HpackDecoder> decoder_;
+    std::vector<HpackDecoder::Header> headers_;
+    std::unordered_map<uint32_t, int64_t> streamTimes_; // 在途的流和发送时间
+    std::unordered_map<uint32_t, int> streamStatus_;
+    std::unordered_map<uint32_t, size_t> streamBytes_;
+    uint32_t nextStreamId_;
+    uint64_t recvConsumed_; // 还没有通过WINDOW_UPDATE归还的连接窗口
+};
+
+// 在loop线程中执行f并等待完成
+template <typename F>
+static void runInLoopAndWait(EventLoop *loop, F f)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]() {
+        f();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-h host] [-p port] [-u path] [-c connections] [-t threads]\n"
+            "          [-q depth] [-d seconds] [-w warmup] [-2]\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    options.host = "127.0.0.1";
+    options.port = 8080;
+    options.path = "/hello";
+    options.connections = 100;
+    options.threads = 4;
+    options.depth = 1;
+    options.duration = 10;
+    options.warmup = 1;
+    options.http2 = false;
+
+    int opt;
+    while ((opt = ::getopt(argc, argv, "h:p:u:c:t:q:d:w:2")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            options.host = optarg;
+            break;
+        case 'p':
+            options.port = static_cast<uint16_t>(atoi(optarg));
+            break;
+        case 'u':
+            options.path = optarg;
+            break;
+        case 'c':
+            options.connections = atoi(optarg);
+            break;
+        case 't':
+            options.threads = atoi(optarg);
+            break;
+        case 'q':
+            options.depth = atoi(optarg);
+            break;
+        case 'd':
+            options.duration = atof(optarg);
+            break;
+        case 'w':
+            options.warmup = atof(optarg);
+            break;
+        case '2':
+            options.http2 = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.connections <= 0 || options.threads <= 0 || options.depth <= 0 || options.path.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    Logger::setLogLevel(Logger::WARN);
+
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<EventLoop *> loops;
+    std::vector<std::unique_ptr<ThreadStats>> stats;
+    for (int i = 0; i < options.threads; ++i)
+    {
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "httpbench" + std::to_string(i)));
+        loops.push_back(threads.back()->startLoop());
+        stats.emplace_back(new ThreadStats);
+    }
+
+    // 连接按轮询分配到各个loop，Session只在自己的loop线程中创建、使用和销毁
+    InetAddress serverAddr(options.port, options.host);
+    std::vector<std::vector<std::unique_ptr<Session>>> sessions(options.threads);
+    for (int i = 0; i < options.threads; ++i)
+    {
+        runInLoopAndWait(loops[i], [&, i]() {
+            for (int id = i; id < options.connections; id += options.threads)
+            {
+                sessions[i].emplace_back(new Session(loops[i], serverAddr, options, stats[i].get(), id));
+                sessions[i].back()->start();
+            }
+        });
+    }
+    fprintf(stderr, "GET http://%s:%d%s%s: %d connections, %d threads, depth %d, warmup %.1fs, duration %.1fs\n",
+            options.host.c_str(), options.port, options.path.c_str(), options.http2 ? " (h2c)" : "",
+            options.connections, options.threads, options.depth, options.warmup, options.duration);
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.warmup));
+    g_measuring = true;
+    Timestamp start = Timestamp::monotonic();
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.duration));
+    g_measuring = false;
+    Timestamp end = Timestamp::monotonic();
+    g_running = false;
+
+    // 在各自的loop线程中读取统计，再停止并销毁会话
+    ThreadStats total;
+    for (int i = 0; i < options.threads; ++i)
+    {
+        runInLoopAndWait(loops[i], [&, i]() {
+            total.requests += stats[i]->requests;
+            total.bytes += stats[i]->bytes;
+            total.errors += stats[i]->errors;
+            total.non2xx += stats[i]->non2xx;
+            total.reconnects += stats[i]->reconnects;
+            total.latency.merge(stats[i]->latency);
+            for (auto &session : sessions[i])
+            {
+                session->stop();
+            }
+            sessions[i].clear();
+        });
+    }
+
+    double seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / Timestamp::kMicroSecondsPerSecond;
+    printf("{\"bench\":\"%s\",\"path\":\"%s\",\"connections\":%d,\"threads\":%d,\"depth\":%d,\"duration_s\":%.3f,"
+           "\"requests\":%llu,\"bytes\":%llu,\"errors\":%llu,\"non2xx\":%llu,\"reconnects\":%llu,"
+           "\"reqs_per_s\":%.1f,\"mb_per_s\":%.2f,",
+           options.http2 ? "http2" : "http", options.path.c_str(), options.connections, options.threads,
+           options.depth, seconds,
+           static_cast<unsigned long long>(total.requests),
+           static_cast<unsigned long long>(total.bytes),
+           static_cast<unsigned long long>(total.errors),
+           static_cast<unsigned long long>(total.non2xx),
+           static_cast<unsigned long long>(total.reconnects),
+           total.requests / seconds,
+           total.bytes / seconds / (1024 * 1024));
+    total.latency.printJson(stdout, "latency_us");
+    printf("}\n");
+    fflush(stdout);
+
+    // 等待析构的TcpClient关闭连接以后再退出loop线程
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    threads.clear();
+    return 0;
+}
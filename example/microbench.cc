@@ -0,0 +1,583 @@
+#include "Buffer.h"
+#include "LogStream.h"
+#include "HttpContext.h"
+#include "HttpResponse.h"
+#include "HttpRouter.h"
+#include "EventLoop.h"
+#include "MemoryPool.h"
+#include "Timestamp.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * 热点基础组件的微基准测试：Buffer、LogStream、HttpContext、TimerQueue、MemoryPool、EventLoop::queueInLoop
+ *
+ *      ./microbench [-f 名字子串] [-r 重复次数] [-t 每次重复的毫秒数] [-c 绑定的CPU]
+ *
+ * 每个用例先倍增迭代次数直到一次运行超过10ms（同时起到预热作用），再按目标时间换算出迭代次数，
+ * 重复运行r次，报告每次操作耗时的中位数、最小值和相对标准差。
+ * 结果以JSON输出到stdout，一个用例一行，方便不同提交之间diff；进度信息输出到stderr。
+ * 比较结果时固定CPU（-c）并关掉其他负载，相对标准差大于几个百分点的结果不可信。
+ */
+
+// 阻止编译器把结果没有被使用的计算优化掉
+template <typename T>
+static inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// 运行n次操作
+using BenchFunction = std::function<void(uint64_t n)>;
+
+struct Benchmark
+{
+    const char *name;
+    BenchFunction run;
+};
+
+struct Result
+{
+    uint64_t iterations;
+    double median; // ns/op
+    double min;
+    double rsd;    // 相对标准差，百分比
+};
+
+static double elapsedNs(const BenchFunction &f, uint64_t n)
+{
+    Timestamp start = Timestamp::monotonic();
+    f(n);
+    Timestamp end = Timestamp::monotonic();
+    return (end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) * 1000.0;
+}
+
+static Result measure(const BenchFunction &f, int repetitions, double targetMs)
+{
+    // 校准迭代次数
+    uint64_t n = 1;
+    double ns = elapsedNs(f, n);
+    while (ns < 10 * 1000 * 1000)
+    {
+        n *= ns < 1000 * 1000 ? 10 : 2;
+        ns = elapsedNs(f, n);
+    }
+    n = std::max<uint64_t>(1, static_cast<uint64_t>(n * (targetMs * 1000 * 1000) / ns));
+
+    std::vector<double> samples;
+    for (int i = 0; i < repetitions; ++i)
+    {
+        samples.push_back(elapsedNs(f, n) / n);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    double mean = 0;
+    for (double s : samples)
+    {
+        mean += s;
+    }
+    mean /= samples.size();
+    double variance = 0;
+    for (double s : samples)
+    {
+        variance += (s - mean) * (s - mean);
+    }
+    variance /= samples.size();
+
+    Result result;
+    result.iterations = n;
+    result.median = samples[samples.size() / 2];
+    result.min = samples.front();
+    result.rsd = mean > 0 ? sqrt(variance) / mean * 100 : 0;
+    return result;
+}
+
+// ---------------------------------------------------------------- Buffer
+
+static void bufferAppend64(uint64_t n)
+{
+    Buffer buf;
+    char data[64];
+    memset(data, 'x', sizeof data);
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        buf.append(data, sizeof data);
+        if (buf.readableBytes() >= 64 * 1024)
+        {
+            buf.retrieveAll();
+        }
+    }
+    doNotOptimize(buf.peek());
+}
+
+static void bufferRetrieve16(uint64_t n)
+{
+    Buffer buf;
+    std::string data(64 * 1024, 'x');
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (buf.readableBytes() < 16)
+        {
+            buf.append(data);
+        }
+        buf.retrieve(16);
+    }
+    doNotOptimize(buf.peek());
+}
+
+static void bufferReadFd4k(uint64_t n)
+{
+    // memfd在内存中，避免磁盘和网络的干扰，只测readv和Buffer本身
+    static int fd = -1;
+    const size_t kFileSize = 1024 * 1024;
+    if (fd < 0)
+    {
+        fd = ::memfd_create("microbench", 0);
+        std::string data(kFileSize, 'x');
+        if (fd < 0 || ::write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size()))
+        {
+            perror("memfd_create");
+            exit(1);
+        }
+    }
+    Buffer buf;
+    int savedErrno = 0;
+    ::lseek(fd, 0, SEEK_SET);
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (buf.readFd(fd, &savedErrno, 4096) < 4096)
+        {
+            ::lseek(fd, 0, SEEK_SET);
+        }
+        buf.retrieveAll();
+    }
+}
+
+static void bufferFindCRLF(uint64_t n)
+{
+    Buffer buf;
+    buf.append("User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+               "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n");
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        doNotOptimize(buf.findCRLF());
+    }
+}
+
+// ---------------------------------------------------------------- LogStream
+
+static void logStreamInt(uint64_t n)
+{
+    LogStream stream;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        stream << static_cast<int>(i * 7919) << ' ';
+        if (stream.buffer().avail() < 64)
+        {
+            stream.resetBuffer();
+        }
+    }
+    doNotOptimize(stream.buffer().data());
+}
+
+static void logStreamDouble(uint64_t n)
+{
+    LogStream stream;
+    double v = 3.14159265358979;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        stream << v << ' ';
+        v += 1.001;
+        if (stream.buffer().avail() < 64)
+        {
+            stream.resetBuffer();
+        }
+    }
+    doNotOptimize(stream.buffer().data());
+}
+
+// ---------------------------------------------------------------- HttpContext
+
+static void parseRequests(const char *request, uint64_t n)
+{
+    Buffer buf;
+    HttpContext context;
+    Timestamp receiveTime = Timestamp::now();
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        buf.append(request, strlen(request));
+        context.parseRequest(&buf, receiveTime);
+        if (!context.gotAll())
+        {
+            fprintf(stderr, "parseRequest failed\n");
+            exit(1);
+        }
+        context.finishRequest(&buf);
+    }
+}
+
+static void httpParseShort(uint64_t n)
+{
+    parseRequests("GET /hello HTTP/1.1\r\n"
+                  "Host: 127.0.0.1:8080\r\n"
+                  "\r\n",
+                  n);
+}
+
+static void httpParseBrowser(uint64_t n)
+{
+    parseRequests("GET /index.html?from=bench&page=2 HTTP/1.1\r\n"
+                  "Host: www.example.com\r\n"
+                  "Connection: keep-alive\r\n"
+                  "Cache-Control: max-age=0\r\n"
+                  "Upgrade-Insecure-Requests: 1\r\n"
+                  "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+                  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+                  "Accept-Encoding: gzip, deflate, br\r\n"
+                  "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+                  "Cookie: session=3f2a9c1d7e; theme=dark\r\n"
+                  "\r\n",
+                  n);
+}
+
+// ---------------------------------------------------------------- HttpResponse
+
+// 和HttpServer示例的/hello一样的响应：状态行、两个头部和14字节的响应体
+static void httpResponseSerialize(uint64_t n)
+{
+    Buffer buf;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        HttpResponse resp(false);
+        resp.setStatusCode(HttpResponse::k200Ok);
+        resp.setStatusMessage("OK");
+        resp.setContentType("text/plain");
+        resp.addHeader("Server", "Muduo");
+        resp.setBody("hello, world!\n");
+        resp.appendToBuffer(&buf);
+        buf.retrieveAll();
+    }
+    doNotOptimize(buf.peek());
+}
+
+// 同样的响应，固定的头部用预先序列化的HttpHeaderBlock
+static void httpResponseSerializeBlock(uint64_t n)
+{
+    static const HttpHeaderBlock headers = HttpHeaderBlock().add("Content-Type", "text/plain").add("Server", "Muduo");
+    Buffer buf;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        HttpResponse resp(false);
+        resp.setStatusCode(HttpResponse::k200Ok);
+        resp.setHeaderBlock(&headers);
+        resp.setBody("hello, world!\n");
+        resp.appendToBuffer(&buf);
+        buf.retrieveAll();
+    }
+    doNotOptimize(buf.peek());
+}
+
+// ---------------------------------------------------------------- HttpRouter
+
+// 300条路由：100种资源，每种有列表、单个对象（:id）和子对象三条
+static void buildRoutes(HttpRouter *router, std::vector<std::string> *paths)
+{
+    HttpRouter::Handler handler = [](const HttpRequest &, HttpResponse *) {};
+    for (int i = 0; i < 100; ++i)
+    {
+        std::string base = "/api/v1/resource" + std::to_string(i);
+        router->get(base, handler);
+        router->get(base + "/:id", handler);
+        router->get(base + "/:id/items", handler);
+        paths->push_back(base);
+        paths->push_back(base + "/12345");
+        paths->push_back(base + "/12345/items");
+    }
+}
+
+static void lookupRoutes(const HttpRouter &router, const std::vector<std::string> &paths, uint64_t n)
+{
+    static const char kGet[] = "GET";
+    HttpRequest req;
+    HttpResponse resp(false);
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        const std::string &path = paths[(i * 7) % paths.size()];
+        req.reset();
+        req.setMethod(kGet, kGet + 3);
+        req.setPath(path.data(), path.data() + path.size());
+        if (!router.dispatch(req, &resp))
+        {
+            fprintf(stderr, "route not found: %s\n", path.c_str());
+            exit(1);
+        }
+    }
+}
+
+static void routerLookup(uint64_t n)
+{
+    static HttpRouter router;
+    static std::vector<std::string> paths;
+    if (paths.empty())
+    {
+        buildRoutes(&router, &paths);
+    }
+    lookupRoutes(router, paths, n);
+}
+
+// 对照：逐条比较路径的if/else链，只有静态路由
+static void routerLinear(uint64_t n)
+{
+    static std::vector<std::string> routes;
+    if (routes.empty())
+    {
+        for (int i = 0; i < 300; ++i)
+        {
+            routes.push_back("/api/v1/resource" + std::to_string(i));
+        }
+    }
+    HttpRequest req;
+    size_t matched = 0;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        const std::string &path = routes[(i * 7) % routes.size()];
+        req.setPath(path.data(), path.data() + path.size());
+        for (const std::string &route : routes)
+        {
+            if (req.path() == route)
+            {
+                ++matched;
+                break;
+            }
+        }
+    }
+    doNotOptimize(matched);
+}
+
+// ---------------------------------------------------------------- TimerQueue / EventLoop
+
+// 一个线程只能有一个EventLoop，定时器和queueInLoop的用例共用主线程的loop
+static EventLoop *g_loop = nullptr;
+
+// 插入n个立即到期的定时器，全部回调执行完以后退出loop
+static void timerInsertExpire(uint64_t n)
+{
+    uint64_t fired = 0;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        g_loop->runAfter(0.0, [&fired, n]() {
+            if (++fired == n)
+            {
+                g_loop->quit();
+            }
+        });
+    }
+    g_loop->loop();
+}
+
+static void timerInsertCancel(uint64_t n)
+{
+    std::vector<TimerId> ids;
+    ids.reserve(1024);
+    for (uint64_t i = 0; i < n; i += ids.size())
+    {
+        ids.clear();
+        for (uint64_t j = i; j < n && ids.size() < 1024; ++j)
+        {
+            ids.push_back(g_loop->runAfter(60.0, []() {}));
+        }
+        for (const TimerId &id : ids)
+        {
+            g_loop->cancel(id);
+        }
+    }
+}
+
+// 另一个线程连续queueInLoop n个回调，loop线程全部执行完以后退出
+static void queueInLoopCrossThread(uint64_t n)
+{
+    uint64_t done = 0;
+    std::thread producer([n, &done]() {
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            g_loop->queueInLoop([&done, n]() {
+                if (++done == n)
+                {
+                    g_loop->quit();
+                }
+            });
+        }
+    });
+    g_loop->loop();
+    producer.join();
+}
+
+// ---------------------------------------------------------------- MemoryPool
+
+// 模拟一次请求内分配kBatch个对象，请求结束时整体释放
+static const int kBatch = 64;
+
+static void memoryPoolSmall(uint64_t n)
+{
+    MemoryPool pool;
+    pool.createPool();
+    for (uint64_t i = 0; i < n; i += kBatch)
+    {
+        for (int j = 0; j < kBatch; ++j)
+        {
+            void *p = pool.malloc(64);
+            doNotOptimize(p);
+        }
+        pool.resetPool();
+    }
+    pool.destroyPool();
+}
+
+static void systemMallocSmall(uint64_t n)
+{
+    void *ptrs[kBatch];
+    for (uint64_t i = 0; i < n; i += kBatch)
+    {
+        for (int j = 0; j < kBatch; ++j)
+        {
+            ptrs[j] = ::malloc(64);
+            doNotOptimize(ptrs[j]);
+        }
+        for (int j = 0; j < kBatch; ++j)
+        {
+            ::free(ptrs[j]);
+        }
+    }
+}
+
+static void memoryPoolLarge(uint64_t n)
+{
+    MemoryPool pool;
+    pool.createPool();
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        void *p = pool.malloc(8192);
+        doNotOptimize(p);
+        pool.freeMemory(p);
+    }
+    pool.destroyPool();
+}
+
+static void systemMallocLarge(uint64_t n)
+{
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        void *p = ::malloc(8192);
+        doNotOptimize(p);
+        ::free(p);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-f filter] [-r repetitions] [-t milliseconds] [-c cpu]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filter = "";
+    int repetitions = 5;
+    double targetMs = 100;
+    int cpu = -1;
+
+    int opt;
+    while ((opt = ::getopt(argc, argv, "f:r:t:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            filter = optarg;
+            break;
+        case 'r':
+            repetitions = atoi(optarg);
+            break;
+        case 't':
+            targetMs = atof(optarg);
+            break;
+        case 'c':
+            cpu = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (repetitions <= 0 || targetMs <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (::sched_setaffinity(0, sizeof set, &set) < 0)
+        {
+            perror("sched_setaffinity");
+        }
+    }
+
+    Logger::setLogLevel(Logger::WARN);
+    EventLoop loop;
+    g_loop = &loop;
+
+    const Benchmark benchmarks[] = {
+        {"buffer_append_64", bufferAppend64},
+        {"buffer_retrieve_16", bufferRetrieve16},
+        {"buffer_readfd_4k", bufferReadFd4k},
+        {"buffer_find_crlf_128", bufferFindCRLF},
+        {"logstream_int", logStreamInt},
+        {"logstream_double", logStreamDouble},
+        {"http_parse_short", httpParseShort},
+        {"http_parse_browser", httpParseBrowser},
+        {"http_response_serialize", httpResponseSerialize},
+        {"http_response_serialize_block", httpResponseSerializeBlock},
+        {"router_lookup_300", routerLookup},
+        {"router_linear_300", routerLinear},
+        {"timer_insert_expire", timerInsertExpire},
+        {"timer_insert_cancel", timerInsertCancel},
+        {"eventloop_queue_in_loop", queueInLoopCrossThread},
+        {"memorypool_alloc_64", memoryPoolSmall},
+        {"malloc_64", systemMallocSmall},
+        {"memorypool_alloc_8k", memoryPoolLarge},
+        {"malloc_8k", systemMallocLarge},
+    };
+
+    printf("{\"suite\":\"microbench\",\"repetitions\":%d,\"target_ms\":%.0f,\"benchmarks\":[", repetitions, targetMs);
+    bool first = true;
+    for (const Benchmark &bench : benchmarks)
+    {
+        if (strstr(bench.name, filter) == NULL)
+        {
+            continue;
+        }
+        fprintf(stderr, "%-28s", bench.name);
+        Result r = measure(bench.run, repetitions, targetMs);
+        fprintf(stderr, "%10.1f ns/op  (min %.1f, rsd %.1f%%)\n", r.median, r.min, r.rsd);
+        printf("%s\n{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.2f,\"min_ns_per_op\":%.2f,\"rsd_pct\":%.2f,\"ops_per_s\":%.0f}",
+               first ? "" : ",", bench.name, static_cast<unsigned long long>(r.iterations),
+               r.median, r.min, r.rsd, r.median > 0 ? 1e9 / r.median : 0.0);
+        first = false;
+    }
+    printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "EventLoop.h"
+#include "TcpServer.h"
+#include "TcpClientPool.h"
+#include "TcpRelay.h"
+#include "Logging.h"
+
+#include <memory>
+#include <stdlib.h>
+
+// 每个subloop一个上游连接池
+thread_local std::unique_ptr<TcpClientPool> t_pool;
+
+class TcpProxy
+{
+public:
+    TcpProxy(EventLoop *loop, const InetAddress &listenAddr, const InetAddress &backendAddr)
+        : server_(loop, listenAddr, "TcpProxy")
+        , backendAddr_(backendAddr)
+    {
+        server_.setThreadInitCallback(
+            std::bind(&TcpProxy::onThreadInit, this, std::placeholders::_1));
+        server_.setConnectionCallback(
+            std::bind(&TcpProxy::onConnection, this, std::placeholders::_1));
+        // 上游连接就绪之前收到的数据先留在inputBuffer_中，TcpRelay启动时会先发给上游
+        server_.setMessageCallback(
+            std::bind(&TcpProxy::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        server_.setThreadNum(2);
+    }
+
+    void start()
+    {
+        server_.start();
+    }
+
+private:
+    void onThreadInit(EventLoop *loop)
+    {
+        t_pool.reset(new TcpClientPool(loop, "backend"));
+    }
+
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (!conn->connected())
+        {
+            return;
+        }
+        LOG_INFO << "Proxy UP : " << conn->peerAddress().toIpPort();
+        TcpClientPool *pool = t_pool.get();
+        pool->acquire(backendAddr_, [conn, pool](const TcpConnectionPtr &upstream) {
+            if (!upstream)
+            {
+                LOG_WARN << "backend unavailable, close " << conn->name();
+                conn->shutdown();
+                return;
+            }
+            if (!conn->connected())
+            {
+                // 客户端在等待上游连接期间已经断开，连接还回池子
+                pool->release(upstream);
+                return;
+            }
+            std::shared_ptr<TcpRelay> relay = std::make_shared<TcpRelay>(conn, upstream);
+            relay->setCloseCallback([](const std::shared_ptr<TcpRelay> &r) {
+                LOG_INFO << "Proxy DOWN : " << r->connA()->peerAddress().toIpPort()
+                         << " up " << r->bytesAtoB() << " bytes, down " << r->bytesBtoA() << " bytes";
+            });
+            relay->start();
+        });
+    }
+
+    void onMessage(const TcpConnectionPtr &, Buffer *, Timestamp)
+    {
+    }
+
+    TcpServer server_;
+    InetAddress backendAddr_;
+};
+
+int main(int argc, char *argv[])
+{
+    uint16_t backendPort = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 8080;
+    EventLoop loop;
+    TcpProxy proxy(&loop, InetAddress(9090), InetAddress(backendPort));
+    proxy.start();
+    loop.loop();
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "EventLoop.h"
+#include "TcpServer.h"
+#include "TlsContext.h"
+#include "Logging.h"
+
+#include <signal.h>
+#include <stdlib.h>
+
+/**
+ * TLS回显服务器，本地测试可以使用自签名证书：
+ *      openssl req -x509 -newkey rsa:2048 -nodes -days 365 -subj /CN=localhost \
+ *              -keyout server.key -out server.crt
+ *      ./tlsEchoServer server.crt server.key [port]
+ *      openssl s_client -connect 127.0.0.1:8443 -quiet
+ *
+ * 内核加载了tls模块(modprobe tls)时握手以后走kTLS，否则回退到用户态加解密，
+ * 可以用Logger::setLogLevel(Logger::DEBUG)查看每条连接的协议版本、加密套件和卸载情况
+ */
+class TlsEchoServer
+{
+public:
+    TlsEchoServer(EventLoop *loop, const InetAddress &addr, const std::shared_ptr<TlsContext> &context)
+        : server_(loop, addr, "TlsEchoServer")
+    {
+        server_.setTlsContext(context);
+        server_.setConnectionCallback(
+            std::bind(&TlsEchoServer::onConnection, this, std::placeholders::_1));
+        server_.setMessageCallback(
+            std::bind(&TlsEchoServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        server_.setThreadNum(2);
+    }
+
+    void start()
+    {
+        server_.start();
+    }
+
+private:
+    // 握手完成以后才会收到连接建立的回调
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        LOG_INFO << "Connection " << (conn->connected() ? "UP : " : "DOWN : ") << conn->peerAddress().toIpPort().c_str();
+    }
+
+    // inputBuffer_中已经是解密后的明文
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        conn->send(buf);
+    }
+
+    TcpServer server_;
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s cert.pem key.pem [port]\n", argv[0]);
+        return 0;
+    }
+    // 对端关闭以后继续写入不要因为SIGPIPE退出
+    ::signal(SIGPIPE, SIG_IGN);
+
+    uint16_t port = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 8443);
+    std::shared_ptr<TlsContext> context = std::make_shared<TlsContext>(argv[1], argv[2]);
+
+    EventLoop loop;
+    TlsEchoServer server(&loop, InetAddress(port), context);
+    server.start();
+    loop.loop();
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <string.h>
+#include <strings.h>
+
+/*
+    StringPiece是一段不拥有所有权的字符串视图：只保存指针和长度，构造和拷贝都不分配内存。
+    用于把解析结果直接指向原始数据（比如HttpRequest指向连接的输入Buffer），
+    使用者必须保证在StringPiece的生命周期内底层数据不被修改或释放。
+    库本身可以用C++11编译，所以没有使用std::string_view。
+*/
+class StringPiece
+{
+public:
+    StringPiece()
+        : ptr_(nullptr),
+          length_(0)
+    {
+    }
+
+    StringPiece(const char *str)
+        : ptr_(str),
+          length_(strlen(str))
+    {
+    }
+
+    StringPiece(const std::string &str)
+        : ptr_(str.data()),
+          length_(str.size())
+    {
+    }
+
+    StringPiece(const char *offset, size_t len)
+        : ptr_(offset),
+          length_(len)
+    {
+    }
+
+    StringPiece(const char *begin, const char *end)
+        : ptr_(begin),
+          length_(static_cast<size_t>(end - begin))
+    {
+    }
+
+    const char *data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char *begin() const { return ptr_; }
+    const char *end() const { return ptr_ + length_; }
+
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void clear()
+    {
+        ptr_ = nullptr;
+        length_ = 0;
+    }
+
+    void removePrefix(size_t n)
+    {
+        ptr_ += n;
+        length_ -= n;
+    }
+
+    void removeSuffix(size_t n)
+    {
+        length_ -= n;
+    }
+
+    bool operator==(const StringPiece &x) const
+    {
+        return length_ == x.length_ && (length_ == 0 || memcmp(ptr_, x.ptr_, length_) == 0);
+    }
+
+    bool operator!=(const StringPiece &x) const
+    {
+        return !(*this == x);
+    }
+
+    // 忽略大小写比较（HTTP头部字段名和一些值不区分大小写）
+    bool equalsIgnoreCase(const StringPiece &x) const
+    {
+        return length_ == x.length_ && (length_ == 0 || strncasecmp(ptr_, x.ptr_, length_) == 0);
+    }
+
+    bool startsWith(const StringPiece &x) const
+    {
+        return length_ >= x.length_ && (x.length_ == 0 || memcmp(ptr_, x.ptr_, x.length_) == 0);
+    }
+
+    std::string asString() const
+    {
+        return std::string(ptr_, length_);
+    }
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
+
+inline bool operator==(const char *lhs, const StringPiece &rhs)
+{
+    return rhs == StringPiece(lhs);
+}
+
+inline bool operator!=(const char *lhs, const StringPiece &rhs)
+{
+    return rhs != StringPiece(lhs);
+}
+
+inline std::ostream &operator<<(std::ostream &os, const StringPiece &piece)
+{
+    return os.write(piece.data(), static_cast<std::streamsize>(piece.size()));
+}
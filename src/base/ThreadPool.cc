@@ -0,0 +1,224 @@
+#include "ThreadPool.h"
+#include "EventLoop.h"
+
+#include <stdio.h>
+#include <thread>
+
+namespace
+{
+    // 当前线程所属的线程池和队列下标，工作线程中提交的任务放入自己的队列
+    __thread ThreadPool *t_pool = nullptr;
+    __thread size_t t_workerIndex = 0;
+}
+
+ThreadPool::ThreadPool(const std::string &name)
+    : name_(name),
+      running_(false),
+      exiting_(false),
+      threadSize_(0),
+      pending_(0),
+      adding_(0),
+      sleepers_(0),
+      nextWorker_(0)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+void ThreadPool::start()
+{
+    if (running_)
+    {
+        return;
+    }
+    size_t num = threadSize_ > 0 ? threadSize_ : std::thread::hardware_concurrency();
+    if (num == 0)
+    {
+        num = 1;
+    }
+
+    workers_.reserve(num);
+    for (size_t i = 0; i < num; ++i)
+    {
+        workers_.emplace_back(new Worker);
+    }
+    {
+        // start()之前提交的任务分给各个队列
+        std::unique_lock<std::mutex> lock(mutex_);
+        size_t i = 0;
+        while (!injectQueue_.empty())
+        {
+            workers_[i++ % num]->tasks.push_back(std::move(injectQueue_.front()));
+            injectQueue_.pop_front();
+            ++pending_;
+        }
+        exiting_ = false;
+        running_ = true;
+    }
+
+    threads_.reserve(num);
+    for (size_t i = 0; i < num; ++i)
+    {
+        char id[32];
+        snprintf(id, sizeof(id), "%zu", i + 1);
+        threads_.emplace_back(new Thread(std::bind(&ThreadPool::runInThread, this, i), name_ + id));
+        threads_[i]->start();
+    }
+}
+
+void ThreadPool::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!running_)
+        {
+            return;
+        }
+        running_ = false;
+    }
+    // 等已经看到running_的add()把任务放完，之后的add()都放入injectQueue_；
+    // 放完以后才让工作线程退出，这样线程退出前能执行完队列中的所有任务，队列也不会在add()使用时被释放
+    while (adding_ > 0)
+    {
+        std::this_thread::yield();
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        exiting_ = true;
+    }
+    cond_.notify_all();
+    for (auto &thread : threads_)
+    {
+        thread->join();
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    threads_.clear();
+    workers_.clear();
+}
+
+void ThreadPool::add(ThreadFunction task)
+{
+    if (t_pool == this)
+    {
+        // 工作线程中提交的任务放入自己的队列：stop()等工作线程都退出以后才释放队列，线程退出前会执行完
+        push(*workers_[t_workerIndex], std::move(task));
+        return;
+    }
+
+    for (;;)
+    {
+        // 和stop()配合：要么stop()等这里放完，要么这里看到running_为false
+        ++adding_;
+        if (running_)
+        {
+            push(*workers_[nextWorker_++ % workers_.size()], std::move(task));
+            --adding_;
+            return;
+        }
+        --adding_;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!running_)
+        {
+            injectQueue_.push_back(std::move(task));
+            return;
+        }
+        // start()刚刚完成，重新放入工作线程的队列
+    }
+}
+
+void ThreadPool::push(Worker &worker, ThreadFunction task)
+{
+    ++pending_;
+    {
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    // 有线程在睡眠才需要唤醒；和runInThread中的检查配合不会丢失唤醒：
+    // 要么这里看到sleepers_>0，要么睡眠线程在sleepers_+1之后看到pending_>0
+    if (sleepers_ > 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+        }
+        cond_.notify_one();
+    }
+}
+
+// 先从自己队列的尾部取，再从其他队列的头部偷
+bool ThreadPool::take(size_t index, ThreadFunction &task)
+{
+    {
+        Worker &self = *workers_[index];
+        std::unique_lock<std::mutex> lock(self.mutex);
+        if (!self.tasks.empty())
+        {
+            task = std::move(self.tasks.back());
+            self.tasks.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+
+    size_t num = workers_.size();
+    for (size_t i = 1; i < num; ++i)
+    {
+        Worker &victim = *workers_[(index + i) % num];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (lock.owns_lock() && !victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runInThread(size_t index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+    if (threadInitCallback_)
+    {
+        threadInitCallback_();
+    }
+
+    ThreadFunction task;
+    for (;;)
+    {
+        if (take(index, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++sleepers_;
+        // 偷任务时try_lock失败的队列可能还有任务，pending_才是准确的
+        cond_.wait(lock, [this]() { return pending_ > 0 || exiting_; });
+        --sleepers_;
+        if (exiting_ && pending_ == 0)
+        {
+            break;
+        }
+    }
+    t_pool = nullptr;
+}
+
+void ThreadPool::postToLoop(EventLoop *loop, ThreadFunction cb)
+{
+    if (loop)
+    {
+        loop->runInLoop(std::move(cb));
+    }
+    else
+    {
+        cb();
+    }
+}
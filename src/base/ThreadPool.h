@@ -0,0 +1,117 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+class EventLoop;
+
+/**
+ * ThreadPool 计算线程池，把CPU密集的工作（JSON、模板渲染、压缩...）从IO线程中拿出来
+ *
+ * 工作窃取(work stealing)：每个工作线程有自己的任务队列，
+ * 外部线程提交的任务轮流放入各个队列，工作线程中提交的任务放入自己的队列；
+ * 工作线程从自己队列的尾部取任务（刚放进去的任务数据还在cache中），
+ * 自己的队列空了就从其他线程队列的头部偷任务，都没有任务时才睡眠。
+ *
+ * 和EventLoop配合：submit在线程池中执行task，完成以后把结果交给replyLoop，
+ * 在replyLoop线程中调用callback，回调里可以直接使用TcpConnection：
+ *
+ *      pool.submit([req]() { return render(req); },          // 线程池中执行
+ *                  conn->getLoop(),
+ *                  [conn](const std::string &body) {          // conn所在的subloop中执行
+ *                      conn->send(body);
+ *                  });
+ */
+class ThreadPool : noncopyable
+{
+public:
+    using ThreadFunction = std::function<void()>;
+
+    explicit ThreadPool(const std::string &name = std::string("ThreadPool"));
+    ~ThreadPool();
+
+    void setThreadInitCallback(const ThreadFunction &cb) { threadInitCallback_ = cb; }
+    // 线程数，0表示使用CPU核数（默认）
+    void setThreadSize(const int &num) { threadSize_ = num; }
+    void start();
+    // 等待已经提交的任务全部执行完，然后结束所有线程
+    void stop();
+
+    const std::string &name() const { return name_; }
+    // 还没有开始执行的任务数
+    size_t queueSize() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return pending_ + injectQueue_.size();
+    }
+
+    // 提交任务，可以在任意线程调用；start()之前、stop()之后提交的任务在下一次start()之后执行
+    void add(ThreadFunction task);
+
+    // 在线程池中执行task，在replyLoop线程中以task的返回值调用callback
+    // task返回void时，callback没有参数
+    template <typename Task, typename Callback>
+    void submit(Task task, EventLoop *replyLoop, Callback callback)
+    {
+        add(std::bind(&ThreadPool::runAndReply<Task, Callback>, task, replyLoop, callback));
+    }
+
+private:
+    // 每个工作线程一个任务队列
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<ThreadFunction> tasks;
+    };
+
+    void runInThread(size_t index);
+    bool take(size_t index, ThreadFunction &task);
+    void push(Worker &worker, ThreadFunction task);
+
+    // 把回调交给loop线程执行
+    static void postToLoop(EventLoop *loop, ThreadFunction cb);
+
+    template <typename Task, typename Callback>
+    static void runAndReply(Task &task, EventLoop *loop, Callback &callback)
+    {
+        reply(task, loop, callback, std::is_void<decltype(task())>());
+    }
+
+    template <typename Task, typename Callback>
+    static void reply(Task &task, EventLoop *loop, Callback &callback, std::true_type)
+    {
+        task();
+        postToLoop(loop, callback);
+    }
+
+    template <typename Task, typename Callback>
+    static void reply(Task &task, EventLoop *loop, Callback &callback, std::false_type)
+    {
+        using Result = typename std::decay<decltype(task())>::type;
+        std::shared_ptr<Result> result = std::make_shared<Result>(task());
+        postToLoop(loop, [callback, result]() { callback(std::move(*result)); });
+    }
+
+    mutable std::mutex mutex_; // 保护injectQueue_，以及睡眠/唤醒
+    std::condition_variable cond_;
+    std::string name_;
+    ThreadFunction threadInitCallback_;
+    std::vector<std::unique_ptr<Thread>> threads_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::deque<ThreadFunction> injectQueue_; // 没有运行时（start()之前、stop()之后）提交的任务
+    std::atomic_bool running_;
+    bool exiting_; // 由mutex_保护，stop()等add()放完任务以后才设置，工作线程看到它且队列为空才退出
+    size_t threadSize_;
+    std::atomic<size_t> pending_;  // 工作线程队列中的任务总数
+    std::atomic<size_t> adding_;   // 正在往工作线程队列中放任务的外部线程数，stop()等它归零
+    std::atomic<size_t> sleepers_; // 正在睡眠的线程数
+    std::atomic<size_t> nextWorker_;
+};
@@ -1,19 +1,38 @@
 #include "Timestamp.h"
 #include <sys/time.h>
+#include <time.h>
 using namespace std;
 
+static int64_t readClock(clockid_t clockId)
+{
+    // 在x86-64平台clock_gettime()通过vDSO实现,不会陷入内核
+    struct timespec ts;
+    ::clock_gettime(clockId, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * Timestamp::kMicroSecondsPerSecond + ts.tv_nsec / 1000;
+}
+
 // 获取当前时间戳
 Timestamp Timestamp::now()
 {
     // 获取微妙和秒
     // 在x86-64平台gettimeofday()已不是系统调用,不会陷入内核, 多次调用不会有性能损失.
     struct timeval tv;
+    gettimeofday(&tv, NULL);
     int64_t seconds = tv.tv_sec;
     int64_t microseconds = tv.tv_usec;
-    gettimeofday(&tv, NULL);
     return Timestamp(seconds * kMicroSecondsPerSecond + microseconds);
 }
 
+Timestamp Timestamp::monotonic()
+{
+    return Timestamp(readClock(CLOCK_MONOTONIC));
+}
+
+Timestamp Timestamp::monotonicCoarse()
+{
+    return Timestamp(readClock(CLOCK_MONOTONIC_COARSE));
+}
+
 string Timestamp::toString() const
 {
     char buf[128] = {0};
@@ -20,8 +20,12 @@ public:
     {
     }
 
-    // 获取当前时间戳
+    // 获取当前时间戳(墙上时间，会被NTP或手动修改时间影响)
     static Timestamp now();
+    // CLOCK_MONOTONIC：开机以来的微秒数，不会跳变，用于定时器和超时的计算
+    static Timestamp monotonic();
+    // CLOCK_MONOTONIC_COARSE：精度为一个时钟节拍(1~4ms)，只读取vDSO中的变量，比monotonic()更便宜
+    static Timestamp monotonicCoarse();
 
     // 用std::string形式返回,格式[millisec].[microsec]
     string toString() const;
@@ -1,38 +1,135 @@
 #include "ThreadPool.h"
+#include "EventLoop.h"
 #include "Logging.h"
 #include "CurrentThread.h"
+#include <assert.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <functional>
+#include <atomic>
+#include <thread>
 
-int count = 0;
-
-void showInfo()
-{
-    LOG_INFO << CurrentThread::tid();
-}
+int threadCount = 0;
 
+// start()之前提交的任务在start()之后执行，stop()等它们全部执行完
 void test1()
 {
     ThreadPool pool;
     pool.setThreadSize(4);
+    std::atomic_int done(0);
     for (int i = 0; i < 5000; i++) 
     {
-        pool.add(showInfo);
+        pool.add([&]() {
+            LOG_DEBUG << CurrentThread::tid();
+            ++done;
+        });
     }
-    pool.add([]{sleep(5);});
+    assert(pool.queueSize() == 5000);
     pool.start();    
+    pool.stop();
+    assert(done == 5000);
+    assert(pool.queueSize() == 0);
+}
+
+// 计算任务在线程池中执行，结果回到loop线程
+void test2()
+{
+    EventLoop loop;
+    ThreadPool pool("compute");
+    pool.setThreadSize(4);
+    pool.start();
+
+    const int kTasks = 1000;
+    int replies = 0;
+    long long sum = 0;
+    for (int i = 0; i < kTasks; i++)
+    {
+        pool.submit([i]() {
+                        long long s = 0;
+                        for (int j = 0; j <= i; j++)
+                        {
+                            s += j;
+                        }
+                        return s;
+                    },
+                    &loop,
+                    [&](long long s) {
+                        // 在loop线程中执行，不需要加锁
+                        sum += s;
+                        if (++replies == kTasks)
+                        {
+                            loop.quit();
+                        }
+                    });
+    }
+    loop.loop();
+    assert(replies == kTasks);
+    assert(sum == static_cast<long long>(kTasks - 1) * kTasks * (kTasks + 1) / 6);
+}
+
+// 工作线程中提交的任务进入自己的队列，空闲线程会来偷
+void test3()
+{
+    ThreadPool pool("steal");
+    pool.setThreadSize(4);
+    pool.start();
+    std::atomic_int done(0);
+    pool.add([&]() {
+        for (int i = 0; i < 100; i++)
+        {
+            pool.add([&]() {
+                usleep(1000);
+                ++done;
+            });
+        }
+    });
+    pool.stop();
+    assert(done == 100);
+}
+
+// 另一个线程不停地add()，同时stop()：任务要么在stop()之前执行完，要么留到下一次start()，不会丢失
+void test4()
+{
+    ThreadPool pool("stop");
+    pool.setThreadSize(4);
+    std::atomic_int done(0);
+    std::atomic_bool adding(true);
+    int added = 0;
+    for (int round = 0; round < 100; round++)
+    {
+        pool.start();
+        adding = true;
+        std::thread producer([&]() {
+            while (adding)
+            {
+                pool.add([&]() { ++done; });
+                ++added;
+            }
+        });
+        usleep(100);
+        pool.stop();
+        adding = false;
+        producer.join();
+    }
+    // 最后一次stop()之后提交的任务在这里执行
+    pool.start();
+    pool.stop();
+    assert(added == done);
+    assert(pool.queueSize() == 0);
 }
 
 void initFunc()
 {
-    printf("Create thread %d\n", ++count);
+    printf("Create thread %d\n", ++threadCount);
 }
 
 int main()
 {
     test1();
-
+    test2();
+    test3();
+    test4();
+    printf("ThreadPool tests passed\n");
     
     return 0;
-}
\ No newline at end of file
+}
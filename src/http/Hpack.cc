@@ -0,0 +1,654 @@
+#include "Hpack.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+namespace
+{
+
+// 长度在启动时算好，编码时逐项比较不用每次strlen
+struct StaticEntry
+{
+    StringPiece name;
+    StringPiece value;
+};
+
+// RFC 7541 附录A，下标从1开始
+const StaticEntry kStaticTable[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+const size_t kStaticTableSize = sizeof kStaticTable / sizeof kStaticTable[0];
+
+struct HuffmanCode
+{
+    uint32_t code;
+    uint8_t bits;
+};
+
+// RFC 7541 附录B，不包括EOS（30个1）
+const HuffmanCode kHuffmanCodes[256] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+};
+
+// Huffman解码树：叶子是符号，解码时每读一位走一步，到叶子输出一个字节再回到根
+class HuffmanTree
+{
+public:
+    struct Node
+    {
+        int16_t children[2]; // -1表示没有
+        int16_t symbol;      // 内部节点是-1
+    };
+
+    HuffmanTree()
+    {
+        nodes_.push_back(Node{{-1, -1}, -1});
+        for (int symbol = 0; symbol < 256; ++symbol)
+        {
+            const HuffmanCode &code = kHuffmanCodes[symbol];
+            size_t node = 0;
+            for (int i = code.bits - 1; i >= 0; --i)
+            {
+                int bit = (code.code >> i) & 1;
+                if (nodes_[node].children[bit] < 0)
+                {
+                    nodes_[node].children[bit] = static_cast<int16_t>(nodes_.size());
+                    nodes_.push_back(Node{{-1, -1}, -1});
+                }
+                node = static_cast<size_t>(nodes_[node].children[bit]);
+            }
+            nodes_[node].symbol = static_cast<int16_t>(symbol);
+        }
+    }
+
+    const Node &node(size_t i) const { return nodes_[i]; }
+
+private:
+    std::vector<Node> nodes_;
+};
+
+const HuffmanTree &huffmanTree()
+{
+    static const HuffmanTree tree;
+    return tree;
+}
+
+// 静态表中名字和值都相同的下标，只有名字相同的下标放在*nameIndex（没有时不修改）
+size_t findStatic(const StringPiece &name, const StringPiece &value, size_t *nameIndex)
+{
+    for (size_t i = 0; i < kStaticTableSize; ++i)
+    {
+        if (name == kStaticTable[i].name)
+        {
+            if (value == kStaticTable[i].value)
+            {
+                return i + 1;
+            }
+            if (*nameIndex == 0)
+            {
+                *nameIndex = i + 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// 每次都不同、加入动态表只会挤掉有用表项的字段
+bool shouldIndex(const StringPiece &name)
+{
+    return name != "content-length" && name != "content-range" && name != "etag" && name != "last-modified";
+}
+
+// 不能被中间代理压缩进动态表的敏感字段（RFC 7541 7.1.3）
+bool neverIndex(const StringPiece &name)
+{
+    return name == "set-cookie" || name == "authorization" || name == "proxy-authorization";
+}
+
+} // namespace
+
+namespace hpack
+{
+
+void encodeInteger(uint64_t value, int prefixBits, unsigned char first, std::string *out)
+{
+    uint64_t max = (1u << prefixBits) - 1;
+    if (value < max)
+    {
+        out->push_back(static_cast<char>(first | value));
+        return;
+    }
+    out->push_back(static_cast<char>(first | max));
+    value -= max;
+    while (value >= 128)
+    {
+        out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+bool decodeInteger(const unsigned char **p, const unsigned char *end, int prefixBits, uint64_t *value)
+{
+    const unsigned char *q = *p;
+    if (q == end)
+    {
+        return false;
+    }
+    uint64_t max = (1u << prefixBits) - 1;
+    uint64_t v = *q++ & max;
+    if (v == max)
+    {
+        // 后续字节每个7位，最多接受到2^62左右，防止溢出
+        int shift = 0;
+        while (true)
+        {
+            if (q == end || shift > 56)
+            {
+                return false;
+            }
+            unsigned char b = *q++;
+            v += static_cast<uint64_t>(b & 0x7f) << shift;
+            shift += 7;
+            if ((b & 0x80) == 0)
+            {
+                break;
+            }
+        }
+    }
+    *value = v;
+    *p = q;
+    return true;
+}
+
+size_t huffmanEncodedLength(const StringPiece &s)
+{
+    uint64_t bits = 0;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        bits += kHuffmanCodes[static_cast<unsigned char>(s[i])].bits;
+    }
+    return static_cast<size_t>((bits + 7) / 8);
+}
+
+void huffmanEncode(const StringPiece &s, std::string *out)
+{
+    uint64_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        const HuffmanCode &code = kHuffmanCodes[static_cast<unsigned char>(s[i])];
+        acc = (acc << code.bits) | code.code;
+        bits += code.bits;
+        while (bits >= 8)
+        {
+            bits -= 8;
+            out->push_back(static_cast<char>(acc >> bits));
+        }
+    }
+    if (bits > 0)
+    {
+        // 用EOS的前几位（全1）补齐最后一个字节
+        out->push_back(static_cast<char>((acc << (8 - bits)) | (0xff >> bits)));
+    }
+}
+
+bool huffmanDecode(const unsigned char *data, size_t len, std::string *out)
+{
+    const HuffmanTree &tree = huffmanTree();
+    size_t node = 0;
+    int depth = 0;       // 上一个符号之后读过的位数
+    bool allOnes = true; // 这些位是否全是1
+    for (size_t i = 0; i < len; ++i)
+    {
+        for (int shift = 7; shift >= 0; --shift)
+        {
+            int bit = (data[i] >> shift) & 1;
+            int16_t next = tree.node(node).children[bit];
+            if (next < 0)
+            {
+                // 只有EOS的编码会走到这里
+                return false;
+            }
+            node = static_cast<size_t>(next);
+            ++depth;
+            allOnes = allOnes && bit == 1;
+            int16_t symbol = tree.node(node).symbol;
+            if (symbol >= 0)
+            {
+                out->push_back(static_cast<char>(symbol));
+                node = 0;
+                depth = 0;
+                allOnes = true;
+            }
+        }
+    }
+    // 填充必须少于8位并且是EOS的前缀
+    return depth < 8 && allOnes;
+}
+
+void encodeString(const StringPiece &s, std::string *out)
+{
+    size_t huffmanLength = huffmanEncodedLength(s);
+    if (huffmanLength < s.size())
+    {
+        encodeInteger(huffmanLength, 7, 0x80, out);
+        huffmanEncode(s, out);
+    }
+    else
+    {
+        encodeInteger(s.size(), 7, 0, out);
+        out->append(s.data(), s.size());
+    }
+}
+
+} // namespace hpack
+
+void HpackTable::setMaxSize(size_t maxSize)
+{
+    maxSize_ = maxSize;
+    evict(maxSize_);
+}
+
+void HpackTable::add(const StringPiece &name, const StringPiece &value)
+{
+    size_t size = name.size() + value.size() + kEntryOverhead;
+    if (size > maxSize_)
+    {
+        evict(0);
+        return;
+    }
+    evict(maxSize_ - size);
+    entries_.emplace_front(name.asString(), value.asString());
+    size_ += size;
+}
+
+void HpackTable::evict(size_t maxSize)
+{
+    while (size_ > maxSize)
+    {
+        const Entry &last = entries_.back();
+        size_ -= last.first.size() + last.second.size() + kEntryOverhead;
+        entries_.pop_back();
+    }
+}
+
+HpackDecoder::HpackDecoder(size_t maxTableSize, size_t maxHeaderListSize)
+    : table_(maxTableSize),
+      maxTableSize_(maxTableSize),
+      maxHeaderListSize_(maxHeaderListSize)
+{
+}
+
+bool HpackDecoder::lookup(size_t index, const HpackTable::Entry **entry) const
+{
+    if (index == 0 || index > kStaticTableSize + table_.entries())
+    {
+        return false;
+    }
+    *entry = index > kStaticTableSize ? &table_.get(index - kStaticTableSize - 1) : nullptr;
+    return true;
+}
+
+// 字符串字面值（RFC 7541 5.2）：最高位表示是否Huffman编码，然后是长度和数据
+bool HpackDecoder::decodeString(const unsigned char **p, const unsigned char *end, std::string *out)
+{
+    bool huffman = *p < end && (**p & 0x80);
+    uint64_t length = 0;
+    if (!hpack::decodeInteger(p, end, 7, &length) || length > static_cast<uint64_t>(end - *p))
+    {
+        return false;
+    }
+    if (huffman)
+    {
+        if (!hpack::huffmanDecode(*p, length, out))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        out->assign(reinterpret_cast<const char *>(*p), length);
+    }
+    *p += length;
+    return true;
+}
+
+bool HpackDecoder::decode(const char *data, size_t len, std::vector<Header> *headers)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *end = p + len;
+    bool headerSeen = false;
+    size_t listSize = 0; // RFC 7540 6.5.2 SETTINGS_MAX_HEADER_LIST_SIZE的算法
+    auto fits = [&](size_t nameSize, size_t valueSize) {
+        listSize += nameSize + valueSize + HpackTable::kEntryOverhead;
+        return maxHeaderListSize_ == 0 || listSize <= maxHeaderListSize_;
+    };
+    while (p < end)
+    {
+        unsigned char b = *p;
+        uint64_t index = 0;
+        if (b & 0x80)
+        {
+            // 6.1 下标表示的字段，先检查大小再拷贝
+            const HpackTable::Entry *entry = nullptr;
+            if (!hpack::decodeInteger(&p, end, 7, &index) || !lookup(index, &entry))
+            {
+                return false;
+            }
+            if (entry)
+            {
+                if (!fits(entry->first.size(), entry->second.size()))
+                {
+                    return false;
+                }
+                headers->push_back(*entry);
+            }
+            else
+            {
+                const StaticEntry &field = kStaticTable[index - 1];
+                if (!fits(field.name.size(), field.value.size()))
+                {
+                    return false;
+                }
+                headers->emplace_back(field.name.asString(), field.value.asString());
+            }
+            headerSeen = true;
+            continue;
+        }
+        if ((b & 0xe0) == 0x20)
+        {
+            // 6.3 动态表大小更新，只能出现在头部块开头
+            if (headerSeen || !hpack::decodeInteger(&p, end, 5, &index) || index > maxTableSize_)
+            {
+                return false;
+            }
+            table_.setMaxSize(index);
+            continue;
+        }
+
+        // 6.2 字面值：0x40加入动态表，0x00不加入，0x10永不加入
+        bool indexing = (b & 0xc0) == 0x40;
+        if (!hpack::decodeInteger(&p, end, indexing ? 6 : 4, &index))
+        {
+            return false;
+        }
+        headers->emplace_back();
+        Header &header = headers->back();
+        if (index > 0)
+        {
+            const HpackTable::Entry *entry = nullptr;
+            if (!lookup(index, &entry))
+            {
+                return false;
+            }
+            if (entry)
+            {
+                header.first = entry->first;
+            }
+            else
+            {
+                header.first.assign(kStaticTable[index - 1].name.data(), kStaticTable[index - 1].name.size());
+            }
+        }
+        else
+        {
+            // 字段名也是字面值，需要两个字符串
+            if (!decodeString(&p, end, &header.first))
+            {
+                return false;
+            }
+        }
+        if (!decodeString(&p, end, &header.second) || !fits(header.first.size(), header.second.size()))
+        {
+            return false;
+        }
+        if (indexing)
+        {
+            table_.add(header.first, header.second);
+        }
+        headerSeen = true;
+    }
+    return true;
+}
+
+HpackEncoder::HpackEncoder()
+    : table_(4096),
+      sizeUpdate_(false),
+      minSizeSeen_(4096)
+{
+}
+
+void HpackEncoder::setMaxTableSize(size_t size)
+{
+    // 本端最多使用4096字节，对端允许更大时不需要通知
+    size_t newSize = std::min<size_t>(size, 4096);
+    if (newSize == table_.maxSize())
+    {
+        return;
+    }
+    minSizeSeen_ = sizeUpdate_ ? std::min(minSizeSeen_, newSize) : std::min(table_.maxSize(), newSize);
+    table_.setMaxSize(newSize);
+    sizeUpdate_ = true;
+}
+
+void HpackEncoder::encodeTableSizeUpdate(std::string *out)
+{
+    if (sizeUpdate_)
+    {
+        // 两次设置之间变小过时，先通知最小值，保证对端淘汰了同样的表项
+        if (minSizeSeen_ < table_.maxSize())
+        {
+            hpack::encodeInteger(minSizeSeen_, 5, 0x20, out);
+        }
+        hpack::encodeInteger(table_.maxSize(), 5, 0x20, out);
+        sizeUpdate_ = false;
+    }
+}
+
+void HpackEncoder::encodeStatus(int status, std::string *out)
+{
+    encodeTableSizeUpdate(out);
+    switch (status)
+    {
+    case 200:
+        out->push_back(static_cast<char>(0x80 | 8));
+        return;
+    case 204:
+        out->push_back(static_cast<char>(0x80 | 9));
+        return;
+    case 206:
+        out->push_back(static_cast<char>(0x80 | 10));
+        return;
+    case 304:
+        out->push_back(static_cast<char>(0x80 | 11));
+        return;
+    case 400:
+        out->push_back(static_cast<char>(0x80 | 12));
+        return;
+    case 404:
+        out->push_back(static_cast<char>(0x80 | 13));
+        return;
+    case 500:
+        out->push_back(static_cast<char>(0x80 | 14));
+        return;
+    default:
+        break;
+    }
+    // 字段名用静态表的":status"，值不加入动态表
+    char buf[8];
+    int n = snprintf(buf, sizeof buf, "%d", status);
+    hpack::encodeInteger(8, 4, 0x00, out);
+    hpack::encodeString(StringPiece(buf, n), out);
+}
+
+void HpackEncoder::encode(const StringPiece &name, const StringPiece &value, std::string *out)
+{
+    encodeTableSizeUpdate(out);
+    size_t nameIndex = 0;
+    size_t index = findStatic(name, value, &nameIndex);
+    if (index > 0)
+    {
+        hpack::encodeInteger(index, 7, 0x80, out);
+        return;
+    }
+    for (size_t i = 0; i < table_.entries(); ++i)
+    {
+        const HpackTable::Entry &entry = table_.get(i);
+        if (name == entry.first)
+        {
+            if (value == entry.second)
+            {
+                hpack::encodeInteger(kStaticTableSize + 1 + i, 7, 0x80, out);
+                return;
+            }
+            if (nameIndex == 0)
+            {
+                nameIndex = kStaticTableSize + 1 + i;
+            }
+        }
+    }
+
+    bool indexing = shouldIndex(name) && !neverIndex(name);
+    if (indexing)
+    {
+        hpack::encodeInteger(nameIndex, 6, 0x40, out);
+    }
+    else
+    {
+        hpack::encodeInteger(nameIndex, 4, neverIndex(name) ? 0x10 : 0x00, out);
+    }
+    if (nameIndex == 0)
+    {
+        hpack::encodeString(name, out);
+    }
+    hpack::encodeString(value, out);
+    if (indexing)
+    {
+        table_.add(name, value);
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef HTTP_HPACK_H
+#define HTTP_HPACK_H
+
+#include "noncopyable.h"
+#include "StringPiece.h"
+
+#include <deque>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+    HPACK（RFC 7541）：HTTP/2的头部压缩。
+
+    头部字段用静态表（61个常用字段）和动态表（最近发送过的字段，按字节数限制大小）的下标表示，
+    不在表中的字段名和值按字面发送，可以再用固定的Huffman编码压缩。
+    编码器和解码器各自维护一张动态表，按同样的规则插入和淘汰，两边的表始终一致，
+    所以一条连接上的两个方向各需要一个编码器和一个解码器，头部块必须按发送的顺序解码。
+*/
+class HpackTable
+{
+public:
+    using Entry = std::pair<std::string, std::string>;
+
+    // 每个表项除了名字和值以外的开销（RFC 7541 4.1）
+    static const size_t kEntryOverhead = 32;
+
+    explicit HpackTable(size_t maxSize) : size_(0), maxSize_(maxSize) {}
+
+    // 调整最大字节数，超出的表项立即淘汰
+    void setMaxSize(size_t maxSize);
+    size_t maxSize() const { return maxSize_; }
+    size_t size() const { return size_; }
+    size_t entries() const { return entries_.size(); }
+
+    // 插入到最前面，淘汰最旧的表项直到放得下；比整张表还大的字段只是清空表
+    void add(const StringPiece &name, const StringPiece &value);
+    // 0是最新插入的表项
+    const Entry &get(size_t index) const { return entries_[index]; }
+
+private:
+    void evict(size_t maxSize);
+
+    std::deque<Entry> entries_;
+    size_t size_;
+    size_t maxSize_;
+};
+
+class HpackDecoder : noncopyable
+{
+public:
+    using Header = std::pair<std::string, std::string>;
+
+    // maxTableSize是本端通告的SETTINGS_HEADER_TABLE_SIZE，对端更新动态表大小时不能超过它；
+    // maxHeaderListSize是本端通告的SETTINGS_MAX_HEADER_LIST_SIZE，0表示不限制
+    explicit HpackDecoder(size_t maxTableSize = 4096, size_t maxHeaderListSize = 0);
+
+    /**
+     * 解码一个完整的头部块（HEADERS和所有CONTINUATION的内容拼在一起），字段追加到headers。
+     * 格式错误返回false，这是连接错误（COMPRESSION_ERROR），之后的动态表已经不可信。
+     * 解码出的头部列表（每个字段按名字+值+32字节计算）超过maxHeaderListSize时也返回false：
+     * 很小的头部块可以反复引用动态表中的大字段，解码结果会比头部块大几千倍
+     */
+    bool decode(const char *data, size_t len, std::vector<Header> *headers);
+
+    // 动态表当前的字节数，按RFC 7541 4.1计算
+    size_t tableSize() const { return table_.size(); }
+
+private:
+    bool lookup(size_t index, const HpackTable::Entry **entry) const;
+    static bool decodeString(const unsigned char **p, const unsigned char *end, std::string *out);
+
+    HpackTable table_;
+    const size_t maxTableSize_;
+    const size_t maxHeaderListSize_;
+};
+
+class HpackEncoder : noncopyable
+{
+public:
+    HpackEncoder();
+
+    // 对端通告的SETTINGS_HEADER_TABLE_SIZE，变小时在下一个头部块开头通知对端
+    void setMaxTableSize(size_t size);
+
+    // 编码":status"，常用状态码在静态表中只要一个字节
+    void encodeStatus(int status, std::string *out);
+    // 编码一个字段，名字必须是小写的；Content-Length这样每次都不同的值不加入动态表
+    void encode(const StringPiece &name, const StringPiece &value, std::string *out);
+
+private:
+    void encodeTableSizeUpdate(std::string *out);
+
+    HpackTable table_;
+    bool sizeUpdate_;    // 需要在下一个头部块开头发送动态表大小更新
+    size_t minSizeSeen_; // 两个头部块之间设置过的最小值，要先通知它
+};
+
+// 以下函数供编码器、解码器和测试使用
+namespace hpack
+{
+
+// 前缀为prefixBits位的整数编码（RFC 7541 5.1），first是第一个字节中前缀以外的高位
+void encodeInteger(uint64_t value, int prefixBits, unsigned char first, std::string *out);
+// 解码整数，成功时*p指向整数之后
+bool decodeInteger(const unsigned char **p, const unsigned char *end, int prefixBits, uint64_t *value);
+
+// 字符串字面值：Huffman编码更短时使用Huffman
+void encodeString(const StringPiece &s, std::string *out);
+size_t huffmanEncodedLength(const StringPiece &s);
+void huffmanEncode(const StringPiece &s, std::string *out);
+// 解码失败（非法的填充、EOS）返回false
+bool huffmanDecode(const unsigned char *data, size_t len, std::string *out);
+
+} // namespace hpack
+
+#endif
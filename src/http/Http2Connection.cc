@@ -0,0 +1,1223 @@
+#include "Http2Connection.h"
+#include "HttpResponse.h"
+#include "ResponseWriter.h"
+#include "HttpStream.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace http2;
+
+namespace
+{
+
+const char kSwitchingProtocols[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+
+// 追加到已经预留好空间的storage，返回拷贝的位置：容量足够时append不会重新分配，之前返回的指针一直有效
+const char *store(std::string *storage, const char *data, size_t len)
+{
+    assert(storage->size() + len <= storage->capacity());
+    const char *p = storage->data() + storage->size();
+    storage->append(data, len);
+    return p;
+}
+
+// HTTP/2禁止的逐跳（connection-specific）头部，名字是小写的
+bool connectionSpecific(const StringPiece &name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+// 取出content-length的值：只能是数字，出现多次时必须完全相同
+bool parseContentLength(const HttpRequest &request, StringPiece *value)
+{
+    if (!request.headerValuesAgree("content-length"))
+    {
+        return false;
+    }
+    *value = request.getHeader("content-length");
+    for (char c : *value)
+    {
+        if (c < '0' || c > '9')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int base64Value(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '-' || c == '+')
+        return 62;
+    if (c == '_' || c == '/')
+        return 63;
+    return -1;
+}
+
+// HTTP2-Settings是base64url编码的，通常没有结尾的'='
+bool decodeBase64Url(const StringPiece &in, std::string *out)
+{
+    uint32_t bits = 0;
+    int count = 0;
+    for (size_t i = 0; i < in.size(); ++i)
+    {
+        if (in[i] == '=')
+        {
+            break;
+        }
+        int v = base64Value(in[i]);
+        if (v < 0)
+        {
+            return false;
+        }
+        bits = (bits << 6) | v;
+        count += 6;
+        if (count >= 8)
+        {
+            count -= 8;
+            out->push_back(static_cast<char>(bits >> count));
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+struct Http2Connection::Stream
+{
+    Stream(uint32_t streamId, uint32_t initialWindow)
+        : id(streamId),
+          remoteClosed(false),
+          localClosed(false),
+          streamingBody(false),
+          rejected(false),
+          sendWindow(initialWindow),
+          recvWindow(kStreamWindowSize),
+          recvConsumed(0),
+          bodyReceived(0),
+          pendingOffset(0),
+          fileFd(-1),
+          fileOffset(0),
+          fileRemaining(0),
+          endAfterPending(false)
+    {
+    }
+
+    // 还没有发出去的响应体字节数
+    size_t backlog() const { return fileFd >= 0 ? fileRemaining : pending.size() - pendingOffset; }
+
+    const uint32_t id;
+    bool remoteClosed;  // 收到了END_STREAM
+    bool localClosed;   // 发送了END_STREAM
+    bool streamingBody; // 请求体交给bodyCallback_
+    bool rejected;      // 已经回复了错误，忽略之后的请求体
+    int64_t sendWindow;
+    int64_t recvWindow;
+    uint32_t recvConsumed;
+
+    HttpRequest request;
+    std::string storage; // 请求的路径和头部，request中的StringPiece指向这里
+    std::string body;
+    size_t bodyReceived;
+
+    // 等待发送的响应体：内存中的数据或者文件的一段
+    std::string pending;
+    size_t pendingOffset;
+    std::shared_ptr<void> fileOwner;
+    int fileFd;
+    off_t fileOffset;
+    size_t fileRemaining;
+    bool endAfterPending; // 等待发送的数据就是响应体的全部，发完以后结束流
+    HttpStreamPtr httpStream;
+};
+
+Http2Connection::Http2Connection(TcpConnection *conn, const RequestCallback &cb)
+    : conn_(conn),
+      requestCallback_(cb),
+      maxBufferedBodySize_(1024 * 1024),
+      maxBodySize_(0),
+      prefaceReceived_(false),
+      closing_(false),
+      lastStreamId_(0),
+      continuationStreamId_(0),
+      headerFlags_(0),
+      decoder_(4096, kMaxHeaderListSize),
+      peerInitialWindowSize_(kDefaultWindowSize),
+      peerMaxFrameSize_(kDefaultMaxFrameSize),
+      sendWindow_(kDefaultWindowSize),
+      recvWindow_(kConnectionWindowSize),
+      recvConsumed_(0),
+      sending_(false)
+{
+}
+
+Http2Connection::~Http2Connection() = default;
+
+void Http2Connection::start()
+{
+    std::weak_ptr<Http2Connection> weakSelf(shared_from_this());
+    conn_->setWriteCompleteCallback([weakSelf](const TcpConnectionPtr &) {
+        std::shared_ptr<Http2Connection> self = weakSelf.lock();
+        if (self)
+        {
+            self->onWriteComplete();
+        }
+    });
+
+    appendFrameHeader(&output_, 18, kSettings, 0, 0);
+    appendSetting(&output_, kSettingsMaxConcurrentStreams, kMaxConcurrentStreams);
+    appendSetting(&output_, kSettingsInitialWindowSize, kStreamWindowSize);
+    appendSetting(&output_, kSettingsMaxHeaderListSize, kMaxHeaderListSize);
+    // 连接窗口不能通过SETTINGS修改，只能用WINDOW_UPDATE从默认的64KB加上去
+    appendWindowUpdate(&output_, 0, kConnectionWindowSize - kDefaultWindowSize);
+    recvWindow_ = kConnectionWindowSize;
+    sendOutput();
+}
+
+bool Http2Connection::upgrade(const StringPiece &settings, const HttpRequest &req)
+{
+    std::string payload;
+    if (!decodeBase64Url(settings, &payload) || payload.size() % 6 != 0)
+    {
+        return false;
+    }
+    conn_->send(std::string(kSwitchingProtocols, sizeof kSwitchingProtocols - 1));
+    start();
+    // 101就是对这些设置的确认，不用再发送SETTINGS ACK
+    if (!applySettings(payload.data(), payload.size()))
+    {
+        sendOutput();
+        return true;
+    }
+
+    // 升级的请求是流1，请求已经完整，由HTTP/1.1的Buffer拷贝到流自己的存储中
+    lastStreamId_ = 1;
+    Stream *stream = new Stream(1, peerInitialWindowSize_);
+    streams_[1] = StreamPtr(stream);
+    stream->remoteClosed = true;
+
+    size_t size = req.path().size() + req.query().size() + req.body().size();
+    for (const HttpRequest::Header &header : req.headers())
+    {
+        size += header.first.size() + header.second.size() + 1;
+    }
+    stream->storage.reserve(size);
+    HttpRequest &request = stream->request;
+    request.setVersion(HttpRequest::kHttp20);
+    request.setReceiveTime(req.receiveTime());
+    const char *method = req.methodString();
+    request.setMethod(method, method + strlen(method));
+    const char *p = store(&stream->storage, req.path().data(), req.path().size());
+    request.setPath(p, p + req.path().size());
+    if (!req.query().empty())
+    {
+        p = store(&stream->storage, req.query().data(), req.query().size());
+        request.setQuery(p, p + req.query().size());
+    }
+    for (const HttpRequest::Header &header : req.headers())
+    {
+        if (header.first.equalsIgnoreCase("Connection") || header.first.equalsIgnoreCase("Upgrade") ||
+            header.first.equalsIgnoreCase("HTTP2-Settings"))
+        {
+            continue;
+        }
+        const char *name = store(&stream->storage, header.first.data(), header.first.size());
+        store(&stream->storage, ":", 1);
+        const char *end = store(&stream->storage, header.second.data(), header.second.size()) + header.second.size();
+        request.addHeader(name, name + header.first.size(), end);
+    }
+    stream->body.assign(req.body().data(), req.body().size());
+
+    handleRequest(stream);
+    sendOutput();
+    return true;
+}
+
+void Http2Connection::onMessage(Buffer *buf, Timestamp receiveTime)
+{
+    if (closing_ && !conn_->connected())
+    {
+        buf->retrieveAll();
+        return;
+    }
+    if (!prefaceReceived_)
+    {
+        size_t n = std::min(buf->readableBytes(), kClientPrefaceLength);
+        if (memcmp(buf->peek(), kClientPreface, n) != 0)
+        {
+            LOG_DEBUG << "Http2Connection: bad client preface";
+            connectionError(kProtocolError);
+            buf->retrieveAll();
+            return;
+        }
+        if (n < kClientPrefaceLength)
+        {
+            return;
+        }
+        buf->retrieve(kClientPrefaceLength);
+        prefaceReceived_ = true;
+    }
+
+    while (buf->readableBytes() >= kFrameHeaderLength)
+    {
+        FrameHeader header = parseFrameHeader(buf->peek());
+        // 本端没有修改SETTINGS_MAX_FRAME_SIZE，帧不能超过默认的16KB
+        if (header.length > kDefaultMaxFrameSize)
+        {
+            connectionError(kFrameSizeError);
+            buf->retrieveAll();
+            return;
+        }
+        if (buf->readableBytes() < kFrameHeaderLength + header.length)
+        {
+            break;
+        }
+        bool ok = processFrame(header, buf->peek() + kFrameHeaderLength, receiveTime);
+        buf->retrieve(kFrameHeaderLength + header.length);
+        if (!ok)
+        {
+            buf->retrieveAll();
+            return;
+        }
+    }
+    sendOutput();
+}
+
+void Http2Connection::handleClose()
+{
+    // 先从streams_中取出，handleClose()的回调中可能再调用到这里的其他函数
+    std::map<uint32_t, StreamPtr> streams;
+    streams.swap(streams_);
+    for (auto &it : streams)
+    {
+        if (it.second->httpStream)
+        {
+            it.second->httpStream->handleClose();
+        }
+    }
+}
+
+bool Http2Connection::processFrame(const FrameHeader &header, const char *payload, Timestamp receiveTime)
+{
+    // 头部块必须连续：HEADERS之后直到END_HEADERS只能是同一个流的CONTINUATION
+    if (continuationStreamId_ != 0 && (header.type != kContinuation || header.streamId != continuationStreamId_))
+    {
+        return connectionError(kProtocolError);
+    }
+
+    switch (header.type)
+    {
+    case kData:
+        return onData(header, payload);
+    case kHeaders:
+        return onHeaders(header, payload, receiveTime);
+    case kContinuation:
+        return onContinuation(header, payload, receiveTime);
+    case kPriority:
+        // 不支持优先级，各个流轮流发送
+        if (header.streamId == 0)
+        {
+            return connectionError(kProtocolError);
+        }
+        return true;
+    case kRstStream:
+        if (header.streamId == 0 || header.streamId > lastStreamId_)
+        {
+            return connectionError(kProtocolError);
+        }
+        if (header.length != 4)
+        {
+            return connectionError(kFrameSizeError);
+        }
+        onRstStream(header, payload);
+        return true;
+    case kSettings:
+        return onSettings(header, payload);
+    case kPushPromise:
+        // 客户端不能推送
+        return connectionError(kProtocolError);
+    case kPing:
+        if (header.streamId != 0)
+        {
+            return connectionError(kProtocolError);
+        }
+        if (header.length != 8)
+        {
+            return connectionError(kFrameSizeError);
+        }
+        if (!(header.flags & kAck))
+        {
+            appendFrameHeader(&output_, 8, kPing, kAck, 0);
+            output_.append(payload, 8);
+        }
+        return true;
+    case kGoAway:
+        if (header.streamId != 0)
+        {
+            return connectionError(kProtocolError);
+        }
+        // 客户端不再打开新的流，已经开始的响应照常发送完，由客户端关闭连接
+        return true;
+    case kWindowUpdate:
+        return onWindowUpdate(header, payload);
+    default:
+        // 未知类型的帧必须忽略
+        return true;
+    }
+}
+
+bool Http2Connection::onHeaders(const FrameHeader &header, const char *payload, Timestamp receiveTime)
+{
+    if (header.streamId == 0)
+    {
+        return connectionError(kProtocolError);
+    }
+    const char *p = payload;
+    size_t length = header.length;
+    if (header.flags & kPadded)
+    {
+        size_t padding = length > 0 ? static_cast<unsigned char>(*p) : 0;
+        if (length == 0 || padding >= length)
+        {
+            return connectionError(kProtocolError);
+        }
+        ++p;
+        length -= 1 + padding;
+    }
+    if (header.flags & kPriorityFlag)
+    {
+        // 依赖的流和权重，忽略
+        if (length < 5)
+        {
+            return connectionError(kFrameSizeError);
+        }
+        p += 5;
+        length -= 5;
+    }
+    headerFlags_ = header.flags;
+    headerBlock_.assign(p, length);
+    if (header.flags & kEndHeaders)
+    {
+        return onHeaderBlock(header.streamId, receiveTime);
+    }
+    continuationStreamId_ = header.streamId;
+    return true;
+}
+
+bool Http2Connection::onContinuation(const FrameHeader &header, const char *payload, Timestamp receiveTime)
+{
+    if (continuationStreamId_ == 0)
+    {
+        return connectionError(kProtocolError);
+    }
+    // 头部块不能只解码一部分（动态表会不一致），太大只能关闭连接
+    if (headerBlock_.size() + header.length > kMaxHeaderBlockSize)
+    {
+        return connectionError(kEnhanceYourCalm);
+    }
+    headerBlock_.append(payload, header.length);
+    if (!(header.flags & kEndHeaders))
+    {
+        return true;
+    }
+    continuationStreamId_ = 0;
+    return onHeaderBlock(header.streamId, receiveTime);
+}
+
+bool Http2Connection::onHeaderBlock(uint32_t streamId, Timestamp receiveTime)
+{
+    // 不管这个流还要不要，头部块都要解码，保持动态表和客户端一致；
+    // 超过SETTINGS_MAX_HEADER_LIST_SIZE时解码停在中间，动态表已经不一致，只能关闭连接
+    decodedHeaders_.clear();
+    if (!decoder_.decode(headerBlock_.data(), headerBlock_.size(), &decodedHeaders_))
+    {
+        return connectionError(kCompressionError);
+    }
+    bool endStream = headerFlags_ & kEndStream;
+
+    auto it = streams_.find(streamId);
+    if (it != streams_.end())
+    {
+        // 已经打开的流上的第二个头部块是请求体之后的trailer，只能带着END_STREAM
+        Stream *stream = it->second.get();
+        if (stream->remoteClosed)
+        {
+            resetStream(streamId, kStreamClosed);
+        }
+        else if (!endStream)
+        {
+            resetStream(streamId, kProtocolError);
+        }
+        else
+        {
+            stream->remoteClosed = true;
+            if (!stream->rejected)
+            {
+                handleRequest(stream);
+            }
+        }
+        return true;
+    }
+    if (streamId <= lastStreamId_)
+    {
+        // 已经关闭（比如被本端RST_STREAM）的流，可能是之前发出的帧，忽略
+        return true;
+    }
+    if ((streamId & 1) == 0)
+    {
+        return connectionError(kProtocolError);
+    }
+    lastStreamId_ = streamId;
+    if (streams_.size() >= kMaxConcurrentStreams)
+    {
+        appendRstStream(&output_, streamId, kRefusedStream);
+        return true;
+    }
+
+    Stream *stream = new Stream(streamId, peerInitialWindowSize_);
+    streams_[streamId] = StreamPtr(stream);
+    stream->remoteClosed = endStream;
+    // Content-Length不是数字或者多个值不一致的请求是格式错误的（RFC 9113 8.1.1）
+    StringPiece contentLength;
+    if (!buildRequest(stream, receiveTime) || !parseContentLength(stream->request, &contentLength))
+    {
+        resetStream(streamId, kProtocolError);
+        return true;
+    }
+    if (stream->request.method() == HttpRequest::kInvalid)
+    {
+        // 和HTTP/1.1一样，不支持的方法回复400
+        sendErrorResponse(stream, 400);
+        return true;
+    }
+    if (!endStream)
+    {
+        // 声明了Content-Length的请求体在收到之前就能拒绝
+        if (!contentLength.empty())
+        {
+            size_t length = strtoull(contentLength.asString().c_str(), NULL, 10);
+            if ((maxBodySize_ > 0 && length > maxBodySize_) || (length > maxBufferedBodySize_ && !bodyCallback_))
+            {
+                sendErrorResponse(stream, 413);
+            }
+        }
+        return true;
+    }
+    handleRequest(stream);
+    return true;
+}
+
+bool Http2Connection::buildRequest(Stream *stream, Timestamp receiveTime)
+{
+    // 伪头部必须在普通头部之前，每个只能出现一次；普通头部的名字必须是小写的
+    StringPiece method, scheme, path, authority;
+    bool regular = false;
+    bool hasHost = false;
+    size_t size = 0;
+    size_t cookies = 0;
+    for (const HpackDecoder::Header &header : decodedHeaders_)
+    {
+        StringPiece name(header.first);
+        StringPiece value(header.second);
+        if (name.empty())
+        {
+            return false;
+        }
+        if (name[0] == ':')
+        {
+            StringPiece *target = nullptr;
+            if (name == ":method")
+                target = &method;
+            else if (name == ":scheme")
+                target = &scheme;
+            else if (name == ":path")
+                target = &path;
+            else if (name == ":authority")
+                target = &authority;
+            if (regular || target == nullptr || !target->empty() || value.empty())
+            {
+                return false;
+            }
+            *target = value;
+            continue;
+        }
+        regular = true;
+        for (size_t i = 0; i < name.size(); ++i)
+        {
+            if (name[i] >= 'A' && name[i] <= 'Z')
+            {
+                return false;
+            }
+        }
+        if (connectionSpecific(name) || (name == "te" && value != "trailers"))
+        {
+            return false;
+        }
+        if (name == "host")
+        {
+            hasHost = true;
+        }
+        else if (name == "cookie")
+        {
+            // 多个cookie字段合并成一个（RFC 9113 8.2.3），放在最后
+            ++cookies;
+            size += value.size() + 2;
+            continue;
+        }
+        size += name.size() + value.size() + 1;
+    }
+    if (method.empty() || scheme.empty() || path.empty())
+    {
+        return false;
+    }
+
+    size += method.size() + path.size() + authority.size() + sizeof "host:" + sizeof "cookie:";
+    stream->storage.reserve(size);
+    HttpRequest &request = stream->request;
+    request.setVersion(HttpRequest::kHttp20);
+    request.setReceiveTime(receiveTime);
+    const char *p = store(&stream->storage, method.data(), method.size());
+    request.setMethod(p, p + method.size());
+    p = store(&stream->storage, path.data(), path.size());
+    const char *question = static_cast<const char *>(memchr(p, '?', path.size()));
+    if (question)
+    {
+        request.setPath(p, question);
+        request.setQuery(question, p + path.size());
+    }
+    else
+    {
+        request.setPath(p, p + path.size());
+    }
+    if (!hasHost && !authority.empty())
+    {
+        // :authority相当于HTTP/1.1的Host
+        const char *name = store(&stream->storage, "host:", 5);
+        store(&stream->storage, authority.data(), authority.size());
+        request.addHeader(name, name + 4, name + 5 + authority.size());
+    }
+    for (const HpackDecoder::Header &header : decodedHeaders_)
+    {
+        if (header.first[0] == ':' || header.first == "cookie")
+        {
+            continue;
+        }
+        const char *name = store(&stream->storage, header.first.data(), header.first.size());
+        store(&stream->storage, ":", 1);
+        const char *end = store(&stream->storage, header.second.data(), header.second.size()) + header.second.size();
+        request.addHeader(name, name + header.first.size(), end);
+    }
+    if (cookies > 0)
+    {
+        const char *name = store(&stream->storage, "cookie:", 7);
+        size_t n = 0;
+        for (const HpackDecoder::Header &header : decodedHeaders_)
+        {
+            if (header.first == "cookie")
+            {
+                if (n++ > 0)
+                {
+                    store(&stream->storage, "; ", 2);
+                }
+                store(&stream->storage, header.second.data(), header.second.size());
+            }
+        }
+        request.addHeader(name, name + 6, stream->storage.data() + stream->storage.size());
+    }
+    return true;
+}
+
+bool Http2Connection::onData(const FrameHeader &header, const char *payload)
+{
+    if (header.streamId == 0)
+    {
+        return connectionError(kProtocolError);
+    }
+    const char *data = payload;
+    size_t length = header.length;
+    if (header.flags & kPadded)
+    {
+        size_t padding = length > 0 ? static_cast<unsigned char>(*data) : 0;
+        if (length == 0 || padding >= length)
+        {
+            return connectionError(kProtocolError);
+        }
+        ++data;
+        length -= 1 + padding;
+    }
+
+    // 流量控制按整个负载（包括填充）计算，不管这个流还在不在
+    if (header.length > recvWindow_)
+    {
+        return connectionError(kFlowControlError);
+    }
+    recvWindow_ -= header.length;
+    recvConsumed_ += header.length;
+    if (recvConsumed_ >= kConnectionWindowSize / 2)
+    {
+        appendWindowUpdate(&output_, 0, recvConsumed_);
+        recvWindow_ += recvConsumed_;
+        recvConsumed_ = 0;
+    }
+
+    auto it = streams_.find(header.streamId);
+    if (it == streams_.end())
+    {
+        if (header.streamId > lastStreamId_)
+        {
+            return connectionError(kProtocolError);
+        }
+        // 已经关闭的流，忽略
+        return true;
+    }
+    Stream *stream = it->second.get();
+    if (stream->remoteClosed)
+    {
+        resetStream(header.streamId, kStreamClosed);
+        return true;
+    }
+    if (header.length > stream->recvWindow)
+    {
+        resetStream(header.streamId, kFlowControlError);
+        return true;
+    }
+    stream->recvWindow -= header.length;
+    stream->recvConsumed += header.length;
+    bool endStream = header.flags & kEndStream;
+    if (stream->recvConsumed >= kStreamWindowSize / 2 && !endStream)
+    {
+        appendWindowUpdate(&output_, header.streamId, stream->recvConsumed);
+        stream->recvWindow += stream->recvConsumed;
+        stream->recvConsumed = 0;
+    }
+
+    if (!stream->rejected && length > 0)
+    {
+        stream->bodyReceived += length;
+        if (maxBodySize_ > 0 && stream->bodyReceived > maxBodySize_)
+        {
+            sendErrorResponse(stream, 413);
+            return true;
+        }
+        if (!stream->streamingBody && stream->body.size() + length > maxBufferedBodySize_)
+        {
+            if (!bodyCallback_)
+            {
+                sendErrorResponse(stream, 413);
+                return true;
+            }
+            // 超过缓存上限，改为流式接收，已经缓存的部分先交给回调
+            stream->streamingBody = true;
+            if (!stream->body.empty())
+            {
+                bodyCallback_(stream->request, stream->body.data(), stream->body.size());
+            }
+            std::string().swap(stream->body);
+        }
+        if (stream->streamingBody)
+        {
+            bodyCallback_(stream->request, data, length);
+        }
+        else
+        {
+            stream->body.append(data, length);
+        }
+    }
+    if (endStream)
+    {
+        stream->remoteClosed = true;
+        if (stream->rejected)
+        {
+            maybeCloseStream(stream);
+        }
+        else
+        {
+            handleRequest(stream);
+        }
+    }
+    return true;
+}
+
+bool Http2Connection::onSettings(const FrameHeader &header, const char *payload)
+{
+    if (header.streamId != 0)
+    {
+        return connectionError(kProtocolError);
+    }
+    if (header.flags & kAck)
+    {
+        return header.length == 0 ? true : connectionError(kFrameSizeError);
+    }
+    if (header.length % 6 != 0)
+    {
+        return connectionError(kFrameSizeError);
+    }
+    if (!applySettings(payload, header.length))
+    {
+        return false;
+    }
+    appendFrameHeader(&output_, 0, kSettings, kAck, 0);
+    // 初始窗口可能变大了
+    flushData();
+    return true;
+}
+
+bool Http2Connection::applySettings(const char *payload, size_t length)
+{
+    for (size_t i = 0; i + 6 <= length; i += 6)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(payload + i);
+        uint16_t id = static_cast<uint16_t>((p[0] << 8) | p[1]);
+        uint32_t value = readUint32(payload + i + 2);
+        switch (id)
+        {
+        case kSettingsHeaderTableSize:
+            encoder_.setMaxTableSize(value);
+            break;
+        case kSettingsEnablePush:
+            if (value > 1)
+            {
+                return connectionError(kProtocolError);
+            }
+            break;
+        case kSettingsInitialWindowSize:
+        {
+            if (value > kMaxWindowSize)
+            {
+                return connectionError(kFlowControlError);
+            }
+            // 所有流的发送窗口按差值调整，可能变成负数
+            int64_t delta = static_cast<int64_t>(value) - peerInitialWindowSize_;
+            for (auto &it : streams_)
+            {
+                it.second->sendWindow += delta;
+                if (it.second->sendWindow > kMaxWindowSize)
+                {
+                    return connectionError(kFlowControlError);
+                }
+            }
+            peerInitialWindowSize_ = value;
+            break;
+        }
+        case kSettingsMaxFrameSize:
+            if (value < kDefaultMaxFrameSize || value > kMaxMaxFrameSize)
+            {
+                return connectionError(kProtocolError);
+            }
+            peerMaxFrameSize_ = value;
+            break;
+        default:
+            // MAX_CONCURRENT_STREAMS只限制推送，MAX_HEADER_LIST_SIZE是建议，其他未知的设置必须忽略
+            break;
+        }
+    }
+    return true;
+}
+
+bool Http2Connection::onWindowUpdate(const FrameHeader &header, const char *payload)
+{
+    if (header.length != 4)
+    {
+        return connectionError(kFrameSizeError);
+    }
+    uint32_t increment = readUint32(payload) & 0x7fffffff;
+    if (header.streamId == 0)
+    {
+        if (increment == 0)
+        {
+            return connectionError(kProtocolError);
+        }
+        sendWindow_ += increment;
+        if (sendWindow_ > kMaxWindowSize)
+        {
+            return connectionError(kFlowControlError);
+        }
+    }
+    else
+    {
+        auto it = streams_.find(header.streamId);
+        if (it == streams_.end())
+        {
+            return header.streamId > lastStreamId_ ? connectionError(kProtocolError) : true;
+        }
+        Stream *stream = it->second.get();
+        if (increment == 0)
+        {
+            resetStream(header.streamId, kProtocolError);
+            return true;
+        }
+        stream->sendWindow += increment;
+        if (stream->sendWindow > kMaxWindowSize)
+        {
+            resetStream(header.streamId, kFlowControlError);
+            return true;
+        }
+    }
+    flushData();
+    return true;
+}
+
+void Http2Connection::onRstStream(const FrameHeader &header, const char *payload)
+{
+    LOG_DEBUG << "Http2Connection: stream " << header.streamId << " reset by peer, error " << readUint32(payload);
+    closeStream(header.streamId);
+}
+
+void Http2Connection::handleRequest(Stream *stream)
+{
+    if (!stream->streamingBody)
+    {
+        stream->request.setBody(stream->body);
+    }
+    HttpResponse response(false);
+    response.setHeadOnly(stream->request.method() == HttpRequest::kHead);
+    requestCallback_(stream->request, &response);
+    if (response.deferred())
+    {
+        // 延迟响应：完成以后再发送，其他流照常处理
+        std::weak_ptr<Http2Connection> weakSelf(shared_from_this());
+        uint32_t id = stream->id;
+        response.deferredResponse()->bind(conn_->getLoop(), [weakSelf, id](HttpResponse *resp) {
+            std::shared_ptr<Http2Connection> self = weakSelf.lock();
+            if (self)
+            {
+                self->onDeferredResponse(id, resp);
+            }
+        });
+        return;
+    }
+    // 请求已经处理完，之后只剩发送响应
+    sendResponse(stream, &response);
+}
+
+void Http2Connection::onDeferredResponse(uint32_t streamId, HttpResponse *response)
+{
+    auto it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        // 完成之前流已经被重置或者连接已经关闭
+        return;
+    }
+    sendResponse(it->second.get(), response);
+    sendOutput();
+}
+
+void Http2Connection::sendResponse(Stream *stream, HttpResponse *response)
+{
+    std::string &block = headerBuffer_;
+    block.clear();
+    int status = response->statusCode();
+    encoder_.encodeStatus(status, &block);
+
+    responseHeaders_.clear();
+    response->headerList(&responseHeaders_);
+    std::string &name = nameBuffer_;
+    for (const auto &header : responseHeaders_)
+    {
+        // HTTP/2的头部名字必须是小写的
+        name.assign(header.first.data(), header.first.size());
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (connectionSpecific(name) || name == "content-length")
+        {
+            continue;
+        }
+        encoder_.encode(name, header.second, &block);
+    }
+
+    bool noBody = response->headOnly() || status == HttpResponse::k304NotModified;
+    size_t length = response->hasBodyFile() ? response->fileLength() : response->body().size();
+    if (!response->streaming() && status != HttpResponse::k304NotModified)
+    {
+        char buf[32];
+        int n = snprintf(buf, sizeof buf, "%zu", length);
+        encoder_.encode("content-length", StringPiece(buf, n), &block);
+    }
+
+    bool endStream = noBody || (!response->streaming() && length == 0);
+    writeHeaders(stream->id, block, endStream);
+    if (endStream)
+    {
+        stream->localClosed = true;
+        maybeCloseStream(stream);
+        return;
+    }
+
+    if (response->streaming())
+    {
+        // 流式响应：HttpStream写入的数据经过onStreamWrite()按DATA帧发送。
+        // 回调可能同步写完并结束流，之后不能再访问stream
+        std::weak_ptr<Http2Connection> weakSelf(shared_from_this());
+        uint32_t id = stream->id;
+        HttpStreamPtr httpStream = std::make_shared<HttpStream>(
+            conn_->shared_from_this(), [weakSelf, id](const StringPiece &data, bool end) -> size_t {
+                std::shared_ptr<Http2Connection> self = weakSelf.lock();
+                return self ? self->onStreamWrite(id, data, end) : 0;
+            });
+        stream->httpStream = httpStream;
+        sendOutput();
+        response->streamCallback()(httpStream);
+        return;
+    }
+
+    if (response->hasBodyFile())
+    {
+        stream->fileOwner = response->fileOwner();
+        stream->fileFd = response->fileFd();
+        stream->fileOffset = response->fileOffset();
+        stream->fileRemaining = length;
+    }
+    else
+    {
+        response->swapBody(stream->pending);
+    }
+    stream->endAfterPending = true;
+    flushData();
+}
+
+void Http2Connection::sendErrorResponse(Stream *stream, int code)
+{
+    std::string &block = headerBuffer_;
+    block.clear();
+    encoder_.encodeStatus(code, &block);
+    encoder_.encode("content-length", "0", &block);
+    writeHeaders(stream->id, block, true);
+    stream->localClosed = true;
+    stream->rejected = true;
+    if (!stream->remoteClosed)
+    {
+        // 请求体还没有收完：告诉客户端不用再发送（RFC 9113 8.1）
+        resetStream(stream->id, kNoError);
+    }
+    else
+    {
+        closeStream(stream->id);
+    }
+}
+
+void Http2Connection::writeHeaders(uint32_t streamId, const std::string &block, bool endStream)
+{
+    // 超过对端的最大帧长度时拆成HEADERS加CONTINUATION，END_STREAM标志在HEADERS上
+    size_t offset = 0;
+    uint8_t type = kHeaders;
+    uint8_t flags = endStream ? kEndStream : 0;
+    do
+    {
+        size_t n = std::min(block.size() - offset, static_cast<size_t>(peerMaxFrameSize_));
+        bool last = offset + n == block.size();
+        appendFrameHeader(&output_, static_cast<uint32_t>(n), type, last ? flags | kEndHeaders : flags, streamId);
+        output_.append(block.data() + offset, n);
+        offset += n;
+        type = kContinuation;
+        flags = 0;
+    } while (offset < block.size());
+}
+
+void Http2Connection::flushData()
+{
+    // 每一轮给每个有数据的流发送一帧，直到窗口用完、没有数据或者输出缓冲区到了高水位
+    bool progress = true;
+    while (progress && sendWindow_ > 0 &&
+           conn_->outputBuffer()->readableBytes() + output_.size() < kHighWaterMark)
+    {
+        progress = false;
+        for (auto it = streams_.begin(); it != streams_.end();)
+        {
+            // sendData()可能关闭并删除这个流
+            Stream *stream = it->second.get();
+            ++it;
+            if (sendData(stream))
+            {
+                progress = true;
+            }
+        }
+    }
+}
+
+bool Http2Connection::hasPendingData(const Stream *stream) const
+{
+    return !stream->localClosed && (stream->backlog() > 0 || stream->endAfterPending);
+}
+
+bool Http2Connection::sendData(Stream *stream)
+{
+    if (!hasPendingData(stream))
+    {
+        return false;
+    }
+    size_t available = stream->backlog();
+    int64_t window = std::min<int64_t>(std::min(sendWindow_, stream->sendWindow), peerMaxFrameSize_);
+    if (available > 0 && window <= 0)
+    {
+        return false;
+    }
+    size_t n = std::min<size_t>(available, static_cast<size_t>(std::max<int64_t>(window, 0)));
+    bool end = stream->endAfterPending && n == available;
+    appendFrameHeader(&output_, static_cast<uint32_t>(n), kData, end ? kEndStream : 0, stream->id);
+    if (stream->fileFd >= 0)
+    {
+        // DATA帧要加帧头，不能sendfile，每帧pread一次
+        size_t start = output_.size();
+        output_.resize(start + n);
+        ssize_t nread = n > 0 ? ::pread(stream->fileFd, &output_[start], n, stream->fileOffset) : 0;
+        if (nread != static_cast<ssize_t>(n))
+        {
+            LOG_ERROR << "Http2Connection: pread failed, stream " << stream->id;
+            // 去掉这一帧，Content-Length已经发出，只能重置流
+            output_.resize(start - kFrameHeaderLength);
+            resetStream(stream->id, kInternalError);
+            return false;
+        }
+        stream->fileOffset += n;
+        stream->fileRemaining -= n;
+    }
+    else
+    {
+        output_.append(stream->pending.data() + stream->pendingOffset, n);
+        stream->pendingOffset += n;
+        if (stream->pendingOffset == stream->pending.size())
+        {
+            stream->pending.clear();
+            stream->pendingOffset = 0;
+        }
+    }
+    sendWindow_ -= n;
+    stream->sendWindow -= n;
+    if (end)
+    {
+        stream->localClosed = true;
+        maybeCloseStream(stream);
+    }
+    // 流式响应的数据都发完了还没有结束，下一轮不再有数据
+    return n > 0 || end;
+}
+
+size_t Http2Connection::onStreamWrite(uint32_t streamId, const StringPiece &data, bool end)
+{
+    auto it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        // 流已经被重置
+        return 0;
+    }
+    Stream *stream = it->second.get();
+    if (stream->pendingOffset > 0 && stream->pendingOffset >= stream->pending.size() / 2)
+    {
+        // 已经发出去的部分超过一半时整理一次，避免pending无限增长
+        stream->pending.erase(0, stream->pendingOffset);
+        stream->pendingOffset = 0;
+    }
+    stream->pending.append(data.data(), data.size());
+    if (end)
+    {
+        stream->endAfterPending = true;
+    }
+    flushData();
+    // flushData()可能发完并删除了这个流
+    it = streams_.find(streamId);
+    size_t backlog = it != streams_.end() ? it->second->backlog() : 0;
+    sendOutput();
+    return backlog;
+}
+
+void Http2Connection::onWriteComplete()
+{
+    flushData();
+    sendOutput();
+    if (conn_->outputBuffer()->readableBytes() == 0)
+    {
+        notifyWritable();
+    }
+}
+
+void Http2Connection::notifyWritable()
+{
+    // 积压的数据都已经发出的流式响应可以继续写；回调中可能写完并删除流，先收集起来
+    std::vector<HttpStreamPtr> writable;
+    for (auto &it : streams_)
+    {
+        if (it.second->httpStream && it.second->backlog() == 0)
+        {
+            writable.push_back(it.second->httpStream);
+        }
+    }
+    for (const HttpStreamPtr &stream : writable)
+    {
+        stream->handleWriteComplete();
+    }
+}
+
+void Http2Connection::resetStream(uint32_t streamId, ErrorCode error)
+{
+    appendRstStream(&output_, streamId, error);
+    closeStream(streamId);
+}
+
+void Http2Connection::closeStream(uint32_t streamId)
+{
+    auto it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        return;
+    }
+    StreamPtr stream(std::move(it->second));
+    streams_.erase(it);
+    if (stream->httpStream && !stream->httpStream->finished())
+    {
+        // 流式响应还没有写完，通知写入者停止
+        stream->httpStream->handleClose();
+    }
+}
+
+void Http2Connection::maybeCloseStream(Stream *stream)
+{
+    if (stream->localClosed && stream->remoteClosed)
+    {
+        closeStream(stream->id);
+    }
+}
+
+bool Http2Connection::connectionError(ErrorCode error)
+{
+    LOG_DEBUG << "Http2Connection: connection error " << error;
+    if (!closing_)
+    {
+        closing_ = true;
+        appendGoAway(&output_, lastStreamId_, error);
+        sendOutput();
+        conn_->shutdown();
+    }
+    return false;
+}
+
+void Http2Connection::sendOutput()
+{
+    if (sending_)
+    {
+        return;
+    }
+    sending_ = true;
+    while (!output_.empty() && conn_->connected())
+    {
+        sendBuffer_.swap(output_);
+        conn_->send(sendBuffer_);
+        sendBuffer_.clear();
+    }
+    output_.clear();
+    sending_ = false;
+}
@@ -0,0 +1,157 @@
+#ifndef HTTP_HTTP2CONNECTION_H
+#define HTTP_HTTP2CONNECTION_H
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Hpack.h"
+#include "HttpRequest.h"
+#include "Http2Frame.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+class Buffer;
+class HttpResponse;
+class HttpStream;
+
+/*
+    Http2Connection是一条HTTP/2（明文h2c）连接的协议状态，和HTTP/1.1的HttpContext一样由连接持有，
+    只在连接的loop线程中使用。HttpServer在连接开头看到客户端前言（prior knowledge），
+    或者HTTP/1.1请求带着"Upgrade: h2c"时切换到HTTP/2。
+
+    - 多路复用：一条连接上的请求是各自的流，请求收齐（END_STREAM）就调用RequestCallback，
+      和HTTP/1.1使用同一个路由表和处理函数；各个流的响应按流量控制窗口轮流发送，互不阻塞。
+    - HPACK：请求头用HpackDecoder解码，响应头用HpackEncoder编码，两个方向各有一张动态表。
+    - 流量控制：发送受对端连接窗口和流窗口限制，窗口用完的流等WINDOW_UPDATE；
+      接收时每消费一半窗口就补发WINDOW_UPDATE。输出缓冲区超过高水位时也暂停，写完以后继续。
+    - 响应体可以是内存中的数据、文件（分段pread，HTTP/2的DATA帧需要帧头，不能sendfile）
+      或者流式响应（HttpStream写入的数据按DATA帧发送）。
+
+    不支持服务端推送和优先级（PRIORITY帧被忽略）。
+*/
+class Http2Connection : noncopyable, public std::enable_shared_from_this<Http2Connection>
+{
+public:
+    // 生成响应，HttpServer把路由、HttpCallback和压缩放在这里，和HTTP/1.1共用
+    using RequestCallback = std::function<void(HttpRequest &, HttpResponse *)>;
+    // 流式接收请求体，同HttpContext::BodyCallback
+    using BodyCallback = std::function<void(const HttpRequest &, const char *data, size_t len)>;
+
+    // 同时打开的流的上限，通过SETTINGS_MAX_CONCURRENT_STREAMS通告
+    static const uint32_t kMaxConcurrentStreams = 100;
+    // 本端的流接收窗口和连接接收窗口
+    static const uint32_t kStreamWindowSize = 1024 * 1024;
+    static const uint32_t kConnectionWindowSize = 16 * 1024 * 1024;
+    // 输出缓冲区超过这个大小时暂停发送DATA帧
+    static const size_t kHighWaterMark = 1024 * 1024;
+    // 一个请求的头部块最大长度
+    static const size_t kMaxHeaderBlockSize = 64 * 1024;
+    // 解码以后的头部列表最大长度，通过SETTINGS_MAX_HEADER_LIST_SIZE通告
+    static const uint32_t kMaxHeaderListSize = 64 * 1024;
+
+    // conn持有这个对象，所以只保存裸指针
+    Http2Connection(TcpConnection *conn, const RequestCallback &cb);
+    ~Http2Connection();
+
+    void setBodyLimits(size_t maxBufferedBodySize, size_t maxBodySize)
+    {
+        maxBufferedBodySize_ = maxBufferedBodySize;
+        maxBodySize_ = maxBodySize;
+    }
+    void setBodyCallback(const BodyCallback &cb) { bodyCallback_ = cb; }
+
+    // 发送本端的SETTINGS，之后的数据从客户端前言开始
+    void start();
+
+    /**
+     * h2c升级（代替start()）：settings是请求的HTTP2-Settings头部（base64url编码的SETTINGS负载）。
+     * 发送101和本端的SETTINGS，升级的请求作为流1（已经半关闭）处理，响应用HTTP/2发送。
+     * settings格式错误时返回false，什么也不发送，调用者按HTTP/1.1处理这个请求
+     */
+    bool upgrade(const StringPiece &settings, const HttpRequest &req);
+
+    // 处理buf中所有完整的帧
+    void onMessage(Buffer *buf, Timestamp receiveTime);
+    // 连接断开：通知还在写的流式响应
+    void handleClose();
+
+private:
+    struct Stream;
+    using StreamPtr = std::unique_ptr<Stream>;
+
+    bool processFrame(const http2::FrameHeader &header, const char *payload, Timestamp receiveTime);
+    bool onHeaders(const http2::FrameHeader &header, const char *payload, Timestamp receiveTime);
+    bool onContinuation(const http2::FrameHeader &header, const char *payload, Timestamp receiveTime);
+    bool onHeaderBlock(uint32_t streamId, Timestamp receiveTime);
+    bool onData(const http2::FrameHeader &header, const char *payload);
+    bool onSettings(const http2::FrameHeader &header, const char *payload);
+    bool applySettings(const char *payload, size_t length);
+    bool onWindowUpdate(const http2::FrameHeader &header, const char *payload);
+    void onRstStream(const http2::FrameHeader &header, const char *payload);
+
+    // 请求头解码以后构造HttpRequest，格式错误返回false
+    bool buildRequest(Stream *stream, Timestamp receiveTime);
+    void handleRequest(Stream *stream);
+    void sendResponse(Stream *stream, HttpResponse *response);
+    // 延迟响应（见ResponseWriter.h）在loop线程中完成
+    void onDeferredResponse(uint32_t streamId, HttpResponse *response);
+    void sendErrorResponse(Stream *stream, int code);
+    void writeHeaders(uint32_t streamId, const std::string &block, bool endStream);
+
+    // 按窗口发送各个流积压的响应体
+    void flushData();
+    // 发送stream的下一个DATA帧，没有可以发送的数据时返回false
+    bool sendData(Stream *stream);
+    bool hasPendingData(const Stream *stream) const;
+    // HttpStream写入一段响应体（end表示结束），返回这个流还没有发出去的字节数
+    size_t onStreamWrite(uint32_t streamId, const StringPiece &data, bool end);
+    void onWriteComplete();
+    void notifyWritable();
+
+    void resetStream(uint32_t streamId, http2::ErrorCode error);
+    void closeStream(uint32_t streamId);
+    void maybeCloseStream(Stream *stream);
+    bool connectionError(http2::ErrorCode error);
+    void sendOutput();
+
+    TcpConnection *conn_;
+    RequestCallback requestCallback_;
+    BodyCallback bodyCallback_;
+    size_t maxBufferedBodySize_;
+    size_t maxBodySize_;
+
+    bool prefaceReceived_;
+    bool closing_; // 发送了GOAWAY
+    std::map<uint32_t, StreamPtr> streams_;
+    uint32_t lastStreamId_; // 客户端打开过的最大流ID
+
+    // 正在接收的头部块（HEADERS之后等待CONTINUATION）
+    uint32_t continuationStreamId_;
+    uint8_t headerFlags_;
+    std::string headerBlock_;
+
+    HpackDecoder decoder_;
+    HpackEncoder encoder_;
+    std::vector<HpackDecoder::Header> decodedHeaders_;
+    std::vector<std::pair<StringPiece, StringPiece>> responseHeaders_;
+    std::string headerBuffer_; // 编码中的响应头部块
+    std::string nameBuffer_;   // 转成小写的头部名字
+
+    // 对端的设置
+    uint32_t peerInitialWindowSize_;
+    uint32_t peerMaxFrameSize_;
+    int64_t sendWindow_;    // 对端的连接接收窗口
+    int64_t recvWindow_;    // 本端的连接接收窗口还剩多少
+    uint32_t recvConsumed_; // 已经消费、还没有通过WINDOW_UPDATE归还的字节数
+
+    std::string output_;     // 这一批要发送的帧，sendOutput()一次发送
+    std::string sendBuffer_; // 正在发送的帧
+    bool sending_;           // 在sendOutput()中：全部写入socket时写完成回调会同步执行，期间产生的帧由外层发送
+};
+
+#endif
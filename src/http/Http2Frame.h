@@ -0,0 +1,148 @@
+#ifndef HTTP_HTTP2FRAME_H
+#define HTTP_HTTP2FRAME_H
+
+#include <stdint.h>
+#include <string>
+
+/*
+    HTTP/2（RFC 9113）帧格式的常量和编解码函数，服务端（Http2Connection）和httpbench共用。
+
+    每个帧有9字节的帧头：24位长度、8位类型、8位标志、1位保留加31位流ID，后面是长度字节的负载。
+*/
+namespace http2
+{
+
+// 客户端在连接开头发送的24字节前言
+const char kClientPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t kClientPrefaceLength = sizeof kClientPreface - 1;
+
+const size_t kFrameHeaderLength = 9;
+const uint32_t kDefaultWindowSize = 65535;
+const uint32_t kMaxWindowSize = 0x7fffffff;
+const uint32_t kDefaultMaxFrameSize = 16384;
+const uint32_t kMaxMaxFrameSize = (1 << 24) - 1;
+
+enum FrameType
+{
+    kData = 0x0,
+    kHeaders = 0x1,
+    kPriority = 0x2,
+    kRstStream = 0x3,
+    kSettings = 0x4,
+    kPushPromise = 0x5,
+    kPing = 0x6,
+    kGoAway = 0x7,
+    kWindowUpdate = 0x8,
+    kContinuation = 0x9,
+};
+
+enum FrameFlag
+{
+    kEndStream = 0x1,
+    kAck = 0x1, // SETTINGS和PING
+    kEndHeaders = 0x4,
+    kPadded = 0x8,
+    kPriorityFlag = 0x20,
+};
+
+enum SettingId
+{
+    kSettingsHeaderTableSize = 0x1,
+    kSettingsEnablePush = 0x2,
+    kSettingsMaxConcurrentStreams = 0x3,
+    kSettingsInitialWindowSize = 0x4,
+    kSettingsMaxFrameSize = 0x5,
+    kSettingsMaxHeaderListSize = 0x6,
+};
+
+enum ErrorCode
+{
+    kNoError = 0x0,
+    kProtocolError = 0x1,
+    kInternalError = 0x2,
+    kFlowControlError = 0x3,
+    kSettingsTimeout = 0x4,
+    kStreamClosed = 0x5,
+    kFrameSizeError = 0x6,
+    kRefusedStream = 0x7,
+    kCancel = 0x8,
+    kCompressionError = 0x9,
+    kConnectError = 0xa,
+    kEnhanceYourCalm = 0xb,
+    kInadequateSecurity = 0xc,
+    kHttp11Required = 0xd,
+};
+
+struct FrameHeader
+{
+    uint32_t length;
+    uint8_t type;
+    uint8_t flags;
+    uint32_t streamId;
+};
+
+inline uint32_t readUint32(const char *p)
+{
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+    return (static_cast<uint32_t>(u[0]) << 24) | (static_cast<uint32_t>(u[1]) << 16) |
+           (static_cast<uint32_t>(u[2]) << 8) | u[3];
+}
+
+inline void appendUint32(std::string *out, uint32_t v)
+{
+    char buf[4] = {static_cast<char>(v >> 24), static_cast<char>(v >> 16),
+                   static_cast<char>(v >> 8), static_cast<char>(v)};
+    out->append(buf, 4);
+}
+
+// p至少有kFrameHeaderLength字节
+inline FrameHeader parseFrameHeader(const char *p)
+{
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+    FrameHeader header;
+    header.length = (static_cast<uint32_t>(u[0]) << 16) | (static_cast<uint32_t>(u[1]) << 8) | u[2];
+    header.type = u[3];
+    header.flags = u[4];
+    header.streamId = readUint32(p + 5) & 0x7fffffff;
+    return header;
+}
+
+inline void appendFrameHeader(std::string *out, uint32_t length, uint8_t type, uint8_t flags, uint32_t streamId)
+{
+    char buf[kFrameHeaderLength] = {static_cast<char>(length >> 16), static_cast<char>(length >> 8),
+                                    static_cast<char>(length), static_cast<char>(type),
+                                    static_cast<char>(flags), static_cast<char>((streamId >> 24) & 0x7f),
+                                    static_cast<char>(streamId >> 16), static_cast<char>(streamId >> 8),
+                                    static_cast<char>(streamId)};
+    out->append(buf, kFrameHeaderLength);
+}
+
+inline void appendSetting(std::string *out, uint16_t id, uint32_t value)
+{
+    char buf[2] = {static_cast<char>(id >> 8), static_cast<char>(id)};
+    out->append(buf, 2);
+    appendUint32(out, value);
+}
+
+inline void appendWindowUpdate(std::string *out, uint32_t streamId, uint32_t increment)
+{
+    appendFrameHeader(out, 4, kWindowUpdate, 0, streamId);
+    appendUint32(out, increment);
+}
+
+inline void appendRstStream(std::string *out, uint32_t streamId, ErrorCode error)
+{
+    appendFrameHeader(out, 4, kRstStream, 0, streamId);
+    appendUint32(out, error);
+}
+
+inline void appendGoAway(std::string *out, uint32_t lastStreamId, ErrorCode error)
+{
+    appendFrameHeader(out, 8, kGoAway, 0, 0);
+    appendUint32(out, lastStreamId);
+    appendUint32(out, error);
+}
+
+} // namespace http2
+
+#endif
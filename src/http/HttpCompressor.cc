@@ -0,0 +1,429 @@
+#include "HttpCompressor.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "HttpStream.h"
+#include "ThreadPool.h"
+#include "Logging.h"
+
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+namespace
+{
+
+// 流式压缩时每次发送的数据量
+const size_t kStreamChunkSize = 32 * 1024;
+// 缓存中每一项除了数据以外的大约开销（链表节点、哈希表节点、shared_ptr控制块）
+const size_t kEntryOverhead = 128;
+
+const char *const kDefaultContentTypes[] = {
+    "text/",
+    "application/json",
+    "application/javascript",
+    "application/xml",
+    "image/svg+xml",
+    "application/wasm",
+};
+
+StringPiece trim(const char *begin, const char *end)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t'))
+    {
+        ++begin;
+    }
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+    {
+        --end;
+    }
+    return StringPiece(begin, end);
+}
+
+// Accept-Encoding某一项的参数中是否有q=0（"q=0"、"q=0.0"...），表示不接受这种编码
+bool zeroQuality(const char *begin, const char *end)
+{
+    StringPiece params = trim(begin, end);
+    if (params.size() < 2 || (params[0] != 'q' && params[0] != 'Q') || params[1] != '=')
+    {
+        return false;
+    }
+    StringPiece value = trim(params.begin() + 2, params.end());
+    if (value.empty() || value[0] != '0')
+    {
+        return false;
+    }
+    for (size_t i = 1; i < value.size(); ++i)
+    {
+        if (value[i] != '0' && !(i == 1 && value[i] == '.'))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int windowBits(HttpCompressor::Encoding encoding)
+{
+    // gzip格式在窗口大小上加16，deflate是zlib格式（RFC 1950），不是裸的deflate数据
+    return encoding == HttpCompressor::kGzip ? 15 + 16 : 15;
+}
+
+} // namespace
+
+struct HttpCompressor::StreamState
+{
+    StreamState(const std::shared_ptr<std::string> &b, const std::shared_ptr<HttpStream> &s)
+        : initialized(false), body(b), stream(s)
+    {
+        memset(&zs, 0, sizeof zs);
+        zs.next_in = reinterpret_cast<Bytef *>(&(*body)[0]);
+        zs.avail_in = static_cast<uInt>(body->size());
+    }
+    ~StreamState()
+    {
+        if (initialized)
+        {
+            deflateEnd(&zs);
+        }
+    }
+
+    z_stream zs;
+    bool initialized;
+    std::shared_ptr<std::string> body;
+    std::shared_ptr<HttpStream> stream;
+};
+
+HttpCompressor::HttpCompressor(size_t maxCacheBytes)
+    : maxCacheBytes_(maxCacheBytes),
+      minSize_(1024),
+      level_(Z_DEFAULT_COMPRESSION),
+      contentTypes_(std::begin(kDefaultContentTypes), std::end(kDefaultContentTypes)),
+      pool_(nullptr),
+      offloadSize_(0),
+      cachedBytes_(0)
+{
+}
+
+HttpCompressor::~HttpCompressor() = default;
+
+HttpCompressor::Encoding HttpCompressor::negotiate(const StringPiece &acceptEncoding)
+{
+    // -1表示没有提到，由"*"决定
+    int gzip = -1;
+    int deflate = -1;
+    int any = -1;
+    const char *p = acceptEncoding.begin();
+    const char *end = acceptEncoding.end();
+    while (p < end)
+    {
+        const char *comma = static_cast<const char *>(memchr(p, ',', end - p));
+        if (comma == nullptr)
+        {
+            comma = end;
+        }
+        const char *semicolon = static_cast<const char *>(memchr(p, ';', comma - p));
+        StringPiece name = trim(p, semicolon ? semicolon : comma);
+        int accepted = semicolon && zeroQuality(semicolon + 1, comma) ? 0 : 1;
+        if (name.equalsIgnoreCase("gzip") || name.equalsIgnoreCase("x-gzip"))
+        {
+            gzip = accepted;
+        }
+        else if (name.equalsIgnoreCase("deflate"))
+        {
+            deflate = accepted;
+        }
+        else if (name == "*")
+        {
+            any = accepted;
+        }
+        p = comma + 1;
+    }
+
+    if (gzip == 1 || (gzip == -1 && any == 1))
+    {
+        return kGzip;
+    }
+    if (deflate == 1 || (deflate == -1 && any == 1))
+    {
+        return kDeflate;
+    }
+    return kIdentity;
+}
+
+const char *HttpCompressor::encodingName(Encoding encoding)
+{
+    switch (encoding)
+    {
+    case kGzip:
+        return "gzip";
+    case kDeflate:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+bool HttpCompressor::compressible(const StringPiece &contentType, size_t size) const
+{
+    if (size < minSize_ || contentType.empty())
+    {
+        return false;
+    }
+    // 去掉"; charset=utf-8"这样的参数
+    const char *semicolon = static_cast<const char *>(memchr(contentType.data(), ';', contentType.size()));
+    StringPiece type = trim(contentType.begin(), semicolon ? semicolon : contentType.end());
+    for (const std::string &allowed : contentTypes_)
+    {
+        if (!allowed.empty() && allowed.back() == '/')
+        {
+            if (type.size() > allowed.size() && strncasecmp(type.data(), allowed.data(), allowed.size()) == 0)
+            {
+                return true;
+            }
+        }
+        else if (type.equalsIgnoreCase(allowed))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpCompressor::compress(Encoding encoding, const char *data, size_t len, std::string *out) const
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof zs);
+    if (encoding == kIdentity ||
+        deflateInit2(&zs, level_, Z_DEFLATED, windowBits(encoding), 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return false;
+    }
+    // deflateBound是一次压缩完的输出上限，输出空间足够时一次deflate调用就能完成
+    size_t start = out->size();
+    out->resize(start + deflateBound(&zs, len));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    zs.avail_in = static_cast<uInt>(len);
+    zs.next_out = reinterpret_cast<Bytef *>(&(*out)[start]);
+    zs.avail_out = static_cast<uInt>(out->size() - start);
+    int ret = deflate(&zs, Z_FINISH);
+    out->resize(start + zs.total_out);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END)
+    {
+        LOG_ERROR << "HttpCompressor::compress deflate error " << ret;
+        out->resize(start);
+        return false;
+    }
+    return true;
+}
+
+std::string HttpCompressor::cacheKey(const std::string &key, Encoding encoding)
+{
+    std::string result(key);
+    result += '\n';
+    result += encodingName(encoding);
+    return result;
+}
+
+HttpCompressor::Result HttpCompressor::find(const std::string &key, Encoding encoding)
+{
+    std::string k = cacheKey(key, encoding);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(k);
+    if (it == index_.end())
+    {
+        return Result();
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+}
+
+HttpCompressor::Result HttpCompressor::compressAndCache(const std::string &key, Encoding encoding,
+                                                        const char *data, size_t len)
+{
+    std::string out;
+    if (!compress(encoding, data, len, &out))
+    {
+        return Result();
+    }
+    if (out.size() >= len)
+    {
+        // 已经压缩过的内容（图片、压缩包）越压越大，记住结果，以后直接发送原文
+        out.clear();
+    }
+    Result result = std::make_shared<const std::string>(std::move(out));
+    insert(cacheKey(key, encoding), result);
+    return result;
+}
+
+void HttpCompressor::compressInBackground(const std::string &key, Encoding encoding, const Loader &loader)
+{
+    std::string k = cacheKey(key, encoding);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.count(k) || !pending_.insert(k).second)
+        {
+            return;
+        }
+    }
+    pool_->add([this, key, k, encoding, loader]() {
+        std::string data;
+        if (loader(&data))
+        {
+            compressAndCache(key, encoding, data.data(), data.size());
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.erase(k);
+    });
+}
+
+void HttpCompressor::insert(const std::string &cacheKey, const Result &result)
+{
+    size_t bytes = cacheKey.size() + result->size() + kEntryOverhead;
+    if (bytes > maxCacheBytes_)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(cacheKey);
+    if (it != index_.end())
+    {
+        cachedBytes_ -= it->first.size() + it->second->second->size() + kEntryOverhead;
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    lru_.emplace_front(cacheKey, result);
+    index_[cacheKey] = lru_.begin();
+    cachedBytes_ += bytes;
+    while (cachedBytes_ > maxCacheBytes_)
+    {
+        const LruList::value_type &last = lru_.back();
+        cachedBytes_ -= last.first.size() + last.second->size() + kEntryOverhead;
+        index_.erase(last.first);
+        lru_.pop_back();
+    }
+}
+
+size_t HttpCompressor::cachedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cachedBytes_;
+}
+
+void HttpCompressor::apply(const HttpRequest &req, HttpResponse *resp)
+{
+    apply(req.getHeader("Accept-Encoding"), req.version() != HttpRequest::kHttp10, resp);
+}
+
+void HttpCompressor::apply(const StringPiece &acceptEncoding, bool streamable, HttpResponse *resp)
+{
+    const std::string &body = resp->body();
+    if (resp->statusCode() != HttpResponse::k200Ok || resp->streaming() || resp->hasBodyFile() ||
+        !compressible(resp->getHeader("Content-Type"), body.size()) ||
+        !resp->getHeader("Content-Encoding").empty())
+    {
+        return;
+    }
+    // 响应随Accept-Encoding变化，告诉中间的缓存按它区分
+    resp->addHeader("Vary", "Accept-Encoding");
+    Encoding encoding = negotiate(acceptEncoding);
+    if (encoding == kIdentity)
+    {
+        return;
+    }
+
+    Result result;
+    const std::string &key = resp->cacheKey();
+    if (!key.empty())
+    {
+        result = find(key, encoding);
+        if (!result && shouldOffload(body.size()))
+        {
+            // 这一次发送原文，压缩好的结果给后面的请求用
+            std::shared_ptr<std::string> data = std::make_shared<std::string>(body);
+            compressInBackground(key, encoding, [data](std::string *out) {
+                out->swap(*data);
+                return true;
+            });
+            return;
+        }
+        if (!result)
+        {
+            result = compressAndCache(key, encoding, body.data(), body.size());
+        }
+    }
+    else if (shouldOffload(body.size()) && streamable && !resp->headOnly())
+    {
+        // 不能缓存的大响应：改成流式响应（HTTP/1.1用chunked编码，HTTP/2用DATA帧），
+        // 在线程池中边压缩边发送，压缩后的长度不需要事先知道
+        std::shared_ptr<std::string> data = std::make_shared<std::string>();
+        resp->swapBody(*data);
+        resp->addHeader("Content-Encoding", encodingName(encoding));
+        resp->setStreamCallback([this, encoding, data](const std::shared_ptr<HttpStream> &stream) {
+            std::shared_ptr<StreamState> state = std::make_shared<StreamState>(data, stream);
+            if (deflateInit2(&state->zs, level_, Z_DEFLATED, windowBits(encoding), 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            {
+                LOG_ERROR << "HttpCompressor::compressStream deflateInit2 failed";
+                stream->finish();
+                return;
+            }
+            state->initialized = true;
+            // 连接的输出积压超过高水位时暂停压缩，写完以后回到线程池继续；
+            // 流结束或者连接断开时HttpStream释放这个回调，state随之释放
+            stream->setWritableCallback([this, state](const std::shared_ptr<HttpStream> &) {
+                pool_->add(std::bind(&HttpCompressor::compressStream, this, state));
+            });
+            pool_->add(std::bind(&HttpCompressor::compressStream, this, state));
+        });
+        return;
+    }
+    else
+    {
+        std::string out;
+        if (compress(encoding, body.data(), body.size(), &out) && out.size() < body.size())
+        {
+            result = std::make_shared<const std::string>(std::move(out));
+        }
+    }
+
+    if (result && !result->empty())
+    {
+        // 缓存中的压缩结果直接共享，不拷贝
+        resp->setSharedBody(result);
+        resp->addHeader("Content-Encoding", encodingName(encoding));
+    }
+}
+
+// 在线程池中执行：压缩body，每攒够kStreamChunkSize就写入stream；
+// 写入返回false（输出积压超过高水位）时返回，等WritableCallback把它再放回线程池
+void HttpCompressor::compressStream(const std::shared_ptr<StreamState> &state) const
+{
+    z_stream &zs = state->zs;
+    HttpStream &stream = *state->stream;
+    char out[kStreamChunkSize];
+    while (!stream.closed())
+    {
+        zs.next_out = reinterpret_cast<Bytef *>(out);
+        zs.avail_out = sizeof out;
+        int ret = deflate(&zs, Z_FINISH);
+        size_t n = sizeof out - zs.avail_out;
+        if (ret != Z_OK)
+        {
+            // Z_STREAM_END：最后一段
+            if (ret != Z_STREAM_END)
+            {
+                LOG_ERROR << "HttpCompressor::compressStream deflate failed " << ret;
+            }
+            if (n > 0)
+            {
+                stream.write(StringPiece(out, n));
+            }
+            stream.finish();
+            return;
+        }
+        if (n > 0 && !stream.write(StringPiece(out, n)))
+        {
+            return;
+        }
+    }
+}
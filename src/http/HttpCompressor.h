@@ -0,0 +1,121 @@
+#ifndef HTTP_HTTPCOMPRESSOR_H
+#define HTTP_HTTPCOMPRESSOR_H
+
+#include "noncopyable.h"
+#include "StringPiece.h"
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+class HttpRequest;
+class HttpResponse;
+class HttpStream;
+class ThreadPool;
+
+/*
+    HttpCompressor按请求的Accept-Encoding用gzip/deflate（zlib）压缩响应体。
+
+    只压缩不小于minSize（默认1KB）、Content-Type在白名单中（text/前缀、JSON、JavaScript、XML、SVG、wasm）的200响应。
+    压缩很费CPU，在IO线程中每个请求压缩一次会拖慢同一个subloop上的所有连接，所以：
+    - 内容不变的响应（静态文件，或者处理函数用setCacheKey标明的响应）压缩结果按key缓存在内存LRU中
+      （默认最多64MB），之后的请求直接发送压缩好的数据；
+    - 设置了线程池时，比offloadSize（默认64KB）大的响应在线程池中压缩：能缓存的响应这一次先发送原文，
+      压缩结果放入缓存给后面的请求用；不能缓存的响应用chunked流式发送，边压缩边发送，
+      连接的输出积压超过HttpStream的高水位时暂停压缩，写完以后再继续。
+
+    注意：没有调用setThreadPool()时所有压缩都在IO线程中同步进行，不能缓存的大响应（每次都不同的大JSON）
+    每个请求都要压缩一次，会阻塞同一个subloop上的所有连接。响应可能比较大时一定要设置线程池。
+
+    多个subloop共享同一个压缩器，缓存由一把锁保护，压缩在锁外进行。
+*/
+class HttpCompressor : noncopyable
+{
+public:
+    enum Encoding
+    {
+        kIdentity,
+        kGzip,
+        kDeflate,
+    };
+
+    // 压缩结果，空字符串表示压缩以后没有变小，应该发送原文
+    using Result = std::shared_ptr<const std::string>;
+    // 在线程池中读取要压缩的内容，失败时返回false
+    using Loader = std::function<bool(std::string *)>;
+
+    explicit HttpCompressor(size_t maxCacheBytes = 64 * 1024 * 1024);
+    ~HttpCompressor();
+
+    void setMinSize(size_t bytes) { minSize_ = bytes; }
+    // zlib压缩级别1~9，默认6
+    void setLevel(int level) { level_ = level; }
+    // 替换Content-Type白名单，以'/'结尾的是前缀（比如"text/"）
+    void setContentTypes(const std::vector<std::string> &types) { contentTypes_ = types; }
+    // 大响应交给pool压缩，在start()之前设置；压缩器要在pool停止以后才能销毁。
+    // 不设置时大响应也在IO线程中同步压缩（见类的说明）
+    void setThreadPool(ThreadPool *pool, size_t offloadSize = 64 * 1024)
+    {
+        pool_ = pool;
+        offloadSize_ = offloadSize;
+    }
+
+    // 选择客户端接受的编码，优先gzip，都不接受时返回kIdentity
+    static Encoding negotiate(const StringPiece &acceptEncoding);
+    static const char *encodingName(Encoding encoding);
+
+    // 这种类型、这个长度的内容是否需要压缩
+    bool compressible(const StringPiece &contentType, size_t size) const;
+    // 大内容是否应该交给线程池
+    bool shouldOffload(size_t size) const { return pool_ != nullptr && size > offloadSize_; }
+
+    // 压缩[data, data + len)追加到out，失败返回false
+    bool compress(Encoding encoding, const char *data, size_t len, std::string *out) const;
+
+    // 查找缓存的压缩结果，没有时返回空
+    Result find(const std::string &key, Encoding encoding);
+    // 压缩并放入缓存，相同key的内容必须相同
+    Result compressAndCache(const std::string &key, Encoding encoding, const char *data, size_t len);
+    // 在线程池中读取并压缩，放入缓存；同一个key正在压缩时忽略
+    void compressInBackground(const std::string &key, Encoding encoding, const Loader &loader);
+
+    /**
+     * HttpServer在处理函数生成响应以后调用：按请求的Accept-Encoding压缩内存中的响应体，
+     * 设置Content-Encoding和Vary，或者把响应改成在线程池中压缩的流式响应
+     */
+    void apply(const HttpRequest &req, HttpResponse *resp);
+    // 延迟响应完成时请求已经不在了：acceptEncoding是请求的Accept-Encoding，streamable表示可以改成流式响应（不是HTTP/1.0）
+    void apply(const StringPiece &acceptEncoding, bool streamable, HttpResponse *resp);
+
+    size_t cachedBytes() const;
+
+private:
+    using LruList = std::list<std::pair<std::string, Result>>;
+
+    static std::string cacheKey(const std::string &key, Encoding encoding);
+    void insert(const std::string &cacheKey, const Result &result);
+    // 流式压缩的状态，在线程池中分段压缩
+    struct StreamState;
+    void compressStream(const std::shared_ptr<StreamState> &state) const;
+
+    const size_t maxCacheBytes_;
+    size_t minSize_;
+    int level_;
+    std::vector<std::string> contentTypes_;
+    ThreadPool *pool_;
+    size_t offloadSize_;
+
+    mutable std::mutex mutex_;
+    LruList lru_; // 最近使用的在前面
+    std::unordered_map<std::string, LruList::iterator> index_;
+    std::unordered_set<std::string> pending_; // 正在线程池中压缩的key
+    size_t cachedBytes_;
+};
+
+#endif
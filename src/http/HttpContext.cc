@@ -1,25 +1,49 @@
 #include "HttpContext.h"
 #include "Buffer.h"
 
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+namespace
+{
+    // 在[from, end)中查找头部结束的空行，返回空行之后的位置，没找到返回NULL。
+    // 只用memchr找'\n'（glibc中是向量化实现），再向前检查"\r\n\r\n"，
+    // 所以from之前已经找过的部分不需要重复查找
+    const char *findHeaderEnd(const char *begin, const char *from, const char *end)
+    {
+        const char *p = from;
+        while (p < end && (p = static_cast<const char *>(memchr(p, '\n', end - p))) != NULL)
+        {
+            if (p - begin >= 3 && p[-1] == '\r' && p[-2] == '\n' && p[-3] == '\r')
+            {
+                return p + 1;
+            }
+            ++p;
+        }
+        return NULL;
+    }
+}
+
 // 解析请求行
 bool HttpContext::processRequestLine(const char *begin, const char *end)
 {
     bool succeed = false;
     const char *start = begin;
-    const char *space = std::find(start, end, ' ');
+    const char *space = static_cast<const char *>(memchr(start, ' ', end - start));
 
     // 不是最后一个空格，并且成功获取了method并设置到request_
-    if (space != end && request_.setMethod(start, space))
+    if (space != NULL && request_.setMethod(start, space))
     {
         // 跳过空格
         start = space + 1;
         // 继续寻找下一个空格
-        space = std::find(start, end, ' ');
-        if (space != end)
+        space = static_cast<const char *>(memchr(start, ' ', end - start));
+        if (space != NULL && space != start)
         {
             // 查看是否有请求参数
-            const char *question = std::find(start, space, '?');
-            if (question != space) // 如果在start和空格中找到问号
+            const char *question = static_cast<const char *>(memchr(start, '?', space - start));
+            if (question != NULL) // 如果在start和空格中找到问号
             {
                 // 设置访问路径
                 request_.setPath(start, question);
@@ -33,10 +57,10 @@ bool HttpContext::processRequestLine(const char *begin, const char *end)
             }
             start = space + 1;
             // 获取最后的http版本
-            succeed = (end - start == 8 && std::equal(start, end - 1, "HTTP/1."));
+            succeed = (end - start == 8 && memcmp(start, "HTTP/1.", 7) == 0);
             if (succeed)
             {
-                // end迭代器指向字段末尾再+1，end-1即指向末尾最后一个char字符，再通过*取值
+                // end指向版本号之后，end-1即指向最后一个字符
                 if (*(end - 1) == '1')
                 {
                     request_.setVersion(HttpRequest::kHttp11);
@@ -55,73 +79,375 @@ bool HttpContext::processRequestLine(const char *begin, const char *end)
     return succeed;
 }
 
-// return false if any error
+bool HttpContext::processHeaders(const char *begin, const char *end)
+{
+    // 第一行是请求行，一定以"\r\n"结尾
+    const char *eol = static_cast<const char *>(memchr(begin, '\n', end - begin));
+    if (eol == begin || eol[-1] != '\r' || !processRequestLine(begin, eol - 1))
+    {
+        return false;
+    }
+
+    // 之后每行一个头部，直到最后的空行
+    const char *line = eol + 1;
+    const char *last = end - 2;
+    while (line < last)
+    {
+        eol = static_cast<const char *>(memchr(line, '\n', end - line));
+        const char *crlf = eol - 1;
+        if (*crlf != '\r')
+        {
+            return false;
+        }
+        // 找到 : 位置，字段名不能为空
+        const char *colon = static_cast<const char *>(memchr(line, ':', crlf - line));
+        if (colon == NULL || colon == line)
+        {
+            return false;
+        }
+        request_.addHeader(line, colon, crlf);
+        line = eol + 1;
+    }
+    return true;
+}
+
 bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime)
 {
-    bool ok = false;
-    bool hasMore = true;
-    while (hasMore)
+    if (state_ == kGotAll)
+    {
+        return true;
+    }
+
+    if (state_ == kExpectRequestLine)
     {
-        //  解析请求行状态
-        if (state_ == kExpectRequestLine)
+        // 请求之间多余的空行直接丢掉
+        while (buf->readableBytes() >= 2 && buf->peek()[0] == '\r' && buf->peek()[1] == '\n')
         {
-            // 找到 \r\n 位置
-            const char *crlf = buf->findCRLF();
-            if (crlf)
+            buf->retrieve(2);
+            scanned_ = scanned_ > 2 ? scanned_ - 2 : 0;
+        }
+
+        const char *begin = buf->peek();
+        const char *end = buf->beginWrite();
+        const char *headerEnd = findHeaderEnd(begin, begin + scanned_, end);
+        if (headerEnd == NULL)
+        {
+            scanned_ = buf->readableBytes();
+            // 头部过大，不再等待
+            return scanned_ <= kMaxHeaderSize || fail(431);
+        }
+        if (static_cast<size_t>(headerEnd - begin) > kMaxHeaderSize)
+        {
+            return fail(431);
+        }
+        if (!processHeaders(begin, headerEnd))
+        {
+            return fail(400);
+        }
+        request_.setReceiveTime(receiveTime);
+        headerLength_ = headerEnd - begin;
+        requestLength_ = headerLength_;
+        if (!startBody(buf))
+        {
+            return false;
+        }
+    }
+    return processBody(buf);
+}
+
+bool HttpContext::startBody(Buffer *buf)
+{
+    StringPiece transferEncoding = request_.getHeader("Transfer-Encoding");
+    StringPiece contentLength = request_.getHeader("Content-Length");
+    // 多个Content-Length只接受完全相同的值，否则前后两个解析器可能各用一个（请求走私）
+    if (!request_.headerValuesAgree("Content-Length"))
+    {
+        return fail(400);
+    }
+    if (!transferEncoding.empty())
+    {
+        // 两个头部同时出现时无法确定请求的边界（请求走私），直接拒绝
+        if (!contentLength.empty())
+        {
+            return fail(400);
+        }
+        if (!transferEncoding.equalsIgnoreCase("chunked"))
+        {
+            return fail(501);
+        }
+        state_ = kExpectChunkSize;
+    }
+    else if (!contentLength.empty())
+    {
+        size_t length = 0;
+        for (char c : contentLength)
+        {
+            if (c < '0' || c > '9')
             {
-                // 从可读区读取请求行
-                // [peek(), crlf + 2) 是一行
-                ok = processRequestLine(buf->peek(), crlf);
-                if (ok)
-                {
-                    request_.setReceiveTime(receiveTime);
-                    // readerIndex 向后移动位置直到 crlf + 2
-                    buf->retrieveUntil(crlf + 2);
-                    // 状态转移，接下来解析请求头
-                    state_ = kExpectHeaders;
-                }
-                else
+                return fail(400);
+            }
+            if (length > (SIZE_MAX - 9) / 10)
+            {
+                return fail(413);
+            }
+            length = length * 10 + (c - '0');
+        }
+        if (length == 0)
+        {
+            state_ = kGotAll;
+            return true;
+        }
+        // 收到请求体之前就拒绝
+        if (maxBodySize_ > 0 && length > maxBodySize_)
+        {
+            return fail(413);
+        }
+        if (length > maxBufferedBodySize_)
+        {
+            if (!bodyCallback_)
+            {
+                return fail(413);
+            }
+            streaming_ = true;
+        }
+        if (!streaming_ && buf->readableBytes() >= headerLength_ + length)
+        {
+            // 请求体和请求头一起到达，直接指向Buffer
+            request_.setBody(StringPiece(buf->peek() + headerLength_, length));
+            requestLength_ = headerLength_ + length;
+            state_ = kGotAll;
+            return true;
+        }
+        bodyRemaining_ = length;
+        state_ = kExpectBody;
+    }
+    else
+    {
+        state_ = kGotAll;
+        return true;
+    }
+
+    // 请求体要等待后续数据，请求头拷贝出来，Buffer中只留请求体
+    request_.keepHeaders(buf->peek(), buf->peek() + headerLength_);
+    buf->retrieve(headerLength_);
+    requestLength_ = 0;
+    expectContinue_ = request_.version() == HttpRequest::kHttp11 &&
+                      request_.getHeader("Expect").equalsIgnoreCase("100-continue");
+    return true;
+}
+
+namespace
+{
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+}
+
+bool HttpContext::processBody(Buffer *buf)
+{
+    while (state_ != kGotAll)
+    {
+        switch (state_)
+        {
+        case kExpectBody:
+            if (!streaming_)
+            {
+                // 收齐以后直接指向Buffer
+                if (buf->readableBytes() < bodyRemaining_)
                 {
-                    hasMore = false;
+                    return true;
                 }
+                request_.setBody(StringPiece(buf->peek(), bodyRemaining_));
+                requestLength_ = bodyRemaining_;
+                bodyRemaining_ = 0;
+                state_ = kGotAll;
             }
             else
             {
-                hasMore = false;
+                size_t n = std::min(bodyRemaining_, buf->readableBytes());
+                if (n == 0)
+                {
+                    return true;
+                }
+                if (!appendBody(buf->peek(), n))
+                {
+                    return false;
+                }
+                buf->retrieve(n);
+                bodyRemaining_ -= n;
+                if (bodyRemaining_ == 0)
+                {
+                    state_ = kGotAll;
+                }
             }
-        }
-        // 解析请求头
-        else if (state_ == kExpectHeaders)
+            break;
+
+        case kExpectChunkSize:
         {
             const char *crlf = buf->findCRLF();
-            if (crlf)
+            if (crlf == NULL)
             {
-                // 找到 : 位置
-                const char *colon = std::find(buf->peek(), crlf, ':');
-                if (colon != crlf) // 如果找到
+                // 大小一行不会很长
+                return buf->readableBytes() <= 1024 || fail(400);
+            }
+            // 十六进制的大小，后面可能有";扩展"，忽略扩展
+            size_t size = 0;
+            const char *p = buf->peek();
+            for (; p < crlf && hexValue(*p) >= 0; ++p)
+            {
+                if (size > (SIZE_MAX >> 4))
                 {
-                    // 添加状态首部
-                    request_.addHeader(buf->peek(), colon, crlf);
+                    return fail(413);
                 }
-                else // colon == crlf 说明没有找到 : 了，直接返回 end
+                size = size * 16 + hexValue(*p);
+            }
+            if (p == buf->peek() || (p < crlf && *p != ';' && *p != ' ' && *p != '\t'))
+            {
+                return fail(400);
+            }
+            buf->retrieveUntil(crlf + 2);
+            if (size == 0)
+            {
+                state_ = kExpectTrailer;
+            }
+            else
+            {
+                if (maxBodySize_ > 0 && bodyReceived_ + size > maxBodySize_)
                 {
-                    // empty line, end of header
-                    // FIXME:
-                    state_ = kGotAll;
-                    hasMore = false;
+                    return fail(413);
                 }
-                buf->retrieveUntil(crlf + 2);
+                bodyRemaining_ = size;
+                state_ = kExpectChunkData;
             }
-            else
+            break;
+        }
+
+        case kExpectChunkData:
+        {
+            size_t n = std::min(bodyRemaining_, buf->readableBytes());
+            if (n == 0)
             {
-                hasMore = false;
+                return true;
             }
+            if (!appendBody(buf->peek(), n))
+            {
+                return false;
+            }
+            buf->retrieve(n);
+            bodyRemaining_ -= n;
+            if (bodyRemaining_ == 0)
+            {
+                state_ = kExpectChunkCRLF;
+            }
+            break;
         }
-        // 解析请求体，可以看到这里没有做出处理，只支持GET请求
-        else if (state_ == kExpectBody)
+
+        case kExpectChunkCRLF:
+            if (buf->readableBytes() < 2)
+            {
+                return true;
+            }
+            if (buf->peek()[0] != '\r' || buf->peek()[1] != '\n')
+            {
+                return fail(400);
+            }
+            buf->retrieve(2);
+            state_ = kExpectChunkSize;
+            break;
+
+        case kExpectTrailer:
         {
-            // FIXME:
+            // trailer中的头部直接丢掉
+            const char *crlf = buf->findCRLF();
+            if (crlf == NULL)
+            {
+                return buf->readableBytes() <= kMaxHeaderSize || fail(431);
+            }
+            bool emptyLine = crlf == buf->peek();
+            buf->retrieveUntil(crlf + 2);
+            if (emptyLine)
+            {
+                if (!streaming_)
+                {
+                    request_.setBody(bodyStorage_);
+                }
+                state_ = kGotAll;
+            }
+            break;
+        }
+
+        default:
+            return true;
         }
     }
-    return ok;
-}
\ No newline at end of file
+    return true;
+}
+
+bool HttpContext::appendBody(const char *data, size_t len)
+{
+    bodyReceived_ += len;
+    if (maxBodySize_ > 0 && bodyReceived_ > maxBodySize_)
+    {
+        return fail(413);
+    }
+    if (!streaming_ && bodyStorage_.size() + len > maxBufferedBodySize_)
+    {
+        if (!bodyCallback_)
+        {
+            return fail(413);
+        }
+        // 超过缓存上限，改为流式接收，已经缓存的部分先交给回调
+        streaming_ = true;
+        if (!bodyStorage_.empty())
+        {
+            bodyCallback_(request_, bodyStorage_.data(), bodyStorage_.size());
+            bodyStorage_.clear();
+        }
+    }
+
+    if (streaming_)
+    {
+        bodyCallback_(request_, data, len);
+    }
+    else
+    {
+        bodyStorage_.append(data, len);
+    }
+    return true;
+}
+
+void HttpContext::finishRequest(Buffer *buf)
+{
+    buf->retrieve(requestLength_);
+    reset();
+}
+
+void HttpContext::reset()
+{
+    state_ = kExpectRequestLine;
+    scanned_ = 0;
+    requestLength_ = 0;
+    headerLength_ = 0;
+    bodyRemaining_ = 0;
+    bodyReceived_ = 0;
+    streaming_ = false;
+    expectContinue_ = false;
+    errorCode_ = 0;
+    request_.reset();
+    // 偶尔的大请求体不要一直占着内存
+    if (bodyStorage_.capacity() > kMaxHeaderSize)
+    {
+        std::string().swap(bodyStorage_);
+    }
+    else
+    {
+        bodyStorage_.clear();
+    }
+}
@@ -3,41 +3,114 @@
 
 #include "HttpRequest.h"
 
+#include <functional>
+#include <memory>
+#include <string>
+
 class Buffer;
+class HttpStream;
+class Http2Connection;
+class WebSocket;
+
+/*
+    请求头完整到达以前不解析也不取走数据，只记录已经查找过的位置，下次从这里继续找空行；
+    完整以后一次解析请求行和所有头部，request_中的StringPiece直接指向Buffer中的数据。
+    请求处理完以后调用finishRequest()从Buffer中取走这个请求，再解析下一个。
 
+    请求体（Content-Length或者chunked）：
+    - 请求体要等待后续数据时，先把请求头拷贝到request_自己的存储中，从Buffer中取走；
+    - 不超过maxBufferedBodySize的请求体缓存起来：Content-Length请求体留在Buffer中，
+      收齐以后直接指向Buffer，不拷贝；chunked请求体解码到bodyStorage_；
+    - 更大的请求体如果设置了bodyCallback_就边收边交给回调，不在内存中保存，否则返回413；
+    - 超过maxBodySize的请求体（包括流式接收的）返回413，Content-Length在收到请求体之前就能拒绝。
+*/
 class HttpContext
 {
 public:
     // HTTP请求状态
     enum HttpRequestParseState
     {
-        kExpectRequestLine, // 解析请求行状态
-        kExpectHeaders,     // 解析请求头部状态
-        kExpectBody,        // 解析请求体状态
+        kExpectRequestLine, // 等待完整的请求行和头部
+        kExpectBody,        // Content-Length请求体，还剩bodyRemaining_字节
+        kExpectChunkSize,   // 等待chunk大小一行
+        kExpectChunkData,   // chunk数据，还剩bodyRemaining_字节
+        kExpectChunkCRLF,   // chunk数据之后的CRLF
+        kExpectTrailer,     // 最后一个chunk之后的trailer，直到空行
         kGotAll,            // 解析完毕状态
     };
 
+    // 请求行加头部的最大长度，超过仍然没有找到空行认为是错误的请求
+    static const size_t kMaxHeaderSize = 64 * 1024;
+
+    // 流式接收请求体的回调，每次收到一段请求体时调用，只在loop线程中调用
+    using BodyCallback = std::function<void(const HttpRequest &, const char *data, size_t len)>;
+
     HttpContext()
-        : state_(kExpectRequestLine)
+        : state_(kExpectRequestLine),
+          scanned_(0),
+          requestLength_(0),
+          headerLength_(0),
+          bodyRemaining_(0),
+          bodyReceived_(0),
+          streaming_(false),
+          expectContinue_(false),
+          deferred_(false),
+          errorCode_(0),
+          maxBufferedBodySize_(1024 * 1024),
+          maxBodySize_(0)
+    {
+    }
+
+    // 缓存在内存中的请求体上限（默认1MB），以及请求体的绝对上限（0表示不限制，只对流式接收有意义）
+    void setBodyLimits(size_t maxBufferedBodySize, size_t maxBodySize)
     {
+        maxBufferedBodySize_ = maxBufferedBodySize;
+        maxBodySize_ = maxBodySize;
     }
 
+    void setBodyCallback(const BodyCallback &cb) { bodyCallback_ = cb; }
+
+    // 返回false表示请求错误，错误码见errorCode()；数据不完整时返回true，等待更多数据再继续解析
     bool parseRequest(Buffer *buf, Timestamp receiveTime);
 
     bool gotAll() const { return state_ == kGotAll; }
+    // 在两个请求之间，还没有开始解析下一个请求
+    bool idle() const { return state_ == kExpectRequestLine && scanned_ == 0; }
 
-    // 重置HttpContext状态，异常安全
-    void reset()
+    // 请求错误时应答的状态码：400格式错误，413请求体过大，431请求头过大，501不支持的Transfer-Encoding
+    int errorCode() const { return errorCode_; }
+
+    // 请求头带有"Expect: 100-continue"并且接受这个请求体，调用者需要先回复100 Continue；只返回一次true
+    bool takeExpectContinue()
     {
-        state_ = kExpectRequestLine;
-        /**
-         * 构造一个临时空HttpRequest对象，和当前的成员HttpRequest对象交换置空
-         * 然后临时对象析构
-         */
-        HttpRequest dummy;
-        request_.swap(dummy);
+        bool expect = expectContinue_;
+        expectContinue_ = false;
+        return expect;
     }
 
+    // 从buf中取走已经处理完的请求并重置状态，之后request()中的数据失效
+    void finishRequest(Buffer *buf);
+
+    // 重置HttpContext状态，保留request_中头部数组的容量
+    void reset();
+
+    // 正在进行的流式响应（见HttpStream.h），响应结束之前同一连接上后面的请求不处理
+    void setResponseStream(const std::shared_ptr<HttpStream> &stream) { responseStream_ = stream; }
+    const std::shared_ptr<HttpStream> &responseStream() const { return responseStream_; }
+    bool responding() const { return static_cast<bool>(responseStream_); }
+
+    // 正在等待延迟响应（见ResponseWriter.h），完成之前同一连接上后面的请求不处理
+    void setDeferred(bool on) { deferred_ = on; }
+    bool deferred() const { return deferred_; }
+
+    // 切换到HTTP/2以后（见Http2Connection.h）连接上的数据都交给它处理
+    void setHttp2(const std::shared_ptr<Http2Connection> &http2) { http2_ = http2; }
+    const std::shared_ptr<Http2Connection> &http2() const { return http2_; }
+
+    // 升级到WebSocket以后（见WebSocket.h）连接上的数据都是WebSocket帧
+    void setWebSocket(const std::shared_ptr<WebSocket> &webSocket) { webSocket_ = webSocket; }
+    const std::shared_ptr<WebSocket> &webSocket() const { return webSocket_; }
+
     const HttpRequest &request() const { return request_; }
 
     HttpRequest &request() { return request_; }
@@ -45,9 +118,41 @@ public:
 private:
     // 解析请求行
     bool processRequestLine(const char *begin, const char *end);
+    // 解析[begin, end)中完整的请求行和头部，end是空行之后的位置
+    bool processHeaders(const char *begin, const char *end);
+    // 请求头解析完以后，根据Content-Length和Transfer-Encoding决定怎样接收请求体
+    bool startBody(Buffer *buf);
+    // 解析请求体，每次处理一个状态
+    bool processBody(Buffer *buf);
+    // 接收一段请求体：缓存或者交给bodyCallback_
+    bool appendBody(const char *data, size_t len);
+
+    bool fail(int code)
+    {
+        errorCode_ = code;
+        return false;
+    }
 
     HttpRequestParseState state_;
+    size_t scanned_;       // 已经查找过空行的字节数（相对Buffer的peek()）
+    size_t requestLength_; // 当前请求还留在Buffer中的字节数
+    size_t headerLength_;  // 请求行和头部的长度
+    size_t bodyRemaining_; // Content-Length或者当前chunk还没有收到的字节数
+    size_t bodyReceived_;  // 已经收到的请求体长度
+    bool streaming_;       // 请求体交给bodyCallback_
+    bool expectContinue_;
+    bool deferred_;
+    int errorCode_;
+
+    size_t maxBufferedBodySize_;
+    size_t maxBodySize_;
+    BodyCallback bodyCallback_;
+
+    std::string bodyStorage_; // chunked解码以后的请求体
     HttpRequest request_;
+    std::shared_ptr<HttpStream> responseStream_; // 响应结束以前由连接持有
+    std::shared_ptr<Http2Connection> http2_;
+    std::shared_ptr<WebSocket> webSocket_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -3,8 +3,18 @@
 
 #include "noncopyable.h"
 #include "Timestamp.h"
-#include <unordered_map>
+#include "StringPiece.h"
 
+#include <vector>
+#include <utility>
+
+/*
+    HttpRequest不拷贝请求数据：路径、参数和头部都是指向连接输入Buffer的StringPiece，
+    只在HttpServer调用回调期间有效（请求处理完以后这段数据才从Buffer中取走）；
+    请求体需要等待后续数据时，请求行和头部先拷贝到storage_中（keepHeaders）。
+    需要在回调以外保存的内容要用asString()拷贝出来。
+    头部按到达顺序放在vector中，reset()保留容量，长连接上解析后续请求不再分配内存。
+*/
 class HttpRequest
 {
 public:
@@ -24,9 +34,13 @@ public:
     {
         kUnknown,
         kHttp10,
-        kHttp11
+        kHttp11,
+        kHttp20 // 见Http2Connection.h
     };
 
+    // (字段名, 值)
+    using Header = std::pair<StringPiece, StringPiece>;
+
     HttpRequest()
         : method_(kInvalid),
           version_(kUnknown)
@@ -40,35 +54,34 @@ public:
 
     Version version() const { return version_; }
 
+    // 按长度分派再逐字节比较，不构造临时字符串
     bool setMethod(const char *start, const char *end)
     {
-        std::string m(start, end);
-        if (m == "GET")
+        StringPiece m(start, end);
+        method_ = kInvalid;
+        switch (m.size())
         {
-            method_ = kGet;
-        }
-        else if (m == "POST")
-        {
-            method_ = kPost;
-        }
-        else if (m == "HEAD")
-        {
-            method_ = kHead;
-        }
-        else if (m == "PUT")
-        {
-            method_ = kPut;
-        }
-        else if (m == "DELETE")
-        {
-            method_ = kDelete;
-        }
-        else
-        {
-            method_ = kInvalid;
+        case 3:
+            if (m == "GET")
+                method_ = kGet;
+            else if (m == "PUT")
+                method_ = kPut;
+            break;
+        case 4:
+            if (m == "POST")
+                method_ = kPost;
+            else if (m == "HEAD")
+                method_ = kHead;
+            break;
+        case 6:
+            if (m == "DELETE")
+                method_ = kDelete;
+            break;
+        default:
+            break;
         }
         // 判断method_是否合法
-        return method_ = kInvalid;
+        return method_ != kInvalid;
     }
 
     Method method() const { return method_; }
@@ -101,17 +114,19 @@ public:
 
     void setPath(const char *start, const char *end)
     {
-        path_.assign(start, end);
+        path_ = StringPiece(start, end);
     }
 
-    const std::string &path() const { return path_; }
+    StringPiece path() const { return path_; }
 
+    // 包含开头的'?'
     void setQuery(const char *start, const char *end)
     {
-        query_.assign(start, end);
+        query_ = StringPiece(start, end);
     }
 
-    const std::string &query() const { return query_; }
+    // 包含开头的'?'，没有查询串时为空
+    StringPiece query() const { return query_; }
 
     void setReceiveTime(Timestamp t)
     {
@@ -120,60 +135,193 @@ public:
 
     Timestamp receiveTime() const { return receiveTime_; }
 
-    // 添加请求头部的对应值
+    // 添加请求头部，[start, colon)是字段名，(colon, end)是值，值去掉前后的空白
     void addHeader(const char *start, const char *colon, const char *end)
     {
-        std::string field(start, colon);
-        ++colon;
-        // 跳过空格
-        while (colon < end && isspace(*colon))
+        const char *value = colon + 1;
+        while (value < end && (*value == ' ' || *value == '\t'))
         {
-            ++colon;
+            ++value;
         }
-        std::string value(colon, end);
-        // value丢掉后面的空格，通过重新截断大小设置
-        while (!value.empty() && isspace(value[value.size() - 1]))
+        while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
         {
-            value.reserve(value.size() - 1);
+            --end;
         }
-        // key:field  , value:value
-        headers_[field] = value;
+        headers_.push_back(Header(StringPiece(start, colon), StringPiece(value, end)));
     }
 
-    // 获取请求头部的对应值
-    std::string getHeader(const std::string &field) const
+    // 获取请求头部的值，字段名不区分大小写，没有这个头部时返回空
+    // 头部通常只有十几个，线性查找比哈希表快，也不需要为每个头部分配节点
+    StringPiece getHeader(const StringPiece &field) const
     {
-        std::string result;
-        auto it = headers_.find(field);
-        if (it != headers_.end())
+        for (const Header &header : headers_)
         {
-            result = it->second;
+            if (header.first.equalsIgnoreCase(field))
+            {
+                return header.second;
+            }
         }
-        return result;
+        return StringPiece();
     }
 
-    const std::unordered_map<std::string, std::string> &headers() const
+    // 同名的头部出现多次时值是否都相同；Content-Length不一致时无法确定请求的边界（请求走私）
+    bool headerValuesAgree(const StringPiece &field) const
+    {
+        StringPiece first;
+        bool seen = false;
+        for (const Header &header : headers_)
+        {
+            if (header.first.equalsIgnoreCase(field))
+            {
+                if (seen && header.second != first)
+                {
+                    return false;
+                }
+                first = header.second;
+                seen = true;
+            }
+        }
+        return true;
+    }
+
+    const std::vector<Header> &headers() const
     {
         return headers_;
     }
 
-    void swap(HttpRequest &rhs)
+    // 路由匹配到的路径参数（见HttpRouter.h），名字指向路由表，值指向请求路径
+    void addParam(const StringPiece &name, const StringPiece &value)
+    {
+        params_.push_back(Header(name, value));
+    }
+
+    // 回溯时撤销最后一个参数
+    void popParam()
+    {
+        params_.pop_back();
+    }
+
+    // 没有这个参数时返回空
+    StringPiece param(const StringPiece &name) const
+    {
+        for (const Header &param : params_)
+        {
+            if (param.first == name)
+            {
+                return param.second;
+            }
+        }
+        return StringPiece();
+    }
+
+    const std::vector<Header> &params() const
     {
-        std::swap(method_, rhs.method_);
-        std::swap(version_, rhs.version_);
-        path_.swap(rhs.path_);
-        query_.swap(rhs.query_);
-        std::swap(receiveTime_, rhs.receiveTime_);
-        headers_.swap(rhs.headers_);
+        return params_;
+    }
+
+    // 请求体，流式接收（见HttpServer::setBodyCallback）的请求体为空
+    void setBody(const StringPiece &body)
+    {
+        body_ = body;
+    }
+
+    StringPiece body() const { return body_; }
+
+    /**
+     * 把[begin, end)中的请求行和头部拷贝到请求自己的存储中，之后的StringPiece不再指向Buffer。
+     * 请求体要等后续数据到达时使用，期间Buffer可能扩容或者取走数据
+     */
+    void keepHeaders(const char *begin, const char *end)
+    {
+        storage_.assign(begin, end);
+        const char *base = storage_.data();
+        relocate(&path_, begin, base);
+        relocate(&query_, begin, base);
+        for (Header &header : headers_)
+        {
+            relocate(&header.first, begin, base);
+            relocate(&header.second, begin, base);
+        }
+    }
+
+    /**
+     * 拷贝一份不指向连接Buffer的请求：路径、参数、头部和请求体都拷贝到out自己的存储中，
+     * 用于请求处理完以后还要再次使用请求的地方（比如响应缓存的等待者）
+     */
+    void copyTo(HttpRequest *out) const
+    {
+        out->reset();
+        out->method_ = method_;
+        out->version_ = version_;
+        out->receiveTime_ = receiveTime_;
+        size_t total = path_.size() + query_.size() + body_.size();
+        for (const Header &header : headers_)
+        {
+            total += header.first.size() + header.second.size();
+        }
+        for (const Header &param : params_)
+        {
+            total += param.first.size() + param.second.size();
+        }
+        // 事先分配好，追加时不会重新分配，之前返回的StringPiece一直有效
+        out->storage_.reserve(total);
+        out->path_ = out->keep(path_);
+        out->query_ = out->keep(query_);
+        for (const Header &header : headers_)
+        {
+            out->headers_.push_back(Header(out->keep(header.first), out->keep(header.second)));
+        }
+        for (const Header &param : params_)
+        {
+            out->params_.push_back(Header(out->keep(param.first), out->keep(param.second)));
+        }
+        out->body_ = out->keep(body_);
+    }
+
+    // 清空请求，保留headers_和params_的容量
+    void reset()
+    {
+        method_ = kInvalid;
+        version_ = kUnknown;
+        path_.clear();
+        query_.clear();
+        receiveTime_ = Timestamp();
+        headers_.clear();
+        params_.clear();
+        body_.clear();
+        storage_.clear();
     }
 
 private:
-    Method method_;                                        // 请求方法
-    Version version_;                                      // 协议版本号
-    std::string path_;                                     // 请求路径
-    std::string query_;                                    // 询问参数
-    Timestamp receiveTime_;                                // 请求时间
-    std::unordered_map<std::string, std::string> headers_; // 请求头部列表
+    // 把s追加到storage_，返回指向副本的StringPiece
+    StringPiece keep(const StringPiece &s)
+    {
+        if (s.empty())
+        {
+            return StringPiece();
+        }
+        size_t offset = storage_.size();
+        storage_.append(s.data(), s.size());
+        return StringPiece(storage_.data() + offset, s.size());
+    }
+
+    static void relocate(StringPiece *piece, const char *oldBase, const char *newBase)
+    {
+        if (!piece->empty())
+        {
+            *piece = StringPiece(newBase + (piece->data() - oldBase), piece->size());
+        }
+    }
+
+    Method method_;               // 请求方法
+    Version version_;             // 协议版本号
+    StringPiece path_;            // 请求路径
+    StringPiece query_;           // 询问参数
+    Timestamp receiveTime_;       // 请求时间
+    std::vector<Header> headers_; // 请求头部列表
+    std::vector<Header> params_;  // 路径参数
+    StringPiece body_;            // 请求体
+    std::string storage_;         // keepHeaders()拷贝的请求行和头部
 };
 
-#endif
\ No newline at end of file
+#endif
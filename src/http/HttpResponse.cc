@@ -1,54 +1,253 @@
 #include "HttpResponse.h"
+#include "ResponseWriter.h"
 #include "Buffer.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
-void HttpResponse::appendToBuffer(Buffer *output) const
+namespace
+{
+
+// 常用状态码的完整状态行，编译期拼好，序列化时直接拷贝
+StringPiece standardStatusLine(int code)
+{
+#define STATUS_LINE(code, reason) \
+    case code:                    \
+        return StringPiece("HTTP/1.1 " #code " " reason "\r\n", sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1)
+
+    switch (code)
+    {
+        STATUS_LINE(200, "OK");
+        STATUS_LINE(206, "Partial Content");
+        STATUS_LINE(301, "Moved Permanently");
+        STATUS_LINE(304, "Not Modified");
+        STATUS_LINE(400, "Bad Request");
+        STATUS_LINE(403, "Forbidden");
+        STATUS_LINE(404, "Not Found");
+        STATUS_LINE(405, "Method Not Allowed");
+        STATUS_LINE(416, "Range Not Satisfiable");
+        STATUS_LINE(500, "Internal Server Error");
+    default:
+        return StringPiece();
+    }
+#undef STATUS_LINE
+}
+
+// "HTTP/1.1 200 "的长度，后面是原因短语和"\r\n"
+const size_t kStatusPrefixLength = 13;
+
+// Date头部每个线程（也就是每个EventLoop）缓存一份，秒数变化时才重新格式化
+__thread time_t t_dateSecond = 0;
+__thread char t_dateHeader[64];
+__thread size_t t_dateHeaderLength = 0;
+
+StringPiece dateHeader()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec != t_dateSecond || t_dateHeaderLength == 0)
+    {
+        t_dateSecond = now.tv_sec;
+        struct tm tm;
+        gmtime_r(&now.tv_sec, &tm);
+        t_dateHeaderLength = strftime(t_dateHeader, sizeof t_dateHeader, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+    }
+    return StringPiece(t_dateHeader, t_dateHeaderLength);
+}
+
+// 把n格式化为十进制写在end之前，返回第一个数字的位置
+char *formatDecimal(char *end, size_t n)
+{
+    char *p = end;
+    do
+    {
+        *--p = static_cast<char>('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+    return p;
+}
+
+// 在序列化好的头部"Name: value\r\n"...中查找name
+StringPiece findHeader(const std::string &headers, const StringPiece &name)
+{
+    const char *p = headers.data();
+    const char *end = p + headers.size();
+    while (p < end)
+    {
+        const char *crlf = static_cast<const char *>(memchr(p, '\r', end - p));
+        if (crlf == nullptr)
+        {
+            break;
+        }
+        const char *colon = static_cast<const char *>(memchr(p, ':', crlf - p));
+        if (colon && StringPiece(p, colon).equalsIgnoreCase(name))
+        {
+            return StringPiece(colon + 2, crlf);
+        }
+        p = crlf + 2;
+    }
+    return StringPiece();
+}
+
+// 把序列化好的头部"Name: value\r\n"...拆成字段
+void splitHeaders(const std::string &headers, std::vector<std::pair<StringPiece, StringPiece>> *out)
+{
+    const char *p = headers.data();
+    const char *end = p + headers.size();
+    while (p < end)
+    {
+        const char *crlf = static_cast<const char *>(memchr(p, '\r', end - p));
+        if (crlf == nullptr)
+        {
+            break;
+        }
+        const char *colon = static_cast<const char *>(memchr(p, ':', crlf - p));
+        if (colon)
+        {
+            out->push_back(std::make_pair(StringPiece(p, colon), StringPiece(colon + 2, crlf)));
+        }
+        p = crlf + 2;
+    }
+}
+
+inline void append(Buffer *output, const StringPiece &s)
+{
+    output->append(s.data(), s.size());
+}
+
+} // namespace
+
+StringPiece HttpResponse::getHeader(const StringPiece &name) const
+{
+    if (!contentType_.empty() && name.equalsIgnoreCase("Content-Type"))
+    {
+        return contentType_;
+    }
+    StringPiece value = findHeader(headers_, name);
+    if (value.empty() && headerBlock_)
+    {
+        value = findHeader(headerBlock_->data(), name);
+    }
+    if (value.empty() && defaultHeaders_)
+    {
+        value = findHeader(defaultHeaders_->data(), name);
+    }
+    return value;
+}
+
+ResponseWriter HttpResponse::defer()
+{
+    if (!deferred_)
+    {
+        // 拷贝的时候deferred_还是空的，共享状态中的响应不会指向自己
+        deferred_ = std::make_shared<DeferredResponse>(*this);
+    }
+    return ResponseWriter(deferred_);
+}
+
+void HttpResponse::appendStatusLine(Buffer *output) const
 {
     // 响应行
     // HTTP/1.1 200 OK
+    StringPiece line = standardStatusLine(statusCode_);
+    if (!line.empty())
+    {
+        StringPiece reason(line.data() + kStatusPrefixLength, line.size() - kStatusPrefixLength - 2);
+        if (statusMessage_.empty() || reason == statusMessage_)
+        {
+            append(output, line);
+            return;
+        }
+    }
+
     char buf[32];
-    memset(buf, '\0', sizeof(buf));
-    snprintf(buf, sizeof(buf), "HTTP/1.1 %d ", statusCode_);
-    output->append(buf);
+    int n = snprintf(buf, sizeof(buf), "HTTP/1.1 %d ", statusCode_);
+    output->append(buf, n);
     output->append(statusMessage_);
-    output->append("\r\n");
+    output->append("\r\n", 2);
+}
+
+void HttpResponse::appendToBuffer(Buffer *output) const
+{
+    appendStatusLine(output);
 
     /*
     HTTP/1.1 200 OK
+    Content-Length: 14
     Connection: close
+    Date: Sun, 18 Oct 2026 08:00:00 GMT
     */
-    if (closeConnection_)
+    if (streamCallback_)
     {
-        output->append("Connection: close\r\n");
+        if (chunked_)
+        {
+            // 流式响应事先不知道长度
+            append(output, "Transfer-Encoding: chunked\r\n");
+        }
     }
-    else
-    /*
-    HTTP/1.1 200 OK
-    Content-Length: %zd
-    Content-Length: %zd
-    */
+    else if (statusCode_ != k304NotModified)
     {
-        snprintf(buf, sizeof(buf), "Content-Length: %zd\r\n", body_.size());
-        output->append(buf);
-        output->append("Content-Length: %zd\r\n");
+        // 304没有响应体，Content-Length只能是原来的长度，干脆不发送
+        char buf[48];
+        char *end = buf + sizeof buf;
+        memcpy(end - 2, "\r\n", 2);
+        char *p = formatDecimal(end - 2, fileFd_ >= 0 ? fileLength_ : body().size());
+        static const char kContentLength[] = "Content-Length: ";
+        p -= sizeof kContentLength - 1;
+        memcpy(p, kContentLength, sizeof kContentLength - 1);
+        output->append(p, end - p);
     }
+    if (closeConnection_)
+    {
+        append(output, "Connection: close\r\n");
+    }
+    append(output, dateHeader());
 
     /*
     HTTP/1.1 200 OK
-    Content-Length: %zd
-    Content-Length: %zd
+    Content-Length: 14
     header:value
     header:value
     */
-    for (const auto &header : headers_)
+    if (defaultHeaders_)
+    {
+        output->append(defaultHeaders_->data());
+    }
+    if (headerBlock_)
+    {
+        output->append(headerBlock_->data());
+    }
+    if (!contentType_.empty())
+    {
+        append(output, "Content-Type: ");
+        output->append(contentType_);
+        output->append("\r\n", 2);
+    }
+    output->append(headers_);
+    output->append("\r\n", 2);
+    if (!streamCallback_ && !headOnly_)
+    {
+        output->append(body());
+    }
+}
+
+void HttpResponse::headerList(std::vector<std::pair<StringPiece, StringPiece>> *headers) const
+{
+    // "Date: "和结尾的"\r\n"之间是值
+    StringPiece date = dateHeader();
+    headers->push_back(std::make_pair(StringPiece("Date", 4), StringPiece(date.data() + 6, date.size() - 8)));
+    if (defaultHeaders_)
+    {
+        splitHeaders(defaultHeaders_->data(), headers);
+    }
+    if (headerBlock_)
+    {
+        splitHeaders(headerBlock_->data(), headers);
+    }
+    if (!contentType_.empty())
     {
-        output->append(header.first);
-        output->append(": ");
-        output->append(header.second);
-        output->append("\r\n");
+        headers->push_back(std::make_pair(StringPiece("Content-Type", 12), StringPiece(contentType_)));
     }
-    output->append("\r\n");
-    output->append(body_);
-}
\ No newline at end of file
+    splitHeaders(headers_, headers);
+}
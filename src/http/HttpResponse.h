@@ -1,9 +1,44 @@
 #ifndef HTTP_HTTPRESPONSE_H
 #define HTTP_HTTPRESPONSE_H
 
-#include <unordered_map>
+#include "StringPiece.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
 
 class Buffer;
+class HttpStream;
+class DeferredResponse;
+class ResponseWriter;
+
+/*
+    预先序列化好的一组响应头部（"Name: value\r\n"...），比如Server、Content-Type这些每个响应都一样的头部。
+    HttpResponse只保存指针，序列化时一次拷贝追加到输出，块本身应该在使用它的响应发送之前一直有效
+    （通常是静态变量或者HttpServer的成员），构造完以后只读，多个线程可以共享
+*/
+class HttpHeaderBlock
+{
+public:
+    HttpHeaderBlock &add(const StringPiece &name, const StringPiece &value)
+    {
+        data_.append(name.data(), name.size());
+        data_.append(": ", 2);
+        data_.append(value.data(), value.size());
+        data_.append("\r\n", 2);
+        return *this;
+    }
+
+    const std::string &data() const { return data_; }
+    bool empty() const { return data_.empty(); }
+
+private:
+    std::string data_;
+};
+
 class HttpResponse
 {
 public:
@@ -12,14 +47,30 @@ public:
     {
         kUnknown,
         k200Ok = 200,
+        k206PartialContent = 206,
         k301MovedPermanently = 301,
+        k304NotModified = 304,
         k400BadRequest = 400,
+        k403Forbidden = 403,
         k404NotFound = 404,
+        k405MethodNotAllowed = 405,
+        k416RangeNotSatisfiable = 416,
+        k500InternalServerError = 500,
     };
 
+    // 流式响应的回调，参数是响应体的写入端（见HttpStream.h）
+    using StreamCallback = std::function<void(const std::shared_ptr<HttpStream> &)>;
+
     explicit HttpResponse(bool close)
         : statusCode_(kUnknown),
-          closeConnection_(close)
+          closeConnection_(close),
+          chunked_(false),
+          headOnly_(false),
+          defaultHeaders_(nullptr),
+          headerBlock_(nullptr),
+          fileFd_(-1),
+          fileOffset_(0),
+          fileLength_(0)
     {
     }
 
@@ -28,6 +79,9 @@ public:
         statusCode_ = code;
     }
 
+    HttpStatusCode statusCode() const { return statusCode_; }
+
+    // 不设置或者和标准的原因短语相同时使用预先生成的状态行
     void setStatusMessage(const std::string& message)
     {
         statusMessage_ = message;
@@ -43,31 +97,153 @@ public:
         return closeConnection_;
     }
 
-    void setContentType(const std::string& contentType)
+    // 重复设置时以最后一次为准；Content-Type已经放在HttpHeaderBlock里时不要再设置
+    void setContentType(const StringPiece& contentType)
+    {
+        contentType_.assign(contentType.data(), contentType.size());
+    }
+
+    // 头部直接序列化追加，不检查重复（Set-Cookie这样的头部本来就可以出现多次）
+    void addHeader(const StringPiece& key, const StringPiece& value)
     {
-        addHeader("Content-Type", contentType);
+        headers_.append(key.data(), key.size());
+        headers_.append(": ", 2);
+        headers_.append(value.data(), value.size());
+        headers_.append("\r\n", 2);
     }
 
-    void addHeader(const std::string& key, const std::string& value)
+    // 追加一组预先序列化的头部，block必须在响应发送之前一直有效
+    void setHeaderBlock(const HttpHeaderBlock *block)
     {
-        headers_[key] = value;
+        headerBlock_ = block;
+    }
+
+    // 服务器级别的默认头部（见HttpServer::addResponseHeader），由HttpServer设置
+    void setDefaultHeaders(const HttpHeaderBlock *block)
+    {
+        defaultHeaders_ = block;
     }
 
     void setBody(const std::string& body)
     {
         body_ = body;
+        sharedBody_.reset();
+    }
+
+    // 多个响应共享的只读响应体（比如缓存中的内容），不拷贝；之后的setBody()替换它
+    void setSharedBody(const std::shared_ptr<const std::string> &body)
+    {
+        sharedBody_ = body;
+        body_.clear();
+    }
+
+    const std::string &body() const { return sharedBody_ ? *sharedBody_ : body_; }
+    const std::shared_ptr<const std::string> &sharedBody() const { return sharedBody_; }
+    // 和body交换响应体，不拷贝（共享的响应体先拷贝一份）
+    void swapBody(std::string &body)
+    {
+        if (sharedBody_)
+        {
+            body_ = *sharedBody_;
+            sharedBody_.reset();
+        }
+        body_.swap(body);
+    }
+
+    /**
+     * 标明响应体只由key决定（比如资源路径加版本号），相同key的响应体必须相同。
+     * 压缩结果按key缓存（见HttpCompressor.h），不用每次重新压缩
+     */
+    void setCacheKey(const std::string &key) { cacheKey_ = key; }
+    const std::string &cacheKey() const { return cacheKey_; }
+
+    // 已经设置的头部的值（包括HttpHeaderBlock中的），名字不区分大小写，没有时返回空
+    StringPiece getHeader(const StringPiece &name) const;
+
+    /**
+     * 响应体是文件fd中[offset, offset + length)的内容，HttpServer用sendfile发送（见TcpConnection::sendFile），
+     * 不经过用户态。owner持有fd，发送完以前不会释放
+     */
+    void setBodyFile(const std::shared_ptr<void> &owner, int fd, off_t offset, size_t length)
+    {
+        fileOwner_ = owner;
+        fileFd_ = fd;
+        fileOffset_ = offset;
+        fileLength_ = length;
+    }
+
+    bool hasBodyFile() const { return fileFd_ >= 0; }
+    const std::shared_ptr<void> &fileOwner() const { return fileOwner_; }
+    int fileFd() const { return fileFd_; }
+    off_t fileOffset() const { return fileOffset_; }
+    size_t fileLength() const { return fileLength_; }
+
+    // HEAD请求的响应：Content-Length照常，但是不发送响应体，由HttpServer设置
+    void setHeadOnly(bool on)
+    {
+        headOnly_ = on;
+    }
+
+    bool headOnly() const { return headOnly_; }
+
+    /**
+     * 流式响应：HttpServer先发送状态行和头部（没有Content-Length，setBody()被忽略），
+     * 然后调用cb，由cb（或者它交给的其他线程）通过HttpStream分段写入响应体。
+     * 响应结束之前，同一连接上后面的请求不会处理
+     */
+    void setStreamCallback(const StreamCallback &cb)
+    {
+        streamCallback_ = cb;
+    }
+
+    const StreamCallback &streamCallback() const { return streamCallback_; }
+    bool streaming() const { return static_cast<bool>(streamCallback_); }
+
+    /**
+     * 延迟响应（见ResponseWriter.h）：处理函数不在返回之前生成响应，而是通过返回的ResponseWriter
+     * 之后在任意线程填写并完成。调用以后对这个HttpResponse的修改都被忽略
+     */
+    ResponseWriter defer();
+    bool deferred() const { return static_cast<bool>(deferred_); }
+    const std::shared_ptr<DeferredResponse> &deferredResponse() const { return deferred_; }
+
+    // 流式响应是否使用chunked编码，由HttpServer根据请求的协议版本设置
+    void setChunked(bool on)
+    {
+        chunked_ = on;
     }
 
     void appendToBuffer(Buffer* output) const;
 
+    /**
+     * HTTP/2按字段编码头部（见Http2Connection.cc）：追加Date、默认头部、HttpHeaderBlock、Content-Type
+     * 和addHeader()添加的头部，不包括状态行和Content-Length这些由协议层生成的部分。
+     * 值指向响应自己的数据，Date指向线程局部的缓存，在下一次调用之前有效
+     */
+    void headerList(std::vector<std::pair<StringPiece, StringPiece>> *headers) const;
 
 private:
-    std::unordered_map<std::string, std::string> headers_;
+    void appendStatusLine(Buffer *output) const;
+
+    std::string headers_;            // 序列化好的其他头部
+    std::string contentType_;
     HttpStatusCode statusCode_;      //响应状态码
     // FIXME: add http version
     std::string statusMessage_;
     bool closeConnection_;
     std::string body_;
+    std::shared_ptr<const std::string> sharedBody_;
+    std::string cacheKey_;
+    StreamCallback streamCallback_;
+    std::shared_ptr<DeferredResponse> deferred_;
+    bool chunked_;
+    bool headOnly_;
+    const HttpHeaderBlock *defaultHeaders_;
+    const HttpHeaderBlock *headerBlock_;
+    std::shared_ptr<void> fileOwner_; // 文件响应体
+    int fileFd_;
+    off_t fileOffset_;
+    size_t fileLength_;
 };
 
 #endif
\ No newline at end of file
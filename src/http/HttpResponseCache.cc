@@ -0,0 +1,268 @@
+#include "HttpResponseCache.h"
+#include "HttpRequest.h"
+#include "EventLoop.h"
+
+namespace
+{
+
+// 每个条目在键和内容之外的大致开销（链表节点、哈希表节点、HttpResponse）
+const size_t kEntryOverhead = 256;
+
+} // namespace
+
+struct HttpResponseCache::Waiter
+{
+    Waiter(EventLoop *l, const ResponseWriter &w, const Generator &g)
+        : loop(l), writer(w), generate(g), done(false)
+    {
+    }
+
+    EventLoop *loop;
+    HttpRequest request; // 请求的副本，自己生成时使用
+    ResponseWriter writer;
+    Generator generate;
+    TimerId timer;
+    bool done;
+};
+
+HttpResponseCache::HttpResponseCache(size_t maxBytes, size_t shards)
+    : maxShardBytes_(maxBytes / (shards > 0 ? shards : 1)),
+      shards_(new Shard[shards > 0 ? shards : 1]),
+      shardCount_(shards > 0 ? shards : 1),
+      hits_(0),
+      misses_(0),
+      generation_(0),
+      waitTimeout_(5.0)
+{
+}
+
+void HttpResponseCache::cache(const std::string &pathPrefix, double ttlSeconds)
+{
+    rules_.push_back(std::make_pair(pathPrefix, ttlSeconds));
+}
+
+void HttpResponseCache::varyOn(const std::string &name)
+{
+    varyHeaders_.push_back(name);
+}
+
+double HttpResponseCache::ttlFor(const HttpRequest &req) const
+{
+    if (req.method() != HttpRequest::kGet && req.method() != HttpRequest::kHead)
+    {
+        return 0;
+    }
+    for (const auto &rule : rules_)
+    {
+        if (req.path().startsWith(rule.first))
+        {
+            return rule.second;
+        }
+    }
+    return 0;
+}
+
+bool HttpResponseCache::cacheable(const HttpResponse &resp) const
+{
+    // 延迟响应这时还没有生成，完成以后HttpServer再调用一次complete()
+    if (resp.deferred() || resp.statusCode() != HttpResponse::k200Ok || resp.streaming() || resp.hasBodyFile())
+    {
+        return false;
+    }
+    StringPiece control = resp.getHeader("Cache-Control");
+    std::string value(control.data(), control.size());
+    return value.find("no-store") == std::string::npos && value.find("private") == std::string::npos;
+}
+
+HttpResponseCache::Shard &HttpResponseCache::shardFor(const std::string &key)
+{
+    return shards_[std::hash<std::string>()(key) % shardCount_];
+}
+
+HttpResponseCache::Result HttpResponseCache::lookup(const HttpRequest &req, HttpResponse *resp, std::string *key,
+                                                    const Generator &generate)
+{
+    key->clear();
+    if (ttlFor(req) <= 0)
+    {
+        return kMiss;
+    }
+    key->assign(req.path().data(), req.path().size());
+    // query()带着开头的'?'
+    key->append(req.query().data(), req.query().size());
+    for (const std::string &name : varyHeaders_)
+    {
+        StringPiece value = req.getHeader(name);
+        key->push_back('\n');
+        key->append(value.data(), value.size());
+    }
+
+    Shard &shard = shardFor(*key);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(*key);
+    if (it != shard.index.end())
+    {
+        if (Timestamp::monotonicCoarse() < (*it->second)->expires)
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            EntryPtr entry = *it->second;
+            lock.unlock();
+            ++hits_;
+            fill(*entry, resp);
+            return kHit;
+        }
+        erase(shard, it);
+    }
+
+    Timestamp now = Timestamp::monotonicCoarse();
+    auto pending = shard.pending.find(*key);
+    EventLoop *loop = EventLoop::getEventLoopOfCurrentThread();
+    if (pending == shard.pending.end() || !(now < pending->second->deadline) || !loop || !generate)
+    {
+        // 第一个未命中的请求负责生成；之前的生成者超时时由这个请求重新生成，等待者都已经超时。
+        // 不在loop线程中时不能等待，也由自己生成
+        shard.pending[*key] = std::make_shared<Pending>(addTime(now, waitTimeout_));
+        ++misses_;
+        return kMiss;
+    }
+    // 另一个请求正在生成同一个键的响应：登记为等待者，不阻塞当前loop
+    WaiterPtr waiter = addWaiter(shard, *key, req, resp, loop, generate);
+    lock.unlock();
+    key->clear();
+    // 生成者完成时放入当前loop的队列，这之前定时器已经设置好
+    waiter->timer = loop->runAfter(waitTimeout_, std::bind(&HttpResponseCache::resume, this, waiter, EntryPtr()));
+    return kWait;
+}
+
+HttpResponseCache::WaiterPtr HttpResponseCache::addWaiter(Shard &shard, const std::string &key, const HttpRequest &req,
+                                                          HttpResponse *resp, EventLoop *loop, const Generator &generate)
+{
+    WaiterPtr waiter = std::make_shared<Waiter>(loop, resp->defer(), generate);
+    req.copyTo(&waiter->request);
+    shard.pending[key]->waiters.push_back(waiter);
+    return waiter;
+}
+
+// 在等待者的loop中调用：用生成的结果填好响应，或者自己生成（entry为空）
+void HttpResponseCache::resume(const WaiterPtr &waiter, const EntryPtr &entry)
+{
+    if (waiter->done)
+    {
+        // 已经超时（或者已经完成）
+        return;
+    }
+    waiter->done = true;
+    waiter->loop->cancel(waiter->timer);
+    if (entry)
+    {
+        ++hits_;
+        fill(*entry, waiter->writer.response());
+        waiter->writer.complete();
+    }
+    else
+    {
+        // 结果不能缓存或者等待超时，自己调用处理函数，不再登记
+        ++misses_;
+        waiter->generate(waiter->request, waiter->writer);
+    }
+}
+
+void HttpResponseCache::complete(const std::string &key, HttpResponse *resp)
+{
+    EntryPtr entry;
+    double ttl = 0;
+    if (cacheable(*resp))
+    {
+        for (const auto &rule : rules_)
+        {
+            if (StringPiece(key).startsWith(rule.first))
+            {
+                ttl = rule.second;
+                break;
+            }
+        }
+    }
+    if (ttl > 0)
+    {
+        if (!resp->sharedBody())
+        {
+            // 响应体移到共享的字符串中，这个响应和之后命中的响应都不拷贝
+            std::shared_ptr<std::string> body = std::make_shared<std::string>();
+            resp->swapBody(*body);
+            resp->setSharedBody(body);
+        }
+        if (resp->cacheKey().empty())
+        {
+            // 每个条目的内容可能不同，加上编号区分，过期条目的压缩结果由压缩器的LRU淘汰
+            resp->setCacheKey("cache:" + std::to_string(++generation_) + ":" + key);
+        }
+        size_t bytes = key.size() + resp->body().size() + kEntryOverhead;
+        entry = std::make_shared<Entry>(key, *resp, addTime(Timestamp::monotonicCoarse(), ttl), bytes);
+    }
+
+    Shard &shard = shardFor(key);
+    std::vector<WaiterPtr> waiters;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto pending = shard.pending.find(key);
+        if (pending != shard.pending.end())
+        {
+            waiters.swap(pending->second->waiters);
+            shard.pending.erase(pending);
+        }
+        if (entry && entry->bytes <= maxShardBytes_)
+        {
+            insert(shard, entry);
+        }
+    }
+    for (const WaiterPtr &waiter : waiters)
+    {
+        // 总是放入队列：complete()可能正在同一个loop的处理函数中调用
+        waiter->loop->queueInLoop(std::bind(&HttpResponseCache::resume, this, waiter, entry));
+    }
+}
+
+void HttpResponseCache::insert(Shard &shard, const EntryPtr &entry)
+{
+    const std::string &key = entry->key;
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+    {
+        erase(shard, it);
+    }
+    shard.lru.push_front(entry);
+    shard.index[key] = shard.lru.begin();
+    shard.bytes += entry->bytes;
+    while (shard.bytes > maxShardBytes_)
+    {
+        erase(shard, shard.index.find(shard.lru.back()->key));
+    }
+}
+
+void HttpResponseCache::erase(Shard &shard, std::unordered_map<std::string, LruList::iterator>::iterator it)
+{
+    shard.bytes -= (*it->second)->bytes;
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+}
+
+// 用缓存的响应替换处理函数的输出，保留按请求决定的连接和HEAD设置
+void HttpResponseCache::fill(const Entry &entry, HttpResponse *resp)
+{
+    bool close = resp->closeConnection();
+    bool headOnly = resp->headOnly();
+    *resp = entry.response;
+    resp->setCloseConnection(close);
+    resp->setHeadOnly(headOnly);
+}
+
+size_t HttpResponseCache::cachedBytes() const
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < shardCount_; ++i)
+    {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        bytes += shards_[i].bytes;
+    }
+    return bytes;
+}
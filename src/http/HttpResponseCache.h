@@ -0,0 +1,136 @@
+#ifndef HTTP_HTTPRESPONSECACHE_H
+#define HTTP_HTTPRESPONSECACHE_H
+
+#include "noncopyable.h"
+#include "HttpResponse.h"
+#include "ResponseWriter.h"
+#include "Timestamp.h"
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class EventLoop;
+class HttpRequest;
+
+/*
+    HttpResponseCache缓存处理函数生成的响应，命中时HttpServer不调用路由和HttpCallback，直接发送缓存的响应。
+
+    - 哪些请求缓存由规则决定（cache()）：路径以前缀开头的GET/HEAD请求，缓存ttl秒。
+      键是路径、查询参数和varyOn()指定的请求头部的值，HEAD和GET共用同一个条目。
+    - 只缓存200的内存响应；流式响应、文件响应、带"Cache-Control: no-store/private"的响应不缓存。
+    - 按键的哈希分成若干分片，每个分片一把锁、一个LRU链表，总大小不超过maxBytes，过期的条目在查找时丢弃。
+    - 合并并发的未命中：同一个键第一个未命中的请求调用处理函数，同时到达的同一个键的请求
+      变成延迟响应（见ResponseWriter.h）登记为等待者，不阻塞自己的loop。生成者完成以后在每个等待者的loop中
+      用结果填好响应；结果不能缓存、或者等了setWaitTimeout()还没有完成（处理函数抛出异常、延迟响应一直没有完成），
+      等待者用请求的副本自己调用处理函数，超时的生成者之后的请求重新生成。
+    - 命中时响应体是共享的，不拷贝；没有设置cacheKey的响应以条目的键作为压缩缓存的key（见HttpCompressor.h），
+      压缩结果也只计算一次。
+
+    多个subloop共享同一个缓存，由调用者持有，在HttpServer::start()之前设置好规则。
+*/
+class HttpResponseCache : noncopyable
+{
+public:
+    explicit HttpResponseCache(size_t maxBytes = 64 * 1024 * 1024, size_t shards = 16);
+
+    // 缓存路径以pathPrefix开头的请求ttlSeconds秒，先添加的规则优先
+    void cache(const std::string &pathPrefix, double ttlSeconds);
+    // 响应随这个请求头部变化（比如Accept-Language），它的值加入键
+    void varyOn(const std::string &name);
+
+    // 等待者自己生成响应：在等待者的loop中以请求的副本调用，生成以后complete()写入端
+    using Generator = std::function<void(HttpRequest &req, const ResponseWriter &writer)>;
+
+    enum Result
+    {
+        kHit,  // 命中，resp已经填好
+        kMiss, // 未命中，key非空时调用者负责生成这个键的响应
+        kWait, // 另一个请求正在生成，resp已经改成延迟响应，等待结束时在当前loop中完成
+    };
+
+    // 等待生成者的最长时间（默认5秒），超时以后等待者自己生成
+    void setWaitTimeout(double seconds) { waitTimeout_ = seconds; }
+
+    /**
+     * 由HttpServer在loop线程中调用处理函数之前调用。返回kMiss并且key非空时，
+     * 调用者生成响应以后必须调用complete(key, resp)，让等待同一个键的其他请求继续。
+     * 返回kWait时generate可能在之后被调用
+     */
+    Result lookup(const HttpRequest &req, HttpResponse *resp, std::string *key, const Generator &generate);
+    // 处理函数生成了key的响应：可以缓存时把响应体改成共享的并放入缓存，唤醒等待的请求
+    void complete(const std::string &key, HttpResponse *resp);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t cachedBytes() const;
+
+private:
+    struct Entry
+    {
+        Entry(const std::string &k, const HttpResponse &r, Timestamp e, size_t b)
+            : key(k), response(r), expires(e), bytes(b)
+        {
+        }
+
+        std::string key;
+        HttpResponse response; // 响应体是共享的
+        Timestamp expires;
+        size_t bytes;
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+    using LruList = std::list<EntryPtr>;
+
+    // 等待者只在自己的loop线程中访问
+    struct Waiter;
+    using WaiterPtr = std::shared_ptr<Waiter>;
+
+    // 正在生成的键
+    struct Pending
+    {
+        explicit Pending(Timestamp d) : deadline(d) {}
+
+        Timestamp deadline; // 超过这个时间还没有完成，认为生成者已经放弃
+        std::vector<WaiterPtr> waiters;
+    };
+
+    struct Shard
+    {
+        Shard() : bytes(0) {}
+
+        std::mutex mutex;
+        LruList lru; // 最近使用的在前面
+        std::unordered_map<std::string, LruList::iterator> index;
+        std::unordered_map<std::string, std::shared_ptr<Pending>> pending;
+        size_t bytes;
+    };
+
+    // 请求匹配的规则的ttl，不缓存时返回0
+    double ttlFor(const HttpRequest &req) const;
+    bool cacheable(const HttpResponse &resp) const;
+    Shard &shardFor(const std::string &key);
+    void fill(const Entry &entry, HttpResponse *resp);
+    WaiterPtr addWaiter(Shard &shard, const std::string &key, const HttpRequest &req, HttpResponse *resp,
+                        EventLoop *loop, const Generator &generate);
+    void resume(const WaiterPtr &waiter, const EntryPtr &entry);
+    void insert(Shard &shard, const EntryPtr &entry);
+    void erase(Shard &shard, std::unordered_map<std::string, LruList::iterator>::iterator it);
+
+    const size_t maxShardBytes_;
+    std::vector<std::pair<std::string, double>> rules_;
+    std::vector<std::string> varyHeaders_;
+    std::unique_ptr<Shard[]> shards_;
+    const size_t shardCount_;
+    std::atomic<size_t> hits_;
+    std::atomic<size_t> misses_;
+    std::atomic<uint64_t> generation_; // 每个条目一个编号，作为压缩缓存key的一部分
+    double waitTimeout_;
+};
+
+#endif
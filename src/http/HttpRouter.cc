@@ -0,0 +1,237 @@
+#include "HttpRouter.h"
+#include "HttpResponse.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+
+const int kMethodCount = HttpRequest::kDelete + 1;
+
+const char *const kMethodNames[kMethodCount] = {"", "GET", "POST", "HEAD", "PUT", "DELETE"};
+
+} // namespace
+
+struct HttpRouter::Node
+{
+    Node() : hasHandler(false) {}
+
+    std::string prefix;  // 从父节点到这里的静态路径（基数树的边）
+    std::string indices; // 静态子节点前缀的首字符，和children一一对应
+    std::vector<std::unique_ptr<Node>> children;
+    std::unique_ptr<Node> paramChild;    // ":name"
+    std::unique_ptr<Node> wildcardChild; // "*name"
+    std::string paramName;               // 参数节点和通配节点的名字
+    Handler handlers[kMethodCount];      // 按请求方法下标
+    bool hasHandler;
+};
+
+HttpRouter::HttpRouter()
+    : root_(new Node),
+      routes_(0)
+{
+}
+
+HttpRouter::~HttpRouter() = default;
+
+void HttpRouter::addRoute(HttpRequest::Method method, const std::string &pattern, const Handler &handler)
+{
+    if (pattern.empty() || pattern[0] != '/' || method == HttpRequest::kInvalid || !handler)
+    {
+        LOG_FATAL << "HttpRouter::addRoute invalid route " << pattern;
+    }
+
+    Node *node = root_.get();
+    const char *p = pattern.data();
+    const char *end = p + pattern.size();
+    while (p < end)
+    {
+        if (*p == ':' || *p == '*')
+        {
+            bool wildcard = *p == '*';
+            const char *nameEnd = std::find(p + 1, end, '/');
+            // 参数必须是完整的一段，通配段只能在最后
+            if (nameEnd == p + 1 || p[-1] != '/' || (wildcard && nameEnd != end))
+            {
+                LOG_FATAL << "HttpRouter::addRoute invalid parameter in " << pattern;
+            }
+            std::string name(p + 1, nameEnd);
+            std::unique_ptr<Node> &child = wildcard ? node->wildcardChild : node->paramChild;
+            if (!child)
+            {
+                child.reset(new Node);
+                child->paramName = name;
+            }
+            else if (child->paramName != name)
+            {
+                LOG_FATAL << "HttpRouter::addRoute " << pattern << " conflicts with parameter " << child->paramName;
+            }
+            node = child.get();
+            p = nameEnd;
+        }
+        else
+        {
+            const char *next = p;
+            while (next < end && *next != ':' && *next != '*')
+            {
+                ++next;
+            }
+            node = insertStatic(node, p, next);
+            p = next;
+        }
+    }
+
+    if (node->handlers[method])
+    {
+        LOG_FATAL << "HttpRouter::addRoute duplicate route " << kMethodNames[method] << " " << pattern;
+    }
+    node->handlers[method] = handler;
+    node->hasHandler = true;
+    ++routes_;
+}
+
+// 在node下面插入静态路径[begin, end)，返回路径末尾的节点；和已有的边只有部分公共前缀时分裂这条边
+HttpRouter::Node *HttpRouter::insertStatic(Node *node, const char *begin, const char *end)
+{
+    while (begin < end)
+    {
+        size_t i = node->indices.find(*begin);
+        if (i == std::string::npos)
+        {
+            std::unique_ptr<Node> child(new Node);
+            child->prefix.assign(begin, end);
+            node->indices.push_back(*begin);
+            node->children.push_back(std::move(child));
+            return node->children.back().get();
+        }
+
+        Node *child = node->children[i].get();
+        size_t len = std::min(child->prefix.size(), static_cast<size_t>(end - begin));
+        size_t common = 0;
+        while (common < len && child->prefix[common] == begin[common])
+        {
+            ++common;
+        }
+        if (common < child->prefix.size())
+        {
+            // 公共部分成为新的中间节点，原来的节点保留剩下的前缀
+            std::unique_ptr<Node> middle(new Node);
+            middle->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            middle->indices.push_back(child->prefix[0]);
+            middle->children.push_back(std::move(node->children[i]));
+            node->children[i] = std::move(middle);
+            child = node->children[i].get();
+        }
+        node = child;
+        begin += common;
+    }
+    return node;
+}
+
+// node的前缀已经匹配，继续匹配[p, end)；匹配的参数追加到req，失败的分支撤销自己添加的参数
+const HttpRouter::Node *HttpRouter::find(const Node *node, const char *p, const char *end, HttpRequest *req) const
+{
+    if (p == end)
+    {
+        if (node->hasHandler)
+        {
+            return node;
+        }
+        if (node->wildcardChild)
+        {
+            // "/static/"匹配"/static/*path"，通配部分为空
+            req->addParam(node->wildcardChild->paramName, StringPiece(p, static_cast<size_t>(0)));
+            return node->wildcardChild.get();
+        }
+        return nullptr;
+    }
+
+    size_t i = node->indices.find(*p);
+    if (i != std::string::npos)
+    {
+        const Node *child = node->children[i].get();
+        size_t len = child->prefix.size();
+        if (static_cast<size_t>(end - p) >= len && memcmp(p, child->prefix.data(), len) == 0)
+        {
+            const Node *found = find(child, p + len, end, req);
+            if (found)
+            {
+                return found;
+            }
+        }
+    }
+
+    if (node->paramChild && *p != '/')
+    {
+        const char *segmentEnd = static_cast<const char *>(memchr(p, '/', end - p));
+        if (segmentEnd == nullptr)
+        {
+            segmentEnd = end;
+        }
+        req->addParam(node->paramChild->paramName, StringPiece(p, segmentEnd));
+        const Node *found = find(node->paramChild.get(), segmentEnd, end, req);
+        if (found)
+        {
+            return found;
+        }
+        req->popParam();
+    }
+
+    if (node->wildcardChild)
+    {
+        req->addParam(node->wildcardChild->paramName, StringPiece(p, end));
+        return node->wildcardChild.get();
+    }
+    return nullptr;
+}
+
+void HttpRouter::addAsyncRoute(HttpRequest::Method method, const std::string &pattern, const AsyncHttpHandler &handler)
+{
+    // 包装成普通的处理函数：把响应改成延迟响应，写入端交给handler
+    addRoute(method, pattern, [handler](const HttpRequest &req, HttpResponse *resp) {
+        handler(req, resp->defer());
+    });
+}
+
+bool HttpRouter::dispatch(HttpRequest &req, HttpResponse *resp) const
+{
+    StringPiece path = req.path();
+    const Node *node = find(root_.get(), path.begin(), path.end(), &req);
+    if (node == nullptr)
+    {
+        return false;
+    }
+
+    HttpRequest::Method method = req.method();
+    const Handler *handler = &node->handlers[method];
+    if (!*handler && method == HttpRequest::kHead)
+    {
+        // HEAD使用GET的处理函数，HttpServer不发送响应体
+        handler = &node->handlers[HttpRequest::kGet];
+    }
+    if (*handler)
+    {
+        (*handler)(req, resp);
+        return true;
+    }
+
+    std::string allow;
+    for (int m = HttpRequest::kGet; m < kMethodCount; ++m)
+    {
+        if (node->handlers[m] || (m == HttpRequest::kHead && node->handlers[HttpRequest::kGet]))
+        {
+            if (!allow.empty())
+            {
+                allow += ", ";
+            }
+            allow += kMethodNames[m];
+        }
+    }
+    resp->setStatusCode(HttpResponse::k405MethodNotAllowed);
+    resp->setStatusMessage("Method Not Allowed");
+    resp->addHeader("Allow", allow);
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef HTTP_HTTPROUTER_H
+#define HTTP_HTTPROUTER_H
+
+#include "noncopyable.h"
+#include "HttpRequest.h"
+#include "ResponseWriter.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class HttpResponse;
+
+/*
+    HttpRouter把注册的路由编译成一棵基数树（radix tree），按请求方法和路径分派给各自的处理函数。
+
+    路由模式：
+    - 静态段：/api/users
+    - 参数段：/api/users/:id，匹配一个路径段（不含'/'），通过req.param("id")取值
+    - 通配段：'*'开头的段，如/static/后面的*path，只能出现在最后，匹配剩下的全部路径（可以为空）
+
+    树中公共前缀只保存一次，查找时逐字符比较边上的前缀，时间和路径长度成正比，与路由数量无关；
+    参数值是指向请求路径的StringPiece，放在HttpRequest中复用容量的数组里，查找不分配内存。
+    同一位置静态段优先于参数段，参数段优先于通配段，前面的分支匹配失败时回溯尝试后面的分支。
+
+    路径匹配但方法不匹配时回复405（HEAD没有单独注册时使用GET的处理函数）。
+    路由表应该在HttpServer::start()之前注册好，之后只读，多个subloop并发查找不需要加锁。
+*/
+class HttpRouter : noncopyable
+{
+public:
+    using Handler = std::function<void(const HttpRequest &, HttpResponse *)>;
+
+    HttpRouter();
+    ~HttpRouter();
+
+    // 注册路由，模式不合法或者和已有的路由冲突（同一位置参数名不同、重复注册）时LOG_FATAL
+    void addRoute(HttpRequest::Method method, const std::string &pattern, const Handler &handler);
+
+    void get(const std::string &pattern, const Handler &handler) { addRoute(HttpRequest::kGet, pattern, handler); }
+    void post(const std::string &pattern, const Handler &handler) { addRoute(HttpRequest::kPost, pattern, handler); }
+    void put(const std::string &pattern, const Handler &handler) { addRoute(HttpRequest::kPut, pattern, handler); }
+    void del(const std::string &pattern, const Handler &handler) { addRoute(HttpRequest::kDelete, pattern, handler); }
+
+    // 异步处理函数（见ResponseWriter.h）：拿到ResponseWriter以后可以立即返回，响应之后在任意线程完成
+    void addAsyncRoute(HttpRequest::Method method, const std::string &pattern, const AsyncHttpHandler &handler);
+
+    void getAsync(const std::string &pattern, const AsyncHttpHandler &handler) { addAsyncRoute(HttpRequest::kGet, pattern, handler); }
+    void postAsync(const std::string &pattern, const AsyncHttpHandler &handler) { addAsyncRoute(HttpRequest::kPost, pattern, handler); }
+
+    bool empty() const { return routes_ == 0; }
+
+    /**
+     * 查找路由并调用处理函数，路径参数写入req。
+     * 返回false表示没有匹配的路径，由调用者处理（HttpServer交给HttpCallback）
+     */
+    bool dispatch(HttpRequest &req, HttpResponse *resp) const;
+
+private:
+    struct Node;
+
+    Node *insertStatic(Node *node, const char *begin, const char *end);
+    const Node *find(const Node *node, const char *p, const char *end, HttpRequest *req) const;
+
+    std::unique_ptr<Node> root_;
+    size_t routes_;
+};
+
+#endif
@@ -2,8 +2,17 @@
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "HttpContext.h"
+#include "HttpStream.h"
+#include "HttpCompressor.h"
+#include "HttpResponseCache.h"
+#include "ResponseWriter.h"
+#include "Http2Connection.h"
+#include "Http2Frame.h"
 
+#include <algorithm>
 #include <memory>
+#include <stdio.h>
+#include <string.h>
 
 /**
  * 默认的http回调函数
@@ -16,12 +25,42 @@ void defaultHttpCallback(const HttpRequest &, HttpResponse *resp)
     resp->setCloseConnection(true);
 }
 
+// 解析请求出错时的应答，之后关闭连接
+static void appendErrorResponse(Buffer *output, int code)
+{
+    const char *message = "Bad Request";
+    switch (code)
+    {
+    case 413:
+        message = "Payload Too Large";
+        break;
+    case 431:
+        message = "Request Header Fields Too Large";
+        break;
+    case 501:
+        message = "Not Implemented";
+        break;
+    default:
+        code = 400;
+        break;
+    }
+    char buf[128];
+    snprintf(buf, sizeof buf, "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", code, message);
+    output->append(buf);
+}
+
 HttpServer::HttpServer(EventLoop *loop,
                        const InetAddress &listenAddr,
                        const std::string &name,
                        TcpServer::Option option)
     : server_(loop, listenAddr, name, option),
-      httpCallback_(defaultHttpCallback)
+      httpCallback_(defaultHttpCallback),
+      maxBufferedBodySize_(1024 * 1024),
+      maxBodySize_(0),
+      compressor_(nullptr),
+      cache_(nullptr),
+      cacheGenerator_(std::bind(&HttpServer::generateForCache, this, std::placeholders::_1, std::placeholders::_2)),
+      http2Enabled_(true)
 {
     server_.setConnectionCallback(
         std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
@@ -40,11 +79,42 @@ void HttpServer::onConnection(const TcpConnectionPtr &conn)
 {
     if (conn->connected())
     {
-        LOG_INFO << "new Connection arrived";
+        // 每条连接一个解析状态，一个请求分几次到达时接着上次的状态解析
+        std::shared_ptr<HttpContext> context = std::make_shared<HttpContext>();
+        context->setBodyLimits(maxBufferedBodySize_, maxBodySize_);
+        if (bodyCallback_)
+        {
+            // context由连接持有，只能保存连接的裸指针，否则会循环引用
+            TcpConnection *connection = conn.get();
+            context->setBodyCallback([this, connection](const HttpRequest &req, const char *data, size_t len) {
+                bodyCallback_(connection->shared_from_this(), req, data, len);
+            });
+        }
+        conn->setContext(context);
+        // 流式响应的最后一块（比如chunked的结束标志）常常是紧跟在数据后面的小包，
+        // 开着Nagle要等客户端的延迟ACK（40ms）才发出去；普通响应每批只写一次，不受影响
+        conn->setTcpNoDelay(true);
+        LOG_DEBUG << "new Connection arrived";
     }
     else
     {
-        LOG_INFO << "Connection closed";
+        LOG_DEBUG << "Connection closed";
+        // 通知还在写响应体的流式响应
+        HttpContext *context = static_cast<HttpContext *>(conn->getContext().get());
+        if (context && context->http2())
+        {
+            context->http2()->handleClose();
+        }
+        if (context && context->webSocket())
+        {
+            context->webSocket()->handleClose();
+        }
+        if (context && context->responding())
+        {
+            HttpStreamPtr stream = context->responseStream();
+            context->setResponseStream(HttpStreamPtr());
+            stream->handleClose();
+        }
     }
 }
 
@@ -53,54 +123,387 @@ void HttpServer::onMessage(const TcpConnectionPtr &conn,
                            Buffer *buf,
                            Timestamp receiveTime)
 {
-    LOG_INFO << "HttpServer::onMessage";
-    std::unique_ptr<HttpContext> context(new HttpContext);
+    if (!conn->connected())
+    {
+        // 已经决定关闭连接（shutdown以后），之后到达的请求不再处理
+        buf->retrieveAll();
+        return;
+    }
+    HttpContext *context = static_cast<HttpContext *>(conn->getContext().get());
+    if (context->http2())
+    {
+        context->http2()->onMessage(buf, receiveTime);
+        return;
+    }
+    if (context->webSocket())
+    {
+        context->webSocket()->onMessage(buf, receiveTime);
+        return;
+    }
+    if (context->responding() || context->deferred())
+    {
+        // 流式响应或者延迟响应还没有结束，后面的请求留在buf中，响应结束以后再处理（见onStreamFinished、onDeferredComplete）
+        return;
+    }
+
+    // 按顺序处理inputBuffer_中所有完整的请求（pipelining），响应合并成一次发送
+    Buffer output;
+    while (buf->readableBytes() > 0 && conn->connected())
+    {
+        if (http2Enabled_ && context->idle() && buf->peek()[0] == 'P')
+        {
+            // HTTP/2客户端前言"PRI * HTTP/2.0..."，不完整时等待剩下的部分
+            size_t n = std::min(buf->readableBytes(), http2::kClientPrefaceLength);
+            if (memcmp(buf->peek(), http2::kClientPreface, n) == 0)
+            {
+                if (n < http2::kClientPrefaceLength)
+                {
+                    break;
+                }
+                if (output.readableBytes() > 0)
+                {
+                    conn->send(&output);
+                }
+                std::shared_ptr<Http2Connection> http2 = newHttp2Connection(conn);
+                context->setHttp2(http2);
+                http2->start();
+                http2->onMessage(buf, receiveTime);
+                return;
+            }
+        }
+        // 进行状态机解析
+        // 错误则发送 BAD REQUEST 半关闭
+        if (!context->parseRequest(buf, receiveTime))
+        {
+            LOG_DEBUG << "parseRequest failed: " << context->errorCode();
+            appendErrorResponse(&output, context->errorCode());
+            conn->send(&output);
+            conn->shutdown();
+            buf->retrieveAll();
+            return;
+        }
+        if (!context->gotAll())
+        {
+            // 请求不完整，等待更多数据；客户端在等待100 Continue时先回复
+            if (context->takeExpectContinue())
+            {
+                output.append("HTTP/1.1 100 Continue\r\n\r\n");
+            }
+            break;
+        }
+
+        // request中的数据指向buf，处理完以后才能取走
+        bool close = onRequest(conn, context, context->request(), &output);
+        context->finishRequest(buf);
+        if (context->http2())
+        {
+            // 升级到了HTTP/2，之后的数据是HTTP/2的帧
+            context->http2()->onMessage(buf, receiveTime);
+            return;
+        }
+        if (context->webSocket())
+        {
+            // 握手以后客户端可能紧接着发来了帧
+            context->webSocket()->onMessage(buf, receiveTime);
+            return;
+        }
+        if (close)
+        {
+            conn->send(&output);
+            conn->shutdown();
+            buf->retrieveAll();
+            return;
+        }
+        if (context->responding() || context->deferred())
+        {
+            // 开始了流式响应或者延迟响应，之前的响应已经发送
+            break;
+        }
+    }
+    if (output.readableBytes() > 0)
+    {
+        conn->send(&output);
+    }
+}
+
+// 生成响应追加到output，返回是否需要关闭连接
+bool HttpServer::onRequest(const TcpConnectionPtr &conn, HttpContext *context, HttpRequest &req, Buffer *output)
+{
+    if (http2Enabled_ && req.version() == HttpRequest::kHttp11 && req.getHeader("Upgrade").equalsIgnoreCase("h2c"))
+    {
+        // 没有HTTP2-Settings或者格式错误时不升级，按HTTP/1.1处理
+        StringPiece settings = req.getHeader("HTTP2-Settings");
+        if (!settings.empty())
+        {
+            if (output->readableBytes() > 0)
+            {
+                // 101必须排在之前的响应后面
+                conn->send(output);
+            }
+            std::shared_ptr<Http2Connection> http2 = newHttp2Connection(conn);
+            if (http2->upgrade(settings, req))
+            {
+                context->setHttp2(http2);
+                return false;
+            }
+        }
+    }
+
+    if (webSocketCallback_ && WebSocket::isUpgradeRequest(req))
+    {
+        return upgradeWebSocket(conn, context, req, output);
+    }
+
+    StringPiece connection = req.getHeader("Connection");
+
+    // 判断长连接还是短连接：HTTP/1.1默认长连接，HTTP/1.0默认短连接
+    bool close = connection.equalsIgnoreCase("close") ||
+                 (req.version() == HttpRequest::kHttp10 && !connection.equalsIgnoreCase("keep-alive"));
+    // 响应信息
+    HttpResponse response(close);
+    response.setHeadOnly(req.method() == HttpRequest::kHead);
+    handleRequest(req, &response);
+    if (response.deferred())
+    {
+        deferResponse(conn, context, req.version(), &response, output);
+        return false;
+    }
+    return writeResponse(conn, context, req.version(), &response, output);
+}
+
+// 把生成好的响应追加到output（或者开始流式响应），返回是否需要关闭连接
+bool HttpServer::writeResponse(const TcpConnectionPtr &conn, HttpContext *context, HttpRequest::Version version,
+                               HttpResponse *response, Buffer *output)
+{
+    if (!response->closeConnection() && version == HttpRequest::kHttp10)
+    {
+        // HTTP/1.0的长连接需要在响应中确认
+        response->addHeader("Connection", "Keep-Alive");
+    }
+    if (response->streaming())
+    {
+        startStream(conn, context, version, response, output);
+        return false;
+    }
+    response->appendToBuffer(output);
+    if (response->hasBodyFile() && !response->headOnly())
+    {
+        // 已经生成的响应（包括这个响应头）和文件一起发送，之后的响应排在文件之后
+        conn->sendFile(response->fileOwner(), response->fileFd(), response->fileOffset(), response->fileLength(), output);
+    }
+    return response->closeConnection();
+}
 
-#if 0
-        // 打印请求报文
-    std::string request = buf->GetBufferAllAsString();
-    std::cout << request << std::endl;
-#endif
+// 延迟响应：之前的响应先发送，后面的请求等这个响应完成（见onDeferredComplete）
+void HttpServer::deferResponse(const TcpConnectionPtr &conn, HttpContext *context, HttpRequest::Version version,
+                               HttpResponse *response, Buffer *output)
+{
+    if (output->readableBytes() > 0)
+    {
+        conn->send(output);
+    }
+    context->setDeferred(true);
+    response->deferredResponse()->bind(conn->getLoop(),
+                                       std::bind(&HttpServer::onDeferredComplete, this,
+                                                 std::weak_ptr<TcpConnection>(conn), version, std::placeholders::_1));
+}
 
-    // 进行状态机解析
-    // 错误则发送 BAD REQUEST 半关闭
-    if (!context->parseRequest(buf, receiveTime))
+// 延迟响应完成（loop线程）：发送响应，然后继续处理在等待的pipelining请求
+void HttpServer::onDeferredComplete(const std::weak_ptr<TcpConnection> &weakConn, HttpRequest::Version version,
+                                    HttpResponse *response)
+{
+    TcpConnectionPtr conn = weakConn.lock();
+    if (!conn || !conn->connected())
     {
-        LOG_INFO << "parseRequest failed!";
-        conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+        return;
+    }
+    HttpContext *context = static_cast<HttpContext *>(conn->getContext().get());
+    context->setDeferred(false);
+    Buffer output;
+    if (writeResponse(conn, context, version, response, &output))
+    {
+        conn->send(&output);
         conn->shutdown();
+        return;
+    }
+    if (output.readableBytes() > 0)
+    {
+        conn->send(&output);
+    }
+    if (!context->responding() && conn->inputBuffer()->readableBytes() > 0)
+    {
+        onMessage(conn, conn->inputBuffer(), Timestamp::now());
     }
+}
 
-    // 如果成功解析
-    if (context->gotAll())
+void HttpServer::handleRequest(HttpRequest &req, HttpResponse *response)
+{
+    if (!defaultHeaders_.empty())
+    {
+        response->setDefaultHeaders(&defaultHeaders_);
+    }
+    // 缓存命中时直接使用缓存的响应；未命中并且由这个请求负责生成时，生成以后放入缓存；
+    // 另一个请求正在生成时响应变成延迟响应，由缓存在生成完成以后填好（见HttpResponseCache.h）
+    std::string cacheKey;
+    HttpResponseCache::Result result = HttpResponseCache::kMiss;
+    if (cache_)
+    {
+        result = cache_->lookup(req, response, &cacheKey, cacheGenerator_);
+    }
+    if (result == HttpResponseCache::kMiss)
     {
-        LOG_INFO << "parseRequest success!";
-        onRequest(conn, context->request());
-        context->reset();
+        // 先查路由表，没有匹配的路由再交给httpCallback_，怎么写响应由用户决定
+        if (!router_.dispatch(req, response))
+        {
+            httpCallback_(req, response);
+        }
+        if (!cacheKey.empty() && !response->deferred())
+        {
+            cache_->complete(cacheKey, response);
+        }
+    }
+    if (response->deferred())
+    {
+        // 延迟响应在完成时放入缓存（唤醒等待者）、压缩，请求那时已经不在了，先记下需要的字段
+        if (!cacheKey.empty() || compressor_)
+        {
+            StringPiece acceptEncoding = req.getHeader("Accept-Encoding");
+            std::string encoding(acceptEncoding.data(), acceptEncoding.size());
+            bool streamable = req.version() != HttpRequest::kHttp10;
+            HttpResponseCache *cache = cache_;
+            HttpCompressor *compressor = compressor_;
+            response->deferredResponse()->setPrepareCallback(
+                [cache, cacheKey, compressor, encoding, streamable](HttpResponse *resp) {
+                    if (!cacheKey.empty())
+                    {
+                        cache->complete(cacheKey, resp);
+                    }
+                    if (compressor)
+                    {
+                        compressor->apply(encoding, streamable, resp);
+                    }
+                });
+        }
+    }
+    else if (compressor_)
+    {
+        // 可能把响应改成在线程池中压缩的流式响应
+        compressor_->apply(req, response);
     }
 }
 
-// 发送请求
-void HttpServer::onRequest(const TcpConnectionPtr &conn, const HttpRequest &req)
+// 响应缓存的等待者自己生成响应（在等待者的loop中），不经过缓存和压缩：外层的延迟响应完成时再压缩
+void HttpServer::generateForCache(HttpRequest &req, const ResponseWriter &writer)
 {
-    const std::string &connection = req.getHeader("Connection");
+    HttpResponse *response = writer.response();
+    if (!router_.dispatch(req, response))
+    {
+        httpCallback_(req, response);
+    }
+    if (!response->deferred())
+    {
+        writer.complete();
+        return;
+    }
+    // 处理函数也延迟了：它完成时把结果拷贝到外层的响应
+    response->deferredResponse()->bind(EventLoop::getEventLoopOfCurrentThread(), [writer](HttpResponse *inner) {
+        *writer.response() = *inner;
+        writer.complete();
+    });
+}
 
-    // 判断长连接还是短连接
-    bool close = connection == "close" ||
-                 (req.version() == HttpRequest::kHttp10 && connection != "Keep-Alive");
-    // TODO:这里有问题，但是强制改写了
-    close = true;
-    // 响应信息
-    HttpResponse response(close);
-    // httpCallback_ 由用户传入，怎么写响应体由用户决定
-    // 此处初始化了一些response的信息，比如响应码，回复OK
-    httpCallback_(req, &response);
-    Buffer buf;
-    response.appendToBuffer(&buf);
-    // TODO:需要重载 TcpConnection::send 使其可以接收一个缓冲区
-    conn->send(&buf);
-    if (response.closeConnection())
+std::shared_ptr<Http2Connection> HttpServer::newHttp2Connection(const TcpConnectionPtr &conn)
+{
+    // Http2Connection由连接的HttpContext持有，只保存连接的裸指针
+    std::shared_ptr<Http2Connection> http2 = std::make_shared<Http2Connection>(
+        conn.get(), std::bind(&HttpServer::handleRequest, this, std::placeholders::_1, std::placeholders::_2));
+    http2->setBodyLimits(maxBufferedBodySize_, maxBodySize_);
+    if (bodyCallback_)
+    {
+        TcpConnection *connection = conn.get();
+        http2->setBodyCallback([this, connection](const HttpRequest &req, const char *data, size_t len) {
+            bodyCallback_(connection->shared_from_this(), req, data, len);
+        });
+    }
+    return http2;
+}
+
+bool HttpServer::upgradeWebSocket(const TcpConnectionPtr &conn, HttpContext *context, const HttpRequest &req, Buffer *output)
+{
+    if (req.getHeader("Sec-WebSocket-Version") != "13")
+    {
+        output->append("HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\n"
+                       "Content-Length: 0\r\nConnection: close\r\n\r\n");
+        return true;
+    }
+    // Sec-WebSocket-Key是16字节随机数的base64编码
+    StringPiece key = req.getHeader("Sec-WebSocket-Key");
+    if (key.size() != 24 || key[22] != '=' || key[23] != '=')
+    {
+        appendErrorResponse(output, 400);
+        return true;
+    }
+    output->append("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Accept: ");
+    output->append(WebSocket::acceptKey(key));
+    output->append("\r\n\r\n");
+    // 之前的响应和101先发出去，回调中发送的消息排在后面
+    conn->send(output);
+
+    WebSocketPtr webSocket = std::make_shared<WebSocket>(conn);
+    context->setWebSocket(webSocket);
+    webSocketCallback_(req, webSocket);
+    return false;
+}
+
+// 发送流式响应的响应头，把HttpStream交给用户的回调
+void HttpServer::startStream(const TcpConnectionPtr &conn, HttpContext *context, HttpRequest::Version version,
+                             HttpResponse *response, Buffer *output)
+{
+    // HTTP/1.0不支持chunked，响应体以关闭连接结束
+    bool chunked = version == HttpRequest::kHttp11;
+    if (!chunked)
+    {
+        response->setCloseConnection(true);
+    }
+    response->setChunked(chunked);
+    response->appendToBuffer(output);
+    // 同一批pipelining请求之前的响应和这个响应头先发送，响应体随后由HttpStream写入
+    conn->send(output);
+
+    HttpStreamPtr stream = std::make_shared<HttpStream>(conn, chunked);
+    std::weak_ptr<HttpStream> weakStream(stream);
+    conn->setWriteCompleteCallback([weakStream](const TcpConnectionPtr &) {
+        HttpStreamPtr stream = weakStream.lock();
+        if (stream)
+        {
+            stream->handleWriteComplete();
+        }
+    });
+    stream->setFinishCallback(std::bind(&HttpServer::onStreamFinished, this,
+                                        std::weak_ptr<TcpConnection>(conn), response->closeConnection()));
+    context->setResponseStream(stream);
+    response->streamCallback()(stream);
+}
+
+// 流式响应结束（loop线程）：关闭连接，或者继续处理在等待的pipelining请求
+void HttpServer::onStreamFinished(const std::weak_ptr<TcpConnection> &weakConn, bool close)
+{
+    TcpConnectionPtr conn = weakConn.lock();
+    if (!conn)
+    {
+        return;
+    }
+    conn->setWriteCompleteCallback(WriteCompleteCallback());
+    HttpContext *context = static_cast<HttpContext *>(conn->getContext().get());
+    context->setResponseStream(HttpStreamPtr());
+    if (close)
     {
         conn->shutdown();
     }
+    else if (conn->inputBuffer()->readableBytes() > 0)
+    {
+        // 可能是在onMessage的回调中同步结束的，放入队列等onMessage返回以后再处理
+        conn->getLoop()->queueInLoop(std::bind(&HttpServer::onMessage, this, conn, conn->inputBuffer(), Timestamp::now()));
+    }
 }
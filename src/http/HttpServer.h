@@ -4,15 +4,28 @@
 #include "TcpServer.h"
 #include "noncopyable.h"
 #include "Logging.h"
+#include "HttpRouter.h"
+#include "HttpResponse.h"
+#include "WebSocket.h"
+#include "ResponseWriter.h"
 #include <string>
 
 class HttpRequest;
-class HttpResponse;
+class HttpContext;
+class HttpCompressor;
+class HttpResponseCache;
+class Http2Connection;
 
 class HttpServer : noncopyable
 {
 public:
     using HttpCallback = std::function<void(const HttpRequest &, HttpResponse *)>;
+    // 流式接收请求体：每收到一段请求体调用一次，请求体收完以后照常调用HttpCallback（此时req.body()为空）
+    using BodyCallback = std::function<void(const TcpConnectionPtr &, const HttpRequest &, const char *data, size_t len)>;
+    // 异步处理函数（见ResponseWriter.h），响应由ResponseWriter之后在任意线程完成
+    using AsyncHttpCallback = AsyncHttpHandler;
+    // 握手完成（101已经发出）以后调用，在这里设置WebSocket的回调；不接受的连接可以直接close()
+    using WebSocketCallback = std::function<void(const HttpRequest &, const WebSocketPtr &)>;
 
     HttpServer(EventLoop *loop,
                const InetAddress &listenAddr,
@@ -21,11 +34,65 @@ public:
 
     EventLoop *getLoop() const { return server_.getLoop(); }
 
+    // 没有匹配的路由时调用，默认回复404
     void setHttpCallback(const HttpCallback &cb)
     {
         httpCallback_ = cb;
     }
 
+    /**
+     * 没有匹配的路由时交给异步处理函数，代替setHttpCallback()：处理函数可以立即返回，
+     * 比如把数据库查询交给线程池，查询完成以后再通过ResponseWriter回复。
+     * 响应完成之前连接保持打开，同一连接上后面的请求等它发送以后才处理
+     */
+    void setAsyncHttpCallback(const AsyncHttpCallback &cb)
+    {
+        httpCallback_ = [cb](const HttpRequest &req, HttpResponse *resp) {
+            cb(req, resp->defer());
+        };
+    }
+
+    // 路由表（见HttpRouter.h），在start()之前注册
+    HttpRouter &router() { return router_; }
+
+    // 每个响应都带上的头部（比如Server），预先序列化好，在start()之前添加
+    void addResponseHeader(const StringPiece &name, const StringPiece &value)
+    {
+        defaultHeaders_.add(name, value);
+    }
+
+    /**
+     * 请求体的处理方式（见HttpContext.h）：不超过maxBufferedBodySize（默认1MB）的请求体缓存以后通过req.body()访问；
+     * 更大的请求体设置了BodyCallback时流式交给回调，否则回复413。超过maxBodySize（默认0，不限制）的请求体都回复413
+     */
+    void setMaxBufferedBodySize(size_t bytes) { maxBufferedBodySize_ = bytes; }
+    void setMaxBodySize(size_t bytes) { maxBodySize_ = bytes; }
+    void setBodyCallback(const BodyCallback &cb) { bodyCallback_ = cb; }
+
+    // 按Accept-Encoding压缩响应（见HttpCompressor.h），compressor由调用者持有，在start()之前设置
+    void setCompressor(HttpCompressor *compressor) { compressor_ = compressor; }
+
+    // 响应缓存（见HttpResponseCache.h），命中时不调用路由和HttpCallback；cache由调用者持有，在start()之前设置
+    void setResponseCache(HttpResponseCache *cache) { cache_ = cache; }
+
+    /**
+     * 明文HTTP/2（h2c，见Http2Connection.h），默认打开：连接以HTTP/2客户端前言开头（prior knowledge），
+     * 或者HTTP/1.1请求带着"Upgrade: h2c"时切换到HTTP/2，请求交给同样的路由表和HttpCallback
+     */
+    void setHttp2Enabled(bool on) { http2Enabled_ = on; }
+
+    /**
+     * WebSocket（见WebSocket.h）：设置以后，HTTP/1.1的GET请求带着"Upgrade: websocket"时完成握手，
+     * 连接切换成WebSocket帧；没有设置时这样的请求按普通请求处理
+     */
+    void setWebSocketCallback(const WebSocketCallback &cb) { webSocketCallback_ = cb; }
+
+    // subloop个数，默认4个
+    void setThreadNum(int numThreads)
+    {
+        server_.setThreadNum(numThreads);
+    }
+
     void start();
 
 private:
@@ -33,10 +100,35 @@ private:
     void onMessage(const TcpConnectionPtr &conn,
                    Buffer *buf,
                    Timestamp receiveTime);
-    void onRequest(const TcpConnectionPtr &, const HttpRequest &);
+    bool onRequest(const TcpConnectionPtr &conn, HttpContext *context, HttpRequest &req, Buffer *output);
+    // 生成响应（路由、HttpCallback、压缩），HTTP/1.1和HTTP/2共用
+    void handleRequest(HttpRequest &req, HttpResponse *response);
+    void generateForCache(HttpRequest &req, const ResponseWriter &writer);
+    std::shared_ptr<Http2Connection> newHttp2Connection(const TcpConnectionPtr &conn);
+    // WebSocket握手，返回是否需要关闭连接
+    bool upgradeWebSocket(const TcpConnectionPtr &conn, HttpContext *context, const HttpRequest &req, Buffer *output);
+    bool writeResponse(const TcpConnectionPtr &conn, HttpContext *context, HttpRequest::Version version,
+                       HttpResponse *response, Buffer *output);
+    void deferResponse(const TcpConnectionPtr &conn, HttpContext *context, HttpRequest::Version version,
+                       HttpResponse *response, Buffer *output);
+    void onDeferredComplete(const std::weak_ptr<TcpConnection> &weakConn, HttpRequest::Version version,
+                            HttpResponse *response);
+    void startStream(const TcpConnectionPtr &conn, HttpContext *context, HttpRequest::Version version,
+                     HttpResponse *response, Buffer *output);
+    void onStreamFinished(const std::weak_ptr<TcpConnection> &weakConn, bool close);
 
     TcpServer server_;
+    HttpRouter router_;
+    HttpHeaderBlock defaultHeaders_;
     HttpCallback httpCallback_;
+    BodyCallback bodyCallback_;
+    WebSocketCallback webSocketCallback_;
+    size_t maxBufferedBodySize_;
+    size_t maxBodySize_;
+    HttpCompressor *compressor_;
+    HttpResponseCache *cache_;
+    std::function<void(HttpRequest &, const ResponseWriter &)> cacheGenerator_; // 缓存的等待者自己生成响应
+    bool http2Enabled_;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "HttpStream.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+
+#include <stdio.h>
+
+HttpStream::HttpStream(const TcpConnectionPtr &conn, bool chunked)
+    : loop_(conn->getLoop()),
+      conn_(conn),
+      chunked_(chunked),
+      highWaterMark_(kDefaultHighWaterMark),
+      queued_(0),
+      outputBytes_(0),
+      wantWritable_(false),
+      finished_(false),
+      closed_(false)
+{
+}
+
+HttpStream::HttpStream(const TcpConnectionPtr &conn, const Sink &sink)
+    : loop_(conn->getLoop()),
+      conn_(conn),
+      chunked_(false),
+      sink_(sink),
+      highWaterMark_(kDefaultHighWaterMark),
+      queued_(0),
+      outputBytes_(0),
+      wantWritable_(false),
+      finished_(false),
+      closed_(false)
+{
+}
+
+bool HttpStream::write(const StringPiece &data)
+{
+    if (finished_ || closed_)
+    {
+        return false;
+    }
+    if (data.empty())
+    {
+        // 空的chunk是响应体的结束标志，不能发送
+        return writable();
+    }
+
+    std::string frame;
+    if (chunked_)
+    {
+        char header[32];
+        int n = snprintf(header, sizeof header, "%zx\r\n", data.size());
+        frame.reserve(n + data.size() + 2);
+        frame.append(header, n);
+        frame.append(data.data(), data.size());
+        frame.append("\r\n", 2);
+    }
+    else
+    {
+        frame.assign(data.data(), data.size());
+    }
+
+    queued_ += frame.size();
+    if (loop_->isInLoopThread())
+    {
+        sendInLoop(frame);
+    }
+    else
+    {
+        loop_->queueInLoop(std::bind(&HttpStream::sendInLoop, shared_from_this(), std::move(frame)));
+    }
+
+    if (writable())
+    {
+        return true;
+    }
+    wantWritable_ = true;
+    // 设置标志的同时积压的数据可能刚好写完：能自己取回标志就继续写，否则等WritableCallback
+    return writable() && wantWritable_.exchange(false);
+}
+
+void HttpStream::finish()
+{
+    if (finished_.exchange(true))
+    {
+        return;
+    }
+    // 和write()一样经过loop的队列，保证在之前的数据之后发送
+    if (loop_->isInLoopThread())
+    {
+        finishInLoop();
+    }
+    else
+    {
+        loop_->queueInLoop(std::bind(&HttpStream::finishInLoop, shared_from_this()));
+    }
+}
+
+bool HttpStream::writable() const
+{
+    return !closed_ && !finished_ && queued_ + outputBytes_ < highWaterMark_;
+}
+
+void HttpStream::sendInLoop(const std::string &frame)
+{
+    queued_ -= frame.size();
+    TcpConnectionPtr conn = conn_.lock();
+    if (conn && conn->connected())
+    {
+        size_t backlog = 0;
+        if (sink_)
+        {
+            backlog = sink_(frame, false);
+        }
+        else
+        {
+            conn->send(frame);
+        }
+        outputBytes_ = backlog + conn->outputBuffer()->readableBytes();
+    }
+}
+
+void HttpStream::finishInLoop()
+{
+    TcpConnectionPtr conn = conn_.lock();
+    if (sink_ && conn && conn->connected())
+    {
+        sink_(StringPiece(), true);
+    }
+    else if (chunked_ && conn && conn->connected())
+    {
+        // 最后一个chunk，没有trailer
+        conn->send(std::string("0\r\n\r\n"));
+    }
+    // 回调可能持有流本身，结束以后释放，打破循环引用
+    writableCallback_ = Callback();
+    closeCallback_ = Callback();
+    std::function<void()> cb;
+    cb.swap(finishCallback_);
+    if (cb)
+    {
+        cb();
+    }
+}
+
+void HttpStream::handleWriteComplete()
+{
+    outputBytes_ = 0;
+    if (writable() && wantWritable_.exchange(false) && writableCallback_)
+    {
+        // 回调中可能finish()并清空writableCallback_，先拷贝一份
+        Callback cb = writableCallback_;
+        cb(shared_from_this());
+    }
+}
+
+void HttpStream::handleClose()
+{
+    if (closed_.exchange(true))
+    {
+        return;
+    }
+    wantWritable_ = false;
+    writableCallback_ = Callback();
+    finishCallback_ = std::function<void()>();
+    Callback cb;
+    cb.swap(closeCallback_);
+    if (cb)
+    {
+        cb(shared_from_this());
+    }
+}
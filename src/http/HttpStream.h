@@ -0,0 +1,91 @@
+#ifndef HTTP_HTTPSTREAM_H
+#define HTTP_HTTPSTREAM_H
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "StringPiece.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+class EventLoop;
+class HttpStream;
+using HttpStreamPtr = std::shared_ptr<HttpStream>;
+
+/*
+    HttpStream是流式响应的响应体写入端（见HttpResponse::setStreamCallback）：
+    响应头已经发出，之后每次write()发送一段响应体，finish()结束响应。
+    HTTP/1.1使用Transfer-Encoding: chunked，每次write()是一个chunk；HTTP/1.0没有chunked，
+    响应体写完以后关闭连接。HTTP/2由Http2Connection通过Sink把数据分成DATA帧发送。
+
+    write()/finish()可以在任意线程调用，但同一个流只能有一个写入者，保证各段的顺序。
+    背压：连接输出缓冲区中的数据加上跨线程排队中的数据超过高水位时writable()返回false，
+    写入者应该暂停，等输出缓冲区写完（TcpConnection的写完成回调）以后在loop线程中调用WritableCallback。
+    响应结束或者连接断开之前连接一直持有HttpStream，写入者只在WritableCallback里继续写也不会被释放；
+    必须调用finish()，否则同一连接上后面的请求永远得不到处理。
+*/
+class HttpStream : noncopyable, public std::enable_shared_from_this<HttpStream>
+{
+public:
+    using Callback = std::function<void(const HttpStreamPtr &)>;
+
+    // 默认高水位1MB
+    static const size_t kDefaultHighWaterMark = 1024 * 1024;
+
+    /**
+     * 由协议层组帧（HTTP/2）：在loop线程中以每段响应体调用，end为true表示响应结束（data为空）；
+     * 返回协议层积压的、还没有写入连接的字节数（比如等待流量控制窗口的数据），计入背压
+     */
+    using Sink = std::function<size_t(const StringPiece &data, bool end)>;
+
+    HttpStream(const TcpConnectionPtr &conn, bool chunked);
+    HttpStream(const TcpConnectionPtr &conn, const Sink &sink);
+
+    /**
+     * 发送一段响应体，返回之后是否还可以继续写（同writable()）。
+     * 返回false时数据也已经接受，只是写入者应该等WritableCallback再继续；连接已经断开或者已经finish()时数据被丢弃
+     */
+    bool write(const StringPiece &data);
+    // 结束响应，之后的write()都被忽略
+    void finish();
+
+    bool writable() const;
+    // 连接已经断开
+    bool closed() const { return closed_; }
+    bool finished() const { return finished_; }
+    EventLoop *getLoop() const { return loop_; }
+
+    // 以下回调都在连接的loop线程中调用，要在开始写之前设置
+    void setWritableCallback(const Callback &cb) { writableCallback_ = cb; }
+    void setCloseCallback(const Callback &cb) { closeCallback_ = cb; }
+    void setHighWaterMark(size_t bytes) { highWaterMark_ = bytes; }
+
+    // 以下由HttpServer在loop线程中调用
+    void setFinishCallback(const std::function<void()> &cb) { finishCallback_ = cb; }
+    void handleWriteComplete();
+    void handleClose();
+
+private:
+    void sendInLoop(const std::string &frame);
+    void finishInLoop();
+
+    EventLoop *loop_;
+    std::weak_ptr<TcpConnection> conn_; // 流不延长连接的生命周期
+    const bool chunked_;
+    const Sink sink_;
+    size_t highWaterMark_;
+
+    std::atomic<size_t> queued_;       // 其他线程write()还没有进入loop线程的字节数
+    std::atomic<size_t> outputBytes_;  // 最近一次发送以后连接输出缓冲区中的字节数
+    std::atomic<bool> wantWritable_;   // 写入者在等待WritableCallback
+    std::atomic<bool> finished_;
+    std::atomic<bool> closed_;
+
+    Callback writableCallback_;
+    Callback closeCallback_;
+    std::function<void()> finishCallback_;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "ResponseWriter.h"
+#include "EventLoop.h"
+
+DeferredResponse::DeferredResponse(const HttpResponse &response)
+    : loop_(nullptr),
+      completed_(false),
+      response_(response)
+{
+}
+
+DeferredResponse::~DeferredResponse()
+{
+    if (!completed_ && loop_)
+    {
+        // 写入端都释放了还没有完成：回复500，之后的请求可以继续处理。
+        // 同样先经过prepareCallback_，等待同一个缓存键的请求不会一直等下去
+        HttpResponse response(response_.closeConnection());
+        response.setStatusCode(HttpResponse::k500InternalServerError);
+        response.setHeadOnly(response_.headOnly());
+        Callback prepare = prepareCallback_;
+        Callback cb = sendCallback_;
+        loop_->queueInLoop([prepare, cb, response]() mutable {
+            if (prepare)
+            {
+                prepare(&response);
+            }
+            cb(&response);
+        });
+    }
+}
+
+void DeferredResponse::complete()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (completed_)
+    {
+        return;
+    }
+    completed_ = true;
+    if (loop_)
+    {
+        // 在loop线程中调用时也放入队列：可能正在处理同一条连接的消息
+        loop_->queueInLoop(std::bind(&DeferredResponse::send, shared_from_this()));
+    }
+}
+
+void DeferredResponse::bind(EventLoop *loop, const Callback &cb)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    sendCallback_ = cb;
+    loop_ = loop;
+    if (completed_)
+    {
+        // 处理函数返回之前就完成了
+        loop_->queueInLoop(std::bind(&DeferredResponse::send, shared_from_this()));
+    }
+}
+
+void DeferredResponse::send()
+{
+    if (prepareCallback_)
+    {
+        prepareCallback_(&response_);
+    }
+    sendCallback_(&response_);
+}
@@ -0,0 +1,80 @@
+#ifndef HTTP_RESPONSEWRITER_H
+#define HTTP_RESPONSEWRITER_H
+
+#include "noncopyable.h"
+#include "HttpResponse.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+class EventLoop;
+class HttpRequest;
+
+/*
+    DeferredResponse是延迟响应的共享状态（见HttpResponse::defer()）：处理函数返回时响应还没有生成，
+    之后由ResponseWriter在任意线程填写并complete()，在连接的loop线程中发送。
+
+    HttpServer在处理函数返回以后bind()发送的方法，complete()可以在bind()之前或者之后发生：
+    两者都到齐以后把发送放入loop的队列。所有ResponseWriter都释放了还没有complete()时回复500，
+    连接不会一直等下去。连接在完成之前断开时响应被丢弃。
+*/
+class DeferredResponse : noncopyable, public std::enable_shared_from_this<DeferredResponse>
+{
+public:
+    // 在loop线程中处理完成的响应
+    using Callback = std::function<void(HttpResponse *)>;
+
+    // response是处理函数开始时的响应（带着HttpServer设置的默认头部、连接和HEAD设置）
+    explicit DeferredResponse(const HttpResponse &response);
+    ~DeferredResponse();
+
+    HttpResponse *response() { return &response_; }
+    // 可以在任意线程调用，只有第一次有效
+    void complete();
+
+    // 以下由HttpServer和Http2Connection在loop线程中调用
+    // 发送之前先调用cb（比如放入响应缓存、压缩），要在bind()之前设置
+    void setPrepareCallback(const Callback &cb) { prepareCallback_ = cb; }
+    // 完成以后在loop中调用cb发送响应
+    void bind(EventLoop *loop, const Callback &cb);
+
+private:
+    void send();
+
+    std::mutex mutex_;
+    EventLoop *loop_;
+    bool completed_;
+    HttpResponse response_;
+    Callback prepareCallback_;
+    Callback sendCallback_;
+};
+
+/*
+    ResponseWriter是延迟响应的写入端，可以拷贝，所有拷贝指向同一个响应。
+    处理函数拿到它以后可以立即返回，比如把数据库查询交给线程池，查询完成时在线程池中填写响应并complete()。
+    同一条HTTP/1.1连接上后面的请求（pipelining）等这个响应发送以后才处理，响应的顺序不变；
+    HTTP/2的其他流不受影响。
+*/
+class ResponseWriter
+{
+public:
+    explicit ResponseWriter(const std::shared_ptr<DeferredResponse> &state)
+        : state_(state)
+    {
+    }
+
+    // complete()之前填写，同一时刻只能有一个线程访问
+    HttpResponse *response() const { return state_->response(); }
+    HttpResponse *operator->() const { return state_->response(); }
+    // 响应已经填好，交给连接的loop线程发送
+    void complete() const { state_->complete(); }
+
+private:
+    std::shared_ptr<DeferredResponse> state_;
+};
+
+// 异步处理函数：req只在调用期间有效（HTTP/1.1的请求指向连接的输入缓冲区），之后要用的字段先拷贝
+using AsyncHttpHandler = std::function<void(const HttpRequest &, ResponseWriter)>;
+
+#endif
@@ -0,0 +1,595 @@
+#include "StaticFileHandler.h"
+#include "HttpCompressor.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Timestamp.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+struct ContentType
+{
+    const char *extension;
+    const char *type;
+};
+
+const ContentType kContentTypes[] = {
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"css", "text/css; charset=utf-8"},
+    {"js", "application/javascript; charset=utf-8"},
+    {"json", "application/json"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"xml", "application/xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"svg", "image/svg+xml"},
+    {"ico", "image/x-icon"},
+    {"webp", "image/webp"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"wasm", "application/wasm"},
+    {"pdf", "application/pdf"},
+    {"mp4", "video/mp4"},
+};
+
+const char *contentTypeOf(const std::string &path)
+{
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        const char *extension = path.c_str() + dot + 1;
+        for (const ContentType &type : kContentTypes)
+        {
+            if (::strcasecmp(extension, type.extension) == 0)
+            {
+                return type.type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+// RFC 7231的IMF-fixdate格式：Sun, 06 Nov 1994 08:49:37 GMT
+std::string formatHttpDate(time_t t)
+{
+    struct tm tm;
+    ::gmtime_r(&t, &tm);
+    char buf[64];
+    size_t n = ::strftime(buf, sizeof buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, n);
+}
+
+bool parseHttpDate(StringPiece value, time_t *t)
+{
+    char buf[64];
+    if (value.size() >= sizeof buf)
+    {
+        return false;
+    }
+    memcpy(buf, value.data(), value.size());
+    buf[value.size()] = '\0';
+    struct tm tm;
+    memset(&tm, 0, sizeof tm);
+    const char *end = ::strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == nullptr || *end != '\0')
+    {
+        return false;
+    }
+    *t = ::timegm(&tm);
+    return true;
+}
+
+// If-None-Match是逗号分隔的ETag列表或者"*"，按弱比较（忽略W/前缀）
+bool etagMatches(StringPiece header, const std::string &etag)
+{
+    while (!header.empty())
+    {
+        while (!header.empty() && (header[0] == ' ' || header[0] == '\t' || header[0] == ','))
+        {
+            header.removePrefix(1);
+        }
+        const char *comma = static_cast<const char *>(memchr(header.data(), ',', header.size()));
+        StringPiece tag(header.data(), comma ? comma : header.end());
+        header.removePrefix(tag.size());
+        while (!tag.empty() && (tag[tag.size() - 1] == ' ' || tag[tag.size() - 1] == '\t'))
+        {
+            tag.removeSuffix(1);
+        }
+        if (tag == "*")
+        {
+            return true;
+        }
+        if (tag.startsWith("W/"))
+        {
+            tag.removePrefix(2);
+        }
+        if (!tag.empty() && tag == etag)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+enum RangeResult
+{
+    kNoRange,         // 没有Range或者不支持的格式（多个区间），返回整个文件
+    kSatisfiable,
+    kNotSatisfiable,
+};
+
+bool parseOffset(StringPiece digits, off_t *value)
+{
+    if (digits.empty() || digits.size() > 18)
+    {
+        return false;
+    }
+    off_t v = 0;
+    for (size_t i = 0; i < digits.size(); ++i)
+    {
+        if (digits[i] < '0' || digits[i] > '9')
+        {
+            return false;
+        }
+        v = v * 10 + (digits[i] - '0');
+    }
+    *value = v;
+    return true;
+}
+
+// 解析"bytes=first-last"、"bytes=first-"、"bytes=-suffix"，结果是闭区间[*first, *last]
+RangeResult parseRange(StringPiece range, off_t size, off_t *first, off_t *last)
+{
+    if (!range.startsWith("bytes="))
+    {
+        return kNoRange;
+    }
+    range.removePrefix(6);
+    if (memchr(range.data(), ',', range.size()) != nullptr)
+    {
+        return kNoRange;
+    }
+    const char *dash = static_cast<const char *>(memchr(range.data(), '-', range.size()));
+    if (dash == nullptr)
+    {
+        return kNoRange;
+    }
+    StringPiece from(range.data(), dash);
+    StringPiece to(dash + 1, range.end());
+    off_t a = 0;
+    off_t b = 0;
+    if (from.empty())
+    {
+        // 最后b个字节
+        if (!parseOffset(to, &b))
+        {
+            return kNoRange;
+        }
+        if (b == 0 || size == 0)
+        {
+            return kNotSatisfiable;
+        }
+        *first = b >= size ? 0 : size - b;
+        *last = size - 1;
+        return kSatisfiable;
+    }
+    if (!parseOffset(from, &a) || (!to.empty() && !parseOffset(to, &b)))
+    {
+        return kNoRange;
+    }
+    if (to.empty() || b >= size)
+    {
+        b = size - 1;
+    }
+    if (a >= size)
+    {
+        return kNotSatisfiable;
+    }
+    if (b < a)
+    {
+        return kNoRange;
+    }
+    *first = a;
+    *last = b;
+    return kSatisfiable;
+}
+
+// 读出整个文件，用于压缩
+bool readAll(int fd, off_t size, std::string *out)
+{
+    out->resize(static_cast<size_t>(size));
+    size_t done = 0;
+    while (done < out->size())
+    {
+        ssize_t n = ::pread(fd, &(*out)[done], out->size() - done, static_cast<off_t>(done));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+void setError(HttpResponse *resp, HttpResponse::HttpStatusCode code, const char *message)
+{
+    resp->setStatusCode(code);
+    resp->setStatusMessage(message);
+    resp->setContentType("text/plain; charset=utf-8");
+    resp->setBody(std::string(message) + "\n");
+}
+
+} // namespace
+
+StaticFileHandler::File::~File()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+StaticFileHandler::StaticFileHandler(const std::string &urlPrefix,
+                                     const std::string &root,
+                                     size_t maxOpenFiles)
+    : prefix_(urlPrefix),
+      root_(root),
+      maxOpenFiles_(maxOpenFiles),
+      revalidateInterval_(1.0),
+      compressor_(nullptr)
+{
+}
+
+bool StaticFileHandler::handle(const HttpRequest &req, HttpResponse *resp)
+{
+    StringPiece urlPath = req.path();
+    if (!urlPath.startsWith(prefix_))
+    {
+        return false;
+    }
+    if (req.method() != HttpRequest::kGet && req.method() != HttpRequest::kHead)
+    {
+        setError(resp, HttpResponse::k405MethodNotAllowed, "Method Not Allowed");
+        resp->addHeader("Allow", "GET, HEAD");
+        return true;
+    }
+
+    urlPath.removePrefix(prefix_.size());
+    std::string path;
+    if (!resolvePath(urlPath, &path))
+    {
+        setError(resp, HttpResponse::k403Forbidden, "Forbidden");
+        return true;
+    }
+    FilePtr file = getFile(path);
+    if (!file && errno == EISDIR)
+    {
+        path += "/index.html";
+        file = getFile(path);
+    }
+    if (!file)
+    {
+        if (errno == EACCES)
+        {
+            setError(resp, HttpResponse::k403Forbidden, "Forbidden");
+        }
+        else
+        {
+            setError(resp, HttpResponse::k404NotFound, "Not Found");
+        }
+        return true;
+    }
+
+    // 压缩版本是同一个资源的另一种表示，ETag不能和原文相同
+    HttpCompressor::Result compressed;
+    HttpCompressor::Encoding encoding = HttpCompressor::kIdentity;
+    std::string compressedEtag;
+    const std::string *etag = &file->etag;
+    if (compressor_ && file->size <= kMaxCompressFileSize &&
+        compressor_->compressible(file->contentType, static_cast<size_t>(file->size)))
+    {
+        resp->addHeader("Vary", "Accept-Encoding");
+        encoding = HttpCompressor::negotiate(req.getHeader("Accept-Encoding"));
+        if (encoding != HttpCompressor::kIdentity && req.getHeader("Range").empty())
+        {
+            compressed = getCompressed(path, file, encoding);
+        }
+        if (compressed && !compressed->empty())
+        {
+            compressedEtag.assign(file->etag, 0, file->etag.size() - 1);
+            compressedEtag += '-';
+            compressedEtag += HttpCompressor::encodingName(encoding);
+            compressedEtag += '"';
+            etag = &compressedEtag;
+        }
+    }
+
+    resp->addHeader("Last-Modified", file->lastModified);
+    resp->addHeader("ETag", *etag);
+
+    // 条件请求：有If-None-Match时忽略If-Modified-Since
+    StringPiece ifNoneMatch = req.getHeader("If-None-Match");
+    StringPiece ifModifiedSince = req.getHeader("If-Modified-Since");
+    time_t since = 0;
+    if ((!ifNoneMatch.empty() && etagMatches(ifNoneMatch, *etag)) ||
+        (ifNoneMatch.empty() && !ifModifiedSince.empty() &&
+         parseHttpDate(ifModifiedSince, &since) && file->mtime <= since))
+    {
+        resp->setStatusCode(HttpResponse::k304NotModified);
+        resp->setStatusMessage("Not Modified");
+        return true;
+    }
+
+    resp->setContentType(file->contentType);
+    if (etag == &compressedEtag)
+    {
+        resp->setStatusCode(HttpResponse::k200Ok);
+        resp->setStatusMessage("OK");
+        resp->addHeader("Content-Encoding", HttpCompressor::encodingName(encoding));
+        // 缓存中的压缩结果直接共享，不拷贝
+        resp->setSharedBody(compressed);
+        return true;
+    }
+    resp->addHeader("Accept-Ranges", "bytes");
+    off_t first = 0;
+    off_t last = file->size - 1;
+    RangeResult range = kNoRange;
+    StringPiece rangeHeader = req.getHeader("Range");
+    if (!rangeHeader.empty())
+    {
+        // If-Range不匹配说明客户端手中的部分已经过期，返回整个文件
+        StringPiece ifRange = req.getHeader("If-Range");
+        if (ifRange.empty() || ifRange == file->etag || ifRange == file->lastModified)
+        {
+            range = parseRange(rangeHeader, file->size, &first, &last);
+        }
+    }
+
+    char buf[96];
+    if (range == kNotSatisfiable)
+    {
+        setError(resp, HttpResponse::k416RangeNotSatisfiable, "Range Not Satisfiable");
+        snprintf(buf, sizeof buf, "bytes */%lld", static_cast<long long>(file->size));
+        resp->addHeader("Content-Range", buf);
+        return true;
+    }
+    if (range == kSatisfiable)
+    {
+        resp->setStatusCode(HttpResponse::k206PartialContent);
+        resp->setStatusMessage("Partial Content");
+        snprintf(buf, sizeof buf, "bytes %lld-%lld/%lld",
+                 static_cast<long long>(first), static_cast<long long>(last), static_cast<long long>(file->size));
+        resp->addHeader("Content-Range", buf);
+    }
+    else
+    {
+        resp->setStatusCode(HttpResponse::k200Ok);
+        resp->setStatusMessage("OK");
+        first = 0;
+        last = file->size - 1;
+    }
+    resp->setBodyFile(file, file->fd, first, static_cast<size_t>(last - first + 1));
+    return true;
+}
+
+// 取出缓存的压缩内容；没有时小文件直接压缩，大文件交给压缩器的线程池，这一次返回空（发送原文）
+HttpCompressor::Result StaticFileHandler::getCompressed(const std::string &path, const FilePtr &file,
+                                                         HttpCompressor::Encoding encoding)
+{
+    // 文件修改以后ETag会变，旧的压缩结果不再命中，由LRU淘汰
+    std::string key = path + '\n' + file->etag;
+    HttpCompressor::Result result = compressor_->find(key, encoding);
+    if (result)
+    {
+        return result;
+    }
+    if (compressor_->shouldOffload(static_cast<size_t>(file->size)))
+    {
+        // 任务持有file，读取完以前fd不会关闭
+        compressor_->compressInBackground(key, encoding, [file](std::string *data) {
+            return readAll(file->fd, file->size, data);
+        });
+        return result;
+    }
+    std::string data;
+    if (readAll(file->fd, file->size, &data))
+    {
+        result = compressor_->compressAndCache(key, encoding, data.data(), data.size());
+    }
+    return result;
+}
+
+bool StaticFileHandler::resolvePath(StringPiece urlPath, std::string *path) const
+{
+    path->assign(root_);
+    path->push_back('/');
+    size_t segmentStart = path->size();
+    for (size_t i = 0; i <= urlPath.size(); ++i)
+    {
+        char c = i < urlPath.size() ? urlPath[i] : '/';
+        if (c == '%')
+        {
+            int hi = i + 2 < urlPath.size() ? hexValue(urlPath[i + 1]) : -1;
+            int lo = i + 2 < urlPath.size() ? hexValue(urlPath[i + 2]) : -1;
+            if (hi < 0 || lo < 0)
+            {
+                return false;
+            }
+            c = static_cast<char>(hi * 16 + lo);
+            i += 2;
+            if (c == '\0' || c == '/')
+            {
+                // 编码的分隔符可能用来绕过下面的检查
+                return false;
+            }
+        }
+        else if (c == '/')
+        {
+            // 一个路径段结束，不允许".."，"."和空段直接去掉
+            StringPiece segment(path->data() + segmentStart, path->size() - segmentStart);
+            if (segment == "..")
+            {
+                return false;
+            }
+            if (segment.empty() || segment == ".")
+            {
+                path->resize(segmentStart);
+            }
+            else if (i < urlPath.size())
+            {
+                path->push_back('/');
+                segmentStart = path->size();
+            }
+            continue;
+        }
+        path->push_back(c);
+    }
+    // 去掉结尾的'/'，目录由调用者补上index.html
+    while (path->size() > root_.size() + 1 && (*path)[path->size() - 1] == '/')
+    {
+        path->resize(path->size() - 1);
+    }
+    return true;
+}
+
+StaticFileHandler::FilePtr StaticFileHandler::getFile(const std::string &path)
+{
+    int64_t now = Timestamp::monotonicCoarse().microSecondsSinceEpoch();
+    FilePtr file;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(path);
+        if (it != index_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            file = it->second->second;
+        }
+    }
+
+    if (file)
+    {
+        int64_t interval = static_cast<int64_t>(revalidateInterval_ * Timestamp::kMicroSecondsPerSecond);
+        if (now - file->checked < interval)
+        {
+            return file;
+        }
+        // 文件可能被修改或者替换（比如部署时rename），inode和修改时间都没变才继续使用
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0 && st.st_ino == file->ino && st.st_size == file->size &&
+            st.st_mtim.tv_sec == file->mtime && st.st_mtim.tv_nsec == file->mtimeNsec)
+        {
+            file->checked = now;
+            return file;
+        }
+    }
+
+    file = openFile(path);
+    if (file)
+    {
+        file->checked = now;
+        insert(path, file);
+    }
+    else
+    {
+        int savedErrno = errno;
+        erase(path);
+        errno = savedErrno;
+    }
+    return file;
+}
+
+StaticFileHandler::FilePtr StaticFileHandler::openFile(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return FilePtr();
+    }
+    FilePtr file = std::make_shared<File>();
+    file->fd = fd;
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+    {
+        return FilePtr();
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        errno = S_ISDIR(st.st_mode) ? EISDIR : EACCES;
+        return FilePtr();
+    }
+    file->size = st.st_size;
+    file->mtime = st.st_mtim.tv_sec;
+    file->mtimeNsec = st.st_mtim.tv_nsec;
+    file->ino = st.st_ino;
+    file->contentType = contentTypeOf(path);
+    file->lastModified = formatHttpDate(file->mtime);
+    char etag[64];
+    snprintf(etag, sizeof etag, "\"%llx-%llx\"",
+             static_cast<unsigned long long>(file->mtime), static_cast<unsigned long long>(file->size));
+    file->etag = etag;
+    return file;
+}
+
+void StaticFileHandler::insert(const std::string &path, const FilePtr &file)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it != index_.end())
+    {
+        it->second->second = file;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return;
+    }
+    lru_.emplace_front(path, file);
+    index_[path] = lru_.begin();
+    while (lru_.size() > maxOpenFiles_)
+    {
+        // 正在发送的文件由连接持有，发送完才关闭
+        index_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+}
+
+void StaticFileHandler::erase(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it != index_.end())
+    {
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+}
+
+size_t StaticFileHandler::cachedFiles() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
@@ -0,0 +1,95 @@
+#ifndef HTTP_STATICFILEHANDLER_H
+#define HTTP_STATICFILEHANDLER_H
+
+#include "noncopyable.h"
+#include "StringPiece.h"
+#include "HttpCompressor.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <sys/types.h>
+#include <time.h>
+
+class HttpRequest;
+class HttpResponse;
+
+/*
+    静态文件处理：把以urlPrefix开头的请求路径映射到root目录下的文件。
+
+    打开的文件连同stat信息、Last-Modified和ETag字符串缓存在一个LRU中（最多maxOpenFiles个），
+    命中时不需要open/stat，超过revalidateInterval（默认1秒）才重新stat一次，发现文件被修改或替换就重新打开。
+    响应体用sendfile发送（见TcpConnection::sendFile），不经过用户态；淘汰出缓存的文件等正在进行的发送结束以后才关闭。
+
+    支持GET/HEAD、单个区间的Range请求（206/416，多个区间时返回整个文件）、If-Range，
+    以及If-None-Match/If-Modified-Since条件请求（304）。
+    设置了HttpCompressor时，文本类的文件按Accept-Encoding发送压缩版本，压缩结果缓存在压缩器中。
+    多个subloop共享同一个处理器，缓存由一把锁保护，锁内只做查找和链表操作，系统调用都在锁外。
+*/
+class StaticFileHandler : noncopyable
+{
+public:
+    StaticFileHandler(const std::string &urlPrefix,
+                      const std::string &root,
+                      size_t maxOpenFiles = 1024);
+
+    // 请求路径以urlPrefix开头时生成响应并返回true，否则返回false，交给其他处理函数
+    bool handle(const HttpRequest &req, HttpResponse *resp);
+
+    // 缓存的stat信息经过多少秒以后重新检查
+    void setRevalidateInterval(double seconds) { revalidateInterval_ = seconds; }
+
+    size_t cachedFiles() const;
+
+    // 压缩文本类的文件（见HttpCompressor.h），compressor由调用者持有，在start()之前设置
+    void setCompressor(HttpCompressor *compressor) { compressor_ = compressor; }
+
+private:
+    // 超过这个大小的文件不压缩，直接sendfile
+    static const off_t kMaxCompressFileSize = 16 * 1024 * 1024;
+
+    struct File : noncopyable
+    {
+        File() : fd(-1), size(0), mtime(0), mtimeNsec(0), ino(0), checked(0), contentType(nullptr) {}
+        ~File();
+
+        // 除了checked，其他成员在放入缓存以后不再修改
+        int fd;
+        off_t size;
+        time_t mtime;
+        long mtimeNsec;
+        ino_t ino;
+        std::atomic<int64_t> checked; // 上次stat的时间（CLOCK_MONOTONIC_COARSE微秒）
+        const char *contentType;
+        std::string lastModified;
+        std::string etag;
+    };
+    using FilePtr = std::shared_ptr<File>;
+    using LruList = std::list<std::pair<std::string, FilePtr>>;
+
+    // 把URL路径转换为文件路径，路径中有".."或者非法编码时返回false
+    bool resolvePath(StringPiece urlPath, std::string *path) const;
+    // 从缓存中取出文件，不存在或者过期时打开文件；打开失败返回空，errno说明原因
+    FilePtr getFile(const std::string &path);
+    static FilePtr openFile(const std::string &path);
+    HttpCompressor::Result getCompressed(const std::string &path, const FilePtr &file,
+                                         HttpCompressor::Encoding encoding);
+    void insert(const std::string &path, const FilePtr &file);
+    void erase(const std::string &path);
+
+    const std::string prefix_;
+    const std::string root_;
+    const size_t maxOpenFiles_;
+    double revalidateInterval_;
+    HttpCompressor *compressor_;
+
+    mutable std::mutex mutex_;
+    LruList lru_; // 最近使用的在前面
+    std::unordered_map<std::string, LruList::iterator> index_;
+};
+
+#endif
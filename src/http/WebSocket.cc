@@ -0,0 +1,557 @@
+#include "WebSocket.h"
+#include "HttpRequest.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Buffer.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <openssl/sha.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+const char kWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// Close帧的原因短语最长123字节（控制帧负载不超过125字节）
+const size_t kMaxCloseReason = 123;
+// 拼接分片消息的缓冲区超过这个容量时交付以后释放，不为偶尔的大消息一直占着内存
+const size_t kMaxRetainedMessage = 64 * 1024;
+
+/**
+ * 解除掩码：data[i] ^= key[i % 4]。掩码按4字节循环，展开成8字节以后整字（有SSE2时16字节）异或，
+ * 8和16都是4的倍数，相位不变；剩下不足一个字的部分逐字节处理
+ */
+void unmask(char *data, size_t len, const unsigned char key[4])
+{
+    size_t i = 0;
+    if (len >= 8)
+    {
+        unsigned char bytes[8] = {key[0], key[1], key[2], key[3], key[0], key[1], key[2], key[3]};
+        uint64_t mask;
+        memcpy(&mask, bytes, sizeof mask);
+#ifdef __SSE2__
+        const __m128i mask128 = _mm_set1_epi64x(static_cast<long long>(mask));
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i *p = reinterpret_cast<__m128i *>(data + i);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask128));
+        }
+#endif
+        for (; i + 8 <= len; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof word);
+            word ^= mask;
+            memcpy(data + i, &word, sizeof word);
+        }
+    }
+    for (; i < len; ++i)
+    {
+        data[i] = static_cast<char>(data[i] ^ key[i & 3]);
+    }
+}
+
+// 文本消息必须是合法的UTF-8（不允许过长编码和代理对），ASCII部分8字节一起检查
+bool validUtf8(const char *data, size_t len)
+{
+    static const uint32_t kMinCodePoint[4] = {0, 0x80, 0x800, 0x10000};
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(data);
+    size_t i = 0;
+    while (i < len)
+    {
+        if (i + 8 <= len)
+        {
+            uint64_t word;
+            memcpy(&word, s + i, sizeof word);
+            if ((word & 0x8080808080808080ULL) == 0)
+            {
+                i += 8;
+                continue;
+            }
+        }
+        unsigned char c = s[i];
+        if (c < 0x80)
+        {
+            ++i;
+            continue;
+        }
+        size_t n;
+        uint32_t codePoint;
+        if ((c & 0xE0) == 0xC0)
+        {
+            n = 1;
+            codePoint = c & 0x1F;
+        }
+        else if ((c & 0xF0) == 0xE0)
+        {
+            n = 2;
+            codePoint = c & 0x0F;
+        }
+        else if ((c & 0xF8) == 0xF0)
+        {
+            n = 3;
+            codePoint = c & 0x07;
+        }
+        else
+        {
+            return false;
+        }
+        if (len - i <= n)
+        {
+            return false;
+        }
+        for (size_t k = 1; k <= n; ++k)
+        {
+            unsigned char b = s[i + k];
+            if ((b & 0xC0) != 0x80)
+            {
+                return false;
+            }
+            codePoint = (codePoint << 6) | (b & 0x3F);
+        }
+        if (codePoint < kMinCodePoint[n] || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        {
+            return false;
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+// 对端可以发送的关闭码：1004、1005、1006、1015是保留的，1016~2999未分配
+bool validCloseCode(int code)
+{
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) || (code >= 3000 && code <= 4999);
+}
+
+// Connection头部是逗号分隔的列表，比如"keep-alive, Upgrade"
+bool hasToken(StringPiece value, const StringPiece &token)
+{
+    while (!value.empty())
+    {
+        const char *comma = static_cast<const char *>(memchr(value.data(), ',', value.size()));
+        size_t n = comma ? comma - value.data() : value.size();
+        StringPiece item(value.data(), n);
+        while (!item.empty() && (item[0] == ' ' || item[0] == '\t'))
+        {
+            item.removePrefix(1);
+        }
+        while (!item.empty() && (item[item.size() - 1] == ' ' || item[item.size() - 1] == '\t'))
+        {
+            item.removeSuffix(1);
+        }
+        if (item.equalsIgnoreCase(token))
+        {
+            return true;
+        }
+        value.removePrefix(comma ? n + 1 : n);
+    }
+    return false;
+}
+
+std::string encodeBase64(const unsigned char *data, size_t len)
+{
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((len + 2) / 3 * 4);
+    for (size_t i = 0; i < len; i += 3)
+    {
+        uint32_t bits = data[i] << 16;
+        if (i + 1 < len)
+            bits |= data[i + 1] << 8;
+        if (i + 2 < len)
+            bits |= data[i + 2];
+        out.push_back(kAlphabet[(bits >> 18) & 0x3F]);
+        out.push_back(kAlphabet[(bits >> 12) & 0x3F]);
+        out.push_back(i + 1 < len ? kAlphabet[(bits >> 6) & 0x3F] : '=');
+        out.push_back(i + 2 < len ? kAlphabet[bits & 0x3F] : '=');
+    }
+    return out;
+}
+
+} // namespace
+
+WebSocket::WebSocket(const TcpConnectionPtr &conn)
+    : loop_(conn->getLoop()),
+      conn_(conn),
+      maxMessageSize_(kDefaultMaxMessageSize),
+      closeSent_(false),
+      closeReceived_(false),
+      closeCode_(kAbnormalClosure),
+      closed_(false),
+      fragmented_(false),
+      messageOpcode_(kText)
+{
+}
+
+bool WebSocket::isUpgradeRequest(const HttpRequest &req)
+{
+    return req.method() == HttpRequest::kGet &&
+           req.version() == HttpRequest::kHttp11 &&
+           req.getHeader("Upgrade").equalsIgnoreCase("websocket") &&
+           hasToken(req.getHeader("Connection"), "upgrade");
+}
+
+std::string WebSocket::acceptKey(const StringPiece &key)
+{
+    std::string input(key.data(), key.size());
+    input.append(kWebSocketGuid, sizeof kWebSocketGuid - 1);
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char *>(input.data()), input.size(), digest);
+    return encodeBase64(digest, sizeof digest);
+}
+
+std::string WebSocket::makeFrame(Opcode opcode, const StringPiece &payload)
+{
+    size_t len = payload.size();
+    std::string frame;
+    frame.reserve(len + 10);
+    frame.push_back(static_cast<char>(0x80 | opcode)); // 服务端不分片，FIN总是1
+    if (len < 126)
+    {
+        frame.push_back(static_cast<char>(len));
+    }
+    else if (len <= 0xFFFF)
+    {
+        frame.push_back(static_cast<char>(126));
+        frame.push_back(static_cast<char>(len >> 8));
+        frame.push_back(static_cast<char>(len));
+    }
+    else
+    {
+        frame.push_back(static_cast<char>(127));
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            frame.push_back(static_cast<char>(static_cast<uint64_t>(len) >> shift));
+        }
+    }
+    frame.append(payload.data(), len);
+    return frame;
+}
+
+void WebSocket::send(Opcode opcode, const StringPiece &payload)
+{
+    if (closed_)
+    {
+        return;
+    }
+    std::string frame = makeFrame(opcode, payload);
+    if (loop_->isInLoopThread())
+    {
+        sendInLoop(frame);
+    }
+    else
+    {
+        // 和HttpStream一样经过loop的队列，Close帧之后的消息在loop线程中丢弃
+        loop_->queueInLoop(std::bind(&WebSocket::sendInLoop, shared_from_this(), std::move(frame)));
+    }
+}
+
+void WebSocket::sendFrame(const std::shared_ptr<const std::string> &frame)
+{
+    if (closed_)
+    {
+        return;
+    }
+    if (loop_->isInLoopThread())
+    {
+        sendSharedInLoop(frame);
+    }
+    else
+    {
+        loop_->queueInLoop(std::bind(&WebSocket::sendSharedInLoop, shared_from_this(), frame));
+    }
+}
+
+void WebSocket::sendInLoop(const std::string &frame)
+{
+    TcpConnectionPtr conn = conn_.lock();
+    if (!closeSent_ && conn && conn->connected())
+    {
+        conn->send(frame);
+    }
+}
+
+void WebSocket::sendSharedInLoop(const std::shared_ptr<const std::string> &frame)
+{
+    sendInLoop(*frame);
+}
+
+void WebSocket::close(int code, const StringPiece &reason)
+{
+    std::string text(reason.data(), std::min(reason.size(), kMaxCloseReason));
+    if (loop_->isInLoopThread())
+    {
+        closeInLoop(code, text);
+    }
+    else
+    {
+        loop_->queueInLoop(std::bind(&WebSocket::closeInLoop, shared_from_this(), code, std::move(text)));
+    }
+}
+
+// code为0时发送没有关闭码的Close帧（回复没有关闭码的Close帧）
+void WebSocket::closeInLoop(int code, const std::string &reason)
+{
+    if (closeSent_)
+    {
+        return;
+    }
+    closeSent_ = true;
+    closed_ = true;
+    TcpConnectionPtr conn = conn_.lock();
+    if (!conn || !conn->connected())
+    {
+        return;
+    }
+    std::string payload;
+    if (code != 0)
+    {
+        payload.push_back(static_cast<char>(code >> 8));
+        payload.push_back(static_cast<char>(code));
+        payload.append(reason);
+    }
+    conn->send(makeFrame(kClose, payload));
+    if (closeReceived_)
+    {
+        conn->shutdown();
+    }
+    else
+    {
+        // 等对端回复Close，超时强制关闭；连接先断开时定时器什么也不做
+        std::weak_ptr<TcpConnection> weakConn(conn);
+        loop_->runAfter(kCloseTimeoutSeconds, [weakConn]() {
+            TcpConnectionPtr conn = weakConn.lock();
+            if (conn)
+            {
+                conn->forceClose();
+            }
+        });
+    }
+}
+
+bool WebSocket::fail(int code)
+{
+    LOG_DEBUG << "WebSocket protocol error, close with " << code;
+    closeCode_ = code;
+    closeInLoop(code, std::string());
+    TcpConnectionPtr conn = conn_.lock();
+    if (conn)
+    {
+        conn->shutdown();
+    }
+    return false;
+}
+
+void WebSocket::onMessage(Buffer *buf, Timestamp)
+{
+    while (!closeReceived_)
+    {
+        size_t readable = buf->readableBytes();
+        if (readable < 2)
+        {
+            break;
+        }
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(buf->peek());
+        bool fin = (p[0] & 0x80) != 0;
+        Opcode opcode = static_cast<Opcode>(p[0] & 0x0F);
+        uint64_t len = p[1] & 0x7F;
+        size_t headerLength = 2;
+        // 没有协商扩展，RSV位必须是0；客户端的帧必须带掩码
+        if ((p[0] & 0x70) != 0 || (p[1] & 0x80) == 0)
+        {
+            fail(kProtocolError);
+            buf->retrieveAll();
+            return;
+        }
+        if (len == 126)
+        {
+            if (readable < 4)
+            {
+                break;
+            }
+            len = (p[2] << 8) | p[3];
+            headerLength = 4;
+        }
+        else if (len == 127)
+        {
+            if (readable < 10)
+            {
+                break;
+            }
+            len = 0;
+            for (int i = 2; i < 10; ++i)
+            {
+                len = (len << 8) | p[i];
+            }
+            headerLength = 10;
+        }
+        if ((opcode & 0x8) != 0 && (!fin || len > 125))
+        {
+            // 控制帧不能分片，负载不超过125字节
+            fail(kProtocolError);
+            buf->retrieveAll();
+            return;
+        }
+        if (len > maxMessageSize_ || (opcode == kContinuation && message_.size() + len > maxMessageSize_))
+        {
+            fail(kMessageTooBig);
+            buf->retrieveAll();
+            return;
+        }
+        const unsigned char *key = p + headerLength;
+        headerLength += 4;
+        if (readable < headerLength + len)
+        {
+            // 帧不完整，等待剩下的部分
+            break;
+        }
+
+        // 原地解除掩码，没有分片的消息直接指向inputBuffer_交付
+        char *payload = buf->beginRead() + headerLength;
+        unmask(payload, static_cast<size_t>(len), key);
+        if (!onFrame(opcode, fin, payload, static_cast<size_t>(len)))
+        {
+            buf->retrieveAll();
+            return;
+        }
+        buf->retrieve(headerLength + static_cast<size_t>(len));
+    }
+    if (closeReceived_)
+    {
+        // 对端的Close帧之后不应该再有数据；出错关闭以后连接已经shutdown，HttpServer不会再交来数据
+        buf->retrieveAll();
+    }
+}
+
+bool WebSocket::onFrame(Opcode opcode, bool fin, const char *payload, size_t len)
+{
+    switch (opcode)
+    {
+    case kText:
+    case kBinary:
+        if (fragmented_)
+        {
+            // 上一条分片消息还没有结束
+            return fail(kProtocolError);
+        }
+        if (fin)
+        {
+            if (opcode == kText && !validUtf8(payload, len))
+            {
+                return fail(kInvalidPayload);
+            }
+            deliver(opcode, StringPiece(payload, len));
+        }
+        else
+        {
+            fragmented_ = true;
+            messageOpcode_ = opcode;
+            message_.assign(payload, len);
+        }
+        return true;
+    case kContinuation:
+        if (!fragmented_)
+        {
+            return fail(kProtocolError);
+        }
+        message_.append(payload, len);
+        if (fin)
+        {
+            fragmented_ = false;
+            if (messageOpcode_ == kText && !validUtf8(message_.data(), message_.size()))
+            {
+                return fail(kInvalidPayload);
+            }
+            deliver(messageOpcode_, message_);
+            if (message_.capacity() > kMaxRetainedMessage)
+            {
+                std::string().swap(message_);
+            }
+            else
+            {
+                message_.clear();
+            }
+        }
+        return true;
+    case kPing:
+        sendInLoop(makeFrame(kPong, StringPiece(payload, len)));
+        return true;
+    case kPong:
+        return true;
+    case kClose:
+        onClose(payload, len);
+        return true;
+    default:
+        return fail(kProtocolError);
+    }
+}
+
+void WebSocket::onClose(const char *payload, size_t len)
+{
+    closeReceived_ = true;
+    int code = kNoStatusReceived;
+    if (len == 1)
+    {
+        fail(kProtocolError);
+        return;
+    }
+    if (len >= 2)
+    {
+        code = (static_cast<unsigned char>(payload[0]) << 8) | static_cast<unsigned char>(payload[1]);
+        if (!validCloseCode(code))
+        {
+            fail(kProtocolError);
+            return;
+        }
+        if (!validUtf8(payload + 2, len - 2))
+        {
+            fail(kInvalidPayload);
+            return;
+        }
+    }
+    closeCode_ = code;
+    if (closeSent_)
+    {
+        // 本端发起的关闭握手完成
+        TcpConnectionPtr conn = conn_.lock();
+        if (conn)
+        {
+            conn->shutdown();
+        }
+    }
+    else
+    {
+        // 回复同样的关闭码，发送以后关闭连接
+        closeInLoop(code == kNoStatusReceived ? 0 : code, std::string());
+    }
+}
+
+void WebSocket::deliver(Opcode opcode, const StringPiece &message)
+{
+    // 本端已经发出Close帧，之后收到的消息丢弃
+    if (!closeSent_ && messageCallback_)
+    {
+        messageCallback_(shared_from_this(), message, opcode);
+    }
+}
+
+void WebSocket::handleClose()
+{
+    closed_ = true;
+    closeSent_ = true;
+    messageCallback_ = MessageCallback();
+    CloseCallback cb;
+    cb.swap(closeCallback_);
+    if (cb)
+    {
+        cb(shared_from_this(), closeCode_);
+    }
+    context_.reset();
+}
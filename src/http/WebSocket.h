@@ -0,0 +1,136 @@
+#ifndef HTTP_WEBSOCKET_H
+#define HTTP_WEBSOCKET_H
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "StringPiece.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+class Buffer;
+class EventLoop;
+class HttpRequest;
+class WebSocket;
+using WebSocketPtr = std::shared_ptr<WebSocket>;
+
+/*
+    WebSocket是一条升级以后的WebSocket连接（RFC 6455）：HttpServer在HTTP/1.1请求带着
+    "Upgrade: websocket"时完成握手（101），之后连接上的数据按WebSocket帧解析，交给这个对象。
+
+    - 接收：客户端的帧必须带掩码，在inputBuffer_中原地解除掩码；没有分片的消息直接以指向inputBuffer_的
+      StringPiece交给MessageCallback，不拷贝；分片的消息拼接完整以后再交付。文本消息检查UTF-8。
+    - Ping自动回复Pong；收到Close时回复Close并关闭连接。协议错误时发送对应的关闭码并关闭连接。
+    - 发送：sendText()/sendBinary()可以在任意线程调用，帧在loop线程中按调用顺序写入连接。
+      服务端的帧不带掩码，同一条消息发给很多连接时可以用makeFrame()编码一次，再对每条连接sendFrame()。
+
+    连接断开之前由连接持有；回调在连接的loop线程中调用，连接断开以后释放，打破回调持有WebSocket的循环引用。
+    不支持扩展（permessage-deflate）和子协议协商。
+*/
+class WebSocket : noncopyable, public std::enable_shared_from_this<WebSocket>
+{
+public:
+    enum Opcode
+    {
+        kContinuation = 0x0,
+        kText = 0x1,
+        kBinary = 0x2,
+        kClose = 0x8,
+        kPing = 0x9,
+        kPong = 0xA,
+    };
+
+    // 常用的关闭码
+    enum CloseCode
+    {
+        kNormalClosure = 1000,
+        kGoingAway = 1001,
+        kProtocolError = 1002,
+        kNoStatusReceived = 1005, // 只用于回调，不能发送
+        kAbnormalClosure = 1006,  // 只用于回调：没有收到Close帧连接就断开了
+        kInvalidPayload = 1007,
+        kPolicyViolation = 1008,
+        kMessageTooBig = 1009,
+        kInternalError = 1011,
+    };
+
+    // 收到一条完整的消息，opcode是kText或者kBinary；message只在回调期间有效
+    using MessageCallback = std::function<void(const WebSocketPtr &, const StringPiece &message, Opcode opcode)>;
+    // 连接断开，code是对端Close帧中的关闭码（没有时为kNoStatusReceived）、本端发现的协议错误或者kAbnormalClosure
+    using CloseCallback = std::function<void(const WebSocketPtr &, int code)>;
+
+    // 一条消息（包括所有分片）的默认上限1MB，超过时以kMessageTooBig关闭
+    static const size_t kDefaultMaxMessageSize = 1024 * 1024;
+    // 发出Close帧以后等待对端Close帧的时间，超时强制关闭
+    static const int kCloseTimeoutSeconds = 5;
+
+    explicit WebSocket(const TcpConnectionPtr &conn);
+
+    // 请求是否要求升级到WebSocket（GET、Upgrade: websocket、Connection中有upgrade）
+    static bool isUpgradeRequest(const HttpRequest &req);
+    // 握手响应的Sec-WebSocket-Accept：base64(SHA1(key + GUID))
+    static std::string acceptKey(const StringPiece &key);
+    // 编码一个服务端的帧（不带掩码）
+    static std::string makeFrame(Opcode opcode, const StringPiece &payload);
+
+    // 以下可以在任意线程调用，发出Close帧或者连接断开以后的消息被丢弃
+    void sendText(const StringPiece &message) { send(kText, message); }
+    void sendBinary(const StringPiece &message) { send(kBinary, message); }
+    void ping(const StringPiece &payload = StringPiece()) { send(kPing, payload); }
+    // 发送makeFrame()编码好的帧，多条连接共享同一个帧，跨线程发送时也不拷贝
+    void sendFrame(const std::shared_ptr<const std::string> &frame);
+    // 开始关闭握手：发送Close帧，等对端回复Close以后关闭连接
+    void close(int code = kNormalClosure, const StringPiece &reason = StringPiece());
+
+    // 连接已经断开，或者已经发出了Close帧
+    bool closed() const { return closed_; }
+    EventLoop *getLoop() const { return loop_; }
+
+    // 以下回调在连接的loop线程中调用，在HttpServer的WebSocketCallback中设置
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setCloseCallback(const CloseCallback &cb) { closeCallback_ = cb; }
+    void setMaxMessageSize(size_t bytes) { maxMessageSize_ = bytes; }
+
+    // 用户数据，比如订阅的频道
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void> &getContext() const { return context_; }
+
+    // 以下由HttpServer在loop线程中调用
+    // 处理buf中所有完整的帧
+    void onMessage(Buffer *buf, Timestamp receiveTime);
+    void handleClose();
+
+private:
+    void send(Opcode opcode, const StringPiece &payload);
+    void sendInLoop(const std::string &frame);
+    void sendSharedInLoop(const std::shared_ptr<const std::string> &frame);
+    void closeInLoop(int code, const std::string &reason);
+    // 处理一个解除掩码以后的帧，返回false时连接已经因为错误关闭
+    bool onFrame(Opcode opcode, bool fin, const char *payload, size_t len);
+    void onClose(const char *payload, size_t len);
+    void deliver(Opcode opcode, const StringPiece &message);
+    // 协议错误：发送Close帧并关闭连接，不等对端回复
+    bool fail(int code);
+
+    EventLoop *loop_;
+    std::weak_ptr<TcpConnection> conn_; // 用户持有WebSocket不延长连接的生命周期
+    size_t maxMessageSize_;
+
+    bool closeSent_;     // 已经发出Close帧，只在loop线程中访问
+    bool closeReceived_;
+    int closeCode_;
+    std::atomic<bool> closed_;
+
+    // 正在拼接的分片消息
+    bool fragmented_;
+    Opcode messageOpcode_;
+    std::string message_;
+
+    MessageCallback messageCallback_;
+    CloseCallback closeCallback_;
+    std::shared_ptr<void> context_;
+};
+
+#endif
@@ -2,65 +2,381 @@
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "HttpContext.h"
+#include "HttpStream.h"
+#include "StaticFileHandler.h"
+#include "HttpCompressor.h"
+#include "HttpResponseCache.h"
+#include "WebSocket.h"
+#include "ResponseWriter.h"
+#include "ThreadPool.h"
 #include "Timestamp.h"
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 extern char favicon[555];
+// 压测模式（-b）：不打印请求，日志只输出WARN以上，配合example/httpbench使用
 bool benchmark = false;
 
-void onRequest(const HttpRequest &req, HttpResponse *resp)
-{ // 请求方法                                      //请求URL
-    std::cout << "Headers " << req.methodString() << " " << req.path() << std::endl;
+// 流式接收的请求体总字节数
+std::atomic<size_t> g_streamedBytes(0);
+
+// 大请求体流式接收：这里只统计字节数，不保存
+void onBody(const TcpConnectionPtr &, const HttpRequest &, const char *, size_t len)
+{
+    g_streamedBytes += len;
+}
+
+// 流式响应示例：定时器每100ms写一行，第一行不必等整个响应体生成
+void tick(const HttpStreamPtr &stream, int count)
+{
+    if (stream->closed())
+    {
+        return;
+    }
+    if (count == 10)
+    {
+        stream->finish();
+        return;
+    }
+    stream->write("tick " + std::to_string(count) + "\n");
+    stream->getLoop()->runAfter(0.1, std::bind(tick, stream, count + 1));
+}
+
+// 背压示例：生成64MB响应体，writable()为false时暂停，输出缓冲区写完以后从WritableCallback继续
+void pump(const HttpStreamPtr &stream, std::shared_ptr<size_t> remaining)
+{
+    std::string block(16 * 1024, 'x');
+    bool writable = true;
+    while (writable && *remaining > 0)
+    {
+        size_t n = std::min(*remaining, block.size());
+        *remaining -= n;
+        writable = stream->write(StringPiece(block.data(), n));
+    }
+    if (*remaining == 0)
+    {
+        stream->finish();
+    }
+}
 
-    // 打印头部
+// 打印请求方法、URL和头部
+void printRequest(const HttpRequest &req)
+{
     if (!benchmark)
     {
-        const std::unordered_map<std::string, std::string> &headers = req.headers();
-        for (const auto &header : headers)
+        std::cout << "Headers " << req.methodString() << " " << req.path() << std::endl;
+        for (const HttpRequest::Header &header : req.headers())
         {
             std::cout << header.first << ": " << header.second << std::endl;
         }
     }
+}
+
+// 给处理函数加上打印请求
+HttpRouter::Handler traced(const HttpRouter::Handler &handler)
+{
+    return [handler](const HttpRequest &req, HttpResponse *resp) {
+        printRequest(req);
+        handler(req, resp);
+    };
+}
+
+void onIndex(const HttpRequest &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/html");
+    std::string now = Timestamp::now().toFormattedString();
+    resp->setBody("<html><head><title>This is title</title></head>"
+                  "<body><h1>Hello</h1>Now is " +
+                  now +
+                  "</body></html>");
+}
+
+void onFavicon(const HttpRequest &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("image/png");
+    resp->setBody(std::string(favicon, sizeof favicon));
+}
+
+// 固定不变的头部预先序列化，每个响应一次拷贝
+const HttpHeaderBlock kTextHeaders = HttpHeaderBlock().add("Content-Type", "text/plain");
+
+void onHello(const HttpRequest &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setHeaderBlock(&kTextHeaders);
+    resp->setBody("hello, world!\n");
+}
+
+// 路径参数示例：/users/:id
+void onUser(const HttpRequest &req, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain");
+    resp->setBody("user " + req.param("id").asString() + "\n");
+}
+
+// 请求体不超过1MB时缓存在内存中，原样返回
+void onEcho(const HttpRequest &req, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("application/octet-stream");
+    resp->setBody(req.body().asString());
+}
+
+// 大于1MB的请求体由onBody流式接收，这里只报告统计结果
+void onUpload(const HttpRequest &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain");
+    resp->setBody("streamed " + std::to_string(g_streamedBytes.load()) + " bytes in total\n");
+}
+
+void onStream(const HttpRequest &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain");
+    resp->setStreamCallback(std::bind(tick, std::placeholders::_1, 0));
+}
+
+void onLarge(const HttpRequest &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("application/octet-stream");
+    resp->setStreamCallback([](const HttpStreamPtr &stream) {
+        std::shared_ptr<size_t> remaining = std::make_shared<size_t>(64 * 1024 * 1024);
+        stream->setWritableCallback(std::bind(pump, std::placeholders::_1, remaining));
+        pump(stream, remaining);
+    });
+}
 
-    if (req.path() == "/")
+// 生成n条记录的JSON数组，压缩示例用
+std::string makeItems(int n, const std::string &stamp)
+{
+    std::string json = "[";
+    for (int i = 0; i < n; ++i)
+    {
+        if (i > 0)
+        {
+            json += ",";
+        }
+        json += "{\"id\":" + std::to_string(i) + ",\"name\":\"item" + std::to_string(i) +
+                "\",\"price\":" + std::to_string(i % 100) + ".99,\"updated\":\"" + stamp + "\"}";
+    }
+    json += "]\n";
+    return json;
+}
+
+// 内容不变的JSON：setCacheKey以后压缩结果被缓存，不用每次压缩
+void onItems(const HttpRequest &, HttpResponse *resp)
+{
+    static const std::string items = makeItems(5000, "2024-01-01");
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setContentType("application/json");
+    resp->setCacheKey("/items@v1");
+    resp->setBody(items);
+}
+
+// 每次都不同的JSON：开启压缩时在线程池中边压缩边发送
+void onReport(const HttpRequest &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setContentType("application/json");
+    resp->setBody(makeItems(5000, Timestamp::now().toFormattedString()));
+}
+
+// 异步处理函数示例：模拟在线程池中执行一次50ms的数据库查询，subloop不阻塞，查询完成以后在线程池中回复。
+// 请求只在调用期间有效，要用的参数先拷贝
+void onQuery(ThreadPool *queryPool, const HttpRequest &req, ResponseWriter writer)
+{
+    printRequest(req);
+    std::string id = req.param("id").asString();
+    queryPool->add([writer, id]() {
+        ::usleep(50 * 1000);
+        writer->setStatusCode(HttpResponse::k200Ok);
+        writer->setStatusMessage("OK");
+        writer->setContentType("text/plain");
+        writer->setBody("row " + id + "\n");
+        writer.complete();
+    });
+}
+
+// WebSocket示例：/ws/echo原样返回每条消息；/ws/chat把消息广播给所有聊天连接，帧只编码一次
+std::mutex g_chatMutex;
+std::set<WebSocketPtr> g_chatRoom;
+
+void onChatMessage(const WebSocketPtr &, const StringPiece &message, WebSocket::Opcode opcode)
+{
+    std::shared_ptr<const std::string> frame = std::make_shared<std::string>(WebSocket::makeFrame(opcode, message));
+    std::vector<WebSocketPtr> members;
     {
-        resp->setStatusCode(HttpResponse::k200Ok);
-        resp->setStatusMessage("OK");
-        resp->setContentType("text/html");
-        resp->addHeader("Server", "Muduo");
-        std::string now = Timestamp::now().toFormattedString();
-        resp->setBody("<html><head><title>This is title</title></head>"
-                      "<body><h1>Hello</h1>Now is " +
-                      now +
-                      "</body></html>");
+        std::lock_guard<std::mutex> lock(g_chatMutex);
+        members.assign(g_chatRoom.begin(), g_chatRoom.end());
     }
-    else if (req.path() == "/favicon.ico")
+    for (const WebSocketPtr &member : members)
     {
-        resp->setStatusCode(HttpResponse::k200Ok);
-        resp->setStatusMessage("OK");
-        resp->setContentType("image/png");
-        resp->setBody(std::string(favicon, sizeof favicon));
+        member->sendFrame(frame);
     }
-    else if (req.path() == "/hello")
+}
+
+void onWebSocket(const HttpRequest &req, const WebSocketPtr &ws)
+{
+    printRequest(req);
+    if (req.path() == "/ws/echo")
     {
-        resp->setStatusCode(HttpResponse::k200Ok);
-        resp->setStatusMessage("OK");
-        resp->setContentType("text/plain");
-        resp->addHeader("Server", "Muduo");
-        resp->setBody("hello, world!\n");
+        ws->setMessageCallback([](const WebSocketPtr &ws, const StringPiece &message, WebSocket::Opcode opcode) {
+            if (opcode == WebSocket::kText)
+            {
+                ws->sendText(message);
+            }
+            else
+            {
+                ws->sendBinary(message);
+            }
+        });
+    }
+    else if (req.path() == "/ws/chat")
+    {
+        {
+            std::lock_guard<std::mutex> lock(g_chatMutex);
+            g_chatRoom.insert(ws);
+        }
+        ws->setMessageCallback(onChatMessage);
+        ws->setCloseCallback([](const WebSocketPtr &ws, int) {
+            std::lock_guard<std::mutex> lock(g_chatMutex);
+            g_chatRoom.erase(ws);
+        });
     }
     else
     {
-        resp->setStatusCode(HttpResponse::k404NotFound);
-        resp->setStatusMessage("Not Found");
-        resp->setCloseConnection(true);
+        ws->close(WebSocket::kPolicyViolation, "unknown path");
     }
 }
 
+// 没有匹配的路由
+void onNotFound(const HttpRequest &req, HttpResponse *resp)
+{
+    printRequest(req);
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setStatusMessage("Not Found");
+    resp->setCloseConnection(true);
+}
+
 int main(int argc, char *argv[])
 {
+    uint16_t port = 8080;
+    int threads = 4;
+    const char *root = nullptr;
+    bool compress = false;
+    bool cache = false;
+    int opt;
+    while ((opt = ::getopt(argc, argv, "p:t:r:bzc")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            port = static_cast<uint16_t>(atoi(optarg));
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'r':
+            root = optarg;
+            break;
+        case 'b':
+            benchmark = true;
+            break;
+        case 'z':
+            compress = true;
+            break;
+        case 'c':
+            cache = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p port] [-t threads] [-r static_root] [-b] [-z] [-c]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (benchmark)
+    {
+        Logger::setLogLevel(Logger::WARN);
+    }
+
     EventLoop loop; // mainloop
-    HttpServer server(&loop, InetAddress(8080), "http-server");
-    server.setHttpCallback(onRequest);
+    HttpServer server(&loop, InetAddress(port), "http-server");
+    server.addResponseHeader("Server", "Muduo");
+    HttpRouter &router = server.router();
+    router.get("/", traced(onIndex));
+    router.get("/favicon.ico", traced(onFavicon));
+    router.get("/hello", traced(onHello));
+    router.get("/users/:id", traced(onUser));
+    router.post("/echo", traced(onEcho));
+    router.put("/upload", traced(onUpload));
+    router.get("/stream", traced(onStream));
+    router.get("/large", traced(onLarge));
+    router.get("/items", traced(onItems));
+    router.get("/report", traced(onReport));
+
+    // /query/:id在线程池中“查询数据库”，用ResponseWriter延迟回复
+    ThreadPool queryPool("query");
+    queryPool.setThreadSize(8);
+    queryPool.start();
+    router.getAsync("/query/:id", [&queryPool](const HttpRequest &req, ResponseWriter writer) {
+        onQuery(&queryPool, req, writer);
+    });
+
+    // -z开启gzip/deflate压缩，大响应在线程池中压缩；压缩器要比线程池后销毁
+    HttpCompressor compressor;
+    ThreadPool compressPool("compress");
+    if (compress)
+    {
+        compressPool.setThreadSize(2);
+        compressPool.start();
+        compressor.setThreadPool(&compressPool);
+        server.setCompressor(&compressor);
+    }
+
+    // -c开启响应缓存：/report每次都重新生成JSON，缓存1秒，这一秒内的请求不再调用处理函数
+    HttpResponseCache responseCache;
+    if (cache)
+    {
+        responseCache.cache("/report", 1.0);
+        server.setResponseCache(&responseCache);
+    }
+
+    // -r指定目录时，/static/下的请求由StaticFileHandler处理
+    std::unique_ptr<StaticFileHandler> staticFiles;
+    if (root)
+    {
+        staticFiles.reset(new StaticFileHandler("/static/", root));
+        StaticFileHandler *handler = staticFiles.get();
+        if (compress)
+        {
+            handler->setCompressor(&compressor);
+        }
+        router.get("/static/*path", traced([handler](const HttpRequest &req, HttpResponse *resp) {
+                       handler->handle(req, resp);
+                   }));
+    }
+    server.setHttpCallback(onNotFound);
+    server.setBodyCallback(onBody);
+    server.setWebSocketCallback(onWebSocket);
+    server.setThreadNum(threads);
     server.start();
     loop.loop();
 }
@@ -0,0 +1,273 @@
+#include "Hpack.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using Headers = std::vector<HpackDecoder::Header>;
+
+// "8286 8441"这样的十六进制串（可以带空格）转成字节
+std::string fromHex(const char *hex)
+{
+    std::string out;
+    int high = -1;
+    for (const char *p = hex; *p; ++p)
+    {
+        int v;
+        if (*p >= '0' && *p <= '9')
+            v = *p - '0';
+        else if (*p >= 'a' && *p <= 'f')
+            v = *p - 'a' + 10;
+        else
+            continue;
+        if (high < 0)
+        {
+            high = v;
+        }
+        else
+        {
+            out.push_back(static_cast<char>(high << 4 | v));
+            high = -1;
+        }
+    }
+    return out;
+}
+
+// 解码一个头部块，和期望的字段、动态表大小比较
+void expectBlock(HpackDecoder *decoder, const char *hex, const Headers &expected, size_t tableSize)
+{
+    std::string block = fromHex(hex);
+    Headers headers;
+    assert(decoder->decode(block.data(), block.size(), &headers));
+    assert(headers == expected);
+    assert(decoder->tableSize() == tableSize);
+}
+
+// RFC 7541 C.1 整数编码
+void testInteger()
+{
+    std::string out;
+    hpack::encodeInteger(10, 5, 0, &out);
+    assert(out == fromHex("0a"));
+    out.clear();
+    hpack::encodeInteger(1337, 5, 0, &out);
+    assert(out == fromHex("1f9a0a"));
+    out.clear();
+    hpack::encodeInteger(42, 8, 0, &out);
+    assert(out == fromHex("2a"));
+
+    for (uint64_t value : {0ULL, 30ULL, 31ULL, 127ULL, 128ULL, 1337ULL, 65535ULL, 1ULL << 40})
+    {
+        for (int prefix = 1; prefix <= 8; ++prefix)
+        {
+            out.clear();
+            hpack::encodeInteger(value, prefix, 0, &out);
+            const unsigned char *p = reinterpret_cast<const unsigned char *>(out.data());
+            const unsigned char *end = p + out.size();
+            uint64_t decoded = 0;
+            assert(hpack::decodeInteger(&p, end, prefix, &decoded));
+            assert(decoded == value && p == end);
+        }
+    }
+
+    // 不完整的整数
+    std::string truncated = fromHex("1f9a");
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(truncated.data());
+    uint64_t value = 0;
+    assert(!hpack::decodeInteger(&p, p + truncated.size(), 5, &value));
+}
+
+void testHuffman()
+{
+    // RFC 7541 C.4中的字符串
+    std::string out;
+    hpack::huffmanEncode("www.example.com", &out);
+    assert(out == fromHex("f1e3 c2e5 f23a 6ba0 ab90 f4ff"));
+    assert(hpack::huffmanEncodedLength("www.example.com") == out.size());
+    out.clear();
+    hpack::huffmanEncode("no-cache", &out);
+    assert(out == fromHex("a8eb 1064 9cbf"));
+    out.clear();
+    hpack::huffmanEncode("custom-value", &out);
+    assert(out == fromHex("25a8 49e9 5bb8 e8b4 bf"));
+
+    // 所有字节值的往返
+    std::string all;
+    for (int c = 0; c < 256; ++c)
+    {
+        all.push_back(static_cast<char>(c));
+    }
+    srand(1);
+    for (int round = 0; round < 1000; ++round)
+    {
+        std::string s;
+        size_t len = rand() % 64;
+        for (size_t i = 0; i < len; ++i)
+        {
+            s.push_back(all[rand() % all.size()]);
+        }
+        if (round == 0)
+        {
+            s = all;
+        }
+        std::string encoded;
+        hpack::huffmanEncode(s, &encoded);
+        assert(encoded.size() == hpack::huffmanEncodedLength(s));
+        std::string decoded;
+        assert(hpack::huffmanDecode(reinterpret_cast<const unsigned char *>(encoded.data()), encoded.size(), &decoded));
+        assert(decoded == s);
+    }
+
+    std::string decoded;
+    // 填充不是全1
+    std::string bad = fromHex("f1e3 c2e5 f23a 6ba0 ab90 f4fe");
+    assert(!hpack::huffmanDecode(reinterpret_cast<const unsigned char *>(bad.data()), bad.size(), &decoded));
+    // 30个1是EOS，不能出现在数据中；填充超过7位也是错误
+    decoded.clear();
+    bad = fromHex("ffff ffff");
+    assert(!hpack::huffmanDecode(reinterpret_cast<const unsigned char *>(bad.data()), bad.size(), &decoded));
+    decoded.clear();
+    bad = fromHex("f1e3 c2e5 f23a 6ba0 ab90 f4ff ff");
+    assert(!hpack::huffmanDecode(reinterpret_cast<const unsigned char *>(bad.data()), bad.size(), &decoded));
+}
+
+// RFC 7541 C.3 不用Huffman的请求，三个头部块共用一个解码器
+void testRequestsWithoutHuffman()
+{
+    HpackDecoder decoder;
+    expectBlock(&decoder, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+                {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}}, 57);
+    expectBlock(&decoder, "8286 84be 5808 6e6f 2d63 6163 6865",
+                {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"},
+                 {"cache-control", "no-cache"}},
+                110);
+    expectBlock(&decoder, "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65",
+                {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, {":authority", "www.example.com"},
+                 {"custom-key", "custom-value"}},
+                164);
+}
+
+// RFC 7541 C.4 同样的请求用Huffman编码
+void testRequestsWithHuffman()
+{
+    HpackDecoder decoder;
+    expectBlock(&decoder, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+                {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}}, 57);
+    expectBlock(&decoder, "8286 84be 5886 a8eb 1064 9cbf",
+                {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"},
+                 {"cache-control", "no-cache"}},
+                110);
+    expectBlock(&decoder, "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf",
+                {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, {":authority", "www.example.com"},
+                 {"custom-key", "custom-value"}},
+                164);
+}
+
+// RFC 7541 C.5 动态表只有256字节的响应，第三个头部块会淘汰旧的表项
+void testResponsesWithEviction()
+{
+    HpackDecoder decoder(256);
+    expectBlock(&decoder,
+                "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 "
+                "3120 474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+                {{":status", "302"}, {"cache-control", "private"}, {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+                 {"location", "https://www.example.com"}},
+                222);
+    expectBlock(&decoder, "4803 3330 37c1 c0bf",
+                {{":status", "307"}, {"cache-control", "private"}, {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+                 {"location", "https://www.example.com"}},
+                222);
+    expectBlock(&decoder,
+                "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 474d 54c0 5a04 677a 6970 "
+                "7738 666f 6f3d 4153 444a 4b48 514b 425a 584f 5157 454f 5049 5541 5851 5745 4f49 553b 206d 6178 2d61 "
+                "6765 3d33 3630 303b 2076 6572 7369 6f6e 3d31",
+                {{":status", "200"}, {"cache-control", "private"}, {"date", "Mon, 21 Oct 2013 20:13:22 GMT"},
+                 {"location", "https://www.example.com"}, {"content-encoding", "gzip"},
+                 {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"}},
+                215);
+}
+
+// 编码器和解码器的动态表保持一致
+void testRoundTrip()
+{
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    for (int round = 0; round < 100; ++round)
+    {
+        if (round == 50)
+        {
+            // 对端缩小动态表，下一个头部块开头带着大小更新
+            encoder.setMaxTableSize(100);
+        }
+        std::string block;
+        encoder.encodeStatus(round % 2 ? 200 : 404, &block);
+        encoder.encode("content-type", "text/html", &block);
+        encoder.encode("content-length", std::to_string(round * 7), &block);
+        encoder.encode("x-request-id", "id-" + std::to_string(round % 5), &block);
+        encoder.encode("server", "muduo", &block);
+
+        Headers headers;
+        assert(decoder.decode(block.data(), block.size(), &headers));
+        Headers expected = {{":status", round % 2 ? "200" : "404"},
+                            {"content-type", "text/html"},
+                            {"content-length", std::to_string(round * 7)},
+                            {"x-request-id", "id-" + std::to_string(round % 5)},
+                            {"server", "muduo"}};
+        assert(headers == expected);
+        assert(decoder.tableSize() <= (round >= 50 ? 100u : 4096u));
+    }
+}
+
+void testErrors()
+{
+    Headers headers;
+    HpackDecoder decoder;
+    // 下标0和超出范围的下标
+    std::string block = fromHex("80");
+    assert(!decoder.decode(block.data(), block.size(), &headers));
+    block = fromHex("be");
+    assert(!decoder.decode(block.data(), block.size(), &headers));
+    // 字符串长度超出头部块
+    block = fromHex("400a 6375 7374");
+    assert(!decoder.decode(block.data(), block.size(), &headers));
+    // 动态表大小更新超过通告的值，或者出现在字段之后
+    block = fromHex("3fe2 1f"); // 4097
+    assert(!decoder.decode(block.data(), block.size(), &headers));
+    block = fromHex("82 20");
+    assert(!decoder.decode(block.data(), block.size(), &headers));
+}
+
+// 头部列表按名字+值+32计算，超过上限时失败；很小的头部块可以反复引用动态表中的大字段
+void testHeaderListLimit()
+{
+    HpackDecoder decoder(4096, 16 * 1024);
+    std::string block = fromHex("40 05") + "x-big";
+    hpack::encodeInteger(4000, 7, 0, &block);
+    block.append(4000, 'a');
+    std::string ok = block + std::string(2, '\xbe');
+    Headers headers;
+    assert(decoder.decode(ok.data(), ok.size(), &headers));
+    assert(headers.size() == 3);
+
+    HpackDecoder limited(4096, 16 * 1024);
+    std::string bomb = block + std::string(1000, '\xbe');
+    headers.clear();
+    assert(!limited.decode(bomb.data(), bomb.size(), &headers));
+    assert(headers.size() <= 4);
+}
+
+int main()
+{
+    testInteger();
+    testHuffman();
+    testRequestsWithoutHuffman();
+    testRequestsWithHuffman();
+    testResponsesWithEviction();
+    testRoundTrip();
+    testErrors();
+    testHeaderListLimit();
+    printf("HpackTest passed\n");
+    return 0;
+}
@@ -0,0 +1,203 @@
+#include "HttpContext.h"
+#include "Buffer.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+
+// 一次放入全部数据并解析，返回parseRequest的结果
+bool parse(HttpContext *context, Buffer *buf, const std::string &data)
+{
+    buf->append(data.data(), data.size());
+    return context->parseRequest(buf, Timestamp());
+}
+
+// 请求行、查询串和头部
+void testRequestLine()
+{
+    HttpContext context;
+    Buffer buf;
+    assert(parse(&context, &buf, "GET /index.html?a=1&b=2 HTTP/1.1\r\nHost: example.com\r\nX-Empty:\r\nAccept:  */*  \r\n\r\n"));
+    assert(context.gotAll());
+    const HttpRequest &req = context.request();
+    assert(req.method() == HttpRequest::kGet);
+    assert(req.version() == HttpRequest::kHttp11);
+    assert(req.path() == "/index.html");
+    assert(req.query() == "?a=1&b=2");
+    assert(req.getHeader("host") == "example.com");
+    assert(req.getHeader("Accept") == "*/*");
+    assert(req.getHeader("X-Empty").empty());
+    assert(req.getHeader("Missing").empty());
+    assert(req.body().empty());
+    context.finishRequest(&buf);
+    assert(buf.readableBytes() == 0);
+    assert(context.idle());
+
+    HttpContext bad;
+    Buffer badBuf;
+    assert(!parse(&bad, &badBuf, "GET /\r\n\r\n"));
+    assert(bad.errorCode() == 400);
+}
+
+// 流水线上的多个请求，一个一个解析
+void testPipelined()
+{
+    HttpContext context;
+    Buffer buf;
+    std::string data = "GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+                       "POST /b HTTP/1.1\r\nHost: x\r\nContent-Length: 5\r\n\r\nhello"
+                       "GET /c HTTP/1.0\r\nConnection: keep-alive\r\n\r\n";
+    assert(parse(&context, &buf, data));
+    assert(context.gotAll() && context.request().path() == "/a");
+    context.finishRequest(&buf);
+
+    assert(context.parseRequest(&buf, Timestamp()));
+    assert(context.gotAll());
+    assert(context.request().method() == HttpRequest::kPost);
+    assert(context.request().path() == "/b");
+    assert(context.request().body() == "hello");
+    context.finishRequest(&buf);
+
+    assert(context.parseRequest(&buf, Timestamp()));
+    assert(context.gotAll());
+    assert(context.request().version() == HttpRequest::kHttp10);
+    assert(context.request().getHeader("Connection") == "keep-alive");
+    context.finishRequest(&buf);
+    assert(buf.readableBytes() == 0);
+}
+
+// 数据一个字节一个字节地到达，结果和一次到达相同
+void testIncremental()
+{
+    std::string data = "POST /upload HTTP/1.1\r\nHost: x\r\nContent-Length: 11\r\n\r\nhello world";
+    HttpContext context;
+    Buffer buf;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        assert(context.gotAll() == false);
+        assert(parse(&context, &buf, data.substr(i, 1)));
+    }
+    assert(context.gotAll());
+    assert(context.request().path() == "/upload");
+    assert(context.request().getHeader("Host") == "x");
+    assert(context.request().body() == "hello world");
+}
+
+// chunked请求体：chunk扩展被忽略，trailer被丢弃
+void testChunked()
+{
+    HttpContext context;
+    Buffer buf;
+    std::string data = "POST /c HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n\r\n"
+                       "4\r\nWiki\r\n"
+                       "5;ext=1\r\npedia\r\n"
+                       "E\r\n in\r\n\r\nchunks.\r\n"
+                       "0\r\nX-Trailer: t\r\n\r\n"
+                       "GET /next HTTP/1.1\r\n\r\n";
+    // 分两次到达，中间断在chunk数据里
+    assert(parse(&context, &buf, data.substr(0, 80)));
+    assert(!context.gotAll());
+    assert(parse(&context, &buf, data.substr(80)));
+    assert(context.gotAll());
+    assert(context.request().body() == "Wikipedia in\r\n\r\nchunks.");
+    context.finishRequest(&buf);
+    assert(context.parseRequest(&buf, Timestamp()));
+    assert(context.gotAll() && context.request().path() == "/next");
+
+    HttpContext bad;
+    Buffer badBuf;
+    assert(!parse(&bad, &badBuf, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n"));
+    assert(bad.errorCode() == 400);
+
+    HttpContext noCrlf;
+    Buffer noCrlfBuf;
+    assert(!parse(&noCrlf, &noCrlfBuf, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcX\r\n"));
+    assert(noCrlf.errorCode() == 400);
+}
+
+// 请求的边界有歧义时拒绝，防止请求走私
+void testFraming()
+{
+    struct Case
+    {
+        const char *request;
+        int errorCode; // 0表示接受
+    } cases[] = {
+        {"POST / HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nabcd", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc", 0},
+        {"POST / HTTP/1.1\r\nContent-Length: 3, 4\r\n\r\nabcd", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n", 413},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", 501},
+    };
+    for (const Case &c : cases)
+    {
+        HttpContext context;
+        Buffer buf;
+        bool ok = parse(&context, &buf, c.request);
+        if (c.errorCode == 0)
+        {
+            assert(ok && context.gotAll());
+            assert(context.request().body() == "abc");
+        }
+        else
+        {
+            assert(!ok);
+            assert(context.errorCode() == c.errorCode);
+        }
+    }
+}
+
+void testLimits()
+{
+    // 请求头太大
+    HttpContext context;
+    Buffer buf;
+    std::string huge = "GET / HTTP/1.1\r\nX-Big: " + std::string(HttpContext::kMaxHeaderSize, 'a');
+    assert(!parse(&context, &buf, huge));
+    assert(context.errorCode() == 431);
+
+    // 请求体超过缓存上限并且没有流式回调
+    HttpContext small;
+    small.setBodyLimits(4, 0);
+    Buffer smallBuf;
+    assert(!parse(&small, &smallBuf, "POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\n"));
+    assert(small.errorCode() == 413);
+
+    // 有回调时流式接收
+    HttpContext streaming;
+    streaming.setBodyLimits(4, 0);
+    std::string received;
+    streaming.setBodyCallback([&](const HttpRequest &, const char *data, size_t len) { received.append(data, len); });
+    Buffer streamBuf;
+    assert(parse(&streaming, &streamBuf, "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\n0123"));
+    assert(parse(&streaming, &streamBuf, "456789"));
+    assert(streaming.gotAll());
+    assert(received == "0123456789");
+}
+
+void testExpectContinue()
+{
+    HttpContext context;
+    Buffer buf;
+    assert(parse(&context, &buf, "POST / HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 2\r\n\r\n"));
+    assert(!context.gotAll());
+    assert(context.takeExpectContinue());
+    assert(!context.takeExpectContinue());
+    assert(parse(&context, &buf, "ok"));
+    assert(context.gotAll() && context.request().body() == "ok");
+}
+
+int main()
+{
+    testRequestLine();
+    testPipelined();
+    testIncremental();
+    testChunked();
+    testFraming();
+    testLimits();
+    testExpectContinue();
+    printf("HttpContextTest passed\n");
+    return 0;
+}
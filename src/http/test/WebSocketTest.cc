@@ -0,0 +1,262 @@
+#include "WebSocket.h"
+#include "HttpContext.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Buffer.h"
+#include "Logging.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+// 客户端的帧：必须带掩码
+std::string clientFrame(WebSocket::Opcode opcode, const std::string &payload, bool fin = true)
+{
+    static const unsigned char kKey[4] = {0x37, 0xfa, 0x21, 0x3d};
+    std::string frame;
+    frame.push_back(static_cast<char>((fin ? 0x80 : 0) | opcode));
+    size_t len = payload.size();
+    if (len < 126)
+    {
+        frame.push_back(static_cast<char>(0x80 | len));
+    }
+    else if (len <= 0xFFFF)
+    {
+        frame.push_back(static_cast<char>(0x80 | 126));
+        frame.push_back(static_cast<char>(len >> 8));
+        frame.push_back(static_cast<char>(len));
+    }
+    else
+    {
+        frame.push_back(static_cast<char>(0x80 | 127));
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            frame.push_back(static_cast<char>(static_cast<uint64_t>(len) >> shift));
+        }
+    }
+    frame.append(reinterpret_cast<const char *>(kKey), 4);
+    for (size_t i = 0; i < len; ++i)
+    {
+        frame.push_back(static_cast<char>(payload[i] ^ kKey[i % 4]));
+    }
+    return frame;
+}
+
+// 一条socketpair上的WebSocket：一端是TcpConnection，另一端模拟客户端读取服务端发出的帧
+struct Harness
+{
+    Harness()
+    {
+        int fds[2];
+        assert(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        peer = fds[1];
+        ::fcntl(peer, F_SETFL, O_NONBLOCK);
+        conn = std::make_shared<TcpConnection>(&loop, "ws", fds[0], InetAddress(), InetAddress());
+        conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+        conn->connectEstablished();
+        ws = std::make_shared<WebSocket>(conn);
+        ws->setMessageCallback([this](const WebSocketPtr &, const StringPiece &message, WebSocket::Opcode opcode) {
+            messages.push_back(message.asString());
+            opcodes.push_back(opcode);
+        });
+    }
+
+    ~Harness()
+    {
+        conn->connectDestroyed();
+        ::close(peer);
+    }
+
+    void feed(const std::string &data)
+    {
+        buf.append(data.data(), data.size());
+        ws->onMessage(&buf, Timestamp());
+    }
+
+    // 服务端发出的数据
+    std::string received()
+    {
+        std::string out;
+        char tmp[65536];
+        ssize_t n;
+        while ((n = ::read(peer, tmp, sizeof tmp)) > 0)
+        {
+            out.append(tmp, n);
+        }
+        return out;
+    }
+
+    // 服务端应该发出一个带关闭码的Close帧
+    void expectClose(int code)
+    {
+        std::string out = received();
+        assert(out.size() >= 4);
+        assert(static_cast<unsigned char>(out[0]) == 0x88);
+        assert(((static_cast<unsigned char>(out[2]) << 8) | static_cast<unsigned char>(out[3])) == code);
+        assert(ws->closed());
+    }
+
+    EventLoop loop;
+    int peer;
+    TcpConnectionPtr conn;
+    WebSocketPtr ws;
+    Buffer buf;
+    std::vector<std::string> messages;
+    std::vector<WebSocket::Opcode> opcodes;
+};
+
+// RFC 6455 1.3的例子
+void testHandshake()
+{
+    assert(WebSocket::acceptKey("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+
+    HttpContext context;
+    Buffer buf;
+    std::string req = "GET /chat HTTP/1.1\r\nHost: x\r\nUpgrade: WebSocket\r\nConnection: keep-alive, Upgrade\r\n"
+                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    buf.append(req.data(), req.size());
+    assert(context.parseRequest(&buf, Timestamp()) && context.gotAll());
+    assert(WebSocket::isUpgradeRequest(context.request()));
+
+    HttpContext plain;
+    Buffer plainBuf;
+    req = "GET /chat HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n";
+    plainBuf.append(req.data(), req.size());
+    assert(plain.parseRequest(&plainBuf, Timestamp()) && plain.gotAll());
+    assert(!WebSocket::isUpgradeRequest(plain.request()));
+}
+
+// 服务端的帧不带掩码，长度按7位、16位、64位三种格式编码
+void testMakeFrame()
+{
+    struct Case
+    {
+        size_t len;
+        size_t headerLength;
+    } cases[] = {{0, 2}, {125, 2}, {126, 4}, {65535, 4}, {65536, 10}};
+    for (const Case &c : cases)
+    {
+        std::string payload(c.len, 'p');
+        std::string frame = WebSocket::makeFrame(WebSocket::kBinary, payload);
+        assert(frame.size() == c.headerLength + c.len);
+        assert(static_cast<unsigned char>(frame[0]) == 0x82);
+        assert((static_cast<unsigned char>(frame[1]) & 0x80) == 0);
+        assert(frame.compare(c.headerLength, std::string::npos, payload) == 0);
+    }
+    std::string frame = WebSocket::makeFrame(WebSocket::kText, std::string(300, 't'));
+    assert(static_cast<unsigned char>(frame[1]) == 126);
+    assert(((static_cast<unsigned char>(frame[2]) << 8) | static_cast<unsigned char>(frame[3])) == 300);
+}
+
+// 各种长度的消息解除掩码以后和原文相同（覆盖整字和逐字节两种路径）
+void testUnmask()
+{
+    Harness h;
+    std::vector<std::string> sent;
+    for (size_t len : {0, 1, 7, 8, 9, 16, 17, 125, 126, 300, 70000})
+    {
+        std::string payload;
+        for (size_t i = 0; i < len; ++i)
+        {
+            payload.push_back(static_cast<char>('a' + i % 26));
+        }
+        sent.push_back(payload);
+        h.feed(clientFrame(WebSocket::kText, payload));
+    }
+    assert(h.messages == sent);
+    assert(h.buf.readableBytes() == 0);
+}
+
+// 不完整的帧等待后续数据；一次到达的多个帧都被处理
+void testPartialAndBatched()
+{
+    Harness h;
+    std::string frames = clientFrame(WebSocket::kBinary, std::string(200, '\x01')) + clientFrame(WebSocket::kText, "second");
+    h.feed(frames.substr(0, 3));
+    assert(h.messages.empty());
+    h.feed(frames.substr(3, 100));
+    assert(h.messages.empty());
+    h.feed(frames.substr(103));
+    assert(h.messages.size() == 2);
+    assert(h.opcodes[0] == WebSocket::kBinary && h.messages[0] == std::string(200, '\x01'));
+    assert(h.opcodes[1] == WebSocket::kText && h.messages[1] == "second");
+}
+
+// 分片消息中间可以插入控制帧，Ping自动回复同样负载的Pong
+void testFragmentsAndPing()
+{
+    Harness h;
+    h.feed(clientFrame(WebSocket::kText, "Hel", false));
+    h.feed(clientFrame(WebSocket::kPing, "are you there"));
+    h.feed(clientFrame(WebSocket::kContinuation, "lo, ", false));
+    h.feed(clientFrame(WebSocket::kContinuation, "world"));
+    assert(h.messages.size() == 1 && h.messages[0] == "Hello, world");
+    assert(h.received() == WebSocket::makeFrame(WebSocket::kPong, "are you there"));
+}
+
+// 对端发起关闭：回复同样的关闭码
+void testCloseHandshake()
+{
+    Harness h;
+    std::string payload = "\x03\xe8";
+    payload += "bye";
+    h.feed(clientFrame(WebSocket::kClose, payload));
+    h.expectClose(1000);
+}
+
+// 协议错误时发送对应的关闭码
+void testProtocolErrors()
+{
+    {
+        Harness h;
+        std::string unmasked = WebSocket::makeFrame(WebSocket::kText, "hi");
+        h.feed(unmasked);
+        h.expectClose(WebSocket::kProtocolError);
+    }
+    {
+        Harness h;
+        h.feed(clientFrame(WebSocket::kContinuation, "orphan"));
+        h.expectClose(WebSocket::kProtocolError);
+    }
+    {
+        Harness h;
+        h.feed(clientFrame(WebSocket::kPing, "x", false)); // 控制帧不能分片
+        h.expectClose(WebSocket::kProtocolError);
+    }
+    {
+        Harness h;
+        h.feed(clientFrame(WebSocket::kText, "\xc0\xaf")); // 过长编码的'/'
+        h.expectClose(WebSocket::kInvalidPayload);
+        assert(h.messages.empty());
+    }
+    {
+        Harness h;
+        h.ws->setMaxMessageSize(10);
+        h.feed(clientFrame(WebSocket::kBinary, "0123456789a"));
+        h.expectClose(WebSocket::kMessageTooBig);
+    }
+    {
+        Harness h;
+        h.feed(clientFrame(WebSocket::kClose, "\x03\xed")); // 1005不能出现在Close帧中
+        h.expectClose(WebSocket::kProtocolError);
+    }
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    testHandshake();
+    testMakeFrame();
+    testUnmask();
+    testPartialAndBatched();
+    testFragmentsAndPing();
+    testCloseHandshake();
+    testProtocolErrors();
+    printf("WebSocketTest passed\n");
+    return 0;
+}
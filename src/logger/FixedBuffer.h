@@ -40,8 +40,8 @@ public:
 
     // 获得data
     const char *data() const {return data_;}
-    // 获得data首地址到结尾的长度
-    int length() const { return static_cast<int>(end() - data_); }
+    // 已写入数据的长度
+    int length() const { return static_cast<int>(cur_ - data_); }
     // 获得当前可用位置
     char *current() { return cur_; }
     // 可用大小
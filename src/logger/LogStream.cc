@@ -1,5 +1,6 @@
 #include "LogStream.h"
 #include <algorithm>
+#include <stdio.h>
 
 static const char digits[] = {'9', '8', '7', '6', '5', '4', '3', '2', '1', '0',
                               '1', '2', '3', '4', '5', '6', '7', '8', '9'};
@@ -92,11 +93,10 @@ LogStream &LogStream::operator<<(double v)
 {
     if (buffer_.avail() >= kMaxNumericSize)
     {
-        char buf[32];
         int len = snprintf(buffer_.current(), kMaxNumericSize, "%.12g", v);
         buffer_.add(len);
-        return *this;
     }
+    return *this;
 }
 
 LogStream &LogStream::operator<<(char c)
@@ -105,9 +105,14 @@ LogStream &LogStream::operator<<(char c)
     return *this;
 }
 
+// 指针按十六进制地址输出
 LogStream &LogStream::operator<<(const void *data)
 {
-    *this << static_cast<const char *>(data);
+    if (buffer_.avail() >= kMaxNumericSize)
+    {
+        int len = snprintf(buffer_.current(), kMaxNumericSize, "%p", data);
+        buffer_.add(len);
+    }
     return *this;
 }
 
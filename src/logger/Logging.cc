@@ -81,31 +81,41 @@ Logger::Impl::Impl(Logger::LogLevel level, int savedErrno, const char *file, int
 }
 
 // Timestamp::toString方法的思路，只不过这里需要输出到流
+// 使用构造时读取的time_，不再读第二次时钟；年月日时分秒只在秒数变化时才格式化一次
 void Logger::Impl::formatTime()
 {
-    Timestamp now = Timestamp::now();
-    time_t seconds = static_cast<time_t>(now.microSecondsSinceEpoch() / Timestamp::kMicroSecondsPerSecond);
-    int microseconds = static_cast<int>(now.microSecondsSinceEpoch() % Timestamp::kMicroSecondsPerSecond);
-
-    struct tm *tm_time = localtime(&seconds);
-    // 写入此线程存储的时间buf中
-    snprintf(ThreadInfo::t_time, sizeof(ThreadInfo::t_time), "%4d/%02d/%02d %02d:%02d:%02d",
-             tm_time->tm_year + 1900,
-             tm_time->tm_mon + 1,
-             tm_time->tm_mday,
-             tm_time->tm_hour,
-             tm_time->tm_min,
-             tm_time->tm_sec);
-    // 更新最后一次时间调用
-    ThreadInfo::t_lastSecond = seconds;
-
-    // muduo使用Fmt格式化整数，这里我们直接写入buf
-    char buf[32] = {0};
-    snprintf(buf, sizeof(buf), "%06d", microseconds);
-
-    // 线程输出时间，附有微秒(之前是(buf, 6),少了一个空格)
-    // 年月日时分秒+微秒
-    stream_ << GeneralTemplate(ThreadInfo::t_time, 17) << GeneralTemplate(buf, 7);
+    time_t seconds = static_cast<time_t>(time_.microSecondsSinceEpoch() / Timestamp::kMicroSecondsPerSecond);
+    int microseconds = static_cast<int>(time_.microSecondsSinceEpoch() % Timestamp::kMicroSecondsPerSecond);
+
+    if (seconds != ThreadInfo::t_lastSecond)
+    {
+        struct tm tm_time;
+        localtime_r(&seconds, &tm_time);
+        // 写入此线程存储的时间buf中
+        snprintf(ThreadInfo::t_time, sizeof(ThreadInfo::t_time), "%4d/%02d/%02d %02d:%02d:%02d",
+                 tm_time.tm_year + 1900,
+                 tm_time.tm_mon + 1,
+                 tm_time.tm_mday,
+                 tm_time.tm_hour,
+                 tm_time.tm_min,
+                 tm_time.tm_sec);
+        // 更新最后一次时间调用
+        ThreadInfo::t_lastSecond = seconds;
+    }
+
+    // muduo使用Fmt格式化整数，这里直接写".微秒 "
+    char buf[8];
+    buf[0] = '.';
+    for (int i = 6; i >= 1; --i)
+    {
+        buf[i] = static_cast<char>('0' + microseconds % 10);
+        microseconds /= 10;
+    }
+    buf[7] = ' ';
+
+    // 线程输出时间，附有微秒
+    // 年月日时分秒(19个字符)+微秒
+    stream_ << GeneralTemplate(ThreadInfo::t_time, 19) << GeneralTemplate(buf, 8);
 }
 
 void Logger::Impl::finish()
@@ -37,6 +37,8 @@ void MemoryPool::createPool()
     pool_->head_->last_ = (unsigned char *)pool_ + sizeof(Pool) + sizeof(SmallNode); // 首个小块内存(block)的使用位置
     pool_->head_->end_ = (unsigned char *)pool_ + PAGE_SIZE;                         // 首个小块内存(block)的末地址
     pool_->head_->failed_ = 0;                                                       // block块失效次数
+    pool_->head_->quote_ = 0;                                                        // block块引用次数
+    pool_->head_->next_ = nullptr;                                                   // posix_memalign不清零内存，必须初始化
     pool_->current_ = pool_->head_;                                                  // 该缓存池当前正在使用的block
 
     return;
@@ -66,7 +68,7 @@ void MemoryPool::destroyPool()
     {
         next = cur->next_;
         free(cur);
-        cur = cur->next_;
+        cur = next;
     }
 
     // pool_中包含头节点，所以free时可以释放小块内存首节点head_
@@ -178,6 +180,8 @@ void *MemoryPool::mallocSmallNode(unsigned long size)
     SmallNode *smallNode = (SmallNode *)block;
     smallNode->end_ = block + PAGE_SIZE;
     smallNode->next_ = nullptr;
+    smallNode->failed_ = 0;
+    smallNode->quote_ = 0;
 
     // 分配新块的起始位置
     // 动态对齐
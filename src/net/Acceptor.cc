@@ -6,6 +6,7 @@
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 static int createNonblocking()
 {
@@ -15,13 +16,15 @@ static int createNonblocking()
         LOG_FATAL << "listen socket create err " << errno;
         // LOG_FATAL("%s:%s:%d listen socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
     }
+    return sockfd;
 }
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop),
       acceptSocket_(createNonblocking()),
       acceptChannel_(loop, acceptSocket_.fd()),
-      listenning_(false)
+      listenning_(false),
+      idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
 {
 
     LOG_DEBUG << "Acceptor create nonblocking socket, [fd = " << acceptChannel_.fd() << "]";
@@ -37,6 +40,7 @@ Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    ::close(idleFd_);
 }
 
 void Acceptor::listen()
@@ -53,7 +57,12 @@ void Acceptor::handleRead()
     int connfd = acceptSocket_.accept(&peerAddr);
     if (connfd >= 0)
     {
-        if (newConnectionCallback_)
+        if (admissionCallback_ && !admissionCallback_(peerAddr))
+        {
+            // 拒绝的连接不创建TcpConnection，直接关闭
+            ::close(connfd);
+        }
+        else if (newConnectionCallback_)
         {
             newConnectionCallback_(connfd, peerAddr); // 轮询找到subLoop，唤醒，分发当前的新客户端的Channel
         }
@@ -76,6 +85,12 @@ void Acceptor::handleRead()
         {
             LOG_ERROR << "sockfd reached limit";
             // LOG_ERROR("%s:%s:%d sockfd reached limit\n", __FILE__, __FUNCTION__, __LINE__);
+            // 连接一直留在accept队列里，LT模式下listenfd会持续可读导致busy loop
+            // 让出预留的fd把这个连接接受下来再关掉，然后重新占住预留的fd
+            ::close(idleFd_);
+            idleFd_ = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+            ::close(idleFd_);
+            idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
         }
     }
 }
\ No newline at end of file
@@ -12,6 +12,8 @@ class Acceptor : noncopyable
 {
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
+    // 准入控制，返回false时新连接在accept之后立即关闭
+    using AdmissionCallback = std::function<bool(const InetAddress&)>;
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
     ~Acceptor();
 
@@ -20,6 +22,8 @@ public:
         newConnectionCallback_ = std::move(cb);
     }
 
+    void setAdmissionCallback(const AdmissionCallback &cb) { admissionCallback_ = cb; }
+
     bool listenning() const {return listenning_;}
     void listen();
 private:
@@ -29,5 +33,7 @@ private:
     Socket acceptSocket_;
     Channel acceptChannel_;
     NewConnectionCallback newConnectionCallback_;
+    AdmissionCallback admissionCallback_;
     bool listenning_;
+    int idleFd_; // 预留的fd，进程fd耗尽(EMFILE)时用来接受并关闭新连接
 };
\ No newline at end of file
@@ -10,20 +10,26 @@ const char Buffer::kCRLF[] = "\r\n";
  * 从fd上读取数据  Poller工作在LT模式
  * Buffer缓冲区是有大小的！ 但是从fd上读数据的时候，却不知道tcp数据最终的大小
  */
-ssize_t Buffer::readFd(int fd, int *saveErrno)
+ssize_t Buffer::readFd(int fd, int *saveErrno, size_t maxBytes)
 {
-    char extrabuf[65536] = {0}; // 栈上的内存空间  64K
+    char extrabuf[65536]; // 栈上的内存空间  64K，readv只写入读到的部分，不需要清零
 
     struct iovec vec[2];
 
     const size_t writable = writableBytes(); // 这是Buffer底层缓冲区剩余的可写空间大小
+    size_t extra = sizeof extrabuf;
+    if (maxBytes > 0)
+    {
+        // 有读取预算时，两块空间加起来不超过maxBytes
+        extra = writable < maxBytes ? std::min(extra, maxBytes - writable) : 0;
+    }
     vec[0].iov_base = begin() + writerIndex_;
-    vec[0].iov_len = writable;
+    vec[0].iov_len = maxBytes > 0 ? std::min(writable, maxBytes) : writable;
 
     vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
+    vec[1].iov_len = extra;
 
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    const int iovcnt = (writable < sizeof extrabuf && extra > 0) ? 2 : 1;
     const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
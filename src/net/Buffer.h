@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <string.h>
 
 // 网络库底层的缓冲器类型定义
 class Buffer
@@ -39,6 +40,12 @@ public:
         return begin() + readerIndex_;
     }
 
+    // 可以原地修改的可读数据（比如WebSocket帧解除掩码）
+    char *beginRead()
+    {
+        return begin() + readerIndex_;
+    }
+
     void retrieveUntil(const char *end)
     {
         retrieve(end - peek());
@@ -108,9 +115,27 @@ public:
     // 这个就是在读位置和写位置之间的数据中找’\r\n’换行,找到的话返回这个指针,没找到返回NULL
     const char *findCRLF() const
     {
-        // FIXME: replace with memmem()?
-        const char *crlf = std::search(peek(), beginWrite(), kCRLF, kCRLF + 2);
-        return crlf == beginWrite() ? NULL : crlf;
+        return findCRLF(peek());
+    }
+
+    // 从start开始找，用memchr找'\r'（glibc中是向量化实现）再检查下一个字符
+    const char *findCRLF(const char *start) const
+    {
+        const char *end = beginWrite();
+        while (start < end)
+        {
+            const char *cr = static_cast<const char *>(memchr(start, '\r', end - start));
+            if (cr == NULL || cr + 1 == end)
+            {
+                return NULL;
+            }
+            if (cr[1] == '\n')
+            {
+                return cr;
+            }
+            start = cr + 1;
+        }
+        return NULL;
     }
 
     char *beginWrite()
@@ -123,8 +148,31 @@ public:
         return begin() + writerIndex_;
     }
 
-    // 从fd上读取数据
-    ssize_t readFd(int fd, int *saveErrno);
+    // 直接向beginWrite()写入len字节以后移动写位置（比如SSL_read解密到缓冲区中）
+    void hasWritten(size_t len)
+    {
+        writerIndex_ += len;
+    }
+
+    // 底层vector占用的内存
+    size_t internalCapacity() const
+    {
+        return buffer_.capacity();
+    }
+
+    // 没有数据并且容量超过maxIdleCapacity时释放内存，回到初始大小
+    void shrinkIfEmpty(size_t maxIdleCapacity)
+    {
+        if (readableBytes() == 0 && buffer_.capacity() > maxIdleCapacity)
+        {
+            std::vector<char>(kCheapPrepend + kInitialSize).swap(buffer_);
+            readerIndex_ = kCheapPrepend;
+            writerIndex_ = kCheapPrepend;
+        }
+    }
+
+    // 从fd上读取数据，一次最多读取maxBytes字节（0表示不限制，最多读满可写空间+64K）
+    ssize_t readFd(int fd, int *saveErrno, size_t maxBytes = 0);
     // 通过fd发送数据
     ssize_t writeFd(int fd, int *saveErrno);
 
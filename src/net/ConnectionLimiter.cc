@@ -0,0 +1,76 @@
+#include "ConnectionLimiter.h"
+#include "InetAddress.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <iterator>
+
+const size_t ConnectionLimiter::kMaxTrackedPeers;
+
+ConnectionLimiter::ConnectionLimiter()
+    : rate_(0),
+      burst_(0),
+      maxConnections_(0),
+      rejectedByRate_(0),
+      rejectedByLimit_(0)
+{
+}
+
+void ConnectionLimiter::setRateLimit(double ratePerSecond, double burst)
+{
+    rate_ = ratePerSecond > 0 ? ratePerSecond / Timestamp::kMicroSecondsPerSecond : 0;
+    burst_ = std::max(burst, 1.0);
+    buckets_.clear();
+    index_.clear();
+}
+
+bool ConnectionLimiter::admit(const InetAddress &peerAddr, size_t activeConnections, Timestamp now)
+{
+    if (maxConnections_ > 0 && activeConnections >= maxConnections_)
+    {
+        ++rejectedByLimit_;
+        LOG_DEBUG << "reject " << peerAddr.toIpPort() << ", too many connections " << activeConnections;
+        return false;
+    }
+    if (rate_ <= 0)
+    {
+        return true;
+    }
+
+    int64_t nowUs = now.microSecondsSinceEpoch();
+    uint32_t ip = peerAddr.getSockAddr()->sin_addr.s_addr;
+    auto it = index_.find(ip);
+    if (it == index_.end())
+    {
+        if (buckets_.size() >= kMaxTrackedPeers)
+        {
+            // 复用最旧的节点，不用重新分配
+            index_.erase(buckets_.back().ip);
+            buckets_.splice(buckets_.begin(), buckets_, std::prev(buckets_.end()));
+        }
+        else
+        {
+            buckets_.emplace_front();
+        }
+        // 新IP从满桶开始
+        Bucket &bucket = buckets_.front();
+        bucket.ip = ip;
+        bucket.tokens = burst_ - 1;
+        bucket.lastRefill = nowUs;
+        index_.emplace(ip, buckets_.begin());
+        return true;
+    }
+
+    buckets_.splice(buckets_.begin(), buckets_, it->second);
+    Bucket &bucket = *it->second;
+    bucket.tokens = std::min(burst_, bucket.tokens + (nowUs - bucket.lastRefill) * rate_);
+    bucket.lastRefill = nowUs;
+    if (bucket.tokens < 1)
+    {
+        ++rejectedByRate_;
+        LOG_DEBUG << "reject " << peerAddr.toIpPort() << ", connection rate limited";
+        return false;
+    }
+    bucket.tokens -= 1;
+    return true;
+}
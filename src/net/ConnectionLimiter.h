@@ -0,0 +1,59 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+
+class InetAddress;
+
+/**
+ * ConnectionLimiter 新连接准入控制，在accept之后、创建TcpConnection之前判断
+ *
+ * 1. 按对端IP的令牌桶限速：每个IP每秒最多新建rate个连接，允许burst个的突发
+ * 2. 全局最大连接数
+ *
+ * 被拒绝的连接直接close，不会分配TcpConnection/Buffer/Channel，也不会注册到epoll、
+ * 不会触发用户回调，连接洪泛时mainLoop和subloop都只付出一次accept+close的代价。
+ * 只在mainLoop（Acceptor所在线程）中使用，不需要加锁。
+ */
+class ConnectionLimiter : noncopyable
+{
+public:
+    ConnectionLimiter();
+
+    // 每个IP每秒允许新建的连接数和突发上限，rate <= 0 表示不限速（默认）
+    void setRateLimit(double ratePerSecond, double burst);
+    // 最大连接数，0表示不限制（默认）
+    void setMaxConnections(size_t maxConnections) { maxConnections_ = maxConnections; }
+
+    // 是否接受来自peerAddr的新连接，activeConnections为当前已有的连接数
+    bool admit(const InetAddress &peerAddr, size_t activeConnections, Timestamp now);
+
+    uint64_t rejectedByRate() const { return rejectedByRate_; }
+    uint64_t rejectedByLimit() const { return rejectedByLimit_; }
+
+    // 最多跟踪的IP个数，超过以后淘汰最久没有新连接的IP（它的令牌桶最可能已经回满）
+    static const size_t kMaxTrackedPeers = 64 * 1024;
+
+private:
+    struct Bucket
+    {
+        uint32_t ip; // IPv4地址
+        double tokens;
+        int64_t lastRefill; // 上次补充令牌的时间（微秒）
+    };
+    using LruList = std::list<Bucket>;
+
+    double rate_;  // 每微秒补充的令牌数
+    double burst_; // 令牌桶容量
+    size_t maxConnections_;
+    // 表的大小有上限，淘汰是O(1)的：大量不同源IP的洪泛下每次accept的代价也是固定的
+    LruList buckets_; // 最近有新连接的在前面
+    std::unordered_map<uint32_t, LruList::iterator> index_;
+
+    uint64_t rejectedByRate_;
+    uint64_t rejectedByLimit_;
+};
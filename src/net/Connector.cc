@@ -0,0 +1,260 @@
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logging.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+static int createNonblockingSocket()
+{
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_ERROR << "Connector socket create err " << errno;
+    }
+    return sockfd;
+}
+
+static int getSocketError(int sockfd)
+{
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+// 本地端口和对端端口相同时（连接本机未监听的端口），TCP可能发生自连接
+static bool isSelfConnect(int sockfd)
+{
+    sockaddr_in local, peer;
+    socklen_t addrlen = sizeof local;
+    ::memset(&local, 0, sizeof local);
+    ::memset(&peer, 0, sizeof peer);
+    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+    {
+        return false;
+    }
+    addrlen = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr *)&peer, &addrlen) < 0)
+    {
+        return false;
+    }
+    return local.sin_port == peer.sin_port && local.sin_addr.s_addr == peer.sin_addr.s_addr;
+}
+
+const int Connector::kMaxRetryDelayMs;
+const int Connector::kInitRetryDelayMs;
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop),
+      serverAddr_(serverAddr),
+      connect_(false),
+      state_(kDisconnected),
+      retryDelayMs_(kInitRetryDelayMs),
+      retries_(0),
+      maxRetries_(-1)
+{
+    LOG_DEBUG << "Connector ctor[" << this << "]";
+}
+
+Connector::~Connector()
+{
+    LOG_DEBUG << "Connector dtor[" << this << "]";
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    if (state_ != kDisconnected)
+    {
+        return;
+    }
+    if (connect_)
+    {
+        connect();
+    }
+    else
+    {
+        LOG_DEBUG << "do not connect";
+    }
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::stopInLoop()
+{
+    loop_->cancel(retryTimer_);
+    if (state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        ::close(sockfd);
+    }
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelayMs_ = kInitRetryDelayMs;
+    retries_ = 0;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblockingSocket();
+    if (sockfd < 0)
+    {
+        if (errorCallback_)
+        {
+            errorCallback_();
+        }
+        return;
+    }
+    int ret = ::connect(sockfd, (sockaddr *)serverAddr_.getSockAddr(), sizeof(sockaddr_in));
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+    case 0:
+    case EINPROGRESS: // 非阻塞connect正在进行
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd);
+        break;
+
+    // 暂时性的错误，重试
+    case EAGAIN:
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+        retry(sockfd);
+        break;
+
+    default:
+        LOG_ERROR << "connect error in Connector::connect " << savedErrno;
+        ::close(sockfd);
+        if (errorCallback_)
+        {
+            errorCallback_();
+        }
+        break;
+    }
+}
+
+// 等待连接完成：sockfd可写时说明connect有了结果
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    channel_->enableWriting();
+}
+
+// 把Channel从poller中移除，并返回sockfd（sockfd的所有权交给调用者）
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 当前可能正处于Channel::handleEvent中，不能在这里直接释放channel_
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel()
+{
+    channel_.reset();
+}
+
+void Connector::handleWrite()
+{
+    if (state_ != kConnecting)
+    {
+        return;
+    }
+
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if (err)
+    {
+        LOG_WARN << "Connector::handleWrite - SO_ERROR = " << err << " " << getErrnoMsg(err);
+        retry(sockfd);
+    }
+    else if (isSelfConnect(sockfd))
+    {
+        LOG_WARN << "Connector::handleWrite - Self connect";
+        retry(sockfd);
+    }
+    else
+    {
+        setState(kConnected);
+        if (connect_ && newConnectionCallback_)
+        {
+            newConnectionCallback_(sockfd);
+        }
+        else
+        {
+            ::close(sockfd);
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    LOG_ERROR << "Connector::handleError state=" << state_;
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_DEBUG << "SO_ERROR = " << err << " " << getErrnoMsg(err);
+        retry(sockfd);
+    }
+}
+
+// 关闭这次失败的sockfd，按指数退避稍后重试
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    if (!connect_)
+    {
+        return;
+    }
+    if (maxRetries_ >= 0 && retries_ >= maxRetries_)
+    {
+        LOG_WARN << "Connector give up connecting to " << serverAddr_.toIpPort() << " after " << retries_ << " retries";
+        connect_ = false;
+        if (errorCallback_)
+        {
+            errorCallback_();
+        }
+        return;
+    }
+
+    LOG_INFO << "Connector::retry - Retry connecting to " << serverAddr_.toIpPort()
+             << " in " << retryDelayMs_ << " milliseconds. ";
+    ++retries_;
+    retryTimer_ = loop_->runAfter(retryDelayMs_ / 1000.0,
+                                  std::bind(&Connector::startInLoop, shared_from_this()));
+    retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+}
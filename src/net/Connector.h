@@ -0,0 +1,76 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <memory>
+
+class Channel;
+class EventLoop;
+
+/**
+ * Connector 负责主动发起连接（TcpServer的Acceptor对应的客户端一侧）
+ *
+ * 非阻塞connect => Channel关注可写事件 => 可写时getsockopt(SO_ERROR)判断是否连接成功
+ * 失败后按指数退避重试：500ms, 1s, 2s ... 最长30s，
+ * 连接成功以后把sockfd交给TcpClient创建TcpConnection，Connector本身不再持有这个fd
+ */
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+    using ErrorCallback = std::function<void()>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+    // 放弃重试（超过最大重试次数）时的回调
+    void setErrorCallback(const ErrorCallback &cb) { errorCallback_ = cb; }
+    // 最大重试次数，负数表示一直重试（默认）
+    void setMaxRetries(int maxRetries) { maxRetries_ = maxRetries; }
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+
+    void start();   // 可以在任意线程调用
+    void restart(); // 只能在loop线程调用
+    void stop();    // 可以在任意线程调用
+
+    static const int kMaxRetryDelayMs = 30 * 1000;
+    static const int kInitRetryDelayMs = 500;
+
+private:
+    enum States
+    {
+        kDisconnected,
+        kConnecting,
+        kConnected
+    };
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    bool connect_; // 是否需要连接（stop()以后为false）
+    States state_;
+    std::unique_ptr<Channel> channel_;
+    NewConnectionCallback newConnectionCallback_;
+    ErrorCallback errorCallback_;
+    int retryDelayMs_;
+    int retries_;
+    int maxRetries_;
+    TimerId retryTimer_; // 等待重试的定时器，stop()时取消
+};
+
+using ConnectorPtr = std::shared_ptr<Connector>;
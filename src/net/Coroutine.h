@@ -0,0 +1,291 @@
+#pragma once
+
+/**
+ * C++20协程支持（需要用 -std=c++20 编译使用协程的代码，库本身不需要）
+ *
+ * 协程建立在已有的EventLoop/Channel/TimerQueue/TcpConnection回调之上，
+ * 所有协程都在连接所属的loop线程中执行和恢复，不需要额外的线程和锁：
+ *
+ *      Task<> echo(TcpConnectionPtr conn)          // 注意按值传递，协程帧里保存一份
+ *      {
+ *          while (size_t n = co_await conn->readSome())
+ *          {
+ *              std::string msg = conn->inputBuffer()->retrieveAllAsString();
+ *              if (!co_await conn->write(msg)) break;  // 等待发送完成（背压）
+ *          }
+ *          conn->shutdown();
+ *      }
+ *
+ *      server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+ *          if (conn->connected()) echo(conn);      // 立即开始执行，Task析构后协程继续独立运行
+ *      });
+ *
+ * 可等待的操作：
+ *      co_await conn->readSome()           输入缓冲区有数据时返回可读字节数，连接关闭返回0
+ *      co_await conn->readUntil("\r\n")    返回到分隔符（含）为止的字节数，连接关闭返回0
+ *      co_await conn->write(data)          数据全部写入内核后返回true，连接断开返回false
+ *      co_await loop->sleep(ms)            定时器
+ *      co_await task                       等待另一个Task<T>完成并取得结果
+ *
+ * 协程帧从线程局部的空闲链表中分配（按64字节分级），处理完一条连接以后
+ * 帧内存留给下一条连接复用，热路径上不经过malloc，也没有std::function和std::bind。
+ */
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <new>
+#include <stdlib.h>
+
+/**
+ * 协程帧分配器：每个线程一组按大小分级的空闲链表
+ * 帧在哪个线程释放就回到哪个线程的链表，链表长度有上限
+ */
+class CoroutineFrameAllocator
+{
+public:
+    static void *allocate(size_t size)
+    {
+        size_t index = sizeClass(size);
+        if (index < kNumClasses)
+        {
+            FreeList &list = cache().lists[index];
+            if (list.head)
+            {
+                FreeNode *node = list.head;
+                list.head = node->next;
+                --list.count;
+                return node;
+            }
+            size = (index + 1) * kAlignment;
+        }
+        void *p = ::malloc(size);
+        if (p == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    static void deallocate(void *p, size_t size)
+    {
+        size_t index = sizeClass(size);
+        if (index < kNumClasses)
+        {
+            FreeList &list = cache().lists[index];
+            if (list.count < kMaxCachedPerClass)
+            {
+                FreeNode *node = static_cast<FreeNode *>(p);
+                node->next = list.head;
+                list.head = node;
+                ++list.count;
+                return;
+            }
+        }
+        ::free(p);
+    }
+
+    static const size_t kAlignment = 64;
+    static const size_t kNumClasses = 32; // 最大缓存2KB的帧
+    static const size_t kMaxCachedPerClass = 1024;
+
+private:
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    struct FreeList
+    {
+        FreeNode *head = nullptr;
+        size_t count = 0;
+    };
+
+    struct Cache
+    {
+        FreeList lists[kNumClasses];
+
+        ~Cache()
+        {
+            for (FreeList &list : lists)
+            {
+                while (list.head)
+                {
+                    FreeNode *node = list.head;
+                    list.head = node->next;
+                    ::free(node);
+                }
+            }
+        }
+    };
+
+    static size_t sizeClass(size_t size) { return (size - 1) / kAlignment; }
+
+    static Cache &cache()
+    {
+        static thread_local Cache t_cache;
+        return t_cache;
+    }
+};
+
+template <typename T>
+class Task;
+
+namespace detail
+{
+    // Task<T>和Task<void>共用的promise部分
+    class TaskPromiseBase
+    {
+    public:
+        // 协程创建后立即执行，直到第一次挂起
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        // 结束时：有等待者则转到等待者；Task已经析构（分离）则销毁帧；否则留给Task析构
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept { return false; }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+            {
+                TaskPromiseBase &promise = h.promise();
+                promise.done_ = true;
+                if (promise.continuation_)
+                {
+                    return promise.continuation_;
+                }
+                if (promise.detached_)
+                {
+                    h.destroy();
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() { exception_ = std::current_exception(); }
+
+        static void *operator new(size_t size) { return CoroutineFrameAllocator::allocate(size); }
+        static void operator delete(void *p, size_t size) { CoroutineFrameAllocator::deallocate(p, size); }
+
+        std::coroutine_handle<> continuation_;
+        std::exception_ptr exception_;
+        bool detached_ = false;
+        bool done_ = false;
+    };
+
+    template <typename T>
+    class TaskPromise : public TaskPromiseBase
+    {
+    public:
+        Task<T> get_return_object();
+
+        template <typename U>
+        void return_value(U &&value) { value_ = std::forward<U>(value); }
+
+        T result()
+        {
+            if (exception_)
+            {
+                std::rethrow_exception(exception_);
+            }
+            return std::move(value_);
+        }
+
+    private:
+        T value_{};
+    };
+
+    template <>
+    class TaskPromise<void> : public TaskPromiseBase
+    {
+    public:
+        Task<void> get_return_object();
+
+        void return_void() noexcept {}
+
+        void result()
+        {
+            if (exception_)
+            {
+                std::rethrow_exception(exception_);
+            }
+        }
+    };
+} // namespace detail
+
+/**
+ * Task<T> 立即执行的协程
+ *
+ * Task对象析构时如果协程还没有结束，协程继续运行（分离），结束时自己释放协程帧；
+ * co_await一个Task会等待它完成并返回co_return的值（协程中抛出的异常在这里重新抛出）。
+ * 没有被co_await的协程中抛出的异常会被忽略，处理函数应当自己捕获。
+ */
+template <typename T = void>
+class Task
+{
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle h) : handle_(h) {}
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() { release(); }
+
+    bool done() const { return !handle_ || handle_.promise().done_; }
+
+    bool await_ready() const noexcept { return done(); }
+    void await_suspend(std::coroutine_handle<> awaiting) noexcept { handle_.promise().continuation_ = awaiting; }
+    T await_resume() { return handle_.promise().result(); }
+
+private:
+    void release()
+    {
+        if (handle_)
+        {
+            if (handle_.promise().done_)
+            {
+                handle_.destroy();
+            }
+            else
+            {
+                handle_.promise().detached_ = true;
+            }
+            handle_ = nullptr;
+        }
+    }
+
+    Handle handle_;
+};
+
+namespace detail
+{
+    template <typename T>
+    inline Task<T> TaskPromise<T>::get_return_object()
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object()
+    {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+} // namespace detail
+
+#endif // __cpp_impl_coroutine
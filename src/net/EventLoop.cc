@@ -7,12 +7,22 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
 #include <memory>
 #include <mutex>
 
 // 防止一个线程创建多个EventLoop   thread_local
 __thread EventLoop *t_loopInThisThread = nullptr;
 
+// 对端已经关闭的连接上write()/sendfile()会收到SIGPIPE，默认动作是终止进程；
+// 忽略以后写操作返回EPIPE，由TcpConnection按写错误处理
+class IgnoreSigPipe
+{
+public:
+    IgnoreSigPipe() { ::signal(SIGPIPE, SIG_IGN); }
+};
+IgnoreSigPipe initObj;
+
 // 定义默认的Poller IO复用接口的超时时间
 const int kPollTimeMs = 10000;
 
@@ -33,10 +43,13 @@ EventLoop::EventLoop()
       quit_(false),
       callingPendingFunctors_(false),
       threadId_(CurrentThread::tid()),
+      pollReturnTime_(Timestamp::now()),
+      pollReturnMonotonic_(Timestamp::monotonic()),
       poller_(Poller::newDefaultPoller(this)),
       wakeupFd_(createEventfd()),
       wakeupChannel_(new Channel(this, wakeupFd_)),
-      currentActiveChannel_(nullptr)
+      currentActiveChannel_(nullptr),
+      timerQueue_(new TimerQueue(this))
 {
     LOG_DEBUG << "EventLoop created " << this << " the index is " << threadId_;
     LOG_DEBUG << "EventLoop created wakeupFd " << wakeupChannel_->fd();
@@ -64,6 +77,11 @@ EventLoop::~EventLoop()
     t_loopInThisThread = nullptr; // 将当前loop对应的线程置为0
 }
 
+EventLoop *EventLoop::getEventLoopOfCurrentThread()
+{
+    return t_loopInThisThread;
+}
+
 // 开启事件循环
 void EventLoop::loop()
 {
@@ -79,6 +97,7 @@ void EventLoop::loop()
         // 监听两类fd   一种是client的fd，一种wakeupfd
         // 接口的超时时间设置为10000
         pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        pollReturnMonotonic_ = Timestamp::monotonic();
         for (Channel *channel : activeChannels_)
         {
             // Poller监听哪些channel发生事件了，然后上报给EventLoop，通知channel处理相应的事件
@@ -5,6 +5,9 @@
 #include <vector>
 #include <memory>
 #include <mutex>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
 
 #include "noncopyable.h"
 #include "Timestamp.h"
@@ -30,6 +33,14 @@ public:
 
     Timestamp poolReturnTime() const { return pollReturnTime_; }
 
+    /**
+     * 缓存的当前时间，每轮poll返回时刷新一次，只能在loop线程中使用。
+     * 精度是一轮事件循环，用于日志、超时、统计等不需要精确时间的地方，读取不需要系统调用。
+     * now()是墙上时间；monotonicNow()是CLOCK_MONOTONIC时间，不受NTP调整影响，计算时间间隔用它
+     */
+    Timestamp now() const { return pollReturnTime_; }
+    Timestamp monotonicNow() const { return pollReturnMonotonic_; }
+
     // 在当前loop中执行cb
     void runInLoop(Functor cb);
     /**
@@ -54,27 +65,55 @@ public:
 
     // 判断运行当前EventLoop的线程是否是当前使用的线程
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
+    // 当前线程的EventLoop，没有时返回nullptr
+    static EventLoop *getEventLoopOfCurrentThread();
 
     /**
      * 定时任务相关函数
+     * TimerQueue使用CLOCK_MONOTONIC时间，修改系统时间不会让定时器提前或推迟触发
+     * 到期时间从调用时新读取的当前时间算起：用now()/monotonicNow()的缓存时间会让定时器
+     * 提前本轮事件处理已经花掉的时间触发（sleep()、内存预算的重新检查都依赖准确的间隔）
      */
-    void runAt(Timestamp timestamp, Functor&& cb){
-        //添加非重复时间并立刻执行
-        timerQueue_->addTimer(std::move(cb), timestamp, 0.0);
+    //在墙上时间timestamp执行，换算成距离现在的间隔
+    TimerId runAt(Timestamp timestamp, Functor cb){
+        double delay = static_cast<double>(timestamp.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch()) / Timestamp::kMicroSecondsPerSecond;
+        return runAfter(delay, std::move(cb));
     }
 
     //添加非重复事件并在waitTime后执行
-    void runAfter(double waitTime, Functor&& cb){
-        Timestamp time(addTime(Timestamp::now(), waitTime));
-        runAt(time, std::move(cb));
+    TimerId runAfter(double waitTime, Functor cb){
+        Timestamp time(addTime(Timestamp::monotonic(), waitTime));
+        return timerQueue_->addTimer(std::move(cb), time, 0.0);
     }
 
     //添加重复事件且间隔为interval，并在interval时长后执行
-    void runEvery(double interval, Functor&& cb){
-        Timestamp timestamp(addTime(Timestamp::now(), interval));
-        timerQueue_->addTimer(std::move(cb), timestamp, interval);
+    TimerId runEvery(double interval, Functor cb){
+        Timestamp timestamp(addTime(Timestamp::monotonic(), interval));
+        return timerQueue_->addTimer(std::move(cb), timestamp, interval);
     }
 
+    //取消定时器，定时器已经执行完（或已取消）时什么也不做
+    void cancel(TimerId timerId){
+        timerQueue_->cancel(timerId);
+    }
+
+#if defined(__cpp_impl_coroutine)
+    // co_await loop->sleep(ms)：协程挂起ms毫秒后由定时器恢复，只能在loop线程中使用（见Coroutine.h）
+    struct SleepAwaiter
+    {
+        EventLoop *loop_;
+        int ms_;
+
+        bool await_ready() const noexcept { return ms_ <= 0; }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            loop_->runAfter(ms_ / 1000.0, [h]() { h.resume(); });
+        }
+        void await_resume() const noexcept {}
+    };
+    SleepAwaiter sleep(int ms) { return SleepAwaiter{this, ms}; }
+#endif
+
 private:
     void handleRead();        // wake up
     void doPendingFunctors(); // 执行回调
@@ -86,7 +125,8 @@ private:
 
     const pid_t threadId_; // 记录当前loop所在线程的id
 
-    Timestamp pollReturnTime_; // poller返回发生事件的channels的时间点
+    Timestamp pollReturnTime_;      // poller返回发生事件的channels的时间点
+    Timestamp pollReturnMonotonic_; // 同一时刻的CLOCK_MONOTONIC时间
 
     std::unique_ptr<Poller> poller_;
     // 主要作用，当mainLoop获取一个新用户的channel，通过轮询算法选择一个subloop，通过该成员唤醒subloop处理channel
@@ -0,0 +1,74 @@
+#include "MemoryBudget.h"
+#include "TcpConnection.h"
+#include "Logging.h"
+
+MemoryBudget::MemoryBudget()
+    : used_(0),
+      limit_(0),
+      connectionLimit_(0),
+      pausedTimes_(0)
+{
+}
+
+void MemoryBudget::setShedCallback(const ShedCallback &cb)
+{
+    std::lock_guard<std::mutex> lock(shedMutex_);
+    shedCallback_ = cb;
+}
+
+void MemoryBudget::charge(int64_t delta)
+{
+    int64_t before = used_.fetch_add(delta, std::memory_order_relaxed);
+    int64_t after = before + delta;
+    if (limit_ == 0)
+    {
+        return;
+    }
+
+    const int64_t low = static_cast<int64_t>(lowWater());
+    const int64_t hard = static_cast<int64_t>(hardLimit());
+    if (delta < 0 && before > low && after <= low)
+    {
+        resumeAll();
+    }
+    else if (delta > 0 && before <= hard && after > hard)
+    {
+        LOG_WARN << "MemoryBudget: usage " << after << " exceeds hard limit " << hard;
+        std::lock_guard<std::mutex> lock(shedMutex_);
+        if (shedCallback_)
+        {
+            shedCallback_();
+        }
+    }
+}
+
+void MemoryBudget::pause(const TcpConnectionPtr &conn)
+{
+    ++pausedTimes_;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        paused_.push_back(conn);
+    }
+    // 暂停之前用量可能已经降下来，resumeAll()已经执行过，这里不能等下一次
+    if (usage() <= lowWater())
+    {
+        resumeAll();
+    }
+}
+
+void MemoryBudget::resumeAll()
+{
+    std::vector<std::weak_ptr<TcpConnection>> paused;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        paused.swap(paused_);
+    }
+    for (const std::weak_ptr<TcpConnection> &weak : paused)
+    {
+        TcpConnectionPtr conn(weak.lock());
+        if (conn)
+        {
+            conn->resumeRead();
+        }
+    }
+}
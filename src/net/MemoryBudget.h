@@ -0,0 +1,68 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+/**
+ * MemoryBudget 一个TcpServer所有连接的缓冲区内存预算，被所有subloop共享
+ *
+ * 每条TcpConnection把inputBuffer_、outputBuffer_的容量以及跨线程send()排队中的数据计入预算：
+ * 1. 超过limit：读事件到来的连接暂停读取（数据留在内核，TCP窗口形成背压），TcpServer拒绝新连接；
+ *    用量降到limit的3/4以下时恢复所有被暂停的连接，被暂停的连接自己也会定期重新检查
+ * 2. 超过limit的5/4：暂停读取已经降不下来（输出堆积在慢客户端上），通知TcpServer关闭占用最多的连接
+ * 3. 单条连接超过connectionLimit：直接关闭这条连接
+ *
+ * 计数是原子操作，只有跨越阈值时才加锁。
+ */
+class MemoryBudget : noncopyable
+{
+public:
+    using ShedCallback = std::function<void()>;
+
+    MemoryBudget();
+
+    // 0表示不限制
+    void setLimit(size_t bytes) { limit_ = bytes; }
+    void setConnectionLimit(size_t bytes) { connectionLimit_ = bytes; }
+    size_t limit() const { return limit_; }
+    size_t connectionLimit() const { return connectionLimit_; }
+
+    // 超过硬上限时调用（可能在任意subloop线程中），每次越过硬上限只调用一次；
+    // 回调在锁内执行，setShedCallback()返回以后旧的回调不会再被调用，回调要尽快返回
+    void setShedCallback(const ShedCallback &cb);
+
+    // 增加/减少用量，可以在任意线程调用
+    void charge(int64_t delta);
+
+    size_t usage() const
+    {
+        int64_t used = used_.load(std::memory_order_relaxed);
+        return used > 0 ? static_cast<size_t>(used) : 0;
+    }
+    bool overLimit() const { return limit_ > 0 && usage() > limit_; }
+
+    // 因为超出预算暂停读取的连接，用量降下来以后恢复
+    void pause(const TcpConnectionPtr &conn);
+    uint64_t pausedTimes() const { return pausedTimes_; }
+
+private:
+    size_t lowWater() const { return limit_ / 4 * 3; }
+    size_t hardLimit() const { return limit_ / 4 * 5; }
+    void resumeAll();
+
+    std::atomic<int64_t> used_;
+    size_t limit_;
+    size_t connectionLimit_;
+    std::mutex shedMutex_; // 保护shedCallback_，subloop调用时TcpServer可能正在析构中清空它
+    ShedCallback shedCallback_;
+
+    std::mutex mutex_;
+    std::vector<std::weak_ptr<TcpConnection>> paused_;
+    std::atomic<uint64_t> pausedTimes_;
+};
@@ -0,0 +1,166 @@
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Logging.h"
+
+#include <sys/socket.h>
+#include <strings.h>
+#include <stdio.h>
+
+static void defaultConnectionCallback(const TcpConnectionPtr &conn)
+{
+    LOG_DEBUG << conn->localAddress().toIpPort() << " -> " << conn->peerAddress().toIpPort()
+              << " is " << (conn->connected() ? "UP" : "DOWN");
+}
+
+static void defaultMessageCallback(const TcpConnectionPtr &, Buffer *buf, Timestamp)
+{
+    buf->retrieveAll();
+}
+
+// TcpClient析构时连接仍然存在，连接关闭时不能再回调已经析构的TcpClient
+static void detachConnection(EventLoop *loop, const TcpConnectionPtr &conn)
+{
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+// 延长Connector的生命期，等待它的Channel和定时器结束
+static void removeConnector(const ConnectorPtr &)
+{
+}
+
+static sockaddr_in getLocalAddr(int sockfd)
+{
+    sockaddr_in local;
+    ::bzero(&local, sizeof local);
+    socklen_t addrlen = sizeof local;
+    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+    {
+        LOG_ERROR << "sockets::getLocalAddr() failed";
+    }
+    return local;
+}
+
+static sockaddr_in getPeerAddr(int sockfd)
+{
+    sockaddr_in peer;
+    ::bzero(&peer, sizeof peer);
+    socklen_t addrlen = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr *)&peer, &addrlen) < 0)
+    {
+        LOG_ERROR << "sockets::getPeerAddr() failed";
+    }
+    return peer;
+}
+
+TcpClient::TcpClient(EventLoop *loop,
+                     const InetAddress &serverAddr,
+                     const std::string &nameArg)
+    : loop_(loop),
+      connector_(new Connector(loop, serverAddr)),
+      name_(nameArg),
+      connectionCallback_(defaultConnectionCallback),
+      messageCallback_(defaultMessageCallback),
+      retry_(false),
+      connect_(true),
+      nextConnId_(1)
+{
+    // 连接成功以后由Connector回调
+    connector_->setNewConnectionCallback(
+        std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_INFO << "TcpClient::TcpClient[" << name_ << "] - connector " << connector_.get();
+}
+
+TcpClient::~TcpClient()
+{
+    LOG_INFO << "TcpClient::~TcpClient[" << name_ << "] - connector " << connector_.get();
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        unique = connection_.use_count() == 1;
+        conn = connection_;
+    }
+    if (conn)
+    {
+        // 连接还活着：把关闭回调换成不依赖TcpClient的版本
+        CloseCallback cb = std::bind(&detachConnection, loop_, std::placeholders::_1);
+        loop_->runInLoop(std::bind(&TcpConnection::setCloseCallback, conn, cb));
+        if (unique)
+        {
+            conn->forceClose();
+        }
+    }
+    else
+    {
+        connector_->stop();
+        loop_->runAfter(1, std::bind(&removeConnector, connector_));
+    }
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO << "TcpClient::connect[" << name_ << "] - connecting to "
+             << connector_->serverAddress().toIpPort();
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (connection_)
+        {
+            connection_->shutdown();
+        }
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    InetAddress peerAddr(getPeerAddr(sockfd));
+    char buf[64] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    InetAddress localAddr(getLocalAddr(sockfd));
+    TcpConnectionPtr conn(new TcpConnection(loop_,
+                                            connName,
+                                            sockfd,
+                                            localAddr,
+                                            peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(
+        std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO << "TcpClient::connect[" << name_ << "] - Reconnecting to "
+                 << connector_->serverAddress().toIpPort();
+        connector_->restart();
+    }
+}
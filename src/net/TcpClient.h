@@ -0,0 +1,67 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Connector.h"
+#include "TcpConnection.h"
+
+#include <mutex>
+#include <string>
+
+class EventLoop;
+
+/**
+ * 对外的客户端编程使用的类，和TcpServer对应
+ *
+ * TcpClient => Connector 非阻塞connect（失败指数退避重试）=> 连接成功拿到sockfd
+ * => 在loop上创建TcpConnection，之后的读写和TcpServer侧的连接完全一样
+ * 一个TcpClient同一时刻最多管理一条连接，开启retry后断线会自动重连
+ */
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop,
+              const InetAddress &serverAddr,
+              const std::string &nameArg);
+    ~TcpClient();
+
+    void connect();
+    void disconnect();
+    void stop();
+
+    TcpConnectionPtr connection() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop *getLoop() const { return loop_; }
+    bool retry() const { return retry_; }
+    // 连接断开以后自动重连
+    void enableRetry() { retry_ = true; }
+
+    const std::string &name() const { return name_; }
+
+    // 以下回调都不是线程安全的，需要在connect()之前设置
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+
+private:
+    // 在loop线程中被Connector回调
+    void newConnection(int sockfd);
+    // 在loop线程中被TcpConnection回调
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    bool retry_;
+    bool connect_;
+    int nextConnId_; // 只在loop线程中使用
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_; // 由mutex_保护
+};
@@ -0,0 +1,264 @@
+#include "TcpClientPool.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Logging.h"
+
+#include <sys/socket.h>
+#include <strings.h>
+#include <stdio.h>
+#include <algorithm>
+
+// 延长Connector的生命期：回调发生时正处于Connector::handleWrite之中，不能在这里析构它
+static void keepConnectorAlive(const ConnectorPtr &)
+{
+}
+
+TcpClientPool::TcpClientPool(EventLoop *loop, const std::string &name)
+    : loop_(loop),
+      name_(name),
+      maxIdlePerHost_(16),
+      maxConnectionsPerHost_(0),
+      connectRetries_(2),
+      nextConnId_(1)
+{
+}
+
+TcpClientPool::~TcpClientPool()
+{
+    for (auto &item : connectors_)
+    {
+        item.second->stop();
+    }
+    for (auto &item : connections_)
+    {
+        TcpConnectionPtr conn(item.second.conn);
+        item.second.conn.reset();
+        conn->getLoop()->runInLoop(
+            std::bind(&TcpConnection::connectDestroyed, conn));
+    }
+}
+
+uint64_t TcpClientPool::hostKey(const InetAddress &addr)
+{
+    const sockaddr_in *sa = addr.getSockAddr();
+    return (static_cast<uint64_t>(sa->sin_addr.s_addr) << 16) | sa->sin_port;
+}
+
+size_t TcpClientPool::idleConnections() const
+{
+    size_t n = 0;
+    for (const auto &item : hosts_)
+    {
+        n += item.second.idle.size();
+    }
+    return n;
+}
+
+void TcpClientPool::acquire(const InetAddress &addr, const AcquireCallback &cb)
+{
+    uint64_t key = hostKey(addr);
+    Host &host = hosts_[key];
+    host.addr = addr;
+
+    // 优先复用空闲连接
+    while (!host.idle.empty())
+    {
+        TcpConnectionPtr conn(std::move(host.idle.back()));
+        host.idle.pop_back();
+        if (conn->connected())
+        {
+            cb(conn);
+            return;
+        }
+    }
+
+    host.waiters.push_back(cb);
+    if (maxConnectionsPerHost_ == 0 || host.total + host.connecting < maxConnectionsPerHost_)
+    {
+        connect(key, host);
+    }
+}
+
+void TcpClientPool::connect(uint64_t key, Host &host)
+{
+    ConnectorPtr connector(new Connector(loop_, host.addr));
+    connector->setMaxRetries(connectRetries_);
+    connector->setNewConnectionCallback(
+        std::bind(&TcpClientPool::newConnection, this, key, connector.get(), std::placeholders::_1));
+    connector->setErrorCallback(
+        std::bind(&TcpClientPool::connectFailed, this, key, connector.get()));
+    connectors_[connector.get()] = connector;
+    ++host.connecting;
+    connector->start();
+}
+
+ConnectorPtr TcpClientPool::takeConnector(Connector *connector)
+{
+    ConnectorPtr ptr;
+    auto it = connectors_.find(connector);
+    if (it != connectors_.end())
+    {
+        ptr = it->second;
+        connectors_.erase(it);
+        loop_->queueInLoop(std::bind(&keepConnectorAlive, ptr));
+    }
+    return ptr;
+}
+
+void TcpClientPool::newConnection(uint64_t key, Connector *connector, int sockfd)
+{
+    takeConnector(connector);
+    Host &host = hosts_[key];
+    --host.connecting;
+    ++host.total;
+
+    sockaddr_in local;
+    ::bzero(&local, sizeof local);
+    socklen_t addrlen = sizeof local;
+    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+    {
+        LOG_ERROR << "sockets::getLocalAddr() failed";
+    }
+
+    char buf[64] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", host.addr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    TcpConnectionPtr conn(new TcpConnection(loop_,
+                                            name_ + buf,
+                                            sockfd,
+                                            InetAddress(local),
+                                            host.addr));
+    conn->setConnectionCallback(std::bind(&TcpClientPool::onConnection, this, std::placeholders::_1));
+    conn->setMessageCallback(std::bind(&TcpClientPool::onIdleMessage, this,
+                                       std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    conn->setCloseCallback(std::bind(&TcpClientPool::removeConnection, this, std::placeholders::_1));
+    Pooled &pooled = connections_[conn.get()];
+    pooled.conn = conn;
+    pooled.key = key;
+    conn->connectEstablished();
+
+    if (!host.waiters.empty())
+    {
+        AcquireCallback cb(std::move(host.waiters.front()));
+        host.waiters.pop_front();
+        cb(conn);
+    }
+    else if (host.idle.size() < maxIdlePerHost_)
+    {
+        host.idle.push_back(conn);
+    }
+    else
+    {
+        conn->shutdown();
+    }
+}
+
+void TcpClientPool::connectFailed(uint64_t key, Connector *connector)
+{
+    takeConnector(connector);
+    Host &host = hosts_[key];
+    --host.connecting;
+    LOG_WARN << "TcpClientPool[" << name_ << "] connect to " << host.addr.toIpPort() << " failed";
+    std::vector<AcquireCallback> failed;
+    if (!host.waiters.empty())
+    {
+        failed.push_back(std::move(host.waiters.front()));
+        host.waiters.pop_front();
+    }
+    // 没有已建立的连接可以归还时，只有正在建立的连接能满足排队的acquire，
+    // 多出来的等待者也一起失败，否则上游一直连不上时它们会永远等下去
+    size_t keep = host.connecting;
+    if (host.total == 0 && host.waiters.size() > keep)
+    {
+        for (auto it = host.waiters.begin() + keep; it != host.waiters.end(); ++it)
+        {
+            failed.push_back(std::move(*it));
+        }
+        host.waiters.erase(host.waiters.begin() + keep, host.waiters.end());
+    }
+    // 回调中可能再次acquire，先从队列中取出来再调用
+    for (const AcquireCallback &cb : failed)
+    {
+        cb(TcpConnectionPtr());
+    }
+}
+
+void TcpClientPool::release(const TcpConnectionPtr &conn)
+{
+    // release往往是在借用者自己的消息回调中调用的，
+    // 放到下一轮再把回调换回来，避免析构正在执行的std::function
+    loop_->queueInLoop(std::bind(&TcpClientPool::releaseInLoop, this, conn));
+}
+
+void TcpClientPool::releaseInLoop(const TcpConnectionPtr &conn)
+{
+    auto it = connections_.find(conn.get());
+    if (it == connections_.end() || !conn->connected())
+    {
+        // 连接已经断开，removeConnection会负责清理
+        return;
+    }
+
+    conn->setConnectionCallback(std::bind(&TcpClientPool::onConnection, this, std::placeholders::_1));
+    conn->setMessageCallback(std::bind(&TcpClientPool::onIdleMessage, this,
+                                       std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    conn->setWriteCompleteCallback(WriteCompleteCallback());
+
+    Host &host = hosts_[it->second.key];
+    if (!host.waiters.empty())
+    {
+        AcquireCallback cb(std::move(host.waiters.front()));
+        host.waiters.pop_front();
+        cb(conn);
+    }
+    else if (host.idle.size() < maxIdlePerHost_)
+    {
+        host.idle.push_back(conn);
+    }
+    else
+    {
+        conn->shutdown();
+    }
+}
+
+void TcpClientPool::removeConnection(const TcpConnectionPtr &conn)
+{
+    auto it = connections_.find(conn.get());
+    if (it == connections_.end())
+    {
+        return;
+    }
+    uint64_t key = it->second.key;
+    connections_.erase(it);
+
+    Host &host = hosts_[key];
+    --host.total;
+    auto idle = std::find(host.idle.begin(), host.idle.end(), conn);
+    if (idle != host.idle.end())
+    {
+        host.idle.erase(idle);
+    }
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+
+    // 有连接数上限时，空出来的名额留给排队的acquire
+    if (host.waiters.size() > host.connecting &&
+        (maxConnectionsPerHost_ == 0 || host.total + host.connecting < maxConnectionsPerHost_))
+    {
+        connect(key, host);
+    }
+}
+
+void TcpClientPool::onConnection(const TcpConnectionPtr &conn)
+{
+    LOG_DEBUG << "TcpClientPool[" << name_ << "] " << conn->name() << " is "
+              << (conn->connected() ? "UP" : "DOWN");
+}
+
+// 空闲连接上不应该收到数据，协议状态已经不可信，直接关闭
+void TcpClientPool::onIdleMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    LOG_WARN << "TcpClientPool[" << name_ << "] unexpected " << buf->readableBytes()
+             << " bytes on idle connection " << conn->name();
+    buf->retrieveAll();
+    conn->forceClose();
+}
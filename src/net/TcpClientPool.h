@@ -0,0 +1,100 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Connector.h"
+#include "InetAddress.h"
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+class EventLoop;
+
+/**
+ * TcpClientPool 每个EventLoop一个的上游连接池，按上游地址(ip:port)分组
+ *
+ * 服务端连接在哪个subloop上，就从这个subloop自己的池子里借上游连接，
+ * 请求和响应都在同一个线程里完成，不需要阻塞socket也不需要线程间切换。
+ * 一般在TcpServer的ThreadInitCallback里为每个loop创建一个：
+ *
+ *      thread_local std::unique_ptr<TcpClientPool> t_pool;
+ *      server.setThreadInitCallback([](EventLoop *loop) { t_pool.reset(new TcpClientPool(loop, "backend")); });
+ *
+ *      t_pool->acquire(backendAddr, [](const TcpConnectionPtr &upstream) {
+ *          if (!upstream) { 连接失败 ... return; }
+ *          upstream->setMessageCallback(...);
+ *          upstream->send(request);
+ *          ... 收到完整响应以后 t_pool->release(upstream);
+ *      });
+ *
+ * acquire/release都只能在所属loop的线程中调用，回调也在该线程中执行。
+ * 借出的连接可以随意设置消息回调；归还时池子会把回调换回空闲状态的处理函数，
+ * 空闲连接上收到数据或者被对端关闭都会直接丢弃这条连接。
+ */
+class TcpClientPool : noncopyable
+{
+public:
+    // 借到的连接，连接失败时参数为空指针
+    using AcquireCallback = std::function<void(const TcpConnectionPtr &)>;
+
+    TcpClientPool(EventLoop *loop, const std::string &name);
+    ~TcpClientPool();
+
+    void acquire(const InetAddress &addr, const AcquireCallback &cb);
+    void release(const TcpConnectionPtr &conn);
+
+    // 每个上游最多保留的空闲连接数（默认16）
+    void setMaxIdlePerHost(size_t n) { maxIdlePerHost_ = n; }
+    // 每个上游最多同时存在的连接数（含连接中的），0表示不限制（默认）；超过以后acquire排队等待归还
+    void setMaxConnectionsPerHost(size_t n) { maxConnectionsPerHost_ = n; }
+    // 建立连接失败时的重试次数（默认2次，按Connector的指数退避）
+    void setConnectRetries(int n) { connectRetries_ = n; }
+
+    EventLoop *getLoop() const { return loop_; }
+    const std::string &name() const { return name_; }
+    size_t idleConnections() const;
+    size_t totalConnections() const { return connections_.size(); }
+
+private:
+    struct Host
+    {
+        InetAddress addr;
+        std::vector<TcpConnectionPtr> idle; // 空闲连接，后进先出（最近使用过的连接更可能仍然可用）
+        std::deque<AcquireCallback> waiters; // 等待连接的acquire
+        size_t total = 0;                   // 已建立的连接数
+        size_t connecting = 0;              // 正在建立的连接数
+    };
+
+    // 池子创建的每一条连接
+    struct Pooled
+    {
+        TcpConnectionPtr conn;
+        uint64_t key; // 所属上游
+    };
+
+    using HostMap = std::unordered_map<uint64_t, Host>;
+
+    static uint64_t hostKey(const InetAddress &addr);
+
+    void connect(uint64_t key, Host &host);
+    ConnectorPtr takeConnector(Connector *connector);
+    void newConnection(uint64_t key, Connector *connector, int sockfd);
+    void connectFailed(uint64_t key, Connector *connector);
+    void releaseInLoop(const TcpConnectionPtr &conn);
+    void removeConnection(const TcpConnectionPtr &conn);
+    void onIdleMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp);
+    void onConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    const std::string name_;
+    size_t maxIdlePerHost_;
+    size_t maxConnectionsPerHost_;
+    int connectRetries_;
+    int nextConnId_;
+    HostMap hosts_;
+    std::unordered_map<TcpConnection *, Pooled> connections_;
+    std::unordered_map<Connector *, ConnectorPtr> connectors_; // 正在连接中的Connector
+};
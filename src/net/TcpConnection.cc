@@ -4,6 +4,13 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "TlsSession.h"
+#include "MemoryBudget.h"
+
+#include <algorithm>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -28,7 +35,15 @@ TcpConnection::TcpConnection(EventLoop *loop,
       channel_(new Channel(loop, sockfd)),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024) // 64M
+      highWaterMark_(64 * 1024 * 1024), // 64M
+      readBudget_(0),
+      readWaiter_{nullptr, nullptr},
+      writeWaiter_{nullptr, nullptr},
+      coReading_(false),
+      memoryUsage_(0),
+      queuedBytes_(0),
+      pausedByBudget_(false),
+      bufferWritten_(0)
 {
     // 下面给channel设置相应的回调函数，poller给channel通知感兴趣的事件发生了，
     //  channel会回调相应的操作函数
@@ -50,6 +65,10 @@ TcpConnection::TcpConnection(EventLoop *loop,
 TcpConnection::~TcpConnection()
 {
     LOG_INFO << "TcpConnection::dtor[" << name_.c_str() << "] at fd=" << channel_->fd() << " state=" << static_cast<int>(state_);
+    if (budget_)
+    {
+        budget_->charge(-static_cast<int64_t>(memoryUsage_ + queuedBytes_));
+    }
     // LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n",
     //          name_.c_str(), channel_->fd(), (int)state_);
 }
@@ -65,14 +84,14 @@ void TcpConnection::send(const std::string &buf)
         }
         else
         {
-            // 遇到重载函数的绑定，可以使用函数指针来指定确切的函数
-            void (TcpConnection::*fp)(const void *data, size_t len) = &TcpConnection::sendInLoop;
-
-            loop_->runInLoop(std::bind( // 如果不在，唤醒对应线程，随后对应线程执行回调函数
-                fp,
-                this,
-                buf.c_str(),
-                buf.size()));
+            // 如果不在，唤醒对应线程，随后对应线程执行回调函数；
+            // 数据要拷贝一份，调用者的buf在回调执行之前可能已经释放
+            if (budget_)
+            {
+                queuedBytes_ += buf.size();
+                budget_->charge(static_cast<int64_t>(buf.size()));
+            }
+            loop_->runInLoop(std::bind(&TcpConnection::sendQueued, shared_from_this(), buf));
         }
     }
 }
@@ -88,9 +107,13 @@ void TcpConnection::send(Buffer *buf)
         }
         else
         {
-            // sendInLoop有多重重载，需要使用函数指针确定
-            void (TcpConnection::*fp)(const std::string &message) = &TcpConnection::sendInLoop;
-            loop_->runInLoop(std::bind(fp, this, buf->retrieveAllAsString()));
+            std::string message(buf->retrieveAllAsString());
+            if (budget_)
+            {
+                queuedBytes_ += message.size();
+                budget_->charge(static_cast<int64_t>(message.size()));
+            }
+            loop_->runInLoop(std::bind(&TcpConnection::sendQueued, shared_from_this(), std::move(message)));
         }
     }
 }
@@ -100,10 +123,21 @@ void TcpConnection::sendInLoop(const std::string &message)
     sendInLoop(message.data(), message.size());
 }
 
+// 其他线程send()的数据，进入loop线程以后从排队中扣除
+void TcpConnection::sendQueued(const std::string &message)
+{
+    if (budget_)
+    {
+        queuedBytes_ -= message.size();
+        budget_->charge(-static_cast<int64_t>(message.size()));
+    }
+    sendInLoop(message.data(), message.size());
+}
+
 /**
  * 发送数据  应用写的快， 而内核发送数据慢， 需要把待发送数据写入缓冲区， 而且设置了水位回调
  */
-void TcpConnection::sendInLoop(const void *data, size_t len)
+bool TcpConnection::sendInLoop(const void *data, size_t len)
 {
     ssize_t nwrote = 0;
     size_t remaining = len; // 没发送完的数据长度
@@ -115,13 +149,13 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     {
         LOG_ERROR << "disconnected, give up writing";
         // LOG_ERROR("disconnected, give up writing!");
-        return;
+        return false;
     }
 
     // 表示channel_现在不在写数据，而且缓冲区没有待发送数据
     if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len); // 写入数据，返回写入数据大小
+        nwrote = writeSocket(data, len); // 写入数据，返回写入数据大小
         if (nwrote >= 0)                             // 若写入数据
         {
             remaining = len - nwrote;
@@ -173,7 +207,164 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
             // 更新缓冲区并把发送缓冲区中的数据全部发送完成
             channel_->enableWriting();
         }
+        updateMemoryUsage();
     }
+    return !faultError;
+}
+
+// 重新统计两个缓冲区的容量，只在loop线程中调用
+void TcpConnection::updateMemoryUsage()
+{
+    if (!budget_)
+    {
+        return;
+    }
+    inputBuffer_.shrinkIfEmpty(kMaxIdleBufferSize);
+    outputBuffer_.shrinkIfEmpty(kMaxIdleBufferSize);
+    size_t usage = inputBuffer_.internalCapacity() + outputBuffer_.internalCapacity();
+    size_t old = memoryUsage_;
+    if (usage != old)
+    {
+        memoryUsage_ = usage;
+        budget_->charge(static_cast<int64_t>(usage) - static_cast<int64_t>(old));
+    }
+
+    size_t connectionLimit = budget_->connectionLimit();
+    if (connectionLimit > 0 && usage + queuedBytes_ > connectionLimit && state_ == kConnected)
+    {
+        LOG_WARN << "TcpConnection [" << name_.c_str() << "] uses " << usage + queuedBytes_
+                 << " bytes, exceeds connection memory limit " << connectionLimit;
+        forceClose();
+    }
+}
+
+void TcpConnection::sendFile(const std::shared_ptr<void> &owner, int fd, off_t offset, size_t count, Buffer *header)
+{
+    if (state_ != kConnected)
+    {
+        return;
+    }
+    if (header)
+    {
+        // 放在outputBuffer_中，由writeFiles()和文件一起发送
+        outputBuffer_.append(header->peek(), header->readableBytes());
+        header->retrieveAll();
+    }
+    if (count > 0)
+    {
+        files_.push_back(FileSegment{owner, fd, offset, count, bufferWritten_ + outputBuffer_.readableBytes()});
+    }
+    if (channel_->isWriting())
+    {
+        // 之前的数据还没有写完，文件排在后面，由handleWrite发送
+        return;
+    }
+
+    // 没有积压，马上尝试发送；小文件通常一次写完，不需要等一次可写事件
+    ssize_t n = writeFiles();
+    if (n < 0 && errno != EAGAIN)
+    {
+        LOG_ERROR << "TcpConnection::sendFile";
+        if (errno == EPIPE || errno == ECONNRESET)
+        {
+            return;
+        }
+    }
+    updateMemoryUsage();
+    if (files_.empty() && outputBuffer_.readableBytes() == 0)
+    {
+        if (writeCompleteCallback_)
+        {
+            loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+        }
+    }
+    else
+    {
+        channel_->enableWriting();
+    }
+}
+
+ssize_t TcpConnection::writeFiles()
+{
+    ssize_t total = 0;
+    while (true)
+    {
+        ssize_t n = 0;
+        size_t expected = 0;
+        // outputBuffer_中排在下一个文件前面的数据
+        size_t before = files_.empty() ? outputBuffer_.readableBytes()
+                                       : static_cast<size_t>(files_.front().position - bufferWritten_);
+        if (before > 0)
+        {
+            expected = before;
+            n = writeSocket(outputBuffer_.peek(), before, !files_.empty());
+            if (n > 0)
+            {
+                outputBuffer_.retrieve(n);
+                bufferWritten_ += n;
+            }
+        }
+        else if (!files_.empty())
+        {
+            FileSegment &file = files_.front();
+            expected = file.remaining;
+            n = writeFile(file.fd, &file.offset, file.remaining);
+            if (n == 0)
+            {
+                // 文件在发送过程中被截短了，响应已经不完整，只能关闭连接
+                LOG_ERROR << "TcpConnection::writeFiles file truncated, fd=" << file.fd;
+                files_.clear();
+                outputBuffer_.retrieveAll();
+                forceClose();
+                return total;
+            }
+            if (n > 0)
+            {
+                file.remaining -= n;
+                if (file.remaining == 0)
+                {
+                    files_.pop_front();
+                }
+            }
+        }
+        else
+        {
+            break;
+        }
+
+        if (n < 0)
+        {
+            return total > 0 ? total : n;
+        }
+        total += n;
+        if (static_cast<size_t>(n) < expected)
+        {
+            // 内核发送缓冲区满了
+            break;
+        }
+    }
+    return total;
+}
+
+ssize_t TcpConnection::writeFile(int fd, off_t *offset, size_t count)
+{
+    if (!tls_ || tls_->kernelSend())
+    {
+        return ::sendfile(channel_->fd(), fd, offset, count);
+    }
+    // 用户态TLS只能读出来再加密，一次一个TLS记录的大小
+    char buf[16 * 1024];
+    ssize_t n = ::pread(fd, buf, std::min(count, sizeof buf), *offset);
+    if (n <= 0)
+    {
+        return n;
+    }
+    ssize_t nwrote = tls_->write(buf, n);
+    if (nwrote > 0)
+    {
+        *offset += nwrote;
+    }
+    return nwrote;
 }
 
 // 关闭连接
@@ -181,7 +372,7 @@ void TcpConnection::shutdown()
 {
     if (state_ == kConnected)
     {
-        setState(kDisconnected);
+        setState(kDisconnecting);
         loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
     }
 }
@@ -190,20 +381,233 @@ void TcpConnection::shutdownInLoop()
 {
     if (!channel_->isWriting()) // 说明outputBuffer中的数据已经全部发送完成
     {
+        if (tls_)
+        {
+            tls_->shutdown(); // 先发送close_notify
+        }
         socket_->shutdownWrite(); // 关闭写端
     }
 }
 
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        // 放入队列而不是直接执行，保证当前正在执行的回调结束后再关闭
+        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();
+    }
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, this));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    // 超出预算暂停期间不开启读（比如协程的ReadAwaiter重新等待数据），由resumeReadInLoop()恢复
+    if (state_ != kDisconnected && !pausedByBudget_ && !channel_->isReading())
+    {
+        channel_->enableReading();
+        reading_ = true;
+    }
+}
+
+void TcpConnection::resumeRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::resumeReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::pauseReadInLoop()
+{
+    stopReadInLoop();
+    // 已经暂停：定时器和MemoryBudget中的记录都还在，不能再加一份
+    if (pausedByBudget_)
+    {
+        return;
+    }
+    pausedByBudget_ = true;
+    // 用户可能在回调之外异步消费inputBuffer_，这时没有事件触发重新统计，需要定期检查
+    loop_->cancel(budgetTimer_);
+    budgetTimer_ = loop_->runAfter(kBudgetRecheckInterval,
+                                   std::bind(&TcpConnection::resumeReadInLoop, shared_from_this()));
+    // 总用量降到低水位以下时由MemoryBudget恢复
+    budget_->pause(shared_from_this());
+}
+
+void TcpConnection::resumeReadInLoop()
+{
+    if (!pausedByBudget_ || state_ == kDisconnected)
+    {
+        return;
+    }
+    loop_->cancel(budgetTimer_);
+    updateMemoryUsage();
+    if (budget_->overLimit())
+    {
+        budgetTimer_ = loop_->runAfter(kBudgetRecheckInterval,
+                                       std::bind(&TcpConnection::resumeReadInLoop, shared_from_this()));
+        return;
+    }
+    pausedByBudget_ = false;
+    startReadInLoop();
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, this));
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    if (channel_->isReading())
+    {
+        channel_->disableReading();
+        reading_ = false;
+    }
+}
+
+int TcpConnection::fd() const
+{
+    return socket_->fd();
+}
+
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_->setTcpNoDelay(on);
+}
+
+void TcpConnection::startWrite()
+{
+    if (state_ != kDisconnected && !channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
+}
+
+void TcpConnection::stopWrite()
+{
+    // outputBuffer_中还有数据时写事件仍由handleWrite负责
+    if (channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    {
+        channel_->disableWriting();
+    }
+}
+
+void TcpConnection::startTls(TlsContext *context)
+{
+    tls_.reset(new TlsSession(context, socket_->fd()));
+}
+
 // 连接建立
 void TcpConnection::connectEstablished()
 {
-    setState(kConnected);
     channel_->tie(shared_from_this());
     channel_->enableReading(); // 向poller注册channel的epollin事件(读事件)
+    if (tls_)
+    {
+        // 等待客户端的ClientHello，握手完成以后再通知用户；定时器不延长连接的生命期
+        handshakeTimer_ = loop_->runAfter(kTlsHandshakeTimeout,
+                                          std::bind(&TcpConnection::handshakeTimeout, std::weak_ptr<TcpConnection>(shared_from_this())));
+        return;
+    }
 
+    setState(kConnected);
     // 新连接建立，执行回调
     connectionCallback_(shared_from_this()); // 进行connect
 }
+
+// TLS握手，在可读/可写事件中推进，直到完成或失败
+void TcpConnection::handleHandshake()
+{
+    TlsSession::Status status = tls_->handshake();
+    if (status == TlsSession::kDone)
+    {
+        loop_->cancel(handshakeTimer_);
+        if (channel_->isWriting())
+        {
+            channel_->disableWriting();
+        }
+        LOG_DEBUG << "TcpConnection::handleHandshake [" << name_.c_str() << "] " << tls_->version()
+                  << " " << tls_->cipher() << " kTLS tx=" << tls_->kernelSend() << " rx=" << tls_->kernelRecv();
+        setState(kConnected);
+        connectionCallback_(shared_from_this());
+        // OpenSSL中可能已经有解密好的数据，fd不会因为它们再次就绪
+        if (state_ == kConnected && tls_->hasPending())
+        {
+            handleRead(loop_->now());
+        }
+    }
+    else if (status == TlsSession::kWantRead)
+    {
+        if (channel_->isWriting())
+        {
+            channel_->disableWriting();
+        }
+    }
+    else if (status == TlsSession::kWantWrite)
+    {
+        if (!channel_->isWriting())
+        {
+            channel_->enableWriting();
+        }
+    }
+    else
+    {
+        handleClose();
+    }
+}
+
+void TcpConnection::handshakeTimeout(const std::weak_ptr<TcpConnection> &weakConn)
+{
+    TcpConnectionPtr conn(weakConn.lock());
+    if (conn && conn->state_ == kConnecting)
+    {
+        LOG_INFO << "TcpConnection::handshakeTimeout [" << conn->name_.c_str() << "] TLS handshake timed out";
+        conn->handleClose();
+    }
+}
+
+ssize_t TcpConnection::readSocket(int *savedErrno)
+{
+    if (!tls_)
+    {
+        return inputBuffer_.readFd(channel_->fd(), savedErrno, readBudget_);
+    }
+    if (tls_->kernelRecv() && !tls_->hasPending())
+    {
+        // 内核已经解密，readv直接得到明文
+        ssize_t n = inputBuffer_.readFd(channel_->fd(), savedErrno, readBudget_);
+        if (n >= 0 || *savedErrno != EIO)
+        {
+            return n;
+        }
+        // EIO：下一个记录不是应用数据（告警、KeyUpdate等），交给OpenSSL处理
+    }
+    return tls_->read(&inputBuffer_, readBudget_, savedErrno);
+}
+
+ssize_t TcpConnection::writeSocket(const void *data, size_t len, bool more)
+{
+    if (tls_ && !tls_->kernelSend())
+    {
+        return tls_->write(data, len);
+    }
+    if (more)
+    {
+        return ::send(channel_->fd(), data, len, MSG_MORE | MSG_NOSIGNAL);
+    }
+    return ::write(channel_->fd(), data, len);
+}
 // 连接销毁
 void TcpConnection::connectDestroyed()
 {
@@ -218,17 +622,59 @@ void TcpConnection::connectDestroyed()
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    // 旁路模式，数据不经过inputBuffer_
+    if (bypassReadCallback_)
+    {
+        bypassReadCallback_();
+        return;
+    }
+
+    if (tls_ && state_ == kConnecting)
+    {
+        handleHandshake();
+        return;
+    }
+
+    // 超出内存预算：暂停读取，数据留在内核中，用量降下来以后恢复
+    if (budget_ && budget_->overLimit())
+    {
+        pauseReadInLoop();
+        return;
+    }
+
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    ssize_t n = readSocket(&savedErrno);
     if (n > 0)
     {
-        // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        if (coReading_)
+        {
+            wakeReader();
+            // 协程没有继续等待数据，先暂停读，等它下一次读取时再开启
+            if (!readWaiter_.func)
+            {
+                stopReadInLoop();
+            }
+        }
+        else
+        {
+            // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
+            messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        }
+        updateMemoryUsage();
     }
     else if (n == 0)
     {
+        if (tls_)
+        {
+            tls_->shutdown(); // 回应对端的close_notify
+        }
         handleClose();
     }
+    else if (savedErrno == EAGAIN)
+    {
+        // TLS记录还不完整，等待后续数据
+        return;
+    }
     else
     {
         errno = savedErrno;
@@ -239,14 +685,38 @@ void TcpConnection::handleRead(Timestamp receiveTime)
 }
 void TcpConnection::handleWrite()
 {
+    if (tls_ && state_ == kConnecting)
+    {
+        handleHandshake();
+        return;
+    }
+
     if (channel_->isWriting())
     {
-        int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        // 旁路模式下outputBuffer_为空时，可写事件交给处理者
+        if (bypassWriteCallback_ && outputBuffer_.readableBytes() == 0 && files_.empty())
+        {
+            bypassWriteCallback_();
+            return;
+        }
+
+        ssize_t n;
+        if (files_.empty())
+        {
+            n = writeSocket(outputBuffer_.peek(), outputBuffer_.readableBytes());
+            if (n > 0)
+            {
+                outputBuffer_.retrieve(n); // 复位
+            }
+        }
+        else
+        {
+            n = writeFiles();
+        }
         if (n > 0)
         {
-            outputBuffer_.retrieve(n);              // 复位
-            if (outputBuffer_.readableBytes() == 0) // 如果outputBuffer_可读部分为
+            updateMemoryUsage();
+            if (outputBuffer_.readableBytes() == 0 && files_.empty()) // 如果outputBuffer_可读部分为
             {
                 channel_->disableWriting(); // 通道设置为不可写
                 if (writeCompleteCallback_)
@@ -255,13 +725,19 @@ void TcpConnection::handleWrite()
                     loop_->queueInLoop(
                         std::bind(writeCompleteCallback_, shared_from_this()));
                 }
-                if (state_ == kDisconnected) // 如果通道写入数据时conn关闭连接，则关闭写端
+                if (state_ == kDisconnecting) // 如果通道写入数据时conn关闭连接，则关闭写端
                 {
                     shutdownInLoop();
                 }
+                // 旁路处理者可能在等待outputBuffer_中先前的数据发送完
+                if (bypassWriteCallback_)
+                {
+                    bypassWriteCallback_();
+                }
+                wakeWriter();
             }
         }
-        else
+        else if (errno != EAGAIN)
         {
             // LOG_ERROR("TcpConnection::handleWrite");
             LOG_ERROR << "TcpConnection::handleWrite() failed";
@@ -276,12 +752,47 @@ void TcpConnection::handleWrite()
 void TcpConnection::handleClose()
 {
     // LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
+    int oldState = state_;
     setState(kDisconnected);
     channel_->disableAll();
+    files_.clear(); // 释放排队文件的fd
+    loop_->cancel(handshakeTimer_);
 
     TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr); // 连接回调
+    if (bypassCloseCallback_)
+    {
+        bypassCloseCallback_();
+    }
+    if (oldState != kConnecting)
+    {
+        connectionCallback_(connPtr); // 连接回调；TLS握手没有完成的连接用户没有见过，不需要通知
+    }
     closeCallback_(connPtr);      // 关闭连接的回调  执行的是TcpServer::removeConnection回调方法
+
+    // 等待中的协程恢复执行，读取返回0/写入返回false
+    wakeReader();
+    wakeWriter();
+}
+
+// 恢复等待读的协程，等待者可能在回调中重新注册自己
+void TcpConnection::wakeReader()
+{
+    Waiter waiter = readWaiter_;
+    readWaiter_.func = nullptr;
+    if (waiter.func)
+    {
+        waiter.func(waiter.arg);
+    }
+}
+
+void TcpConnection::wakeWriter()
+{
+    Waiter waiter = writeWaiter_;
+    writeWaiter_.func = nullptr;
+    if (waiter.func)
+    {
+        waiter.func(waiter.arg);
+    }
 }
 void TcpConnection::handleError()
 {
@@ -5,14 +5,24 @@
 #include "Timestamp.h"
 #include "InetAddress.h"
 #include "Buffer.h"
+#include "TimerId.h"
 
 #include <memory>
 #include <atomic>
+#include <deque>
 #include <string>
+#include <string.h>
+#include <sys/types.h>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
 
 class EventLoop;
 class Socket;
 class Channel;
+class TlsContext;
+class TlsSession;
+class MemoryBudget;
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过accept函数拿到connfd
@@ -35,8 +45,38 @@ public:
     // 发送数据
     void send(const std::string &buf);
     void send(Buffer *buf);
+    /**
+     * 发送文件fd中[offset, offset + count)的内容，排在之前send()的数据之后，之后send()的数据排在文件之后。
+     * 普通连接和kTLS连接用sendfile()从page cache直接发送，不经过用户态；OpenSSL加密的连接读出来加密发送。
+     * owner持有fd（比如文件缓存中的条目），发送完以前不会释放。
+     * header（比如HTTP响应头）排在文件前面，用MSG_MORE和文件内容合并发送，小文件不会因为Nagle算法等待对端的ACK。
+     * 只能在loop线程中调用
+     */
+    void sendFile(const std::shared_ptr<void> &owner, int fd, off_t offset, size_t count, Buffer *header = nullptr);
     // 关闭连接
     void shutdown();
+    // 强制关闭连接（不等待outputBuffer_中的数据发送完）
+    void forceClose();
+
+    // 开启/暂停读事件，用于流量控制
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
+    /**
+     * 在这条连接上启用TLS（服务端），必须在connectEstablished()之前调用，TcpServer会自动处理。
+     * 握手期间连接处于kConnecting状态，握手完成以后才调用connectionCallback_；握手失败或者
+     * kTlsHandshakeTimeout秒内没有完成时直接关闭，不会通知用户。TLS连接不能使用旁路模式（TcpRelay）
+     */
+    void startTls(TlsContext *context);
+    bool isTls() const { return tls_ != nullptr; }
+
+    // 内存预算（见MemoryBudget.h），必须在connectEstablished()之前设置，TcpServer会自动处理
+    void setMemoryBudget(const std::shared_ptr<MemoryBudget> &budget) { budget_ = budget; }
+    // 缓冲区以及跨线程send()排队中的数据占用的内存，可以在任意线程读取
+    size_t memoryUsage() const { return memoryUsage_ + queuedBytes_; }
+    // 恢复因为超出内存预算而暂停的读取，可以在任意线程调用
+    void resumeRead();
 
     // 连接建立
     void connectEstablished();
@@ -51,6 +91,33 @@ public:
     // 设置状态为连接（kConnected）
     bool connected() const { return state_ == kConnected; }
 
+    int fd() const;
+    // 关闭Nagle算法，小消息请求-响应的场景需要
+    void setTcpNoDelay(bool on);
+    Buffer *inputBuffer() { return &inputBuffer_; }
+    Buffer *outputBuffer() { return &outputBuffer_; }
+
+    /**
+     * 旁路(bypass)模式：设置以后，可读/可写事件不再经过inputBuffer_/outputBuffer_，
+     * 而是直接交给外部的处理者（比如TcpRelay用splice在内核中搬运数据），
+     * 关闭事件也会先通知处理者。以下函数都只能在loop线程中调用
+     */
+    using BypassCallback = std::function<void()>;
+    void setBypassCallbacks(const BypassCallback &readCb,
+                            const BypassCallback &writeCb,
+                            const BypassCallback &closeCb)
+    {
+        bypassReadCallback_ = readCb;
+        bypassWriteCallback_ = writeCb;
+        bypassCloseCallback_ = closeCb;
+    }
+    void clearBypassCallbacks() { setBypassCallbacks(BypassCallback(), BypassCallback(), BypassCallback()); }
+    bool bypassing() const { return static_cast<bool>(bypassReadCallback_); }
+
+    // 旁路模式下由处理者开启/关闭对写事件的关注
+    void startWrite();
+    void stopWrite();
+
     void setConnectionCallback(const ConnectionCallback &cb)
     {
         connectionCallback_ = cb;
@@ -77,6 +144,151 @@ public:
         closeCallback_ = cb;
     }
 
+    // 每次可读事件最多读取的字节数，0表示不限制（默认）
+    // 预算用完时内核里剩下的数据留到下一轮poll：LT模式下fd仍然就绪，
+    // 同一个loop上的其他连接先得到处理，一条很活跃的连接不会独占subloop
+    void setReadBudget(size_t bytes) { readBudget_ = bytes; }
+    size_t readBudget() const { return readBudget_; }
+
+    // 连接上保存的用户数据（比如HttpServer每条连接的解析状态），由用户自己转换类型，只在loop线程中使用
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void> &getContext() const { return context_; }
+
+#if defined(__cpp_impl_coroutine)
+    /**
+     * 协程接口（见Coroutine.h），只能在loop线程中使用。
+     * 协程第一次读取以后，输入数据都交给协程，不再调用messageCallback_；
+     * 协程没有在等待数据时暂停读事件，数据留在内核中形成背压。
+     */
+    class ReadAwaiter
+    {
+    public:
+        // delimLen为0时等待任意数据，否则等待分隔符出现
+        ReadAwaiter(TcpConnection *conn, const char *delim, size_t delimLen)
+            : conn_(conn), delim_(delim), delimLen_(delimLen), scanned_(0), result_(0)
+        {
+            conn_->coReading_ = true;
+        }
+
+        bool await_ready() { return check(); }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            handle_ = h;
+            wait();
+        }
+        // 可读字节数（readUntil为到分隔符末尾的字节数），连接关闭时为0
+        size_t await_resume() const { return result_; }
+
+    private:
+        void wait()
+        {
+            conn_->readWaiter_.func = &ReadAwaiter::onReadable;
+            conn_->readWaiter_.arg = this;
+            conn_->startReadInLoop();
+        }
+
+        // 新数据到达或者连接关闭时由TcpConnection调用
+        static void onReadable(void *arg)
+        {
+            ReadAwaiter *self = static_cast<ReadAwaiter *>(arg);
+            if (self->check())
+            {
+                self->handle_.resume();
+            }
+            else
+            {
+                self->wait();
+            }
+        }
+
+        bool check()
+        {
+            const Buffer &buf = conn_->inputBuffer_;
+            if (delimLen_ == 0)
+            {
+                result_ = buf.readableBytes();
+            }
+            else
+            {
+                // 数据在被取走之前相对peek()的位置不变，已经找过的部分不再重复查找
+                const char *begin = buf.peek() + scanned_;
+                const char *end = buf.beginWrite();
+                const char *found = std::search(begin, end, delim_, delim_ + delimLen_);
+                if (found != end)
+                {
+                    result_ = found + delimLen_ - buf.peek();
+                }
+                else if (buf.readableBytes() >= delimLen_)
+                {
+                    scanned_ = buf.readableBytes() - delimLen_ + 1;
+                }
+            }
+            return result_ > 0 || conn_->state_ == kDisconnected;
+        }
+
+        TcpConnection *conn_;
+        const char *delim_;
+        size_t delimLen_;
+        size_t scanned_;
+        size_t result_;
+        std::coroutine_handle<> handle_;
+    };
+
+    class WriteAwaiter
+    {
+    public:
+        WriteAwaiter(TcpConnection *conn, const void *data, size_t len, Buffer *buf)
+            : conn_(conn), data_(data), len_(len), buf_(buf), accepted_(false)
+        {
+        }
+
+        bool await_ready()
+        {
+            // kDisconnecting（已经shutdown）时也不能再写
+            if (conn_->state_ == kConnected)
+            {
+                accepted_ = conn_->sendInLoop(data_, len_);
+                if (accepted_ && buf_)
+                {
+                    buf_->retrieveAll();
+                }
+            }
+            return !accepted_ || conn_->outputBuffer_.readableBytes() == 0 || conn_->state_ == kDisconnected;
+        }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            handle_ = h;
+            conn_->writeWaiter_.func = &WriteAwaiter::onWritable;
+            conn_->writeWaiter_.arg = this;
+        }
+        // 数据全部写入内核返回true；数据没有被接受（连接不是kConnected、写出错），或者发完之前连接断开返回false
+        bool await_resume() const
+        {
+            return accepted_ && conn_->outputBuffer_.readableBytes() == 0 && conn_->state_ != kDisconnected;
+        }
+
+    private:
+        // outputBuffer_发送完或者连接关闭时由TcpConnection调用
+        static void onWritable(void *arg)
+        {
+            static_cast<WriteAwaiter *>(arg)->handle_.resume();
+        }
+
+        TcpConnection *conn_;
+        const void *data_;
+        size_t len_;
+        Buffer *buf_;
+        bool accepted_; // sendInLoop()接受了数据
+        std::coroutine_handle<> handle_;
+    };
+
+    ReadAwaiter readSome() { return ReadAwaiter(this, nullptr, 0); }
+    ReadAwaiter readUntil(const char *delim) { return ReadAwaiter(this, delim, ::strlen(delim)); }
+    WriteAwaiter write(const void *data, size_t len) { return WriteAwaiter(this, data, len, nullptr); }
+    WriteAwaiter write(const std::string &data) { return WriteAwaiter(this, data.data(), data.size(), nullptr); }
+    WriteAwaiter write(Buffer *buf) { return WriteAwaiter(this, buf->peek(), buf->readableBytes(), buf); }
+#endif
+
 private:
     enum StateE
     {
@@ -95,10 +307,30 @@ private:
     void handleWrite();
     void handleClose();
     void handleError();
+    void handleHandshake();
+    static void handshakeTimeout(const std::weak_ptr<TcpConnection> &weakConn);
 
-    void sendInLoop(const void* message, size_t len);
+    // 普通连接直接读写fd；TLS连接按是否有kTLS卸载选择系统调用或者OpenSSL
+    ssize_t readSocket(int *savedErrno);
+    // more为true时后面还有数据（MSG_MORE），内核先不发送不满一个报文的部分
+    ssize_t writeSocket(const void *data, size_t len, bool more = false);
+
+    // 有文件排队时按顺序发送outputBuffer_和文件，返回写入的字节数
+    ssize_t writeFiles();
+    ssize_t writeFile(int fd, off_t *offset, size_t count);
+    // 数据写入内核或者放入outputBuffer_返回true，连接已经断开或者写出错返回false
+    bool sendInLoop(const void* message, size_t len);
     void sendInLoop(const std::string& message);
+    void sendQueued(const std::string &message);
+    void updateMemoryUsage();
+    void pauseReadInLoop();
+    void resumeReadInLoop();
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void startReadInLoop();
+    void stopReadInLoop();
+    void wakeReader();
+    void wakeWriter();
 
     EventLoop *loop_; // 这里绝对不是baseLoop， 因为TcpConnection都是在subLoop里面管理的
     const std::string name_;
@@ -119,7 +351,51 @@ private:
 
     CloseCallback closeCallback_;
 
+    BypassCallback bypassReadCallback_;
+    BypassCallback bypassWriteCallback_;
+    BypassCallback bypassCloseCallback_;
+
     size_t highWaterMark_;
+    size_t readBudget_; // 每次可读事件最多读取的字节数
+
+    // 等待在这条连接上的协程。只保存函数指针和参数，不依赖C++20，
+    // 库本身可以用较低的标准编译，只有使用协程的代码需要C++20
+    struct Waiter
+    {
+        void (*func)(void *arg);
+        void *arg;
+    };
+    Waiter readWaiter_;
+    Waiter writeWaiter_;
+    bool coReading_; // 输入由协程消费
+
+    std::unique_ptr<TlsSession> tls_; // TLS会话，普通连接为空
+    // 连上以后不发送ClientHello的客户端会一直占着fd和SSL对象
+    static constexpr double kTlsHandshakeTimeout = 10; // 秒
+    TimerId handshakeTimer_;
+
+    // 空闲缓冲区超过这个容量时释放，否则一次突发以后连接会一直占着这块内存
+    static const size_t kMaxIdleBufferSize = 64 * 1024;
+    static constexpr double kBudgetRecheckInterval = 0.1; // 秒
+    std::shared_ptr<MemoryBudget> budget_; // 为空时不统计内存
+    std::atomic<size_t> memoryUsage_;      // 两个缓冲区的容量，已经计入budget_
+    std::atomic<size_t> queuedBytes_;      // 跨线程send()还没有执行的数据
+    bool pausedByBudget_;                  // 因为超出预算暂停了读取
+    TimerId budgetTimer_;                  // 暂停期间定期重新统计用量
+
+    std::shared_ptr<void> context_; // 用户数据
+
+    // 排队发送的文件，position是outputBuffer_中排在它前面的数据写完时bufferWritten_的值
+    struct FileSegment
+    {
+        std::shared_ptr<void> owner;
+        int fd;
+        off_t offset;
+        size_t remaining;
+        uint64_t position;
+    };
+    std::deque<FileSegment> files_;
+    uint64_t bufferWritten_; // 有文件排队期间从outputBuffer_写出的累计字节数
 
     Buffer inputBuffer_;  // 接收数据的缓冲区
     Buffer outputBuffer_; // 发送数据的缓冲区
@@ -0,0 +1,271 @@
+#include "TcpRelay.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Logging.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// 期望的pipe容量，设置失败时使用系统默认值（通常为64K）
+static const int kPipeSize = 256 * 1024;
+
+TcpRelay::TcpRelay(const TcpConnectionPtr &connA, const TcpConnectionPtr &connB)
+    : loop_(connA->getLoop()),
+      started_(false),
+      closed_(false)
+{
+    a2b_.from = connA;
+    a2b_.to = connB;
+    b2a_.from = connB;
+    b2a_.to = connA;
+    for (Direction *dir : {&a2b_, &b2a_})
+    {
+        dir->pipefd[0] = dir->pipefd[1] = -1;
+        dir->capacity = 0;
+        dir->pending = 0;
+        dir->transferred = 0;
+        dir->readDone = false;
+        dir->finished = false;
+    }
+}
+
+TcpRelay::~TcpRelay()
+{
+    for (Direction *dir : {&a2b_, &b2a_})
+    {
+        if (dir->pipefd[0] >= 0)
+        {
+            ::close(dir->pipefd[0]);
+            ::close(dir->pipefd[1]);
+        }
+    }
+}
+
+void TcpRelay::start()
+{
+    loop_->runInLoop(std::bind(&TcpRelay::startInLoop, shared_from_this()));
+}
+
+void TcpRelay::stop()
+{
+    loop_->runInLoop(std::bind(&TcpRelay::stopInLoop, shared_from_this()));
+}
+
+bool TcpRelay::openPipe(Direction *dir)
+{
+    if (::pipe2(dir->pipefd, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_ERROR << "TcpRelay pipe2() failed, errno = " << errno;
+        dir->pipefd[0] = dir->pipefd[1] = -1;
+        return false;
+    }
+    ::fcntl(dir->pipefd[1], F_SETPIPE_SZ, kPipeSize);
+    int capacity = ::fcntl(dir->pipefd[1], F_GETPIPE_SZ);
+    dir->capacity = capacity > 0 ? capacity : 65536;
+    return true;
+}
+
+void TcpRelay::startInLoop()
+{
+    if (started_ || closed_)
+    {
+        return;
+    }
+    started_ = true;
+
+    const TcpConnectionPtr &connA = a2b_.from;
+    const TcpConnectionPtr &connB = b2a_.from;
+    if (connB->getLoop() != loop_)
+    {
+        LOG_ERROR << "TcpRelay [" << connA->name() << "] <=> [" << connB->name()
+                  << "] connections belong to different loops";
+        stopInLoop();
+        return;
+    }
+    if (!connA->connected() || !connB->connected() || !openPipe(&a2b_) || !openPipe(&b2a_))
+    {
+        stopInLoop();
+        return;
+    }
+
+    // start()之前已经读进inputBuffer_的数据（比如代理协议的握手之后多读的部分）先正常发送，
+    // 之后的splice会等待对端outputBuffer_排空，保证字节顺序
+    if (connA->inputBuffer()->readableBytes() > 0)
+    {
+        connB->send(connA->inputBuffer());
+    }
+    if (connB->inputBuffer()->readableBytes() > 0)
+    {
+        connA->send(connB->inputBuffer());
+    }
+
+    TcpRelayPtr self(shared_from_this());
+    connA->setBypassCallbacks(std::bind(&TcpRelay::handleReadable, self, &a2b_),
+                              std::bind(&TcpRelay::handleWritable, self, &b2a_),
+                              std::bind(&TcpRelay::handleClose, self));
+    connB->setBypassCallbacks(std::bind(&TcpRelay::handleReadable, self, &b2a_),
+                              std::bind(&TcpRelay::handleWritable, self, &a2b_),
+                              std::bind(&TcpRelay::handleClose, self));
+    if (!connA->isReading())
+    {
+        connA->startRead();
+    }
+    if (!connB->isReading())
+    {
+        connB->startRead();
+    }
+
+    LOG_INFO << "TcpRelay [" << connA->name() << "] <=> [" << connB->name() << "] started";
+}
+
+// 源端可读：socket => pipe
+void TcpRelay::handleReadable(Direction *dir)
+{
+    if (closed_)
+    {
+        return;
+    }
+
+    size_t room = dir->capacity - dir->pending;
+    if (room == 0)
+    {
+        dir->from->stopRead();
+        return;
+    }
+
+    ssize_t n = ::splice(dir->from->fd(), NULL, dir->pipefd[1], NULL, room,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0)
+    {
+        dir->pending += n;
+        transfer(dir);
+    }
+    else if (n == 0) // 对端关闭了写端
+    {
+        dir->readDone = true;
+        dir->from->stopRead();
+        transfer(dir);
+    }
+    else if (errno != EAGAIN && errno != EINTR)
+    {
+        LOG_ERROR << "TcpRelay splice from [" << dir->from->name() << "] failed, errno = " << errno;
+        stopInLoop();
+    }
+}
+
+// 目的端可写（此前pipe中有积压）
+void TcpRelay::handleWritable(Direction *dir)
+{
+    if (!closed_)
+    {
+        transfer(dir);
+    }
+}
+
+void TcpRelay::handleClose()
+{
+    stopInLoop();
+}
+
+// pipe => socket
+void TcpRelay::transfer(Direction *dir)
+{
+    TcpConnection *to = dir->to.get();
+
+    // start()之前的残留数据还在outputBuffer_中，等handleWrite发送完以后会回调handleWritable
+    if (to->outputBuffer()->readableBytes() > 0)
+    {
+        if (dir->pending > 0)
+        {
+            dir->from->stopRead();
+        }
+        return;
+    }
+
+    while (dir->pending > 0)
+    {
+        ssize_t n = ::splice(dir->pipefd[0], NULL, to->fd(), NULL, dir->pending,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0)
+        {
+            dir->pending -= n;
+            dir->transferred += n;
+        }
+        else if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (n == 0 || errno == EAGAIN) // 目的端的内核发送缓冲区满了
+        {
+            break;
+        }
+        else
+        {
+            LOG_ERROR << "TcpRelay splice to [" << to->name() << "] failed, errno = " << errno;
+            stopInLoop();
+            return;
+        }
+    }
+
+    if (dir->pending > 0)
+    {
+        // 背压：暂停读源端，等待目的端EPOLLOUT
+        if (dir->from->isReading())
+        {
+            dir->from->stopRead();
+        }
+        to->startWrite();
+    }
+    else
+    {
+        to->stopWrite();
+        if (!dir->readDone)
+        {
+            if (!dir->from->isReading())
+            {
+                dir->from->startRead();
+            }
+        }
+        else if (!dir->finished)
+        {
+            // 源端的EOF已经全部转发，半关闭目的端
+            dir->finished = true;
+            to->shutdown();
+            if (a2b_.finished && b2a_.finished)
+            {
+                stopInLoop();
+            }
+        }
+    }
+}
+
+void TcpRelay::stopInLoop()
+{
+    if (closed_)
+    {
+        return;
+    }
+    closed_ = true;
+
+    TcpRelayPtr self(shared_from_this());
+    LOG_INFO << "TcpRelay [" << a2b_.from->name() << "] <=> [" << b2a_.from->name() << "] closed, "
+             << a2b_.transferred << " bytes a->b, " << b2a_.transferred << " bytes b->a";
+
+    // 旁路回调此时可能正在执行，放到下一轮再清除；
+    // 清除后 连接 -> 回调 -> relay -> 连接 的循环引用被打破，relay随之析构
+    loop_->queueInLoop(std::bind(&TcpRelay::release, self));
+    a2b_.from->forceClose();
+    b2a_.from->forceClose();
+
+    if (closeCallback_)
+    {
+        closeCallback_(self);
+    }
+}
+
+void TcpRelay::release()
+{
+    a2b_.from->clearBypassCallbacks();
+    b2a_.from->clearBypassCallbacks();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <memory>
+#include <functional>
+
+class EventLoop;
+
+/**
+ * TcpRelay 把两条TcpConnection首尾相连（四层转发/代理）
+ *
+ * 数据通过splice(2)在 socket => pipe => socket 之间由内核直接搬运，
+ * 不再readv进inputBuffer_、拷贝成string、再write出去，用户态看不到任何字节。
+ * 每个方向各有一个pipe：
+ *      connA --splice--> pipeAB --splice--> connB
+ *      connB --splice--> pipeBA --splice--> connA
+ *
+ * 背压完全依靠Channel的读写关注：目的端发送缓冲区满（pipe中还有数据）时，
+ * 停止读源端、关注目的端的EPOLLOUT；排空后再恢复读源端。
+ * 一端读到EOF并且pipe排空后，对另一端shutdown写端；两个方向都结束或出错时关闭两条连接。
+ *
+ * 使用要求：
+ * 1. 两条连接必须属于同一个EventLoop（比如在服务端连接所在的subloop上发起TcpClient）
+ * 2. start()之后不要再对这两条连接调用send()
+ *
+ *      TcpRelayPtr relay = std::make_shared<TcpRelay>(serverConn, clientConn);
+ *      relay->start();
+ *
+ * start()之后relay由两条连接上注册的回调持有，结束时自动释放，调用者不必保存relay。
+ */
+class TcpRelay : noncopyable, public std::enable_shared_from_this<TcpRelay>
+{
+public:
+    using RelayCloseCallback = std::function<void(const std::shared_ptr<TcpRelay> &)>;
+
+    TcpRelay(const TcpConnectionPtr &connA, const TcpConnectionPtr &connB);
+    ~TcpRelay();
+
+    // 开始转发，线程安全
+    void start();
+    // 结束转发并关闭两条连接，线程安全
+    void stop();
+
+    // 两个方向都结束后的回调（在loop线程中执行）
+    void setCloseCallback(const RelayCloseCallback &cb) { closeCallback_ = cb; }
+
+    const TcpConnectionPtr &connA() const { return a2b_.from; }
+    const TcpConnectionPtr &connB() const { return b2a_.from; }
+
+    // 已转发的字节数
+    size_t bytesAtoB() const { return a2b_.transferred; }
+    size_t bytesBtoA() const { return b2a_.transferred; }
+
+private:
+    // 一个转发方向：from --pipe--> to
+    struct Direction
+    {
+        TcpConnectionPtr from;
+        TcpConnectionPtr to;
+        int pipefd[2];     // pipefd[0]读端, pipefd[1]写端
+        size_t capacity;   // pipe容量
+        size_t pending;    // pipe中尚未写到to的字节数
+        size_t transferred;
+        bool readDone;     // from已经读到EOF
+        bool finished;     // EOF已经传递给to（to已shutdown写端）
+    };
+
+    void startInLoop();
+    void stopInLoop();
+
+    void handleReadable(Direction *dir);
+    void handleWritable(Direction *dir);
+    void handleClose();
+
+    // 把pipe中的数据搬到目的端，并根据结果调整两端的读写关注
+    void transfer(Direction *dir);
+    bool openPipe(Direction *dir);
+    void release();
+
+    EventLoop *loop_;
+    Direction a2b_;
+    Direction b2a_;
+    bool started_;
+    bool closed_;
+    RelayCloseCallback closeCallback_;
+};
+
+using TcpRelayPtr = std::shared_ptr<TcpRelay>;
@@ -1,6 +1,7 @@
 #include "TcpServer.h"
 #include <strings.h>
 #include <functional>
+#include <algorithm>
 #include "Logging.h"
 
 EventLoop *CheckLoopNotNull(EventLoop *loop)
@@ -25,14 +26,25 @@ TcpServer::TcpServer(EventLoop *loop,
       connectionCallback_(),
       messageCallback_(),
       nextConnId_(1),
-      started_(0)
+      started_(0),
+      readBudget_(0),
+      rejectedByMemory_(0),
+      shedConnections_(0),
+      lifeToken_(std::make_shared<int>(0))
 {
     // 当有新用户连接时，会执行TcpServer::newConnection回调(轮询)
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
                                                   std::placeholders::_1, std::placeholders::_2));
+    // 在创建TcpConnection之前做准入判断
+    acceptor_->setAdmissionCallback(std::bind(&TcpServer::admitConnection, this, std::placeholders::_1));
 }
 TcpServer::~TcpServer()
 {
+    if (budget_)
+    {
+        // 连接可能比TcpServer活得久，不能再回调到这里；返回以后正在执行的回调也已经结束
+        budget_->setShedCallback(MemoryBudget::ShedCallback());
+    }
     for (auto &item : connections_)
     {
         // 这个局部的shared_ptr智能指针对象，出右括号，可以自动释放new出来的TcpConnection对象资源
@@ -62,12 +74,86 @@ void TcpServer::start()
             --创建loop--启动loop(loop.loop())--等待mainloop分发事件
             mainloop开始监听客户端事件
         */
+        if (budget_)
+        {
+            budget_->setShedCallback(std::bind(&TcpServer::onMemoryExceeded, this));
+        }
         threadPool_->start(threadInitCallback_);
         // mainloop启动监听
         loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
     }
 }
 
+// Acceptor::handleRead中accept成功以后调用，connections_只在mainLoop中修改，这里直接读取
+bool TcpServer::admitConnection(const InetAddress &peerAddr)
+{
+    if (budget_ && budget_->overLimit())
+    {
+        ++rejectedByMemory_;
+        LOG_DEBUG << "TcpServer::admitConnection reject " << peerAddr.toIpPort().c_str() << ": memory usage " << budget_->usage();
+        return false;
+    }
+    return limiter_.admit(peerAddr, connections_.size(), loop_->monotonicNow());
+}
+
+const std::shared_ptr<MemoryBudget> &TcpServer::memoryBudget()
+{
+    if (!budget_)
+    {
+        budget_ = std::make_shared<MemoryBudget>();
+    }
+    return budget_;
+}
+
+// 用量越过硬上限，可能在任意subloop线程中调用
+void TcpServer::onMemoryExceeded()
+{
+    // 任务在mainLoop中执行时TcpServer可能已经析构（析构也在mainLoop中），用lifeToken_判断
+    std::weak_ptr<void> token(lifeToken_);
+    TcpServer *server = this;
+    loop_->queueInLoop([token, server]() {
+        if (!token.expired())
+        {
+            server->shedLargestConnections();
+        }
+    });
+}
+
+// 按占用从大到小关闭连接，直到预计用量回到上限以下
+void TcpServer::shedLargestConnections()
+{
+    size_t usage = budget_->usage();
+    const size_t limit = budget_->limit();
+    if (usage <= limit)
+    {
+        return;
+    }
+
+    std::vector<std::pair<size_t, TcpConnectionPtr>> candidates;
+    candidates.reserve(connections_.size());
+    for (auto &item : connections_)
+    {
+        candidates.push_back(std::make_pair(item.second->memoryUsage(), item.second));
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::pair<size_t, TcpConnectionPtr> &a, const std::pair<size_t, TcpConnectionPtr> &b) {
+                  return a.first > b.first;
+              });
+
+    for (auto &candidate : candidates)
+    {
+        if (usage <= limit || candidate.first == 0)
+        {
+            break;
+        }
+        LOG_WARN << "TcpServer::shedLargestConnections [" << name_.c_str() << "] close " << candidate.second->name().c_str()
+                 << " using " << candidate.first << " bytes, total " << usage;
+        candidate.second->forceClose();
+        usage -= std::min(usage, candidate.first);
+        ++shedConnections_;
+    }
+}
+
 /*
     有一个新的客户端的连接，acceptor会执行这个回调操作
     1.acceptor触发读事件，通过轮询选择一个subloop
@@ -115,6 +201,15 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setReadBudget(readBudget_);
+    if (tlsContext_)
+    {
+        conn->startTls(tlsContext_.get());
+    }
+    if (budget_)
+    {
+        conn->setMemoryBudget(budget_);
+    }
 
     // 设置了如何关闭连接的回调   conn->shutDown()
     conn->setCloseCallback(
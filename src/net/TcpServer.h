@@ -11,6 +11,9 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "ConnectionLimiter.h"
+#include "TlsContext.h"
+#include "MemoryBudget.h"
 
 #include <functional>
 #include <string>
@@ -41,6 +44,31 @@ public:
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
 
+    // 新连接准入控制，需要在start()之前设置
+    // 每个客户端IP每秒最多新建ratePerSecond个连接，允许burst个的突发
+    void setConnectionRateLimit(double ratePerSecond, double burst) { limiter_.setRateLimit(ratePerSecond, burst); }
+    // 最大连接数，超过以后新连接在accept之后直接关闭，0表示不限制
+    void setMaxConnections(size_t maxConnections) { limiter_.setMaxConnections(maxConnections); }
+    // 被准入控制拒绝的连接数（mainLoop中读取）
+    uint64_t rejectedConnections() const { return limiter_.rejectedByRate() + limiter_.rejectedByLimit() + rejectedByMemory_; }
+
+    /**
+     * 内存预算，需要在start()之前设置，见MemoryBudget
+     * 所有连接的缓冲区总内存超过bytes时暂停读取、拒绝新连接，超过1.25倍时关闭占用最多的连接
+     */
+    void setMemoryLimit(size_t bytes) { memoryBudget()->setLimit(bytes); }
+    // 单条连接的缓冲区内存上限，超过时关闭这条连接
+    void setConnectionMemoryLimit(size_t bytes) { memoryBudget()->setConnectionLimit(bytes); }
+    size_t memoryUsage() const { return budget_ ? budget_->usage() : 0; }
+    // 因为内存超限被关闭的连接数（mainLoop中读取）
+    uint64_t shedConnections() const { return shedConnections_; }
+
+    // 每条连接每次可读事件最多读取的字节数，0表示不限制（默认），见TcpConnection::setReadBudget
+    void setReadBudget(size_t bytes) { readBudget_ = bytes; }
+
+    // 启用TLS：新连接先完成握手再调用connectionCallback_，需要在start()之前设置
+    void setTlsContext(const std::shared_ptr<TlsContext> &context) { tlsContext_ = context; }
+
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
 
@@ -54,9 +82,13 @@ public:
     const std::string ipPort() { return ipPort_; }
 
 private:
+    bool admitConnection(const InetAddress &peerAddr);
     void newConnection(int sockfd, const InetAddress &peerAddr);
     void removeConnection(const TcpConnectionPtr &conn);
     void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    const std::shared_ptr<MemoryBudget> &memoryBudget();
+    void onMemoryExceeded();
+    void shedLargestConnections();
 
     using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
@@ -79,4 +111,12 @@ private:
 
     int nextConnId_;
     ConnectionMap connections_; // 保存所有的连接
+    ConnectionLimiter limiter_; // 新连接准入控制，只在mainLoop中访问
+    size_t readBudget_;
+    std::shared_ptr<TlsContext> tlsContext_; // 为空时是普通TCP
+    std::shared_ptr<MemoryBudget> budget_;   // 为空时不统计内存
+    uint64_t rejectedByMemory_;
+    uint64_t shedConnections_;
+    // 随TcpServer析构而失效，放入loop队列的任务用它判断TcpServer是否还在
+    std::shared_ptr<void> lifeToken_;
 };
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "TlsContext.h"
+#include "Logging.h"
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+static const char *lastSslError()
+{
+    static __thread char buf[256];
+    ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+    return buf;
+}
+
+TlsContext::TlsContext(const std::string &certFile, const std::string &keyFile)
+    : ctx_(SSL_CTX_new(TLS_server_method())),
+      kernelOffload_(true)
+{
+    if (ctx_ == nullptr)
+    {
+        LOG_FATAL << "SSL_CTX_new failed: " << lastSslError();
+    }
+    SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+    /**
+     * PARTIAL_WRITE：SSL_write像write一样可以只写入一部分，剩余的留在outputBuffer_
+     * ACCEPT_MOVING_WRITE_BUFFER：重试SSL_write时数据已经被搬进outputBuffer_，地址会变
+     * RELEASE_BUFFERS：空闲连接释放OpenSSL内部的读写缓冲区，大量长连接时节省内存
+     */
+    SSL_CTX_set_mode(ctx_, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                               SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                               SSL_MODE_RELEASE_BUFFERS);
+    // 对端不发送close_notify直接关闭连接当作正常的EOF处理，和明文连接一致
+    SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS | SSL_OP_IGNORE_UNEXPECTED_EOF);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx_, certFile.c_str()) != 1)
+    {
+        LOG_FATAL << "load certificate " << certFile.c_str() << " failed: " << lastSslError();
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx_, keyFile.c_str(), SSL_FILETYPE_PEM) != 1)
+    {
+        LOG_FATAL << "load private key " << keyFile.c_str() << " failed: " << lastSslError();
+    }
+    if (SSL_CTX_check_private_key(ctx_) != 1)
+    {
+        LOG_FATAL << "private key does not match the certificate: " << lastSslError();
+    }
+}
+
+TlsContext::~TlsContext()
+{
+    SSL_CTX_free(ctx_);
+}
+
+void TlsContext::setKernelOffload(bool on)
+{
+    kernelOffload_ = on;
+    if (on)
+    {
+        SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+    }
+    else
+    {
+        SSL_CTX_clear_options(ctx_, SSL_OP_ENABLE_KTLS);
+    }
+}
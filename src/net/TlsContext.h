@@ -0,0 +1,35 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <string>
+
+struct ssl_ctx_st;
+
+/**
+ * 服务端TLS配置，封装OpenSSL的SSL_CTX，可以被多个TcpServer/多个subloop共享（只读）。
+ *
+ * 开启内核卸载(kTLS)时，OpenSSL在握手完成后通过 setsockopt(TCP_ULP, "tls") 把会话密钥交给内核，
+ * 之后的加解密都在内核中进行，TcpConnection直接使用write/readv（以及sendfile）这些普通系统调用；
+ * 内核不支持tls模块或者协商出的加密套件不支持卸载时，自动回退为用户态SSL_read/SSL_write。
+ *
+ *      auto ctx = std::make_shared<TlsContext>("server.crt", "server.key");
+ *      server.setTlsContext(ctx);
+ */
+class TlsContext : noncopyable
+{
+public:
+    // 加载PEM格式的证书链和私钥，失败时LOG_FATAL
+    TlsContext(const std::string &certFile, const std::string &keyFile);
+    ~TlsContext();
+
+    // 握手以后是否尝试kTLS卸载，默认开启，需要在连接建立之前设置
+    void setKernelOffload(bool on);
+    bool kernelOffload() const { return kernelOffload_; }
+
+    ssl_ctx_st *nativeHandle() const { return ctx_; }
+
+private:
+    ssl_ctx_st *ctx_;
+    bool kernelOffload_;
+};
@@ -0,0 +1,157 @@
+#include "TlsSession.h"
+#include "TlsContext.h"
+#include "Buffer.h"
+#include "Logging.h"
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <errno.h>
+
+TlsSession::TlsSession(TlsContext *context, int sockfd)
+    : ssl_(SSL_new(context->nativeHandle())),
+      established_(false),
+      kernelSend_(false),
+      kernelRecv_(false)
+{
+    if (ssl_ == nullptr)
+    {
+        LOG_FATAL << "SSL_new failed";
+    }
+    // socket BIO不负责关闭fd，fd仍由Socket管理
+    SSL_set_fd(ssl_, sockfd);
+    SSL_set_accept_state(ssl_);
+}
+
+TlsSession::~TlsSession()
+{
+    SSL_free(ssl_);
+}
+
+TlsSession::Status TlsSession::handshake()
+{
+    int ret = SSL_do_handshake(ssl_);
+    if (ret == 1)
+    {
+        established_ = true;
+        // OpenSSL在握手过程中已经尝试设置TCP_ULP，这里查询卸载是否成功
+        kernelSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_)) > 0;
+        kernelRecv_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_)) > 0;
+        return kDone;
+    }
+
+    int err = SSL_get_error(ssl_, ret);
+    if (err == SSL_ERROR_WANT_READ)
+    {
+        return kWantRead;
+    }
+    if (err == SSL_ERROR_WANT_WRITE)
+    {
+        return kWantWrite;
+    }
+    unsigned long code = ERR_get_error();
+    ERR_clear_error();
+    if (code == 0)
+    {
+        // 握手期间对端关闭了连接（比如端口探测）
+        LOG_DEBUG << "TLS handshake aborted by peer";
+        return kFailed;
+    }
+    char buf[256];
+    ERR_error_string_n(code, buf, sizeof(buf));
+    LOG_ERROR << "TLS handshake failed: " << buf;
+    return kFailed;
+}
+
+bool TlsSession::hasPending() const
+{
+    return SSL_pending(ssl_) > 0;
+}
+
+ssize_t TlsSession::read(Buffer *buf, size_t maxBytes, int *saveErrno)
+{
+    // 一个TLS记录最多16K明文
+    const size_t kRecordSize = 16 * 1024;
+    size_t total = 0;
+    for (;;)
+    {
+        if (maxBytes > 0 && total >= maxBytes && SSL_pending(ssl_) == 0)
+        {
+            break;
+        }
+        buf->ensureWriteableBytes(kRecordSize);
+        int n = SSL_read(ssl_, buf->beginWrite(), static_cast<int>(buf->writableBytes()));
+        if (n > 0)
+        {
+            buf->hasWritten(n);
+            total += n;
+            continue;
+        }
+
+        int err = SSL_get_error(ssl_, n);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        {
+            if (total == 0)
+            {
+                *saveErrno = EAGAIN;
+                return -1;
+            }
+            break;
+        }
+        if (total > 0)
+        {
+            // 先交付已经读到的数据，关闭/错误在下一次可读事件中处理
+            break;
+        }
+        if (err == SSL_ERROR_ZERO_RETURN)
+        {
+            // 对端发送了close_notify，或者没有发送就直接关闭了连接(SSL_OP_IGNORE_UNEXPECTED_EOF)
+            return 0;
+        }
+        *saveErrno = (err == SSL_ERROR_SYSCALL && errno != 0) ? errno : EPROTO;
+        ERR_clear_error();
+        return -1;
+    }
+    return static_cast<ssize_t>(total);
+}
+
+ssize_t TlsSession::write(const void *data, size_t len)
+{
+    // SSL_write的长度是int；部分写模式下一次写不完是正常情况
+    const size_t kMaxWrite = 1 << 30;
+    int n = SSL_write(ssl_, data, static_cast<int>(len < kMaxWrite ? len : kMaxWrite));
+    if (n > 0)
+    {
+        return n;
+    }
+    int err = SSL_get_error(ssl_, n);
+    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+    {
+        errno = EAGAIN;
+    }
+    else if (err != SSL_ERROR_SYSCALL || errno == 0)
+    {
+        errno = EPIPE;
+    }
+    ERR_clear_error();
+    return -1;
+}
+
+void TlsSession::shutdown()
+{
+    if (established_)
+    {
+        // 只发送close_notify，不等待对端的回应
+        SSL_shutdown(ssl_);
+        ERR_clear_error();
+    }
+}
+
+const char *TlsSession::version() const
+{
+    return SSL_get_version(ssl_);
+}
+
+const char *TlsSession::cipher() const
+{
+    return SSL_get_cipher_name(ssl_);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <sys/types.h>
+
+struct ssl_st;
+class TlsContext;
+class Buffer;
+
+/**
+ * 一条连接上的TLS会话（服务端），由TcpConnection持有，只在loop线程中使用。
+ *
+ * 握手期间由TcpConnection在可读/可写事件中反复调用handshake()；握手完成以后：
+ * - kernelSend()为true：内核负责加密，直接write/writev/sendfile明文
+ * - kernelRecv()为true：内核负责解密，直接readv读到明文；遇到非应用数据记录(告警等)
+ *   readv返回EIO，此时调用read()由OpenSSL处理
+ * - 否则通过read()/write()在用户态加解密
+ */
+class TlsSession : noncopyable
+{
+public:
+    enum Status
+    {
+        kDone,      // 握手完成
+        kWantRead,  // 等待可读事件
+        kWantWrite, // 等待可写事件
+        kFailed     // 握手失败，应关闭连接
+    };
+
+    TlsSession(TlsContext *context, int sockfd);
+    ~TlsSession();
+
+    Status handshake();
+    bool established() const { return established_; }
+
+    bool kernelSend() const { return kernelSend_; }
+    bool kernelRecv() const { return kernelRecv_; }
+    // OpenSSL内部还有已解密但未读出的数据
+    bool hasPending() const;
+
+    /**
+     * 解密读到buf中，返回值和readFd一致：>0读到的字节数，0对端关闭，
+     * -1出错（*saveErrno为EAGAIN时表示暂时没有完整的记录，不是错误）。
+     * maxBytes为0表示读完为止；预算用完时会把当前记录读完，
+     * 否则剩下的明文留在OpenSSL中，LT模式下fd不会再就绪
+     */
+    ssize_t read(Buffer *buf, size_t maxBytes, int *saveErrno);
+    // 加密写入，返回写入的明文字节数；-1出错，errno为EAGAIN表示发送缓冲区满
+    ssize_t write(const void *data, size_t len);
+    // 发送close_notify，在关闭写端之前调用
+    void shutdown();
+
+    // 协商出的协议版本和加密套件，用于日志
+    const char *version() const;
+    const char *cipher() const;
+
+private:
+    ssl_st *ssl_;
+    bool established_;
+    bool kernelSend_;
+    bool kernelRecv_;
+};
@@ -73,6 +73,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
             // LOG_ERROR("EPollPoller::poll() err!");
         }
     }
+    return now;
 }
 
 // 填写活跃的连接
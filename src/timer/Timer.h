@@ -13,6 +13,9 @@
     我们需要让定时器记录我们设置的超时时间
     如果是重复事件（比如每间隔5秒扫描一次用户连接），我们还需要记录超时时间间隔
     对应的，我们需要一个 bool 类型的值标注这个定时器是一次性的还是重复的
+
+    Timer节点由TimerQueue的空闲链表复用，每次复用分配新的序号，
+    TimerId通过(Timer*, 序号)识别定时器，节点被复用以后旧的TimerId自然失效
 */
 class Timer : noncopyable
 {
@@ -20,14 +23,31 @@ public:
     // 回调函数
     using TimerCallback = std::function<void()>;
 
-    Timer(TimerCallback cb, Timestamp when, double interval)
+    Timer(TimerCallback cb, Timestamp when, double interval, int64_t sequence)
         : callback_(std::move(cb)),
           expiration_(when),
           interval_(interval),
-          repeat_(interval > 0.0) // 一次性定时器设置为0
+          repeat_(interval > 0.0), // 一次性定时器设置为0
+          canceled_(false),
+          sequence_(sequence),
+          heapIndex_(-1),
+          nextFree_(nullptr)
     {
     }
 
+    // 从空闲链表中取出时重新设置
+    void reset(TimerCallback cb, Timestamp when, double interval, int64_t sequence)
+    {
+        callback_ = std::move(cb);
+        expiration_ = when;
+        interval_ = interval;
+        repeat_ = interval > 0.0;
+        canceled_ = false;
+        sequence_ = sequence;
+        heapIndex_ = -1;
+        nextFree_ = nullptr;
+    }
+
     void run() const
     {
         callback_();
@@ -37,15 +57,22 @@ public:
     Timestamp expiration() const { return expiration_; }
     //定时器是否重复
     bool repeat() const {return repeat_;}
+    int64_t sequence() const { return sequence_; }
 
     // 重启定时器(如果是非重复定时事件则到期时间置为0)
     void restart(Timestamp now);
 
 private:
-    const TimerCallback callback_; // 定时器回调函数
-    Timestamp expiration_;         // 下一次的超时时刻
-    const double interval_;        // 超时时间间隔，如果是一次性定时器，该值为0
-    const bool repeat_;            // 是否重复(false 表示是一次性定时器)
+    friend class TimerQueue;
+
+    TimerCallback callback_; // 定时器回调函数
+    Timestamp expiration_;   // 下一次的超时时刻
+    double interval_;        // 超时时间间隔，如果是一次性定时器，该值为0
+    bool repeat_;            // 是否重复(false 表示是一次性定时器)
+    bool canceled_;          // 回调执行期间被取消，不再重新插入
+    int64_t sequence_;       // 序号，和TimerId中的序号一致时才是同一个定时器
+    int heapIndex_;          // 在TimerQueue堆中的下标，不在堆中为-1
+    Timer *nextFree_;        // 空闲链表
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,36 @@
+#ifndef TIMER_ID_H
+#define TIMER_ID_H
+
+#include <stdint.h>
+
+class Timer;
+
+/*
+TimerId用于取消定时器：EventLoop::runAt/runAfter/runEvery返回，EventLoop::cancel使用。
+Timer节点会被复用，所以同时保存序号，节点复用后旧的TimerId取消时什么也不做。
+*/
+class TimerId
+{
+public:
+    TimerId()
+        : timer_(nullptr),
+          sequence_(0)
+    {
+    }
+
+    TimerId(Timer *timer, int64_t seq)
+        : timer_(timer),
+          sequence_(seq)
+    {
+    }
+
+    bool valid() const { return timer_ != nullptr; }
+
+private:
+    friend class TimerQueue;
+
+    Timer *timer_;
+    int64_t sequence_;
+};
+
+#endif // TIMER_ID_H
@@ -7,10 +7,11 @@
 #include <sys/timerfd.h>
 #include <unistd.h>
 #include <string.h>
+#include <algorithm>
 
 /*
 整个TimerQueue只使用一个timerfd来观察定时事件，并且每次重置timerfd时
-只需跟set中第一个节点比较即可，因为set本身是一个有序队列。
+只需跟堆顶比较即可，堆顶就是最早到期的定时器。
 整个定时器队列采用了muduo典型的事件分发机制，可以使的定时器的到期时
 间像fd一样在Loop线程中处理。
 之前Timestamp用于比较大小的重载方法在这里得到了很好的应用
@@ -35,7 +36,10 @@ TimerQueue::TimerQueue(EventLoop *loop)
     : loop_(loop),
       timerfd_(createTimerfd()),
       timerfdChannel_(loop_, timerfd_),
-      timers_() // 定时器队列
+      heap_(), // 定时器堆
+      freeList_(nullptr),
+      nextSequence_(0),
+      callingExpiredTimers_(false)
 {
     timerfdChannel_.setReadCallback(
         std::bind(&TimerQueue::handleRead, this));
@@ -48,20 +52,37 @@ TimerQueue::~TimerQueue()
     timerfdChannel_.remove();
     ::close(timerfd_);
     // 删除所有定时器
-    for (const Entry &timer : timers_)
+    for (const Entry &entry : heap_)
     {
-        delete timer.second;
+        delete entry.timer;
+    }
+    while (freeList_)
+    {
+        Timer *timer = freeList_;
+        freeList_ = timer->nextFree_;
+        delete timer;
     }
 }
 
 // 插入定时器（回调函数，到期时间，是否重复）
-void TimerQueue::addTimer(TimerCallback cb,
-                          Timestamp when,
-                          double interval)
+TimerId TimerQueue::addTimer(TimerCallback cb,
+                             Timestamp when,
+                             double interval)
 {
-    Timer *timer = new Timer(std::move(cb), when, interval);
+    if (loop_->isInLoopThread())
+    {
+        // 快速路径：节点来自空闲链表，直接插入
+        Timer *timer = allocTimer(std::move(cb), when, interval);
+        addTimerInLoop(timer);
+        return TimerId(timer, timer->sequence());
+    }
+
+    // 序号要在交给loop线程之前取出，之后节点可能已经到期并被复用
+    int64_t seq = ++nextSequence_;
+    Timer *timer = new Timer(std::move(cb), when, interval, seq);
     loop_->runInLoop(
         std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return TimerId(timer, seq);
 }
 
 void TimerQueue::addTimerInLoop(Timer *timer)
@@ -76,6 +97,40 @@ void TimerQueue::addTimerInLoop(Timer *timer)
     }
 }
 
+void TimerQueue::cancel(TimerId timerId)
+{
+    if (loop_->isInLoopThread())
+    {
+        cancelInLoop(timerId);
+    }
+    else
+    {
+        loop_->runInLoop(
+            std::bind(&TimerQueue::cancelInLoop, this, timerId));
+    }
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    // Timer节点只会被复用，不会在TimerQueue析构之前释放，这里访问是安全的
+    Timer *timer = timerId.timer_;
+    if (timer == nullptr || timer->sequence() != timerId.sequence_)
+    {
+        return; // 已经到期回收或者被复用
+    }
+    if (timer->heapIndex_ >= 0)
+    {
+        // 最早的定时器被取消时不重置timerfd_，多触发一次handleRead没有影响
+        removeAt(timer->heapIndex_);
+        recycle(timer);
+    }
+    else if (callingExpiredTimers_)
+    {
+        // 正在执行到期回调：还没执行的不再执行，重复定时器不再插入
+        timer->canceled_ = true;
+    }
+}
+
 // 重置timerfd
 void TimerQueue::resetTimerfd(int timerfd_, Timestamp expiration)
 {
@@ -84,18 +139,14 @@ void TimerQueue::resetTimerfd(int timerfd_, Timestamp expiration)
     memset(&newValue, '\0', sizeof(newValue));
     memset(&oldValue, '\0', sizeof(oldValue));
 
-    // 超时时间 - 现在时间
-    int64_t microSecondDif = expiration.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
-    if (microSecondDif < 100)
-    {
-        microSecondDif = 100;
-    }
-
+    // 定时器的到期时间和timerfd都是CLOCK_MONOTONIC时间，直接设置绝对时间，不需要再读一次当前时间；
+    // 已经过去的时间会立即触发
+    int64_t microSeconds = std::max<int64_t>(expiration.microSecondsSinceEpoch(), 1);
     struct timespec ts;
     ts.tv_sec = static_cast<time_t>(
-        microSecondDif / Timestamp::kMicroSecondsPerSecond);
+        microSeconds / Timestamp::kMicroSecondsPerSecond);
     ts.tv_nsec = static_cast<long>(
-        (microSecondDif % Timestamp::kMicroSecondsPerSecond) * 1000);
+        (microSeconds % Timestamp::kMicroSecondsPerSecond) * 1000);
     newValue.it_value = ts;
     // 此函数会唤醒事件循环
     /*
@@ -106,7 +157,7 @@ void TimerQueue::resetTimerfd(int timerfd_, Timestamp expiration)
     old_value	                     不为null，则返回定时器这次设置之前的超时时间
 
     */
-    if (::timerfd_settime(timerfd_, 0, &newValue, &oldValue))
+    if (::timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &newValue, &oldValue))
     {
         LOG_ERROR << "timerfd_settime faield()";
     }
@@ -141,80 +192,163 @@ reset方法内部判断这些定时器是否是可重复使用的，如果是则
 // 定时器读事件触发的函数
 void TimerQueue::handleRead()
 {
-    Timestamp now = Timestamp::now();
+    // timerfd在poll返回之前就已经触发，用loop缓存的时间判断到期不会漏掉定时器
+    Timestamp now = loop_->monotonicNow();
 
     ReadTimerFd(timerfd_);
 
     // 获取到期的定时器
-    std::vector<Entry> expired = getExpired(now);
+    getExpired(now);
 
     // 遍历到期的定时器，调用回调函数
     callingExpiredTimers_ = true;
-    for (const Entry &it : expired)
+    for (Timer *timer : expired_)
     {
-        it.second->run();
+        if (!timer->canceled_)
+        {
+            timer->run();
+        }
     }
     callingExpiredTimers_ = false;
 
     // 重新设置这些定时器
-    reset(expired, now);
+    reset(now);
 }
 
-// 移除所有已到期的定时器
-// 1.获取到期的定时器
-// 2.重置这些定时器（销毁或者重复定时任务）
-std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now)
+// 从堆顶依次取出到期时间<=now的定时器
+void TimerQueue::getExpired(Timestamp now)
 {
-    std::vector<Entry> expired;
+    const int64_t nowUs = now.microSecondsSinceEpoch();
+    while (!heap_.empty() && heap_[0].when <= nowUs)
+    {
+        expired_.push_back(heap_[0].timer);
+        removeAt(0);
+    }
+}
 
-    Entry sentry(now, reinterpret_cast<Timer *>(UINTPTR_MAX)); // 创建一个时间戳和定时器地址的集合
-    TimerList::iterator end = timers_.lower_bound(sentry);     // 二分查找
-    std::copy(timers_.begin(), end, back_inserter(expired));
-    timers_.erase(timers_.begin(), end);
+void TimerQueue::reset(Timestamp now)
+{
+    for (Timer *timer : expired_)
+    {
+        // 重复任务则继续执行
+        if (timer->repeat() && !timer->canceled_)
+        {
+            timer->restart(now);
+            insert(timer);
+        }
+        else // 非重复任务则回收定时器
+        {
+            recycle(timer);
+        }
+    }
+    expired_.clear();
+
+    // 所有定时器处理完以后只重置一次timerfd
+    if (!heap_.empty())
+    {
+        resetTimerfd(timerfd_, heap_[0].timer->expiration());
+    }
+}
 
-    return expired;
+// 插入定时器的内部方法
+bool TimerQueue::insert(Timer *timer)
+{
+    Entry entry = {timer->expiration().microSecondsSinceEpoch(), timer};
+    heap_.push_back(entry);
+    siftUp(heap_.size() - 1);
+    // 新定时器到了堆顶，说明最早的定时器已经被替换了
+    return timer->heapIndex_ == 0;
 }
 
-void TimerQueue::reset(const std::vector<Entry> &expired, Timestamp now)
+void TimerQueue::removeAt(size_t index)
 {
-    Timestamp nextExpire;
-    for (const Entry &it : expired)
+    heap_[index].timer->heapIndex_ = -1;
+    Entry last = heap_.back();
+    heap_.pop_back();
+    if (index < heap_.size())
     {
-        // 重复任务则继续执行
-        if (it.second->repeat())
+        heap_[index] = last;
+        last.timer->heapIndex_ = static_cast<int>(index);
+        if (index > 0 && last.when < heap_[(index - 1) / kArity].when)
         {
-            auto timer = it.second;
-            timer->restart(Timestamp::now());
-            insert(timer); // 插入timer_定时器列表*****
+            siftUp(index);
         }
-        else // 非重复任务则删除定时器
+        else
         {
-            delete it.second;
+            siftDown(index);
         }
+    }
+}
 
-        // 如果重新插入了定时器，需要继续重置timerfd
-        if (!timers_.empty())
+void TimerQueue::siftUp(size_t index)
+{
+    Entry entry = heap_[index];
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / kArity;
+        if (!(entry.when < heap_[parent].when))
         {
-            resetTimerfd(timerfd_, (timers_.begin()->second)->expiration());
+            break;
         }
+        heap_[index] = heap_[parent];
+        heap_[index].timer->heapIndex_ = static_cast<int>(index);
+        index = parent;
     }
+    heap_[index] = entry;
+    entry.timer->heapIndex_ = static_cast<int>(index);
 }
 
-// 插入定时器的内部方法
-bool TimerQueue::insert(Timer *timer)
+void TimerQueue::siftDown(size_t index)
 {
-    bool earliestChanged = false;
-    Timestamp when = timer->expiration();
-    TimerList::iterator it = timers_.begin();
-    // 如果定时器列表为空或插入定时器过期时间最早
-    if (it == timers_.end() || when < it->first)
+    Entry entry = heap_[index];
+    const size_t n = heap_.size();
+    for (;;)
     {
-        // 说明最早的定时器已经被替换了
-        earliestChanged = true;
+        size_t child = index * kArity + 1;
+        if (child >= n)
+        {
+            break;
+        }
+        // 在最多4个孩子中找到期时间最早的
+        size_t best = child;
+        size_t end = std::min(child + kArity, n);
+        for (size_t i = child + 1; i < end; ++i)
+        {
+            if (heap_[i].when < heap_[best].when)
+            {
+                best = i;
+            }
+        }
+        if (!(heap_[best].when < entry.when))
+        {
+            break;
+        }
+        heap_[index] = heap_[best];
+        heap_[index].timer->heapIndex_ = static_cast<int>(index);
+        index = best;
     }
+    heap_[index] = entry;
+    entry.timer->heapIndex_ = static_cast<int>(index);
+}
 
-    // 定时器管理红黑树插入此新定时器
-    timers_.insert(Entry(when, timer));
+Timer *TimerQueue::allocTimer(TimerCallback cb, Timestamp when, double interval)
+{
+    int64_t seq = ++nextSequence_;
+    if (freeList_)
+    {
+        Timer *timer = freeList_;
+        freeList_ = timer->nextFree_;
+        timer->reset(std::move(cb), when, interval, seq);
+        return timer;
+    }
+    return new Timer(std::move(cb), when, interval, seq);
+}
 
-    return earliestChanged;
+void TimerQueue::recycle(Timer *timer)
+{
+    // 回调持有的资源（比如TcpConnectionPtr）立即释放，不能等节点被复用
+    timer->callback_ = nullptr;
+    timer->heapIndex_ = -1;
+    timer->nextFree_ = freeList_;
+    freeList_ = timer;
 }
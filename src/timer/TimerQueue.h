@@ -3,17 +3,22 @@
 
 #include "Timestamp.h"
 #include "Channel.h"
+#include "TimerId.h"
 
 #include <vector>
-#include <set>
+#include <atomic>
 
 class EventLoop;
 class Timer;
 
 /*
-TimerQueue类管理作为管理定时器的结构。其内部使用 STL 容器 set 来管理定时器。
-我们以时间戳作为键值来获取定时器。set 内部实现是红黑树，红黑树中序遍历便可
-以得到按照键值排序过后的定时器节点。
+TimerQueue类管理作为管理定时器的结构。内部是一个4叉最小堆，堆中的元素只有
+(到期时间, Timer*) 16个字节，比较时不需要访问Timer节点，对cache友好；
+4叉堆比2叉堆层数少一半，下沉时一次比较的4个孩子在同一条cache line上。
+每个Timer记录自己在堆中的下标，取消定时器是O(logn)的。
+
+Timer节点从每个loop自己的空闲链表中分配，loop线程中添加定时器不需要new，
+也不需要runInLoop和std::bind；其他线程添加定时器时才new节点并转到loop线程。
 */
 class TimerQueue
 {
@@ -23,18 +28,31 @@ public:
     explicit TimerQueue(EventLoop *loop);
     ~TimerQueue();
 
-    // 插入定时器（回调函数，到期时间，是否重复）
-    void addTimer(TimerCallback cb,
-                                    Timestamp when,
-                                    double interval);
+    // 插入定时器（回调函数，CLOCK_MONOTONIC到期时间，是否重复），可以在任意线程调用
+    TimerId addTimer(TimerCallback cb,
+                     Timestamp when,
+                     double interval);
+
+    // 取消定时器，可以在任意线程调用
+    void cancel(TimerId timerId);
+
+    // 堆中的定时器个数，只能在loop线程中调用
+    size_t size() const { return heap_.size(); }
 
 private:
-    using Entry = std::pair<Timestamp, Timer *>; // 以时间戳作为键值获取定时器
-    using TimerList = std::set<Entry>;           // 底层使用红黑树管理，自动按照时间戳进行排序
+    // 堆中的元素：到期时间(微秒) + 定时器节点
+    struct Entry
+    {
+        int64_t when;
+        Timer *timer;
+    };
+    using TimerHeap = std::vector<Entry>;
+
+    static const size_t kArity = 4;
 
     // 在本loop中添加定时器
-    // 线程安全
     void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
 
     // 定时器读事件触发的函数
     void handleRead();
@@ -42,22 +60,29 @@ private:
     // 重新设置timerfd_
     void resetTimerfd(int timerfd_, Timestamp expiration);
 
-    // 移除所有已到期的定时器
-    // 1.获取到期的定时器
-    // 2.重置这些定时器（销毁或者重复定时任务）
-    std::vector<Entry> getExpired(Timestamp now);
-    void reset(const std::vector<Entry> &expired, Timestamp now);
+    // 取出所有已到期的定时器放入expired_
+    void getExpired(Timestamp now);
+    // 重复定时器重新插入，其余的回收；最后只重置一次timerfd_
+    void reset(Timestamp now);
 
-    // 插入定时器的内部方法
+    // 插入定时器的内部方法，返回最早到期时间是否改变
     bool insert(Timer *timer);
+    void removeAt(size_t index);
+    void siftUp(size_t index);
+    void siftDown(size_t index);
+
+    Timer *allocTimer(TimerCallback cb, Timestamp when, double interval);
+    void recycle(Timer *timer);
 
     EventLoop *loop_;        // 所属的EventLoop
     const int timerfd_;      // timerfd是Linux提供的定时器接口
     Channel timerfdChannel_; // 封装timerfd_文件描述符
-    // Timer list sorted by expiration
-    TimerList timers_; // 定时器队列（内部实现是红黑树）
+    TimerHeap heap_;         // 定时器堆，按到期时间排序
+    std::vector<Timer *> expired_; // 本次到期的定时器，复用以免每次分配
+    Timer *freeList_;        // 回收的Timer节点
 
-    bool callingExpiredTimers_; // 标明正在获取超时定时器
+    std::atomic<int64_t> nextSequence_;
+    bool callingExpiredTimers_; // 标明正在执行到期定时器的回调
 };
 
-#endif // TIMER_QUEUE_H
\ No newline at end of file
+#endif // TIMER_QUEUE_H
@@ -0,0 +1,77 @@
+#include "EventLoop.h"
+#include "Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+/**
+ * 100万个定时器的插入、到期、取消耗时
+ *      ./TimerQueueBench [定时器个数]
+ */
+static double elapsedMs(Timestamp start, Timestamp end)
+{
+    return (end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    const int kTimers = argc > 1 ? atoi(argv[1]) : 1000 * 1000;
+    EventLoop loop;
+    std::mt19937 rng(2024);
+    std::uniform_real_distribution<double> delay(0.2, 0.5);
+
+    int fired = 0;
+    Timestamp firstFire, lastFire;
+    std::vector<TimerId> ids;
+    ids.reserve(kTimers);
+
+    // 1. 插入：loop线程中插入，到期时间随机分布在0.2s~0.5s
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < kTimers; ++i)
+    {
+        loop.runAfter(delay(rng), [&]() {
+            if (fired++ == 0)
+            {
+                firstFire = Timestamp::now();
+            }
+            lastFire = Timestamp::now();
+            if (fired == kTimers)
+            {
+                loop.quit();
+            }
+        });
+    }
+    Timestamp end = Timestamp::now();
+    printf("insert %d timers: %.1f ms, %.0f ns/timer\n",
+           kTimers, elapsedMs(start, end), elapsedMs(start, end) * 1e6 / kTimers);
+
+    // 2. 到期：统计所有回调执行完的时间，减去到期时间的跨度以外就是处理开销
+    loop.loop();
+    printf("fire %d timers: first->last %.1f ms (deadline span 300 ms)\n",
+           fired, elapsedMs(firstFire, lastFire));
+
+    // 3. 取消：插入以后按随机顺序全部取消，节点来自上一轮回收的空闲链表
+    start = Timestamp::now();
+    for (int i = 0; i < kTimers; ++i)
+    {
+        ids.push_back(loop.runAfter(delay(rng) + 10, []() {}));
+    }
+    end = Timestamp::now();
+    printf("re-insert %d timers (pooled nodes): %.1f ms, %.0f ns/timer\n",
+           kTimers, elapsedMs(start, end), elapsedMs(start, end) * 1e6 / kTimers);
+
+    std::shuffle(ids.begin(), ids.end(), rng);
+    start = Timestamp::now();
+    for (const TimerId &id : ids)
+    {
+        loop.cancel(id);
+    }
+    end = Timestamp::now();
+    printf("cancel %d timers: %.1f ms, %.0f ns/timer\n",
+           kTimers, elapsedMs(start, end), elapsedMs(start, end) * 1e6 / kTimers);
+
+    return 0;
+}